@@ -0,0 +1,942 @@
+/**
+ * @file colorbench.c
+ * @brief Throughput and accuracy benchmark for colorspace.c
+ *
+ * This program runs every pair of color spaces supported by GetColorTransform
+ * over a large image and reports, for each implementation, its speed in
+ * megapixels per second at each thread count, its error against a long
+ * double reference, and its round-trip error.
+ *
+ * ==Usage==
+ * The syntax for the program is
+ *    colorbench [options]
+ * with the options
+ *    -n N      number of synthetic pixels (default 1048576)
+ *    -i FILE   use the sRGB pixels of a PFM image instead of synthetic ones
+ *    -p PAIR   benchmark only the transform PAIR, such as "Lab <- RGB"
+ *    -t LIST   comma-separated thread counts (default: 1 and the maximum)
+ *    -r N      timing repetitions, of which the fastest counts (default 3)
+ *    -o FILE   also write the results to FILE as CSV
+ * For example,
+ *    colorbench -n 4000000 -t 1,2,4,8 -o bench.csv
+ *
+ * The implementations are
+ *    pixel     ApplyColorTransform, one pixel at a time,
+ *    exact     ApplyColorTransformPlanar,
+ *    fast      ApplyColorTransformPlanar after SetColorTransformFast,
+ *    float     ApplyColorTransformPlanarf,
+ *    fastf     ApplyColorTransformPlanarf after SetColorTransformFast.
+ *
+ * Synthetic pixels are uniformly distributed sRGB values, plus black, white,
+ * and the primaries, converted to the source space by the reference.  The
+ * inputs are rounded to single precision so that all implementations see the
+ * same values.
+ *
+ * The reference evaluates the same formulas as colorspace.c, with the same
+ * constants and routing through sRGB or XYZ, in long double arithmetic, so
+ * that the errors measure rounding and approximation rather than differences
+ * in definitions.  Errors are absolute, in the units of the destination space,
+ * with hue differences taken modulo 360 and ignored where the hue is
+ * undefined, for saturation or chroma below 1e-4.  HSL saturation is not
+ * compared where the lightness is within 1e-4 of 0 or 1, where it is the
+ * ratio of two vanishing quantities.  Results that are NaN where the reference
+ * is not, or the reverse, are counted separately and left out of the error
+ * statistics.  ULP errors are in units of the spacing of double or float
+ * numbers at the reference value, where values below 2^-10 in magnitude are
+ * counted at 2^-10.  The round-trip error converts the result back to the
+ * source space with the same implementation and compares with the input.
+ *
+ * ==Compiling Instructions==
+ * Compile the files colorbench.c, colorspace.c, and colorspace_select.c with
+ * a C99 compiler, for the long double math functions.  With GCC,
+ *    gcc -std=c99 -O2 -fopenmp colorbench.c colorspace.c colorspace_select.c
+ *       -lm -o colorbench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "colorspace.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+static void HelpMessage();
+
+
+/** @brief Type of the reference computations */
+typedef long double ref;
+
+/** @brief Hubs through which the reference routes conversions */
+#define HUB_RGB		0
+#define HUB_XYZ		1
+
+/** @brief Number of color spaces */
+#define NUM_SPACES		15
+
+/** @brief Saturation or chroma below which hues are not compared */
+#define ACHROMATIC	1e-4L
+
+/** @brief Index of HSL in Space, whose saturation is undefined at L = 0, 1 */
+#define SPACE_HSL		8
+
+/** @brief Number of thread counts that can be benchmarked */
+#define MAX_THREAD_COUNTS	16
+
+/** @brief Implementations that are benchmarked */
+#define VARIANT_PIXEL	0
+#define VARIANT_EXACT	1
+#define VARIANT_FAST	2
+#define VARIANT_FLOAT	3
+#define VARIANT_FASTF	4
+#define NUM_VARIANTS	5
+
+static const char *VariantName[NUM_VARIANTS] =
+	{"pixel", "exact", "fast", "float", "fastf"};
+
+/** @brief Color spaces, their reference hub, and their hue channel */
+static const struct
+{
+	const char *Name;
+	int Hub;
+	int HueChannel;
+} Space[NUM_SPACES] = {
+	{"RGB",        HUB_RGB, -1},
+	{"YUV",        HUB_RGB, -1},
+	{"YCbCr",      HUB_RGB, -1},
+	{"JPEG-YCbCr", HUB_RGB, -1},
+	{"YPbPr",      HUB_RGB, -1},
+	{"YDbDr",      HUB_RGB, -1},
+	{"YIQ",        HUB_RGB, -1},
+	{"HSV",        HUB_RGB,  0},
+	{"HSL",        HUB_RGB,  0},
+	{"HSI",        HUB_RGB,  0},
+	{"XYZ",        HUB_XYZ, -1},
+	{"Lab",        HUB_XYZ, -1},
+	{"Luv",        HUB_XYZ, -1},
+	{"LCH",        HUB_XYZ,  2},
+	{"CAT02 LMS",  HUB_XYZ, -1}
+	};
+
+/** @brief Error statistics of one implementation */
+typedef struct
+{
+	double MaxError;
+	double MeanError;
+	double MaxUlp;
+	long NumNan;
+} errorstat;
+
+
+/*
+ * == Reference ==
+ *
+ * Long double versions of the per-pixel routines of colorspace.c.
+ */
+
+#define REF_PI	3.14159265358979323846264338327950288L
+#define REF_MIN3(A,B,C)	(((A) <= (B)) ? (((A) <= (C)) ? (A) : (C)) \
+	: (((B) <= (C)) ? (B) : (C)))
+#define REF_MAX3(A,B,C)	(((A) >= (B)) ? (((A) >= (C)) ? (A) : (C)) \
+	: (((B) >= (C)) ? (B) : (C)))
+
+/**
+ * @brief Affine luma + chroma spaces, D = M*RGB + Offset and
+ * RGB = Inverse*(D - Offset), indexed from YUV to YIQ
+ */
+static const struct
+{
+	ref M[3][3];
+	ref Offset[3];
+	ref Inverse[3][3];
+} LumaChroma[6] = {
+	{{{0.299L, 0.587L, 0.114L}, {-0.147L, -0.289L, 0.436L},
+		{0.615L, -0.515L, -0.100L}}, {0, 0, 0},
+	{{1, -3.945707070708279e-05L, 1.1398279671717170825L},
+		{1, -0.3946101641414141437L, -0.5805003156565656797L},
+		{1, 2.0319996843434342537L, -4.813762626262513e-04L}}},
+	{{{65.481L, 128.553L, 24.966L}, {-37.797L, -74.203L, 112.0L},
+		{112.0L, -93.786L, -18.214L}}, {16, 128, 128},
+	{{0.00456621004566210107L, 1.1808799897946415e-09L,
+			0.00625892896994393634L},
+		{0.00456621004566210107L, -0.00153632368604490212L,
+			-0.00318811094965570701L},
+		{0.00456621004566210107L, 0.00791071623355474145L,
+			1.1977497040190077e-08L}}},
+	{{{0.299L, 0.587L, 0.114L}, {-0.1687367L, -0.331264L, 0.5L},
+		{0.5L, -0.418688L, -0.081312L}}, {0, 0.5L, 0.5L},
+	{{0.99999999999914679361L, -1.2188941887145875e-06L,
+			1.4019995886561440468L},
+		{0.99999975910502514331L, -0.34413567816504303521L,
+			-0.71413649331646789076L},
+		{1.00000124040004623180L, 1.77200006607230409200L,
+			2.1453384174593273e-06L}}},
+	{{{0.299L, 0.587L, 0.114L}, {-0.1687367L, -0.331264L, 0.5L},
+		{0.5L, -0.418688L, -0.081312L}}, {0, 0, 0},
+	{{0.99999999999914679361L, -1.2188941887145875e-06L,
+			1.4019995886561440468L},
+		{0.99999975910502514331L, -0.34413567816504303521L,
+			-0.71413649331646789076L},
+		{1.00000124040004623180L, 1.77200006607230409200L,
+			2.1453384174593273e-06L}}},
+	{{{0.299L, 0.587L, 0.114L}, {-0.450L, -0.883L, 1.333L},
+		{-1.333L, 1.116L, 0.217L}}, {0, 0, 0},
+	{{1, 9.2303716147657e-05L, -0.52591263066186533L},
+		{1, -0.12913289889050927L, 0.26789932820759876L},
+		{1, 0.66467905997895482L, -7.9202543533108e-05L}}},
+	{{{0.299L, 0.587L, 0.114L}, {0.595716L, -0.274453L, -0.321263L},
+		{0.211456L, -0.522591L, 0.311135L}}, {0, 0, 0},
+	{{1, 0.9562957197589482261L, 0.6210244164652610754L},
+		{1, -0.2721220993185104464L, -0.6473805968256950427L},
+		{1, -1.1069890167364901945L, 1.7046149983646481374L}}}
+	};
+
+static const ref Cat02[3][3] = {{0.7328L, 0.4296L, -0.1624L},
+	{-0.7036L, 1.6975L, 0.0061L}, {0.0030L, 0.0136L, 0.9834L}};
+static const ref InvCat02[3][3] = {
+	{1.096123820835514L, -0.278869000218287L, 0.182745179382773L},
+	{0.454369041975359L, 0.473533154307412L, 0.072097803717229L},
+	{-0.009627608738429L, -0.005698031216113L, 1.015325639954543L}};
+
+
+/** @brief Multiply a 3x3 matrix and a vector */
+static void RefMultiply(ref D[3], const ref M[3][3], const ref S[3])
+{
+	ref T[3];
+	int i;
+	
+	
+	for(i = 0; i < 3; i++)
+		T[i] = M[i][0]*S[0] + M[i][1]*S[1] + M[i][2]*S[2];
+	
+	D[0] = T[0];
+	D[1] = T[1];
+	D[2] = T[2];
+}
+
+
+static ref RefGammaCorrection(ref t)
+{
+	return (t <= 0.0031306684425005883L) ?
+		12.92L*t : 1.055L*powl(t, 0.416666666666666667L) - 0.055L;
+}
+
+
+static ref RefInvGammaCorrection(ref t)
+{
+	return (t <= 0.0404482362771076L) ?
+		t/12.92L : powl((t + 0.055L)/1.055L, 2.4L);
+}
+
+
+static ref RefLabF(ref t)
+{
+	return (t >= 8.85645167903563082e-3L) ?
+		powl(t, 0.333333333333333L) : (841.0L/108.0L)*t + (4.0L/29.0L);
+}
+
+
+static ref RefLabInvF(ref t)
+{
+	return (t >= 0.206896551724137931L) ?
+		t*t*t : (108.0L/841.0L)*(t - (4.0L/29.0L));
+}
+
+
+/** @brief Hue of R, G, B for HSV and HSL */
+static ref RefHue(const ref S[3], ref Max, ref C)
+{
+	ref H;
+	
+	
+	if(Max == S[0])
+	{
+		H = (S[1] - S[2])/C;
+	
+		if(S[1] < S[2])
+			H += 6;
+	}
+	else if(Max == S[1])
+		H = 2 + (S[2] - S[0])/C;
+	else
+		H = 4 + (S[0] - S[1])/C;
+	
+	return 60*H;
+}
+
+
+/** @brief R, G, B from hue, chroma, and minimum for HSV and HSL */
+static void RefHueToRgb(ref D[3], ref H, ref C, ref Min)
+{
+	ref X;
+	
+	
+	H -= 360*floorl(H/360);
+	H /= 60;
+	X = C*(1 - fabsl(H - 2*floorl(H/2) - 1));
+	
+	switch((int)H)
+	{
+	case 0: D[0] = Min + C; D[1] = Min + X; D[2] = Min; break;
+	case 1: D[0] = Min + X; D[1] = Min + C; D[2] = Min; break;
+	case 2: D[0] = Min; D[1] = Min + C; D[2] = Min + X; break;
+	case 3: D[0] = Min; D[1] = Min + X; D[2] = Min + C; break;
+	case 4: D[0] = Min + X; D[1] = Min; D[2] = Min + C; break;
+	case 5: D[0] = Min + C; D[1] = Min; D[2] = Min + X; break;
+	default: D[0] = D[1] = D[2] = 0;
+	}
+}
+
+
+/** @brief Convert a color from its hub space, sRGB or XYZ */
+static void RefFromHub(int SpaceId, ref D[3], const ref S[3])
+{
+	const ref Wx = WHITEPOINT_X, Wy = WHITEPOINT_Y, Wz = WHITEPOINT_Z;
+	const ref Wu = 4*Wx/(Wx + 15*Wy + 3*Wz), Wv = 9*Wy/(Wx + 15*Wy + 3*Wz);
+	ref Max = REF_MAX3(S[0], S[1], S[2]), Min = REF_MIN3(S[0], S[1], S[2]);
+	ref T[3], Denom;
+	int i;
+	
+	
+	switch(SpaceId)
+	{
+	case 0:		/* RGB or XYZ */
+	case 10:
+		D[0] = S[0];
+		D[1] = S[1];
+		D[2] = S[2];
+		break;
+	case 7:		/* HSV */
+		D[2] = Max;
+	
+		if(Max - Min > 0)
+		{
+			D[0] = RefHue(S, Max, Max - Min);
+			D[1] = (Max - Min)/Max;
+		}
+		else
+			D[0] = D[1] = 0;
+		break;
+	case 8:		/* HSL */
+		D[2] = (Max + Min)/2;
+	
+		if(Max - Min > 0)
+		{
+			D[0] = RefHue(S, Max, Max - Min);
+			D[1] = (D[2] <= 0.5L) ?
+				(Max - Min)/(2*D[2]) : (Max - Min)/(2 - 2*D[2]);
+		}
+		else
+			D[0] = D[1] = 0;
+		break;
+	case 9:		/* HSI */
+		D[2] = (S[0] + S[1] + S[2])/3;
+	
+		if(D[2] > 0)
+		{
+			D[1] = 1 - Min/D[2];
+			D[0] = atan2l(0.866025403784439L*(S[1] - S[2]),
+				0.5L*(2*S[0] - S[1] - S[2]))*(180/REF_PI);
+	
+			if(D[0] < 0)
+				D[0] += 360;
+		}
+		else
+			D[0] = D[1] = 0;
+		break;
+	case 11:	/* Lab */
+	case 13:	/* LCH */
+		T[0] = RefLabF(S[0]/Wx);
+		T[1] = RefLabF(S[1]/Wy);
+		T[2] = RefLabF(S[2]/Wz);
+		D[0] = 116*T[1] - 16;
+		D[1] = 500*(T[0] - T[1]);
+		D[2] = 200*(T[1] - T[2]);
+	
+		if(SpaceId == 13)
+		{
+			T[1] = sqrtl(D[1]*D[1] + D[2]*D[2]);
+			D[2] = atan2l(D[2], D[1])*180/REF_PI;
+			D[1] = T[1];
+	
+			if(D[2] < 0)
+				D[2] += 360;
+		}
+		break;
+	case 12:	/* Luv */
+		if((Denom = S[0] + 15*S[1] + 3*S[2]) > 0)
+		{
+			T[0] = 4*S[0]/Denom;
+			T[1] = 9*S[1]/Denom;
+		}
+		else
+			T[0] = T[1] = 0;
+	
+		D[0] = 116*RefLabF(S[1]/Wy) - 16;
+		D[1] = 13*D[0]*(T[0] - Wu);
+		D[2] = 13*D[0]*(T[1] - Wv);
+		break;
+	case 14:	/* CAT02 LMS */
+		RefMultiply(D, Cat02, S);
+		break;
+	default:	/* Luma + chroma */
+		RefMultiply(D, LumaChroma[SpaceId - 1].M, S);
+	
+		for(i = 0; i < 3; i++)
+			D[i] += LumaChroma[SpaceId - 1].Offset[i];
+	}
+}
+
+
+/** @brief Convert a color to its hub space, sRGB or XYZ */
+static void RefToHub(int SpaceId, ref D[3], const ref S[3])
+{
+	const ref Wx = WHITEPOINT_X, Wy = WHITEPOINT_Y, Wz = WHITEPOINT_Z;
+	const ref Wu = 4*Wx/(Wx + 15*Wy + 3*Wz), Wv = 9*Wy/(Wx + 15*Wy + 3*Wz);
+	ref T[3], H, C;
+	int i;
+	
+	
+	switch(SpaceId)
+	{
+	case 0:		/* RGB or XYZ */
+	case 10:
+		D[0] = S[0];
+		D[1] = S[1];
+		D[2] = S[2];
+		break;
+	case 7:		/* HSV */
+		RefHueToRgb(D, S[0], S[1]*S[2], S[2] - S[1]*S[2]);
+		break;
+	case 8:		/* HSL */
+		C = (S[2] <= 0.5L) ? 2*S[2]*S[1] : (2 - 2*S[2])*S[1];
+		RefHueToRgb(D, S[0], C, S[2] - 0.5L*C);
+		break;
+	case 9:		/* HSI */
+		H = S[0] - 360*floorl(S[0]/360);
+		i = (H < 120) ? 0 : ((H < 240) ? 1 : 2);
+		H -= 120*i;
+		/* The channels rotate with the sector, B R G for the first */
+		D[(i + 2) % 3] = S[2]*(1 - S[1]);
+		D[i] = S[2]*(1 + S[1]*cosl(H*(REF_PI/180))/cosl((60 - H)*(REF_PI/180)));
+		D[(i + 1) % 3] = 3*S[2] - D[i] - D[(i + 2) % 3];
+		break;
+	case 11:	/* Lab */
+	case 13:	/* LCH */
+		T[0] = S[0];
+		T[1] = S[1];
+		T[2] = S[2];
+	
+		if(SpaceId == 13)
+		{
+			T[1] = S[1]*cosl(S[2]*(REF_PI/180));
+			T[2] = S[1]*sinl(S[2]*(REF_PI/180));
+		}
+	
+		T[0] = (T[0] + 16)/116;
+		D[0] = Wx*RefLabInvF(T[0] + T[1]/500);
+		D[1] = Wy*RefLabInvF(T[0]);
+		D[2] = Wz*RefLabInvF(T[0] - T[2]/200);
+		break;
+	case 12:	/* Luv */
+		D[1] = Wy*RefLabInvF((S[0] + 16)/116);
+		T[1] = S[1];
+		T[2] = S[2];
+	
+		if(S[0] != 0)
+		{
+			T[1] /= S[0];
+			T[2] /= S[0];
+		}
+	
+		T[1] = T[1]/13 + Wu;
+		T[2] = T[2]/13 + Wv;
+		D[0] = D[1]*((9*T[1])/(4*T[2]));
+		D[2] = D[1]*((3 - 0.75L*T[1])/T[2] - 5);
+		break;
+	case 14:	/* CAT02 LMS */
+		RefMultiply(D, InvCat02, S);
+		break;
+	default:	/* Luma + chroma */
+		for(i = 0; i < 3; i++)
+			T[i] = S[i] - LumaChroma[SpaceId - 1].Offset[i];
+	
+		RefMultiply(D, LumaChroma[SpaceId - 1].Inverse, T);
+	}
+}
+
+
+/** @brief Reference conversion between two spaces */
+static void RefConvert(int DestId, int SrcId, ref D[3], const ref S[3])
+{
+	static const ref Rgb2Xyz[3][3] = {
+		{0.4123955889674142161L, 0.3575834307637148171L, 0.1804926473817015735L},
+		{0.2125862307855955516L, 0.7151703037034108499L, 0.07220049864333622685L},
+		{0.01929721549174694484L, 0.1191838645808485318L, 0.9504971251315797660L}};
+	static const ref Xyz2Rgb[3][3] = {{3.2406L, -1.5372L, -0.4986L},
+		{-0.9689L, 1.8758L, 0.0415L}, {0.0557L, -0.2040L, 1.0570L}};
+	ref T[3], Min;
+	int i;
+	
+	
+	RefToHub(SrcId, T, S);
+	
+	if(Space[SrcId].Hub == HUB_RGB && Space[DestId].Hub == HUB_XYZ)
+	{
+		for(i = 0; i < 3; i++)
+			T[i] = RefInvGammaCorrection(T[i]);
+	
+		RefMultiply(T, Rgb2Xyz, T);
+	}
+	else if(Space[SrcId].Hub == HUB_XYZ && Space[DestId].Hub == HUB_RGB)
+	{
+		RefMultiply(T, Xyz2Rgb, T);
+	
+		/* Force nonnegative values, as Xyz2Rgb does */
+		if((Min = REF_MIN3(T[0], T[1], T[2])) < 0)
+			for(i = 0; i < 3; i++)
+				T[i] -= Min;
+	
+		for(i = 0; i < 3; i++)
+			T[i] = RefGammaCorrection(T[i]);
+	}
+	
+	RefFromHub(DestId, D, T);
+}
+
+
+/*
+ * == Measurements ==
+ */
+
+/** @brief Wall clock time in seconds */
+static double WallTime()
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return clock()/(double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+/** @brief Difference of two values, modulo 360 for hues */
+static ref Difference(ref Value, ref Ref, int IsHue)
+{
+	ref d = Value - Ref;
+	
+	
+	if(IsHue)
+		d -= 360*floorl(d/360 + 0.5L);
+	
+	return fabsl(d);
+}
+
+
+/** @brief Accumulate the error of Out against Ref */
+static void MeasureError(errorstat *Stat, double *Out[3], ref *Ref[3],
+	long NumPixels, int SpaceId, double Epsilon)
+{
+	const int HueChannel = Space[SpaceId].HueChannel;
+	double Error, Sum = 0, Ulp;
+	long i, Count = 0;
+	int Channel, Exponent;
+	
+	
+	Stat->MaxError = Stat->MaxUlp = 0;
+	Stat->NumNan = 0;
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		for(i = 0; i < NumPixels; i++)
+		{
+			/* Saturation or chroma is always the second channel */
+			if((isnan(Out[Channel][i]) && isnan(Ref[Channel][i]))
+				|| (Channel == HueChannel && fabsl(Ref[1][i]) < ACHROMATIC)
+				|| (SpaceId == SPACE_HSL && Channel == 1
+					&& (Ref[2][i] < ACHROMATIC || Ref[2][i] > 1 - ACHROMATIC)))
+				continue;
+	
+			Error = (double)Difference(Out[Channel][i], Ref[Channel][i],
+				Channel == HueChannel);
+	
+			if(isnan(Error))
+			{
+				Stat->NumNan++;
+				continue;
+			}
+	
+			frexp((double)fmaxl(fabsl(Ref[Channel][i]), 1.0L/1024), &Exponent);
+			Ulp = Error/ldexp(Epsilon, Exponent - 1);
+			Sum += Error;
+			Count++;
+			Stat->MaxError = (Error > Stat->MaxError) ? Error : Stat->MaxError;
+			Stat->MaxUlp = (Ulp > Stat->MaxUlp) ? Ulp : Stat->MaxUlp;
+		}
+	
+	Stat->MeanError = (Count > 0) ? Sum/Count : 0;
+}
+
+
+/** @brief Run one implementation of a transform and return its time */
+static double RunVariant(int Variant, const colortransform *Trans,
+	double *Dest[3], const double *Src[3], float *Destf[3],
+	const float *Srcf[3], long NumPixels)
+{
+	double Start = WallTime();
+	long i;
+	
+	
+	switch(Variant)
+	{
+	case VARIANT_PIXEL:
+		for(i = 0; i < NumPixels; i++)
+			ApplyColorTransform(Trans, &Dest[0][i], &Dest[1][i], &Dest[2][i],
+				Src[0][i], Src[1][i], Src[2][i]);
+		break;
+	case VARIANT_EXACT:
+	case VARIANT_FAST:
+		ApplyColorTransformPlanar(Trans, Dest, 1, Src, 1, NumPixels);
+		break;
+	default:
+		ApplyColorTransformPlanarf(Trans, Destf, 1, Srcf, 1, NumPixels);
+	}
+	
+	return WallTime() - Start;
+}
+
+
+/** @brief Read the sRGB pixels of a PFM file */
+static double *ReadPfm(long *NumPixels, const char *FileName)
+{
+	FILE *File;
+	double *Rgb = NULL;
+	float Value, Scale;
+	unsigned char Bytes[4], Swap;
+	char Magic[3];
+	long Width, Height, i;
+	int Channel, BigEndian;
+	unsigned int One = 1;
+	
+	
+	if(!(File = fopen(FileName, "rb")))
+		return NULL;
+	
+	if(fscanf(File, "%2s %ld %ld %f", Magic, &Width, &Height, &Scale) != 4
+		|| strcmp(Magic, "PF") || Width <= 0 || Height <= 0 || Scale == 0
+		|| fgetc(File) == EOF
+		|| !(Rgb = (double *)malloc(sizeof(double)*3*Width*Height)))
+	{
+		fclose(File);
+		return NULL;
+	}
+	
+	*NumPixels = Width*Height;
+	BigEndian = (Scale > 0);
+	
+	for(i = 0; i < *NumPixels; i++)
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			if(fread(Bytes, 1, 4, File) != 4)
+			{
+				free(Rgb);
+				fclose(File);
+				return NULL;
+			}
+	
+			if(BigEndian == (*((unsigned char *)&One) == 1))
+			{
+				Swap = Bytes[0]; Bytes[0] = Bytes[3]; Bytes[3] = Swap;
+				Swap = Bytes[1]; Bytes[1] = Bytes[2]; Bytes[2] = Swap;
+			}
+	
+			memcpy(&Value, Bytes, 4);
+			Rgb[Channel*(*NumPixels) + i] = fabs(Scale)*Value;
+		}
+	
+	fclose(File);
+	return Rgb;
+}
+
+
+/** @brief Fill synthetic sRGB pixels */
+static double *SyntheticRgb(long NumPixels)
+{
+	static const double Special[8][3] = {{0, 0, 0}, {1, 1, 1}, {1, 0, 0},
+		{0, 1, 0}, {0, 0, 1}, {0, 1, 1}, {1, 0, 1}, {1, 1, 0}};
+	double *Rgb;
+	unsigned long Seed = 12345;
+	long i;
+	int Channel;
+	
+	
+	if(!(Rgb = (double *)malloc(sizeof(double)*3*NumPixels)))
+		return NULL;
+	
+	for(i = 0; i < NumPixels; i++)
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			Seed = (1103515245UL*Seed + 12345UL) & 0x7FFFFFFFUL;
+			Rgb[Channel*NumPixels + i] = (i < 8) ?
+				Special[i][Channel] : Seed/2147483648.0;
+		}
+	
+	return Rgb;
+}
+
+
+/** @brief Parse a comma-separated list of thread counts */
+static int ParseThreads(int Threads[MAX_THREAD_COUNTS], const char *List)
+{
+	int Num = 0;
+	
+	
+	while(*List && Num < MAX_THREAD_COUNTS)
+	{
+		if((Threads[Num++] = atoi(List)) <= 0)
+			return 0;
+	
+		List += strcspn(List, ",");
+		List += (*List == ',');
+	}
+	
+	return Num;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *ImageFile = NULL, *PairString = NULL, *CsvFile = NULL;
+	FILE *Csv = NULL;
+	double *Rgb, *Buffer = NULL, *Src[3], *Dest[3], *Back[3];
+	float *Bufferf = NULL, *Srcf[3], *Destf[3], *Backf[3];
+	ref *RefBuffer = NULL, *Ref[3], *SrcRef[3], S[3], D[3];
+	colortransform Trans, Inverse;
+	errorstat Error, RoundTrip;
+	char String[64], InverseString[64];
+	double Time, BestTime;
+	long NumPixels = 1048576, i;
+	int Threads[MAX_THREAD_COUNTS], NumThreadCounts = 0, NumRepeats = 3;
+	int SrcId, DestId, Variant, t, Repeat, Channel, arg;
+	
+	
+	for(arg = 1; arg < argc; arg++)
+	{
+		if(arg + 1 >= argc || argv[arg][0] != '-' || strlen(argv[arg]) != 2)
+		{
+			HelpMessage();
+			return 1;
+		}
+	
+		switch(argv[arg++][1])
+		{
+		case 'n': NumPixels = atol(argv[arg]); break;
+		case 'i': ImageFile = argv[arg]; break;
+		case 'p': PairString = argv[arg]; break;
+		case 't': NumThreadCounts = ParseThreads(Threads, argv[arg]);
+			if(!NumThreadCounts) NumPixels = 0;
+			break;
+		case 'r': NumRepeats = atoi(argv[arg]); break;
+		case 'o': CsvFile = argv[arg]; break;
+		default: NumPixels = 0;
+		}
+	
+		if(NumPixels <= 0 || NumRepeats <= 0)
+		{
+			HelpMessage();
+			return 1;
+		}
+	}
+	
+	if(!NumThreadCounts)
+	{
+		Threads[NumThreadCounts++] = 1;
+#ifdef _OPENMP
+		if(omp_get_max_threads() > 1)
+			Threads[NumThreadCounts++] = omp_get_max_threads();
+#endif
+	}
+	
+	if(ImageFile)
+	{
+		if(!(Rgb = ReadPfm(&NumPixels, ImageFile)))
+		{
+			fprintf(stderr, "Unable to read %s as an RGB PFM file.\n", ImageFile);
+			return 1;
+		}
+	}
+	else if(!(Rgb = SyntheticRgb(NumPixels)))
+		goto OutOfMemory;
+	
+	if(!(Buffer = (double *)malloc(sizeof(double)*9*NumPixels))
+		|| !(Bufferf = (float *)malloc(sizeof(float)*9*NumPixels))
+		|| !(RefBuffer = (ref *)malloc(sizeof(ref)*6*NumPixels)))
+		goto OutOfMemory;
+	
+	for(Channel = 0; Channel < 3; Channel++)
+	{
+		Src[Channel] = Buffer + Channel*NumPixels;
+		Dest[Channel] = Buffer + (3 + Channel)*NumPixels;
+		Back[Channel] = Buffer + (6 + Channel)*NumPixels;
+		Srcf[Channel] = Bufferf + Channel*NumPixels;
+		Destf[Channel] = Bufferf + (3 + Channel)*NumPixels;
+		Backf[Channel] = Bufferf + (6 + Channel)*NumPixels;
+		Ref[Channel] = RefBuffer + Channel*NumPixels;
+		SrcRef[Channel] = RefBuffer + (3 + Channel)*NumPixels;
+	}
+	
+	if(CsvFile)
+	{
+		if(!(Csv = fopen(CsvFile, "w")))
+		{
+			fprintf(stderr, "Unable to create %s.\n", CsvFile);
+			return 1;
+		}
+	
+		fprintf(Csv, "transform,variant,threads,pixels,mpix_per_s,max_error,"
+			"mean_error,max_ulp,nan_count,roundtrip_max_error,"
+			"roundtrip_mean_error,roundtrip_nan_count\n");
+	}
+	
+	printf("%-24s %-6s %8s %12s %12s %12s %12s %8s %12s\n", "transform",
+		"impl", "threads", "Mpx/s", "max err", "mean err", "max ulp",
+		"NaN", "rt max err");
+	
+	for(SrcId = 0; SrcId < NUM_SPACES; SrcId++)
+		for(DestId = 0; DestId < NUM_SPACES; DestId++)
+		{
+			sprintf(String, "%s <- %s", Space[DestId].Name, Space[SrcId].Name);
+			sprintf(InverseString, "%s <- %s", Space[SrcId].Name,
+				Space[DestId].Name);
+	
+			if(SrcId == DestId || (PairString && strcmp(PairString, String)))
+				continue;
+	
+			/* Inputs in the source space, representable as floats */
+			for(i = 0; i < NumPixels; i++)
+			{
+				for(Channel = 0; Channel < 3; Channel++)
+					S[Channel] = Rgb[Channel*NumPixels + i];
+	
+				RefConvert(SrcId, 0, D, S);
+	
+				for(Channel = 0; Channel < 3; Channel++)
+				{
+					Srcf[Channel][i] = (float)D[Channel];
+					Src[Channel][i] = Srcf[Channel][i];
+					SrcRef[Channel][i] = Srcf[Channel][i];
+				}
+			}
+	
+			for(i = 0; i < NumPixels; i++)
+			{
+				for(Channel = 0; Channel < 3; Channel++)
+					S[Channel] = SrcRef[Channel][i];
+	
+				RefConvert(DestId, SrcId, D, S);
+	
+				for(Channel = 0; Channel < 3; Channel++)
+					Ref[Channel][i] = D[Channel];
+			}
+	
+			for(Variant = 0; Variant < NUM_VARIANTS; Variant++)
+			{
+				GetColorTransform(&Trans, String);
+				GetColorTransform(&Inverse, InverseString);
+	
+				if(Variant == VARIANT_FAST || Variant == VARIANT_FASTF)
+				{
+					SetColorTransformFast(&Trans);
+					SetColorTransformFast(&Inverse);
+				}
+	
+				/* Accuracy, then round trip */
+				RunVariant(Variant, &Trans, Dest, (const double **)Src,
+					Destf, (const float **)Srcf, NumPixels);
+				RunVariant(Variant, &Inverse, Back, (const double **)Dest,
+					Backf, (const float **)Destf, NumPixels);
+	
+				if(Variant >= VARIANT_FLOAT)
+					for(Channel = 0; Channel < 3; Channel++)
+						for(i = 0; i < NumPixels; i++)
+						{
+							Dest[Channel][i] = Destf[Channel][i];
+							Back[Channel][i] = Backf[Channel][i];
+						}
+	
+				MeasureError(&Error, Dest, Ref, NumPixels, DestId,
+					(Variant >= VARIANT_FLOAT) ? FLT_EPSILON : DBL_EPSILON);
+				MeasureError(&RoundTrip, Back, SrcRef, NumPixels, SrcId,
+					(Variant >= VARIANT_FLOAT) ? FLT_EPSILON : DBL_EPSILON);
+	
+				/* Throughput at each thread count */
+				for(t = 0; t < NumThreadCounts; t++)
+				{
+					if(Variant == VARIANT_PIXEL && t > 0)
+						break;
+	
+					SetColorThreads(Threads[t], COLOR_PARALLEL_SIZE);
+	
+					for(Repeat = 0, BestTime = HUGE_VAL;
+						Repeat < NumRepeats; Repeat++)
+					{
+						Time = RunVariant(Variant, &Trans, Dest,
+							(const double **)Src, Destf, (const float **)Srcf,
+							NumPixels);
+						BestTime = (Time < BestTime) ? Time : BestTime;
+					}
+	
+					BestTime = (BestTime > 0) ? BestTime : 1e-9;
+					printf("%-24s %-6s %8d %12.2f %12.3g %12.3g %12.3g %8ld "
+						"%12.3g\n", String, VariantName[Variant],
+						(Variant == VARIANT_PIXEL) ? 1 : Threads[t],
+						NumPixels/BestTime/1e6, Error.MaxError,
+						Error.MeanError, Error.MaxUlp, Error.NumNan,
+						RoundTrip.MaxError);
+	
+					if(Csv)
+						fprintf(Csv, "\"%s\",%s,%d,%ld,%.6g,%.6g,%.6g,%.6g,%ld,"
+							"%.6g,%.6g,%ld\n", String, VariantName[Variant],
+							(Variant == VARIANT_PIXEL) ? 1 : Threads[t],
+							NumPixels, NumPixels/BestTime/1e6,
+							Error.MaxError, Error.MeanError, Error.MaxUlp,
+							Error.NumNan, RoundTrip.MaxError,
+							RoundTrip.MeanError, RoundTrip.NumNan);
+				}
+			}
+	
+			fflush(stdout);
+		}
+	
+	if(Csv)
+		fclose(Csv);
+	
+	free(RefBuffer);
+	free(Bufferf);
+	free(Buffer);
+	free(Rgb);
+	return 0;
+OutOfMemory:
+	fprintf(stderr, "Out of memory.\n");
+	return 1;
+}
+
+
+/** @brief Print program help message */
+static void HelpMessage()
+{
+	printf("Colorspace benchmark\n");
+	printf("\nSyntax: colorbench [options]\n\n");
+	printf("Measures the speed and accuracy of every transform supported by\n");
+	printf("colorspace.c against a long double reference.  Options:\n");
+	printf("   -n N      number of synthetic pixels (default 1048576)\n");
+	printf("   -i FILE   use the sRGB pixels of a PFM image\n");
+	printf("   -p PAIR   benchmark only PAIR, such as \"Lab <- RGB\"\n");
+	printf("   -t LIST   comma-separated thread counts\n");
+	printf("   -r N      timing repetitions (default 3)\n");
+	printf("   -o FILE   write the results as CSV\n\n");
+	printf("Example: colorbench -n 4000000 -t 1,2,4,8 -o bench.csv\n");
+}
@@ -4,7 +4,8 @@
  *
  * This is a small command line program to demonstrate colorspace.c.  The
  * program accepts an sRGB color as input and transforms it to all the spaces
- * supported by colorspace.c.
+ * supported by colorspace.c, or converts image files from one color space to
+ * another.
  *
  * ==Usage==
  * The syntax for the program is
@@ -13,96 +14,1119 @@
  * corrected sRGB color space.  For example,
  *    colorcalc 0.5 0.85 0.61
  *
+ * Image files are converted by
+ *    colorcalc [options] TRANSFORM INPUT OUTPUT [INPUT OUTPUT ...]
+ * where TRANSFORM is a string accepted by GetColorTransform, such as
+ * "Lab <- RGB", and each INPUT is converted to the OUTPUT following it, so
+ * that a frame sequence is converted in one call.  For example,
+ *    colorcalc -f "Lab <- RGB" frame1.exr lab1.exr frame2.exr lab2.exr
+ * The options are
+ *    -f       use the vectorized routines (SetColorTransformFast)
+ *    -j N     convert on N threads (default: all)
+ *    -b N     rows per band (default 64)
+ *
+ * Inputs may be PFM files or scanline EXR files, uncompressed or compressed
+ * with RLE, or with ZIP when compiled with zlib, and with half, float, or
+ * uint channels R, G, B or Y.  Outputs are PFM or uncompressed float EXR
+ * files according to their extension, holding the three converted channels.
+ *
+ * The images are streamed in bands of rows, so memory stays at three bands
+ * whatever the image size.  Reading the next band, converting the current
+ * one, and writing the previous one run at the same time when compiled with
+ * OpenMP, and the conversion itself is spread over the remaining threads.
+ *
  * ==Compiling Instructions==
- * Compile the files colorcalc.c and colorspace.c with an ANSI C compiler.  The
- * program is compiled with GCC by
- *    gcc colorcalc.c colorspace.c -lm -o colorcalc
+ * Compile the files colorcalc.c, colorspace.c, and colorspace_select.c with
+ * an ANSI C compiler.  The program is compiled with GCC by
+ *    gcc colorcalc.c colorspace.c colorspace_select.c -lm -o colorcalc
+ * For the pipelined and multithreaded conversion, and for ZIP-compressed EXR
+ * files, compile with
+ *    gcc -O2 -fopenmp -ffp-contract=off -DUSE_ZLIB colorcalc.c colorspace.c
+ *       colorspace_select.c -lz -lm -o colorcalc
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
 #include "colorspace.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
 
 static void HelpMessage();
 
 
-int main(int argc, char *argv[])
+/** @brief Number of destination spaces */
+#define NUM_SPACES	14
+
+/** @brief Destination spaces and their output formats */
+static const struct
+{
+	const char *TransformString;
+	const char *Format;
+} Space[NUM_SPACES] = {
+	{"YCbCr <- RGB",      "Y'CbCr       Y':%8.3f   Cb:%8.3f   Cr:%8.3f\n"},
+	{"JPEG-YCbCr <- RGB", "JPEG-Y'CbCr  Y':%8.3f   Cb:%8.3f   Cr:%8.3f\n"},
+	{"YPbPr <- RGB",      "Y'PbPr       Y':%8.3f   Pb:%8.3f   Pr:%8.3f\n"},
+	{"YDbDr <- RGB",      "Y'DbDr       Y':%8.3f   Db:%8.3f   Dr:%8.3f\n"},
+	{"YUV <- RGB",        "Y'UV         Y':%8.3f    U:%8.3f    V:%8.3f\n"},
+	{"YIQ <- RGB",        "Y'IQ         Y':%8.3f    I:%8.3f    Q:%8.3f\n"},
+	{"HSV <- RGB",        "HSV           H:%8.3f    S:%8.3f    V:%8.3f\n"},
+	{"HSL <- RGB",        "HSL           H:%8.3f    S:%8.3f    L:%8.3f\n"},
+	{"HSI <- RGB",        "HSI           H:%8.3f    S:%8.3f    I:%8.3f\n"},
+	{"XYZ <- RGB",        "XYZ           X:%8.3f    Y:%8.3f    Z:%8.3f\n"},
+	{"Lab <- RGB",        "L*a*b*       L*:%8.3f   a*:%8.3f   b*:%8.3f\n"},
+	{"Luv <- RGB",        "L*u*v*       L*:%8.3f   u*:%8.3f   v*:%8.3f\n"},
+	{"LCH <- RGB",        "L*C*H*       L*:%8.3f   C*:%8.3f   H*:%8.3f\n"},
+	{"CAT02 LMS <- RGB",  "CAT02 LMS     L:%8.3f    M:%8.3f    S:%8.3f\n"}
+	};
+
+
+/*
+ * == Image files ==
+ *
+ * Minimal streaming readers and writers for PFM and scanline EXR files.  Rows
+ * are read and written by band through fseek, so that neither image is held
+ * in memory.  Bands hold interleaved RGB floats with the top row first.
+ */
+
+/** @brief Image file formats */
+#define FORMAT_PFM		0
+#define FORMAT_EXR		1
+
+/** @brief EXR compression methods */
+#define EXR_NO_COMPRESSION		0
+#define EXR_RLE_COMPRESSION		1
+#define EXR_ZIPS_COMPRESSION	2
+#define EXR_ZIP_COMPRESSION		3
+
+/** @brief EXR channel pixel types */
+#define EXR_UINT	0
+#define EXR_HALF	1
+#define EXR_FLOAT	2
+
+/** @brief Maximum number of channels in an EXR file */
+#define EXR_MAX_CHANNELS	64
+
+/** @brief Default number of rows per band */
+#define DEFAULT_BAND_ROWS	64
+
+/** @brief An image file open for streaming */
+typedef struct
+{
+	FILE *File;
+	int Format;
+	long Width;
+	long Height;
+	/** @brief Offset of the pixel data (PFM) or the first chunk (EXR output) */
+	long DataOffset;
+	/** @brief Number of channels stored per pixel */
+	int NumChannels;
+	/** @brief Nonzero if the PFM data is big endian */
+	int BigEndian;
+	/** @brief Factor applied to PFM values */
+	float Scale;
+	int Compression;
+	int LinesPerChunk;
+	long MinY;
+	/** @brief Pixel type of each EXR channel */
+	int ChannelType[EXR_MAX_CHANNELS];
+	/** @brief Band channel of each EXR channel, or -1 to skip it */
+	int ChannelDest[EXR_MAX_CHANNELS];
+	/** @brief Nonzero if a Y channel is copied to all three band channels */
+	int Gray;
+	/** @brief Size in bytes of an EXR scanline */
+	long BytesPerLine;
+	/** @brief File offset of each EXR chunk */
+	long *ChunkOffset;
+	/** @brief Buffers for a compressed and an uncompressed EXR chunk */
+	unsigned char *Chunk;
+	unsigned char *Scratch;
+} imagefile;
+
+/** @brief Table converting half floats to floats */
+static float HalfTable[65536];
+static int HalfTableReady = 0;
+
+
+/** @brief Check whether the machine is big endian */
+static int HostBigEndian()
 {
-	num R, G, B;
-	num D[3];
+	unsigned int One = 1;
+	return !*((unsigned char *)&One);
+}
+
+
+/** @brief Read a little-endian unsigned 32-bit integer */
+static unsigned long GetUint32(const unsigned char *p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8)
+		| ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+
+/** @brief Read a little-endian signed 32-bit integer */
+static long GetInt32(const unsigned char *p)
+{
+	unsigned long Value = GetUint32(p);
+	
+	return (Value & 0x80000000UL) ?
+		-(long)(0xFFFFFFFFUL - Value) - 1 : (long)Value;
+}
+
+
+/** @brief Write a little-endian 32-bit integer */
+static void PutInt32(unsigned char *p, long Value)
+{
+	unsigned long u = (unsigned long)Value;
 	
+	p[0] = (unsigned char)(u & 0xFF);
+	p[1] = (unsigned char)((u >> 8) & 0xFF);
+	p[2] = (unsigned char)((u >> 16) & 0xFF);
+	p[3] = (unsigned char)((u >> 24) & 0xFF);
+}
+
+
+/** @brief Write a little-endian 64-bit offset */
+static void PutInt64(unsigned char *p, long Value)
+{
+	unsigned long u = (unsigned long)Value;
+	int i;
 	
-	if(argc != 4)
+	for(i = 0; i < 8; i++, u /= 256)
+		p[i] = (unsigned char)(u % 256);
+}
+
+
+/** @brief Read a float stored with the given byte order */
+static float GetFloat(const unsigned char *p, int BigEndian)
+{
+	unsigned char Bytes[4];
+	float Value;
+	int i;
+	
+	for(i = 0; i < 4; i++)
+		Bytes[i] = p[(BigEndian == HostBigEndian()) ? i : 3 - i];
+	
+	memcpy(&Value, Bytes, 4);
+	return Value;
+}
+
+
+/** @brief Write a little-endian float */
+static void PutFloat(unsigned char *p, float Value)
+{
+	unsigned char Bytes[4];
+	int i;
+	
+	memcpy(Bytes, &Value, 4);
+	
+	for(i = 0; i < 4; i++)
+		p[i] = Bytes[HostBigEndian() ? 3 - i : i];
+}
+
+
+/** @brief Fill the half float table */
+static void FillHalfTable()
+{
+	long h;
+	int Exponent;
+	double Mantissa, Value;
+	
+	
+	for(h = 0; h < 65536; h++)
 	{
-		HelpMessage();
+		Exponent = (int)((h >> 10) & 0x1F);
+		Mantissa = (double)(h & 0x3FF);
+	
+		if(Exponent == 0)
+			Value = ldexp(Mantissa, -24);
+		else if(Exponent == 31)
+			Value = (Mantissa == 0) ? HUGE_VAL : HUGE_VAL - HUGE_VAL;
+		else
+			Value = ldexp(Mantissa + 1024, Exponent - 25);
+	
+		HalfTable[h] = (float)((h & 0x8000) ? -Value : Value);
+	}
+	
+	HalfTableReady = 1;
+}
+
+
+/** @brief Check the extension of a file name, ignoring case */
+static int HasExtension(const char *FileName, const char *Extension)
+{
+	size_t Length = strlen(FileName), ExtLength = strlen(Extension), i;
+	
+	
+	if(Length < ExtLength)
+		return 0;
+	
+	for(i = 0; i < ExtLength; i++)
+		if(tolower((unsigned char)FileName[Length - ExtLength + i])
+			!= Extension[i])
+			return 0;
+	
+	return 1;
+}
+
+
+/** @brief Read a PFM header */
+static int ReadPfmHeader(imagefile *Image)
+{
+	char Magic[3];
+	float Scale;
+	
+	
+	if(fscanf(Image->File, "%2s %ld %ld %f", Magic,
+		&Image->Width, &Image->Height, &Scale) != 4
+		|| Magic[0] != 'P' || (Magic[1] != 'F' && Magic[1] != 'f')
+		|| Image->Width <= 0 || Image->Height <= 0 || Scale == 0
+		|| fgetc(Image->File) == EOF)
+		return 0;
+	
+	Image->NumChannels = (Magic[1] == 'F') ? 3 : 1;
+	Image->BigEndian = (Scale > 0);
+	Image->Scale = (float)fabs(Scale);
+	Image->LinesPerChunk = 1;
+	Image->DataOffset = ftell(Image->File);
+	return 1;
+}
+
+
+/** @brief Read a null-terminated string from an EXR header */
+static int ReadExrString(FILE *File, char *Buf, int Size)
+{
+	int c, n;
+	
+	
+	for(n = 0; n < Size; n++)
+	{
+		if((c = fgetc(File)) == EOF)
+			return -1;
+		else if(!(Buf[n] = (char)c))
+			return n;
+	}
+	
+	return -1;
+}
+
+
+/** @brief Parse the channel list of an EXR header */
+static int ReadExrChannels(imagefile *Image, const unsigned char *Data,
+	long Size)
+{
+	const char *Name;
+	long i = 0, Length;
+	int Channel, NumRgb = 0, HasY = 0;
+	
+	
+	for(Channel = 0; i < Size && Data[i]; Channel++)
+	{
+		Name = (const char *)(Data + i);
+	
+		for(Length = 0; i + Length < Size && Data[i + Length]; Length++)
+			;
+	
+		if(Channel >= EXR_MAX_CHANNELS || i + Length + 17 > Size)
+			return 0;
+	
+		i += Length + 1;
+		Image->ChannelType[Channel] = (int)GetInt32(Data + i);
+	
+		if(Image->ChannelType[Channel] < EXR_UINT
+			|| Image->ChannelType[Channel] > EXR_FLOAT)
+			return 0;
+		else if(GetInt32(Data + i + 8) != 1 || GetInt32(Data + i + 12) != 1)
+		{
+			fprintf(stderr, "Subsampled EXR channels are not supported.\n");
+			return 0;
+		}
+	
+		if(!strcmp(Name, "R"))
+			Image->ChannelDest[Channel] = 0;
+		else if(!strcmp(Name, "G"))
+			Image->ChannelDest[Channel] = 1;
+		else if(!strcmp(Name, "B"))
+			Image->ChannelDest[Channel] = 2;
+		else if(!strcmp(Name, "Y"))
+			Image->ChannelDest[Channel] = 3;
+		else
+			Image->ChannelDest[Channel] = -1;
+	
+		if(Image->ChannelDest[Channel] == 3)
+			HasY = 1;
+		else if(Image->ChannelDest[Channel] >= 0)
+			NumRgb++;
+	
+		i += 16;
+	}
+	
+	Image->NumChannels = Channel;
+	
+	if(NumRgb < 3 && !HasY)
+	{
+		fprintf(stderr, "EXR files should have channels R, G, B or Y.\n");
+		return 0;
+	}
+	
+	/* Use Y if the file lacks one of R, G, B */
+	Image->Gray = (NumRgb < 3);
+	
+	for(Channel = 0; Channel < Image->NumChannels; Channel++)
+		if(Image->Gray != (Image->ChannelDest[Channel] == 3))
+			Image->ChannelDest[Channel] = -1;
+	
+	return 1;
+}
+
+
+/** @brief Read an EXR header and chunk offset table */
+static int ReadExrHeader(imagefile *Image)
+{
+	unsigned char Version[4], Bytes[8], *Data = NULL;
+	char Name[256], Type[256];
+	long Size, MinX = 0, MaxX = -1, MaxY = -1, NumChunks, c;
+	int i, HaveChannels = 0;
+	
+	
+	if(fread(Version, 1, 4, Image->File) != 4 || Version[0] != 2)
+		return 0;
+	else if(Version[1] & 0x1A)	/* Tiled, deep, or multipart */
+	{
+		fprintf(stderr, "Only single-part scanline EXR files are supported.\n");
+		return 0;
+	}
+	
+	Image->Compression = -1;
+	
+	/* Read the attributes */
+	while(1)
+	{
+		if(ReadExrString(Image->File, Name, 256) < 0)
+			return 0;
+		else if(!Name[0])
+			break;
+	
+		if(ReadExrString(Image->File, Type, 256) < 0
+			|| fread(Bytes, 1, 4, Image->File) != 4
+			|| (Size = GetInt32(Bytes)) < 0
+			|| !(Data = (unsigned char *)malloc(Size + 1)))
+			return 0;
+	
+		if(fread(Data, 1, Size, Image->File) != (size_t)Size)
+		{
+			free(Data);
+			return 0;
+		}
+	
+		if(!strcmp(Name, "channels"))
+		{
+			if(!(HaveChannels = ReadExrChannels(Image, Data, Size)))
+			{
+				free(Data);
+				return 0;
+			}
+		}
+		else if(!strcmp(Name, "compression") && Size == 1)
+			Image->Compression = Data[0];
+		else if(!strcmp(Name, "dataWindow") && Size == 16)
+		{
+			MinX = GetInt32(Data);
+			Image->MinY = GetInt32(Data + 4);
+			MaxX = GetInt32(Data + 8);
+			MaxY = GetInt32(Data + 12);
+		}
+	
+		free(Data);
+	}
+	
+	Image->Width = MaxX - MinX + 1;
+	Image->Height = MaxY - Image->MinY + 1;
+	
+	if(!HaveChannels || Image->Width <= 0 || Image->Height <= 0)
+		return 0;
+	
+	switch(Image->Compression)
+	{
+	case EXR_NO_COMPRESSION:
+	case EXR_RLE_COMPRESSION:
+		Image->LinesPerChunk = 1;
+		break;
+#ifdef USE_ZLIB
+	case EXR_ZIPS_COMPRESSION:
+		Image->LinesPerChunk = 1;
+		break;
+	case EXR_ZIP_COMPRESSION:
+		Image->LinesPerChunk = 16;
+		break;
+#else
+	case EXR_ZIPS_COMPRESSION:
+	case EXR_ZIP_COMPRESSION:
+		fprintf(stderr, "ZIP-compressed EXR files require building with "
+			"-DUSE_ZLIB.\n");
+		return 0;
+#endif
+	default:
+		fprintf(stderr, "Unsupported EXR compression method %d.\n",
+			Image->Compression);
+		return 0;
+	}
+	
+	for(i = 0, Image->BytesPerLine = 0; i < Image->NumChannels; i++)
+		Image->BytesPerLine += Image->Width
+			* ((Image->ChannelType[i] == EXR_HALF) ? 2 : 4);
+	
+	NumChunks = (Image->Height + Image->LinesPerChunk - 1)
+		/ Image->LinesPerChunk;
+	
+	if(!(Image->ChunkOffset = (long *)malloc(sizeof(long)*NumChunks))
+		|| !(Image->Chunk = (unsigned char *)malloc(
+			Image->BytesPerLine*Image->LinesPerChunk))
+		|| !(Image->Scratch = (unsigned char *)malloc(
+			Image->BytesPerLine*Image->LinesPerChunk)))
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 0;
+	}
+	
+	for(c = 0; c < NumChunks; c++)
+	{
+		if(fread(Bytes, 1, 8, Image->File) != 8)
+			return 0;
+	
+		for(i = 7, Image->ChunkOffset[c] = 0; i >= 0; i--)
+			Image->ChunkOffset[c] = Image->ChunkOffset[c]*256 + Bytes[i];
+	}
+	
+	if(!HalfTableReady)
+		FillHalfTable();
+	
+	return 1;
+}
+
+
+/** @brief Open an image file for reading */
+static int OpenImage(imagefile *Image, const char *FileName)
+{
+	unsigned char Magic[4];
+	int Success;
+	
+	
+	memset(Image, 0, sizeof(imagefile));
+	
+	if(!(Image->File = fopen(FileName, "rb")))
+	{
+		fprintf(stderr, "Unable to open %s.\n", FileName);
+		return 0;
+	}
+	
+	if(fread(Magic, 1, 4, Image->File) != 4)
+		Success = 0;
+	else if(Magic[0] == 'P' && (Magic[1] == 'F' || Magic[1] == 'f'))
+	{
+		Image->Format = FORMAT_PFM;
+		rewind(Image->File);
+		Success = ReadPfmHeader(Image);
+	}
+	else if(Magic[0] == 0x76 && Magic[1] == 0x2F
+		&& Magic[2] == 0x31 && Magic[3] == 0x01)
+	{
+		Image->Format = FORMAT_EXR;
+		Success = ReadExrHeader(Image);
+	}
+	else
+		Success = 0;
+	
+	if(!Success)
+		fprintf(stderr, "%s is not a supported PFM or EXR file.\n", FileName);
+	
+	return Success;
+}
+
+
+/** @brief Close an image file and free its buffers */
+static void CloseImage(imagefile *Image)
+{
+	if(Image->File)
+		fclose(Image->File);
+	if(Image->ChunkOffset)
+		free(Image->ChunkOffset);
+	if(Image->Chunk)
+		free(Image->Chunk);
+	if(Image->Scratch)
+		free(Image->Scratch);
+	
+	memset(Image, 0, sizeof(imagefile));
+}
+
+
+/** @brief Read rows from a PFM file into a band */
+static int ReadPfmRows(imagefile *Image, float *Band, long Row, long NumRows)
+{
+	long RowSize = Image->Width*Image->NumChannels, i, n;
+	unsigned char *Bytes = (unsigned char *)Band;
+	float Swap;
+	
+	
+	/* PFM files store the bottom row first */
+	if(fseek(Image->File, Image->DataOffset + 4*RowSize
+		*(Image->Height - Row - NumRows), SEEK_SET)
+		|| fread(Bytes, 4, RowSize*NumRows, Image->File)
+			!= (size_t)(RowSize*NumRows))
+		return 0;
+	
+	for(i = 0; i < RowSize*NumRows; i++)
+		Band[i] = Image->Scale*GetFloat(Bytes + 4*i, Image->BigEndian);
+	
+	for(n = 0; n < NumRows/2; n++)
+		for(i = 0; i < RowSize; i++)
+		{
+			Swap = Band[n*RowSize + i];
+			Band[n*RowSize + i] = Band[(NumRows - 1 - n)*RowSize + i];
+			Band[(NumRows - 1 - n)*RowSize + i] = Swap;
+		}
+	
+	/* Expand grayscale to RGB, from the end to work in place */
+	if(Image->NumChannels == 1)
+		for(i = RowSize*NumRows - 1; i >= 0; i--)
+			Band[3*i] = Band[3*i + 1] = Band[3*i + 2] = Band[i];
+	
+	return 1;
+}
+
+
+/** @brief Undo the RLE compression of an EXR chunk */
+static long RleDecompress(unsigned char *Dest, long DestSize,
+	const unsigned char *Src, long SrcSize)
+{
+	long i = 0, n = 0;
+	int Count;
+	
+	
+	while(i < SrcSize)
+	{
+		Count = (Src[i] > 127) ? Src[i] - 256 : Src[i];
+		i++;
+	
+		if(Count < 0)
+		{
+			if(i - Count > SrcSize || n - Count > DestSize)
+				return -1;
+	
+			memcpy(Dest + n, Src + i, -Count);
+			i -= Count;
+			n -= Count;
+		}
+		else
+		{
+			if(i >= SrcSize || n + Count + 1 > DestSize)
+				return -1;
+	
+			memset(Dest + n, Src[i++], Count + 1);
+			n += Count + 1;
+		}
+	}
+	
+	return n;
+}
+
+
+/** @brief Decompress an EXR chunk from Image->Chunk into Image->Scratch */
+static int DecompressChunk(imagefile *Image, long Size, long UncompressedSize)
+{
+	unsigned char *t = Image->Chunk;
+	long i, Half = (UncompressedSize + 1)/2;
+	
+	
+	if(Image->Compression == EXR_RLE_COMPRESSION)
+	{
+		if(RleDecompress(Image->Scratch, UncompressedSize,
+			Image->Chunk, Size) != UncompressedSize)
+			return 0;
+	}
+#ifdef USE_ZLIB
+	else
+	{
+		uLongf DestLen = (uLongf)UncompressedSize;
+	
+		if(uncompress(Image->Scratch, &DestLen, Image->Chunk, (uLong)Size)
+			!= Z_OK || DestLen != (uLongf)UncompressedSize)
+			return 0;
+	}
+#endif
+	
+	/* Undo the predictor, then interleave the two halves */
+	for(i = 1; i < UncompressedSize; i++)
+		Image->Scratch[i] = (unsigned char)(Image->Scratch[i - 1]
+			+ Image->Scratch[i] - 128);
+	
+	for(i = 0; i < UncompressedSize; i++)
+		t[i] = (i % 2) ? Image->Scratch[Half + i/2] : Image->Scratch[i/2];
+	
+	return 1;
+}
+
+
+/** @brief Read rows from an EXR file into a band */
+static int ReadExrRows(imagefile *Image, float *Band, long Row, long NumRows)
+{
+	const unsigned char *p;
+	unsigned char Bytes[8];
+	long Chunk, FirstRow, NumLines, Size, y, x;
+	int Channel, Dest;
+	float Value;
+	
+	
+	for(Chunk = Row/Image->LinesPerChunk;
+		Chunk*Image->LinesPerChunk < Row + NumRows; Chunk++)
+	{
+		if(fseek(Image->File, Image->ChunkOffset[Chunk], SEEK_SET)
+			|| fread(Bytes, 1, 8, Image->File) != 8)
+			return 0;
+	
+		FirstRow = GetInt32(Bytes) - Image->MinY;
+		Size = GetInt32(Bytes + 4);
+		NumLines = Image->Height - FirstRow;
+		NumLines = (NumLines < Image->LinesPerChunk) ?
+			NumLines : Image->LinesPerChunk;
+	
+		if(FirstRow != Chunk*Image->LinesPerChunk || Size <= 0
+			|| Size > NumLines*Image->BytesPerLine
+			|| fread(Image->Chunk, 1, Size, Image->File) != (size_t)Size)
+			return 0;
+	
+		/* Chunks that do not compress are stored as is */
+		if(Size < NumLines*Image->BytesPerLine && !DecompressChunk(Image,
+			Size, NumLines*Image->BytesPerLine))
+			return 0;
+	
+		for(y = FirstRow, p = Image->Chunk; y < FirstRow + NumLines; y++)
+			for(Channel = 0; Channel < Image->NumChannels; Channel++)
+			{
+				Dest = Image->ChannelDest[Channel];
+	
+				for(x = 0; x < Image->Width; x++)
+				{
+					if(Image->ChannelType[Channel] == EXR_HALF)
+					{
+						Value = HalfTable[p[0] | (p[1] << 8)];
+						p += 2;
+					}
+					else
+					{
+						Value = (Image->ChannelType[Channel] == EXR_FLOAT) ?
+							GetFloat(p, 0) : (float)GetUint32(p);
+						p += 4;
+					}
+	
+					if(y < Row || y >= Row + NumRows || Dest < 0)
+						continue;
+					else if(Dest == 3)
+						Band[3*((y - Row)*Image->Width + x)]
+						= Band[3*((y - Row)*Image->Width + x) + 1]
+						= Band[3*((y - Row)*Image->Width + x) + 2] = Value;
+					else
+						Band[3*((y - Row)*Image->Width + x) + Dest] = Value;
+				}
+			}
+	}
+	
+	return 1;
+}
+
+
+/** @brief Read rows from an image file into a band */
+static int ReadImageRows(imagefile *Image, float *Band, long Row, long NumRows)
+{
+	return (Image->Format == FORMAT_PFM) ?
+		ReadPfmRows(Image, Band, Row, NumRows) :
+		ReadExrRows(Image, Band, Row, NumRows);
+}
+
+
+/** @brief Create an image file and write its header */
+static int CreateImage(imagefile *Image, const char *FileName,
+	long Width, long Height)
+{
+	static const char ChannelName[3] = {'B', 'G', 'R'};
+	unsigned char Header[512], *p;
+	long y;
+	int Channel;
+	
+	
+	memset(Image, 0, sizeof(imagefile));
+	
+	if(HasExtension(FileName, ".exr"))
+		Image->Format = FORMAT_EXR;
+	else if(HasExtension(FileName, ".pfm"))
+		Image->Format = FORMAT_PFM;
+	else
+		return 0;
+	
+	Image->Width = Width;
+	Image->Height = Height;
+	Image->NumChannels = 3;
+	
+	if(!(Image->File = fopen(FileName, "wb")))
+		return 0;
+	
+	if(Image->Format == FORMAT_PFM)
+	{
+		/* Write in the byte order of the machine */
+		if(fprintf(Image->File, "PF\n%ld %ld\n%s\n", Width, Height,
+			HostBigEndian() ? "1.0" : "-1.0") < 0)
+			return 0;
+	
+		Image->DataOffset = ftell(Image->File);
 		return 1;
 	}
 	
-	/* Read the input sRGB values */
-	R = atof(argv[1]);
-	G = atof(argv[2]);
-	B = atof(argv[3]);
+	/* EXR header with float R, G, B channels and no compression */
+	memcpy(Header, "\x76\x2F\x31\x01\x02\x00\x00\x00", 8);
+	p = Header + 8;
+	memcpy(p, "channels\0chlist\0", 16);
+	PutInt32(p + 16, 55);
+	p += 20;
 	
-	if(!(0 <= R && R <= 1 && 0 <= G && G <= 1 && 0 <= B && B <= 1))
-		printf("\nWarning: Input sRGB values should be between 0 and 1.\n\n");
+	for(Channel = 0; Channel < 3; Channel++, p += 18)
+	{
+		memset(p, 0, 18);
+		p[0] = ChannelName[Channel];
+		PutInt32(p + 2, EXR_FLOAT);
+		PutInt32(p + 10, 1);
+		PutInt32(p + 14, 1);
+	}
+	
+	*(p++) = 0;
+	memcpy(p, "compression\0compression\0\x01\0\0\0\0", 29);
+	p += 29;
+	memcpy(p, "dataWindow\0box2i\0\x10\0\0\0", 21);
+	PutInt32(p + 21, 0);
+	PutInt32(p + 25, 0);
+	PutInt32(p + 29, Width - 1);
+	PutInt32(p + 33, Height - 1);
+	p += 37;
+	memcpy(p, "displayWindow\0box2i\0\x10\0\0\0", 24);
+	memcpy(p + 24, p - 16, 16);
+	p += 40;
+	memcpy(p, "lineOrder\0lineOrder\0\x01\0\0\0\0", 25);
+	p += 25;
+	memcpy(p, "pixelAspectRatio\0float\0\x04\0\0\0", 27);
+	PutFloat(p + 27, 1.0f);
+	p += 31;
+	memcpy(p, "screenWindowCenter\0v2f\0\x08\0\0\0", 27);
+	PutFloat(p + 27, 0.0f);
+	PutFloat(p + 31, 0.0f);
+	p += 35;
+	memcpy(p, "screenWindowWidth\0float\0\x04\0\0\0", 28);
+	PutFloat(p + 28, 1.0f);
+	p += 32;
+	*(p++) = 0;
+	
+	if(fwrite(Header, 1, p - Header, Image->File) != (size_t)(p - Header))
+		return 0;
 	
-	printf("sRGB         R':%8.3f   G':%8.3f   B':%8.3f\n", R, G, B);
+	/* The offsets of the single-line chunks are known in advance */
+	Image->BytesPerLine = 12*Width;
+	Image->DataOffset = (long)(p - Header) + 8*Height;
 	
-	/* Transform sRGB to Y'CbCr */
-	Rgb2Ycbcr(&D[0], &D[1], &D[2], R, G, B);
-	printf("Y'CbCr       Y':%8.3f   Cb:%8.3f   Cr:%8.3f\n", D[0], D[1], D[2]);
+	if(!(Image->Chunk = (unsigned char *)malloc(8 + Image->BytesPerLine)))
+		return 0;
 	
-	/* Transform sRGB to JPEG-Y'CbCr */
-	Rgb2Jpegycbcr(&D[0], &D[1], &D[2], R, G, B);
-	printf("JPEG-Y'CbCr  Y':%8.3f   Cb:%8.3f   Cr:%8.3f\n", D[0], D[1], D[2]);
+	for(y = 0; y < Height; y++)
+	{
+		PutInt64(Header, Image->DataOffset + y*(8 + Image->BytesPerLine));
 	
-	/* Transform sRGB to Y'PbPr */
-	Rgb2Ypbpr(&D[0], &D[1], &D[2], R, G, B);
-	printf("Y'PbPr       Y':%8.3f   Pb:%8.3f   Pr:%8.3f\n", D[0], D[1], D[2]);
+		if(fwrite(Header, 1, 8, Image->File) != 8)
+			return 0;
+	}
 	
-	/* Transform sRGB to Y'DbDr */
-	Rgb2Ydbdr(&D[0], &D[1], &D[2], R, G, B);
-	printf("Y'DbDr       Y':%8.3f   Db:%8.3f   Dr:%8.3f\n", D[0], D[1], D[2]);
+	return 1;
+}
+
+
+/** @brief Write rows of a band to an image file */
+static int WriteImageRows(imagefile *Image, const float *Band,
+	long Row, long NumRows)
+{
+	unsigned char *p;
+	long RowSize = 3*Image->Width, n, x;
+	int Channel;
 	
-	/* Transform sRGB to Y'UV */
-	Rgb2Yuv(&D[0], &D[1], &D[2], R, G, B);
-	printf("Y'UV         Y':%8.3f    U:%8.3f    V:%8.3f\n", D[0], D[1], D[2]);
 	
-	/* Transform sRGB to Y'IQ */
-	Rgb2Yiq(&D[0], &D[1], &D[2], R, G, B);
-	printf("Y'IQ         Y':%8.3f    I:%8.3f    Q:%8.3f\n", D[0], D[1], D[2]);
+	if(Image->Format == FORMAT_PFM)
+	{
+		/* Bottom row first, in the byte order of the machine */
+		if(fseek(Image->File, Image->DataOffset
+			+ 4*RowSize*(Image->Height - Row - NumRows), SEEK_SET))
+			return 0;
 	
-	/* Transform sRGB to HSV */
-	Rgb2Hsv(&D[0], &D[1], &D[2], R, G, B);
-	printf("HSV           H:%8.3f    S:%8.3f    V:%8.3f\n", D[0], D[1], D[2]);
+		for(n = NumRows - 1; n >= 0; n--)
+			if(fwrite(Band + n*RowSize, sizeof(float), RowSize, Image->File)
+				!= (size_t)RowSize)
+				return 0;
 	
-	/* Transform sRGB to HSL */
-	Rgb2Hsl(&D[0], &D[1], &D[2], R, G, B);
-	printf("HSL           H:%8.3f    S:%8.3f    L:%8.3f\n", D[0], D[1], D[2]);
+		return 1;
+	}
 	
-	/* Transform sRGB to HSI */
-	Rgb2Hsi(&D[0], &D[1], &D[2], R, G, B);
-	printf("HSI           H:%8.3f    S:%8.3f    I:%8.3f\n", D[0], D[1], D[2]);
+	if(fseek(Image->File, Image->DataOffset
+		+ Row*(8 + Image->BytesPerLine), SEEK_SET))
+		return 0;
 	
-	/* Transform sRGB to CIE XYZ */
-	Rgb2Xyz(&D[0], &D[1], &D[2], R, G, B);
-	printf("XYZ           X:%8.3f    Y:%8.3f    Z:%8.3f\n", D[0], D[1], D[2]);
+	for(n = 0; n < NumRows; n++)
+	{
+		PutInt32(Image->Chunk, Row + n);
+		PutInt32(Image->Chunk + 4, Image->BytesPerLine);
+	
+		/* Channels are stored in the order B, G, R */
+		for(Channel = 0, p = Image->Chunk + 8; Channel < 3; Channel++)
+			for(x = 0; x < Image->Width; x++, p += 4)
+				PutFloat(p, Band[n*RowSize + 3*x + 2 - Channel]);
+	
+		if(fwrite(Image->Chunk, 1, 8 + Image->BytesPerLine, Image->File)
+			!= (size_t)(8 + Image->BytesPerLine))
+			return 0;
+	}
+	
+	return 1;
+}
+
+
+/*
+ * == Streaming conversion ==
+ */
+
+/** @brief Apply a transform to a band in place */
+static void ConvertBand(const colortransform *Trans, float *Band, long NumPixels)
+{
+	float *Pixels[3];
+	
+	
+	Pixels[0] = Band;
+	Pixels[1] = Band + 1;
+	Pixels[2] = Band + 2;
+	ApplyColorTransformPlanarf(Trans, Pixels, 3,
+		(const float **)Pixels, 3, NumPixels);
+}
+
+
+/** @brief Number of rows in a band */
+#define BAND_HEIGHT(Band)	\
+	((((Band) + 1)*BandRows < Height) ? BandRows : Height - (Band)*BandRows)
+
+/**
+ * @brief Convert an image file to another
+ *
+ * @param OutputFile name of the output file, .pfm or .exr
+ * @param InputFile name of the input file
+ * @param Trans the transform to apply
+ * @param BandRows number of rows per band
+ * @return 1 on success, 0 on failure
+ *
+ * Three band buffers rotate through the pipeline: while band k is
+ * converted, band k + 1 is read into the next buffer and band k - 1 is
+ * written from the previous one.
+ */
+static int ConvertFile(const char *OutputFile, const char *InputFile,
+	const colortransform *Trans, long BandRows)
+{
+	imagefile Input, Output;
+	float *Buffer[3] = {NULL, NULL, NULL};
+	long Height, NumBands, k;
+	int i, ReadOk, WriteOk, Success = 0;
+	
+	
+	memset(&Output, 0, sizeof(imagefile));
+	
+	if(!OpenImage(&Input, InputFile))
+		goto Catch;
+	
+	/* Align the bands to the chunks of the input */
+	Height = Input.Height;
+	BandRows = ((BandRows + Input.LinesPerChunk - 1)/Input.LinesPerChunk)
+		* Input.LinesPerChunk;
+	NumBands = (Height + BandRows - 1)/BandRows;
+	
+	if(!CreateImage(&Output, OutputFile, Input.Width, Height))
+	{
+		fprintf(stderr, "Unable to create %s as a .pfm or .exr file.\n",
+			OutputFile);
+		goto Catch;
+	}
+	
+	for(i = 0; i < 3; i++)
+		if(!(Buffer[i] = (float *)malloc(sizeof(float)*3*Input.Width*BandRows)))
+		{
+			fprintf(stderr, "Out of memory.\n");
+			goto Catch;
+		}
+	
+	ReadOk = ReadImageRows(&Input, Buffer[0], 0, BAND_HEIGHT(0));
+	WriteOk = 1;
+	
+	for(k = 0; ReadOk && WriteOk && k <= NumBands; k++)
+	{
+#ifdef _OPENMP
+#pragma omp parallel sections num_threads(3)
+#endif
+		{
+#ifdef _OPENMP
+#pragma omp section
+#endif
+			if(k + 1 < NumBands)
+				ReadOk = ReadImageRows(&Input, Buffer[(k + 1) % 3],
+					(k + 1)*BandRows, BAND_HEIGHT(k + 1));
+#ifdef _OPENMP
+#pragma omp section
+#endif
+			if(k < NumBands)
+				ConvertBand(Trans, Buffer[k % 3], Input.Width*BAND_HEIGHT(k));
+#ifdef _OPENMP
+#pragma omp section
+#endif
+			if(k > 0)
+				WriteOk = WriteImageRows(&Output, Buffer[(k + 2) % 3],
+					(k - 1)*BandRows, BAND_HEIGHT(k - 1));
+		}
+	}
+	
+	if(!ReadOk)
+		fprintf(stderr, "Error reading %s.\n", InputFile);
+	else if(!WriteOk)
+		fprintf(stderr, "Error writing %s.\n", OutputFile);
+	else
+		Success = 1;
+	
+Catch:
+	for(i = 0; i < 3; i++)
+		if(Buffer[i])
+			free(Buffer[i]);
+	
+	if(Output.File && fclose(Output.File))
+		Success = 0;
+	
+	Output.File = NULL;
+	CloseImage(&Output);
+	CloseImage(&Input);
+	return Success;
+}
+
+
+/** @brief Check whether a string is a number */
+static int IsNumber(const char *String)
+{
+	char *End;
+	
+	
+	strtod(String, &End);
+	return End != String && *End == '\0';
+}
+
+
+/** @brief Convert image files as given on the command line */
+static int ConvertFiles(int argc, char *argv[])
+{
+	colortransform Trans;
+	long BandRows = DEFAULT_BAND_ROWS;
+	int i = 1, Fast = 0, NumThreads = 0, NumFailed = 0;
+	
+	
+	/* Parse the options */
+	for(; i < argc && argv[i][0] == '-' && argv[i][1] && !argv[i][2]; i++)
+		if(argv[i][1] == 'f')
+			Fast = 1;
+		else if(argv[i][1] == 'j' && i + 1 < argc)
+			NumThreads = atoi(argv[++i]);
+		else if(argv[i][1] == 'b' && i + 1 < argc)
+			BandRows = atol(argv[++i]);
+		else
+		{
+			HelpMessage();
+			return 1;
+		}
+	
+	if(NumThreads < 0 || BandRows <= 0 
+		|| argc - i < 3 || (argc - i) % 2 != 1)
+	{
+		HelpMessage();
+		return 1;
+	}
+	
+	if(!GetColorTransform(&Trans, argv[i]))
+	{
+		fprintf(stderr, "Unknown transform %s\n", argv[i]);
+		return 1;
+	}
+	
+	if(Fast)
+		SetColorTransformFast(&Trans);
+	
+	SetColorThreads(NumThreads, COLOR_PARALLEL_SIZE);
+#ifdef _OPENMP
+	/* Allow the conversion section to spawn its own threads */
+	omp_set_max_active_levels(2);
+#endif
+	
+	for(i++; i < argc; i += 2)
+		if(!ConvertFile(argv[i + 1], argv[i], &Trans, BandRows))
+			NumFailed++;
+	
+	return NumFailed ? 1 : 0;
+}
 
-	/* Transform sRGB to CIE L*a*b */
-	Rgb2Lab(&D[0], &D[1], &D[2], R, G, B);
-	printf("L*a*b*       L*:%8.3f   a*:%8.3f   b*:%8.3f\n", D[0], D[1], D[2]);
+
+int main(int argc, char *argv[])
+{
+	num S[3], D[3];
+	const num *Src[3];
+	num *Dest[3];
+	colortransform Trans;
+	int i;
+	
+	
+	if(argc != 4 || !IsNumber(argv[1]) || !IsNumber(argv[2])
+		|| !IsNumber(argv[3]))
+	{
+		if(argc >= 4)
+			return ConvertFiles(argc, argv);
+		
+		HelpMessage();
+		return 1;
+	}
+	
+	/* Read the input sRGB values */
+	for(i = 0; i < 3; i++)
+	{
+		S[i] = atof(argv[i + 1]);
+		Src[i] = &S[i];
+		Dest[i] = &D[i];
+	}
 	
-	/* Transform sRGB to CIE L*u*v* */
-	Rgb2Luv(&D[0], &D[1], &D[2], R, G, B);
-	printf("L*u*v*       L*:%8.3f   u*:%8.3f   v*:%8.3f\n", D[0], D[1], D[2]);
+	if(!(0 <= S[0] && S[0] <= 1 && 0 <= S[1] && S[1] <= 1
+		&& 0 <= S[2] && S[2] <= 1))
+		printf("\nWarning: Input sRGB values should be between 0 and 1.\n\n");
 	
-	/* Transform sRGB to CIE L*C*H* */
-	Rgb2Lch(&D[0], &D[1], &D[2], R, G, B);
-	printf("L*C*H*       L*:%8.3f   C*:%8.3f   H*:%8.3f\n", D[0], D[1], D[2]);
+	printf("sRGB         R':%8.3f   G':%8.3f   B':%8.3f\n", S[0], S[1], S[2]);
 	
-	/* Transform sRGB to CIE CAT02 LMS */
-	Rgb2Cat02lms(&D[0], &D[1], &D[2], R, G, B);
-	printf("CAT02 LMS     L:%8.3f    M:%8.3f    S:%8.3f\n", D[0], D[1], D[2]);
+	/* Transform sRGB to every space through the planar interface */
+	for(i = 0; i < NUM_SPACES; i++)
+	{
+		if(!GetColorTransform(&Trans, Space[i].TransformString))
+		{
+			printf("Unknown transform %s\n", Space[i].TransformString);
+			return 1;
+		}
+	
+		ApplyColorTransformPlanar(&Trans, Dest, 1, Src, 1, 1);
+		printf(Space[i].Format, D[0], D[1], D[2]);
+	}
 	
 	return 0;
 }
@@ -117,4 +1141,12 @@ static void HelpMessage()
 	printf("the gamma-corrected sRGB color space.  The color is transformed\n");
 	printf("to all spaces supported by colorspace.c.\n\n");
 	printf("Example: colorcalc 0.5 0.85 0.61\n");
+	printf("\nSyntax: colorcalc [options] TRANSFORM INPUT OUTPUT "
+		"[INPUT OUTPUT ...]\n\n");
+	printf("converts each PFM or EXR file INPUT to the file OUTPUT following\n");
+	printf("it, streaming the images by bands of rows.  Options:\n");
+	printf("   -f       use the vectorized routines\n");
+	printf("   -j N     convert on N threads (default: all)\n");
+	printf("   -b N     rows per band (default %d)\n\n", DEFAULT_BAND_ROWS);
+	printf("Example: colorcalc \"Lab <- RGB\" in.exr out.exr\n");
 }
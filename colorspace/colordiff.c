@@ -0,0 +1,656 @@
+/**
+ * @file colordiff.c
+ * @brief Color difference maps and statistics between two images
+ *
+ * == Summary ==
+ * This file computes the CIE color differences Delta E 1976, Delta E 1994,
+ * and CIEDE2000 between two images, as a per-pixel map and as summary
+ * statistics (mean, max, and percentiles).  The images may be in any space
+ * supported by colorspace.c, and are converted to CIELAB block by block as
+ * the differences are computed, so no intermediate Lab images are stored.
+ *
+ * == Usage ==
+ * Create a transform from the space of the images to Lab, then call
+ * ColorDifferencePlanar with pointers to the three channels of each image:
+@code
+       const num *A[3] = {ImageA, ImageA + N, ImageA + 2*N};
+       const num *B[3] = {ImageB, ImageB + N, ImageB + 2*N};
+       colortransform ToLab;
+       colordiffstats Stats;
+
+       GetColorTransform(&ToLab, "Lab <- RGB");
+
+       if(!ColorDifferencePlanar(Map, &Stats, &ToLab, A, B, 1, N,
+           COLOR_DELTA_E2000))
+           printf("Out of memory\n");
+
+       printf("mean %g, 95th percentile %g, max %g\n", Stats.Mean,
+           ColorDifferencePercentile(&Stats, 95), Stats.Max);
+@endcode
+ * Map receives the N differences, and either Map or &Stats may be NULL when
+ * not needed.  For images already in Lab, use the transform "Lab <- Lab".
+ * Calling SetColorTransformFast(&ToLab) uses the vectorized conversions, and
+ * the blocks are distributed over the threads set by SetColorThreads.
+ *
+ * == Formulas ==
+ * Delta E 1994 uses the graphic arts weights kL = 1, K1 = 0.045,
+ * K2 = 0.015, with A as the reference.  CIEDE2000 follows
+ *    G. Sharma, W. Wu, E. N. Dalal, "The CIEDE2000 Color-Difference
+ *    Formula: Implementation Notes, Supplementary Test Data, and
+ *    Mathematical Observations," Color Research and Application, 2005,
+ * with kL = kC = kH = 1.
+ *
+ * == MEX Interface ==
+ * Compiled with colorspace.c and colorspace_select.c as a MEX function,
+ *    mex -DCOLORSPACE_NO_GATEWAY colordiff.c colorspace.c colorspace_select.c
+ * the syntax is
+ *    Stats = colordiff(A, B);
+ *    [Stats, D] = colordiff(A, B, Options);
+ * where A and B are Mx3 or MxNx3 double or single arrays of the same size
+ * and class.  Stats has the fields numpixels, mean, max, and percentiles, and
+ * D is the MxN map of differences.  The optional Options struct has the
+ * fields
+ *    space       color space of A and B (default 'RGB'),
+ *    formula     'de76', 'de94', or 'de2000' (default),
+ *    percentiles percentiles to report (default [50 90 95 99]),
+ *    fast        nonzero to use the vectorized conversions,
+ *    threads     number of threads, or 0 for the OpenMP default.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "colordiff.h"
+
+#ifdef MATLAB_MEX_FILE
+#include <stdio.h>
+#include "mex.h"
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/** @brief Min of A and B */
+#define MIN(A,B)	(((A) <= (B)) ? (A) : (B))
+
+/** @brief Max of A and B */
+#define MAX(A,B)	(((A) >= (B)) ? (A) : (B))
+
+#ifndef M_PI
+/** @brief The constant pi */
+#define M_PI	3.14159265358979323846264338327950288
+#endif
+
+/** @brief Convert degrees to radians */
+#define DEG2RAD(x)	((x)*(M_PI/180))
+
+/** @brief 25^7, from the chroma terms of CIEDE2000 */
+#define POW25_7		6103515625.0
+
+/* The loops over pixels carry no dependences */
+#if defined(_OPENMP)
+#define SIMD_LOOP	_Pragma("omp simd")
+#elif defined(__GNUC__)
+#define SIMD_LOOP	_Pragma("GCC ivdep")
+#else
+#define SIMD_LOOP
+#endif
+
+
+/**
+ * @brief Get a color difference formula from its name
+ *
+ * @param Name "DE76", "DE94", or "DE2000", or the forms "CIE76", "CIE94",
+ *    and "CIEDE2000", ignoring case, spaces, and '-'
+ * @return COLOR_DELTA_E76, COLOR_DELTA_E94, or COLOR_DELTA_E2000, or -1 if
+ *    the name is unknown
+ */
+int GetColorDifferenceFormula(const char *Name)
+{
+	char Buf[16];
+	int NumChars = 0;
+	
+	
+	for(; *Name; Name++)
+		if(*Name != ' ' && *Name != '-' && NumChars < 15)
+			Buf[NumChars++] = tolower(*Name);
+	
+	Buf[NumChars] = 0;
+	
+	if(!strcmp(Buf, "de76") || !strcmp(Buf, "cie76"))
+		return COLOR_DELTA_E76;
+	else if(!strcmp(Buf, "de94") || !strcmp(Buf, "cie94"))
+		return COLOR_DELTA_E94;
+	else if(!strcmp(Buf, "de2000") || !strcmp(Buf, "ciede2000"))
+		return COLOR_DELTA_E2000;
+	else
+		return -1;
+}
+
+
+/** @brief Delta E 1976, the Euclidean distance in Lab */
+static void DeltaE76(num *D, const num *L1, const num *a1, const num *b1,
+	const num *L2, const num *a2, const num *b2, int N)
+{
+	int i;
+	
+	
+	SIMD_LOOP
+	for(i = 0; i < N; i++)
+	{
+		num dL = L1[i] - L2[i];
+		num da = a1[i] - a2[i];
+		num db = b1[i] - b2[i];
+		
+		D[i] = sqrt(dL*dL + da*da + db*db);
+	}
+}
+
+
+/** @brief Delta E 1994 with the graphic arts weights, L1,a1,b1 the reference */
+static void DeltaE94(num *D, const num *L1, const num *a1, const num *b1,
+	const num *L2, const num *a2, const num *b2, int N)
+{
+	int i;
+	
+	
+	SIMD_LOOP
+	for(i = 0; i < N; i++)
+	{
+		num dL, da, db, C1, C2, dC, dH2, SC, SH;
+		
+		dL = L1[i] - L2[i];
+		da = a1[i] - a2[i];
+		db = b1[i] - b2[i];
+		C1 = sqrt(a1[i]*a1[i] + b1[i]*b1[i]);
+		C2 = sqrt(a2[i]*a2[i] + b2[i]*b2[i]);
+		dC = C1 - C2;
+		/* dH^2 = da^2 + db^2 - dC^2 is only negative by rounding */
+		dH2 = MAX(da*da + db*db - dC*dC, 0);
+		SC = 1 + 0.045*C1;
+		SH = 1 + 0.015*C1;
+		D[i] = sqrt(dL*dL + (dC/SC)*(dC/SC) + dH2/(SH*SH));
+	}
+}
+
+
+/** @brief CIEDE2000, with the hue angles in radians */
+static void DeltaE2000(num *D, const num *L1, const num *a1, const num *b1,
+	const num *L2, const num *a2, const num *b2, int N)
+{
+	int i;
+	
+	
+	/* Temporaries are declared in the loop to be private to each SIMD lane */
+	SIMD_LOOP
+	for(i = 0; i < N; i++)
+	{
+		num C, C7, G, ap1, ap2, Cp1, Cp2, hp1, hp2, CpProd, dhp, dLp, dCp;
+		num dHp, Lp, Cp, Cp7, hp, Lp50, T, dTheta, RC, SL, SC, SH, RT;
+		
+		C = (sqrt(a1[i]*a1[i] + b1[i]*b1[i])
+			+ sqrt(a2[i]*a2[i] + b2[i]*b2[i]))/2;
+		C7 = C*C*C;
+		C7 = C7*C7*C;
+		G = 0.5*(1 - sqrt(C7/(C7 + POW25_7)));
+		ap1 = (1 + G)*a1[i];
+		ap2 = (1 + G)*a2[i];
+		Cp1 = sqrt(ap1*ap1 + b1[i]*b1[i]);
+		Cp2 = sqrt(ap2*ap2 + b2[i]*b2[i]);
+		hp1 = atan2(b1[i], ap1);
+		hp1 += (hp1 < 0) ? 2*M_PI : 0;
+		hp2 = atan2(b2[i], ap2);
+		hp2 += (hp2 < 0) ? 2*M_PI : 0;
+		CpProd = Cp1*Cp2;
+	
+		/* Differences, with the hue difference taken the short way around */
+		dLp = L2[i] - L1[i];
+		dCp = Cp2 - Cp1;
+		dhp = hp2 - hp1;
+		dhp += (dhp > M_PI) ? -2*M_PI : ((dhp < -M_PI) ? 2*M_PI : 0);
+		dhp = (CpProd == 0) ? 0 : dhp;
+		dHp = 2*sqrt(CpProd)*sin(dhp/2);
+	
+		/* Means, with the mean hue also taken the short way around */
+		Lp = (L1[i] + L2[i])/2;
+		Cp = (Cp1 + Cp2)/2;
+		hp = (hp1 + hp2)/2;
+		hp += (fabs(hp1 - hp2) <= M_PI) ? 0 : ((hp < M_PI) ? M_PI : -M_PI);
+		hp = (CpProd == 0) ? hp1 + hp2 : hp;
+	
+		T = 1 - 0.17*cos(hp - DEG2RAD(30)) + 0.24*cos(2*hp)
+			+ 0.32*cos(3*hp + DEG2RAD(6)) - 0.20*cos(4*hp - DEG2RAD(63));
+		dTheta = (hp - DEG2RAD(275))/DEG2RAD(25);
+		dTheta = DEG2RAD(30)*exp(-dTheta*dTheta);
+		Cp7 = Cp*Cp*Cp;
+		Cp7 = Cp7*Cp7*Cp;
+		RC = 2*sqrt(Cp7/(Cp7 + POW25_7));
+		Lp50 = (Lp - 50)*(Lp - 50);
+		SL = 1 + 0.015*Lp50/sqrt(20 + Lp50);
+		SC = 1 + 0.045*Cp;
+		SH = 1 + 0.015*Cp*T;
+		RT = -sin(2*dTheta)*RC;
+	
+		dLp /= SL;
+		dCp /= SC;
+		dHp /= SH;
+		D[i] = sqrt(dLp*dLp + dCp*dCp + dHp*dHp + RT*dCp*dHp);
+	}
+}
+
+
+/** @brief Convert a block of an image to Lab */
+static void LoadBlock(num *Lab[3], const colortransform *ToLab,
+	const num *Src[3], long Stride, long Start, int N)
+{
+	const num *Block[3];
+	int Channel;
+	
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		Block[Channel] = Src[Channel] + Start*Stride;
+	
+	ApplyColorTransformPlanar(ToLab, Lab, 1, Block, Stride, N);
+}
+
+
+/** @brief Convert a block of a float image to Lab */
+static void LoadBlockf(num *Lab[3], float *Labf[3],
+	const colortransform *ToLab, const float *Src[3], long Stride,
+	long Start, int N)
+{
+	const float *Block[3];
+	int Channel, i;
+	
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		Block[Channel] = Src[Channel] + Start*Stride;
+	
+	ApplyColorTransformPlanarf(ToLab, Labf, 1, Block, Stride, N);
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		for(i = 0; i < N; i++)
+			Lab[Channel][i] = Labf[Channel][i];
+}
+
+
+/**
+ * @brief Color difference engine for ColorDifferencePlanar and
+ *    ColorDifferencePlanarf
+ *
+ * Exactly one of the pairs A, B and Af, Bf is set.  Each thread converts
+ * blocks of COLOR_BLOCK_SIZE pixels of both images to Lab on the stack,
+ * computes their differences, and accumulates its own sum, max, and
+ * histogram, which are merged at the end.
+ */
+static int ColorDifference(num *Map, float *Mapf, colordiffstats *Stats,
+	const colortransform *ToLab, const num *A[3], const num *B[3],
+	const float *Af[3], const float *Bf[3], long Stride, long NumPixels,
+	int Formula)
+{
+	void (*Kernel)(num*, const num*, const num*, const num*,
+		const num*, const num*, const num*, int);
+	long NumBlocks = (NumPixels + COLOR_BLOCK_SIZE - 1)/COLOR_BLOCK_SIZE;
+	unsigned long *Histograms = NULL;
+	double Sum = 0, Max = 0;
+	long Count = 0, Bin;
+	int NumThreads = GetColorThreads(NumPixels), Thread;
+	
+	
+	switch(Formula)
+	{
+	case COLOR_DELTA_E76:
+		Kernel = DeltaE76;
+		break;
+	case COLOR_DELTA_E94:
+		Kernel = DeltaE94;
+		break;
+	case COLOR_DELTA_E2000:
+		Kernel = DeltaE2000;
+		break;
+	default:
+		return 0;
+	}
+	
+	if(Stats && !(Histograms = (unsigned long *)calloc(
+		(size_t)NumThreads*COLOR_DIFF_NUM_BINS, sizeof(unsigned long))))
+		return 0;	/* Out of memory */
+	
+#ifdef _OPENMP
+#pragma omp parallel num_threads(NumThreads)
+#endif
+	{
+		num LabA[3][COLOR_BLOCK_SIZE], LabB[3][COLOR_BLOCK_SIZE];
+		num DBuf[COLOR_BLOCK_SIZE];
+		float LabBuf[3][COLOR_BLOCK_SIZE];
+		num *LabAPtr[3], *LabBPtr[3], *D;
+		float *LabBufPtr[3];
+		unsigned long *Histogram = NULL;
+		double ThreadSum = 0, ThreadMax = 0;
+		long ThreadCount = 0, Block, Start, i;
+		int Channel, N;
+	
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			LabAPtr[Channel] = LabA[Channel];
+			LabBPtr[Channel] = LabB[Channel];
+			LabBufPtr[Channel] = LabBuf[Channel];
+		}
+	
+		if(Histograms)
+#ifdef _OPENMP
+			Histogram = Histograms + (long)omp_get_thread_num()
+				*COLOR_DIFF_NUM_BINS;
+#else
+			Histogram = Histograms;
+#endif
+	
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+		for(Block = 0; Block < NumBlocks; Block++)
+		{
+			Start = Block*COLOR_BLOCK_SIZE;
+			N = (int)MIN(NumPixels - Start, COLOR_BLOCK_SIZE);
+	
+			if(Af)
+			{
+				LoadBlockf(LabAPtr, LabBufPtr, ToLab, Af, Stride, Start, N);
+				LoadBlockf(LabBPtr, LabBufPtr, ToLab, Bf, Stride, Start, N);
+			}
+			else
+			{
+				LoadBlock(LabAPtr, ToLab, A, Stride, Start, N);
+				LoadBlock(LabBPtr, ToLab, B, Stride, Start, N);
+			}
+	
+			/* Double maps are written directly */
+			D = (Map) ? Map + Start : DBuf;
+			Kernel(D, LabA[0], LabA[1], LabA[2], LabB[0], LabB[1], LabB[2], N);
+	
+			if(Mapf)
+				for(i = 0; i < N; i++)
+					Mapf[Start + i] = (float)D[i];
+	
+			if(Histogram)
+				for(i = 0; i < N; i++)
+					if(D[i] == D[i])	/* Skip NaNs */
+					{
+						ThreadSum += D[i];
+						ThreadMax = MAX(ThreadMax, D[i]);
+						ThreadCount++;
+						Bin = (long)MIN(D[i]/COLOR_DIFF_BIN_WIDTH,
+							COLOR_DIFF_NUM_BINS - 1);
+						Histogram[Bin]++;
+					}
+		}
+	
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+		{
+			Sum += ThreadSum;
+			Max = MAX(Max, ThreadMax);
+			Count += ThreadCount;
+		}
+	}
+	
+	if(Stats)
+	{
+		Stats->NumPixels = Count;
+		Stats->Mean = (Count) ? Sum/Count : 0;
+		Stats->Max = Max;
+		memcpy(Stats->Histogram, Histograms,
+			sizeof(unsigned long)*COLOR_DIFF_NUM_BINS);
+	
+		for(Thread = 1; Thread < NumThreads; Thread++)
+			for(Bin = 0; Bin < COLOR_DIFF_NUM_BINS; Bin++)
+				Stats->Histogram[Bin] +=
+					Histograms[(long)Thread*COLOR_DIFF_NUM_BINS + Bin];
+	
+		free(Histograms);
+	}
+	
+	return 1;
+}
+
+
+/**
+ * @brief Color differences between two images
+ *
+ * @param Map array of NumPixels to hold the differences, or NULL
+ * @param Stats struct to hold the statistics of the differences, or NULL
+ * @param ToLab colortransform from the space of the images to Lab
+ * @param A, B pointers to the first pixel of each channel of the images
+ * @param Stride distance in elements between consecutive pixels
+ * @param NumPixels number of pixels
+ * @param Formula COLOR_DELTA_E76, COLOR_DELTA_E94, or COLOR_DELTA_E2000
+ * @return 1 on success, 0 if the formula is unknown or out of memory
+ *
+ * The images are converted to Lab in blocks of COLOR_BLOCK_SIZE as the
+ * differences are computed.  When compiled with OpenMP, the blocks are
+ * distributed over the threads set by SetColorThreads.
+ */
+int ColorDifferencePlanar(num *Map, colordiffstats *Stats,
+	const colortransform *ToLab, const num *A[3], const num *B[3], long Stride,
+	long NumPixels, int Formula)
+{
+	return ColorDifference(Map, NULL, Stats, ToLab, A, B, NULL, NULL,
+		Stride, NumPixels, Formula);
+}
+
+
+/**
+ * @brief Color differences between two float images
+ *
+ * Same as ColorDifferencePlanar, where the images are converted to Lab in
+ * single precision and the differences are computed in double precision.
+ */
+int ColorDifferencePlanarf(float *Map, colordiffstats *Stats,
+	const colortransform *ToLab, const float *A[3], const float *B[3], long Stride,
+	long NumPixels, int Formula)
+{
+	return ColorDifference(NULL, Map, Stats, ToLab, NULL, NULL, A, B,
+		Stride, NumPixels, Formula);
+}
+
+
+/**
+ * @brief Percentile of the differences
+ *
+ * @param Stats statistics computed by ColorDifferencePlanar
+ * @param Percent percentile between 0 and 100
+ * @return the difference below which Percent percent of pixels fall
+ *
+ * The differences are taken as uniformly distributed within each histogram
+ * bin, so the result is accurate to within COLOR_DIFF_BIN_WIDTH.  The last
+ * bin extends to the max.
+ */
+double ColorDifferencePercentile(const colordiffstats *Stats, double Percent)
+{
+	double Rank, Lower, Upper;
+	unsigned long Cumulative = 0;
+	long Bin;
+	
+	
+	if(!Stats->NumPixels)
+		return 0;
+	
+	Rank = MIN(MAX(Percent, 0), 100)/100*Stats->NumPixels;
+	
+	for(Bin = 0; Bin < COLOR_DIFF_NUM_BINS - 1; Bin++)
+	{
+		if(Stats->Histogram[Bin] && Cumulative + Stats->Histogram[Bin] >= Rank)
+			break;
+	
+		Cumulative += Stats->Histogram[Bin];
+	}
+	
+	if(!Stats->Histogram[Bin])
+		return Stats->Max;
+	
+	Lower = Bin*COLOR_DIFF_BIN_WIDTH;
+	Upper = (Bin < COLOR_DIFF_NUM_BINS - 1) ?
+		Lower + COLOR_DIFF_BIN_WIDTH : Stats->Max;
+	return MIN(Lower + (Upper - Lower)*(Rank - Cumulative)
+		/Stats->Histogram[Bin], Stats->Max);
+}
+
+
+#ifdef MATLAB_MEX_FILE
+/** @brief MEX gateway */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
+{
+    #define	A_IN	     prhs[0]
+    #define	B_IN	     prhs[1]
+    #define	OPT_IN	     prhs[2]
+    #define	STATS_OUT	 plhs[0]
+    #define	D_OUT	     plhs[1]
+#define IS_REAL_FULL_DOUBLE(P) (!mxIsComplex(P) \
+&& !mxIsSparse(P) && mxIsDouble(P))
+#define IS_REAL_FULL_SINGLE(P) (!mxIsComplex(P) \
+&& !mxIsSparse(P) && mxIsSingle(P))
+	static const char *StatsFields[4] =
+		{"numpixels", "mean", "max", "percentiles"};
+	static const double DefaultPercentiles[4] = {50, 90, 95, 99};
+	const double *Percentiles = DefaultPercentiles;
+	const num *A[3], *B[3];
+	const float *Af[3], *Bf[3];
+	double *Out;
+	colordiffstats *Stats;
+	colortransform ToLab;
+	const mxArray *Field;
+	const mwSize *Size;
+	mwSize DSize[2], NumPixels, Channel;
+	char Space[32] = "RGB", FormulaName[16], TransformString[48];
+	int NumDims, NumPercentiles = 4, NumThreads = 0, Fast = 0;
+	int Formula = COLOR_DELTA_E2000, i, Success;
+	
+	
+	/* Parse the input arguments */
+	if(nrhs != 2 && nrhs != 3)
+		mexErrMsgTxt("Two or three input arguments required.");
+	else if(nlhs > 2)
+		mexErrMsgTxt("Too many output arguments.");
+	
+	if(!(IS_REAL_FULL_DOUBLE(A_IN) && IS_REAL_FULL_DOUBLE(B_IN))
+		&& !(IS_REAL_FULL_SINGLE(A_IN) && IS_REAL_FULL_SINGLE(B_IN)))
+		mexErrMsgTxt("A and B should be real full arrays, both double or both single.");
+	
+	Size = mxGetDimensions(A_IN);
+	NumDims = (int)mxGetNumberOfDimensions(A_IN);
+	
+	if(NumDims > 3 || Size[NumDims - 1] != 3)
+		mexErrMsgTxt("A should be an Mx3 or MxNx3 array.");
+	else if((int)mxGetNumberOfDimensions(B_IN) != NumDims
+		|| memcmp(mxGetDimensions(B_IN), Size, sizeof(mwSize)*NumDims))
+		mexErrMsgTxt("A and B should have the same size.");
+	
+	/* Read the options struct */
+	if(nrhs == 3)
+	{
+		if(!mxIsStruct(OPT_IN))
+			mexErrMsgTxt("Third argument should be a struct.");
+	
+		if((Field = mxGetField(OPT_IN, 0, "space")) != NULL)
+		{
+			if(!mxIsChar(Field))
+				mexErrMsgTxt("Option space should be a string.");
+	
+			mxGetString(Field, Space, sizeof(Space));
+		}
+	
+		if((Field = mxGetField(OPT_IN, 0, "formula")) != NULL)
+		{
+			if(!mxIsChar(Field))
+				mexErrMsgTxt("Option formula should be a string.");
+	
+			mxGetString(Field, FormulaName, sizeof(FormulaName));
+	
+			if((Formula = GetColorDifferenceFormula(FormulaName)) < 0)
+				mexErrMsgTxt("Unknown color difference formula.");
+		}
+	
+		if((Field = mxGetField(OPT_IN, 0, "percentiles")) != NULL)
+		{
+			if(!IS_REAL_FULL_DOUBLE(Field))
+				mexErrMsgTxt("Option percentiles should be a double vector.");
+	
+			Percentiles = (const double *)mxGetData(Field);
+			NumPercentiles = (int)mxGetNumberOfElements(Field);
+		}
+	
+		if((Field = mxGetField(OPT_IN, 0, "fast")) != NULL)
+			Fast = (mxGetScalar(Field) != 0);
+	
+		if((Field = mxGetField(OPT_IN, 0, "threads")) != NULL)
+			NumThreads = (int)mxGetScalar(Field);
+	}
+	
+	SetColorThreads(NumThreads, COLOR_PARALLEL_SIZE);
+	sprintf(TransformString, "Lab <- %s", Space);
+	
+	if(!GetColorTransform(&ToLab, TransformString))
+		mexErrMsgTxt("Unknown color space.");
+	
+	if(Fast)
+		SetColorTransformFast(&ToLab);
+	
+	NumPixels = mxGetNumberOfElements(A_IN)/3;
+	Stats = (colordiffstats *)mxMalloc(sizeof(colordiffstats));
+	
+	/* The map has the size of A without the channel dimension */
+	DSize[0] = Size[0];
+	DSize[1] = (NumDims == 3) ? Size[1] : 1;
+	
+	if(nlhs > 1)
+		D_OUT = mxCreateNumericArray(2, DSize,
+			IS_REAL_FULL_SINGLE(A_IN) ? mxSINGLE_CLASS : mxDOUBLE_CLASS,
+			mxREAL);
+	
+	if(IS_REAL_FULL_SINGLE(A_IN))
+	{
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			Af[Channel] = (const float *)mxGetData(A_IN) + Channel*NumPixels;
+			Bf[Channel] = (const float *)mxGetData(B_IN) + Channel*NumPixels;
+		}
+	
+		Success = ColorDifferencePlanarf(
+			(nlhs > 1) ? (float *)mxGetData(D_OUT) : NULL, Stats,
+			&ToLab, Af, Bf, 1, (long)NumPixels, Formula);
+	}
+	else
+	{
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			A[Channel] = (const num *)mxGetData(A_IN) + Channel*NumPixels;
+			B[Channel] = (const num *)mxGetData(B_IN) + Channel*NumPixels;
+		}
+	
+		Success = ColorDifferencePlanar(
+			(nlhs > 1) ? (num *)mxGetData(D_OUT) : NULL, Stats,
+			&ToLab, A, B, 1, (long)NumPixels, Formula);
+	}
+	
+	if(!Success)
+		mexErrMsgTxt("Out of memory.");
+	
+	/* Create the stats struct */
+	STATS_OUT = mxCreateStructMatrix(1, 1, 4, StatsFields);
+	mxSetField(STATS_OUT, 0, "numpixels",
+		mxCreateDoubleScalar((double)Stats->NumPixels));
+	mxSetField(STATS_OUT, 0, "mean", mxCreateDoubleScalar(Stats->Mean));
+	mxSetField(STATS_OUT, 0, "max", mxCreateDoubleScalar(Stats->Max));
+	mxSetField(STATS_OUT, 0, "percentiles",
+		mxCreateDoubleMatrix(1, NumPercentiles, mxREAL));
+	Out = (double *)mxGetData(mxGetField(STATS_OUT, 0, "percentiles"));
+	
+	for(i = 0; i < NumPercentiles; i++)
+		Out[i] = ColorDifferencePercentile(Stats, Percentiles[i]);
+	
+	mxFree(Stats);
+	return;
+}
+#endif
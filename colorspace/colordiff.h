@@ -0,0 +1,41 @@
+/**
+ * @file colordiff.h
+ * @brief Color difference maps and statistics between two images
+ */
+#ifndef _COLORDIFF_H_
+#define _COLORDIFF_H_
+
+#include "colorspace.h"
+
+/** @brief Color difference formulas of ColorDifferencePlanar */
+#define COLOR_DELTA_E76		0
+#define COLOR_DELTA_E94		1
+#define COLOR_DELTA_E2000	2
+
+/** @brief Width of the histogram bins of a colordiffstats */
+#define COLOR_DIFF_BIN_WIDTH	0.01
+/** @brief Number of histogram bins, the last also counting larger values */
+#define COLOR_DIFF_NUM_BINS		10000
+
+/** @brief Summary statistics of a color difference map
+ * Percentiles are found from the histogram by ColorDifferencePercentile.
+ * Pixels with NaN differences are not counted.
+ */
+typedef struct
+{
+	long NumPixels;
+	double Mean;
+	double Max;
+	unsigned long Histogram[COLOR_DIFF_NUM_BINS];
+} colordiffstats;
+
+int GetColorDifferenceFormula(const char *Name);
+int ColorDifferencePlanar(num *Map, colordiffstats *Stats,
+	const colortransform *ToLab, const num *A[3], const num *B[3], long Stride,
+	long NumPixels, int Formula);
+int ColorDifferencePlanarf(float *Map, colordiffstats *Stats,
+	const colortransform *ToLab, const float *A[3], const float *B[3], long Stride,
+	long NumPixels, int Formula);
+double ColorDifferencePercentile(const colordiffstats *Stats, double Percent);
+
+#endif  /* _COLORDIFF_H_ */
@@ -22,7 +22,50 @@
            return;
        }   
        
-       ApplyColorTransform(Trans, &D[0], &D[1], &D[2], S[0], S[1], S[2]);
+       ApplyColorTransform(&Trans, &D[0], &D[1], &D[2], S[0], S[1], S[2]);
+@endcode
+ * Images are transformed with ApplyColorTransformPlanar, which takes pointers
+ * to the three channels and their strides, and runs the transform over blocks
+ * of pixels.  For an image stored as three consecutive planes of N pixels,
+@code
+       const num *Src[3] = {A, A + N, A + 2*N};
+       num *Dest[3] = {B, B + N, B + 2*N};
+       
+       ApplyColorTransformPlanar(&Trans, Dest, 1, Src, 1, N);
+@endcode
+ * and for interleaved RGBRGB... data, the pointers are {A, A + 1, A + 2} and
+ * the stride is 3.  Dest may equal Src to convert an image in place.  A tile
+ * or region of a larger image is converted by ApplyColorTransformImage, which
+ * also takes the distance between rows, so results can be written directly
+ * into the planes of a caller's output image.  Conversions to and from HSV
+ * and HSL are always done by branch-free routines with the same results as
+ * the per-pixel ones when built without -ffast-math.  Calling
+ * SetColorTransformFast(&Trans) before applying the transform selects
+ * vectorized routines for conversions among sRGB, XYZ, L*a*b*, and L*u*v*,
+ * which agree with the exact ones to about 1e-11 for colors within the sRGB
+ * gamut.  The MEX gateway does the same when called with a third argument
+ * struct('fast', true).  When compiled with OpenMP, large images are split
+ * over threads, whose number is set by SetColorThreads.
+ *
+ * 8- and 16-bit images are converted by ApplyColorTransformPlanaru8 and
+ * ApplyColorTransformPlanaru16, which take code values 0 to 255 or 0 to 65535
+ * as 0 to 1 and read them through precomputed tables.  Transforms from sRGB
+ * to XYZ, L*a*b*, L*u*v*, LCH, or CAT02 LMS then skip gamma correction.
+ *
+ * Long or expensive chains of transforms can be baked into a 3D lookup table,
+ * after which every pixel costs one tetrahedral interpolation:
+@code
+       colortransform Chain[2];
+       colorlut Lut;
+       colorlutreport Report;
+       num Min[3] = {0, -100, -100}, Max[3] = {100, 100, 100};
+       
+       GetColorTransform(&Chain[0], "Lab -> LCH");
+       GetColorTransform(&Chain[1], "LCH -> RGB");
+       BakeColorLut(&Lut, Chain, 2, 65, Min, Max, 1);
+       GetColorLutAccuracy(&Report, &Lut, Chain, 2, 100000);
+       ApplyColorLutPlanar(&Lut, Dest, 1, Src, 1, N);
+       FreeColorLut(&Lut);
 @endcode
  * "num" is a typedef defined at the beginning of colorspace.h that may be set
  * to either double or float, depending on the application.
@@ -53,7 +96,8 @@
  *
  * All transformations assume a two degree observer angle and a D65 illuminant.
  * The white point can be changed by modifying the WHITEPOINT_X, WHITEPOINT_Y,  
- * WHITEPOINT_Z definitions at the beginning of colorspace.h.
+ * WHITEPOINT_Z definitions at the beginning of colorspace.h, or at run time
+ * by GetColorTransformWhite, which adapts colors between two white points.
  *
  * == List of transformation routines ==
  *   - Rgb2Yuv(num *Y, num *U, num *V, num R, num G, num B)
@@ -132,26 +176,20 @@
  */
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include "colorspace.h"
+#include "colorspace_internal.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef MATLAB_MEX_FILE
 #include "mex.h"
 #endif
 
-/** @brief Min of A and B */
-#define MIN(A,B)	(((A) <= (B)) ? (A) : (B))
-
-/** @brief Max of A and B */
-#define MAX(A,B)	(((A) >= (B)) ? (A) : (B))
-
-/** @brief Min of A, B, and C */
-#define MIN3(A,B,C)	(((A) <= (B)) ? MIN(A,C) : MIN(B,C))
-
-/** @brief Max of A, B, and C */
-#define MAX3(A,B,C)	(((A) >= (B)) ? MAX(A,C) : MAX(B,C))
-
 #ifndef M_PI
 /** @brief The constant pi */
 #define M_PI	3.14159265358979323846264338327950288
@@ -215,31 +253,9 @@
 #define NUM_TRANSFORM_PAIRS		18
 
 
-/** @brief Table representing all transformations in this file */
-static const struct
-{
-	int Space[2];
-	void (*Fun[2])(num*, num*, num*, num, num, num);
-} TransformPair[NUM_TRANSFORM_PAIRS] = {
-	{{RGB_SPACE, YUV_SPACE}, {Rgb2Yuv, Yuv2Rgb}},
-	{{RGB_SPACE, YCBCR_SPACE}, {Rgb2Ycbcr, Ycbcr2Rgb}},
-	{{RGB_SPACE, JPEGYCBCR_SPACE}, {Rgb2Jpegycbcr, Jpegycbcr2Rgb}},
-	{{RGB_SPACE, YPBPR_SPACE}, {Rgb2Ypbpr, Ypbpr2Rgb}},
-	{{RGB_SPACE, YDBDR_SPACE}, {Rgb2Ydbdr, Ydbdr2Rgb}},
-	{{RGB_SPACE, YIQ_SPACE}, {Rgb2Yiq, Yiq2Rgb}},
-	{{RGB_SPACE, HSV_SPACE}, {Rgb2Hsv, Hsv2Rgb}},
-	{{RGB_SPACE, HSL_SPACE}, {Rgb2Hsl, Hsl2Rgb}},
-	{{RGB_SPACE, HSI_SPACE}, {Rgb2Hsi, Hsi2Rgb}},
-	{{RGB_SPACE, XYZ_SPACE}, {Rgb2Xyz, Xyz2Rgb}},
-	{{XYZ_SPACE, LAB_SPACE}, {Xyz2Lab, Lab2Xyz}},
-	{{XYZ_SPACE, LUV_SPACE}, {Xyz2Luv, Luv2Xyz}},
-	{{XYZ_SPACE, LCH_SPACE}, {Xyz2Lch, Lch2Xyz}},
-	{{XYZ_SPACE, CAT02LMS_SPACE}, {Xyz2Cat02lms, Cat02lms2Xyz}},
-	{{RGB_SPACE, LAB_SPACE}, {Rgb2Lab, Lab2Rgb}},
-	{{RGB_SPACE, LUV_SPACE}, {Rgb2Luv, Luv2Rgb}},
-	{{RGB_SPACE, LCH_SPACE}, {Rgb2Lch, Lch2Rgb}},
-	{{RGB_SPACE, CAT02LMS_SPACE}, {Rgb2Cat02lms, Cat02lms2Rgb}}
-	};
+
+static void Rgb2YpbprPixel(num *Y, num *Pb, num *Pr, num R, num G, num B);
+static void Ypbpr2RgbPixel(num *R, num *G, num *B, num Y, num Pb, num Pr);
 
 
 /*
@@ -258,7 +274,7 @@ static const struct
  *
  * Wikipedia: http://en.wikipedia.org/wiki/YUV
  */
-void Rgb2Yuv(num *Y, num *U, num *V, num R, num G, num B)
+static void Rgb2YuvPixel(num *Y, num *U, num *V, num R, num G, num B)
 {
 	*Y = (num)( 0.299*R + 0.587*G + 0.114*B);
 	*U = (num)(-0.147*R - 0.289*G + 0.436*B);
@@ -272,7 +288,7 @@ void Rgb2Yuv(num *Y, num *U, num *V, num R, num G, num B)
  * @param R, G, B pointers to hold the result
  * @param Y, U, V the input YUV values
  */
-void Yuv2Rgb(num *R, num *G, num *B, num Y, num U, num V)
+static void Yuv2RgbPixel(num *R, num *G, num *B, num Y, num U, num V)
 {
 	*R = (num)(Y - 3.945707070708279e-05*U + 1.1398279671717170825*V);
 	*G = (num)(Y - 0.3946101641414141437*U - 0.5805003156565656797*V);
@@ -281,7 +297,7 @@ void Yuv2Rgb(num *R, num *G, num *B, num Y, num U, num V)
 
 
 /** @brief sRGB to Y'CbCr Luma + Chroma */
-void Rgb2Ycbcr(num *Y, num *Cb, num *Cr, num R, num G, num B)
+static void Rgb2YcbcrPixel(num *Y, num *Cb, num *Cr, num R, num G, num B)
 {
 	*Y  = (num)( 65.481*R + 128.553*G +  24.966*B +  16);
 	*Cb = (num)(-37.797*R -  74.203*G + 112.0  *B + 128);
@@ -290,7 +306,7 @@ void Rgb2Ycbcr(num *Y, num *Cb, num *Cr, num R, num G, num B)
 
 
 /** @brief Y'CbCr to sRGB */
-void Ycbcr2Rgb(num *R, num *G, num *B, num Y, num Cr, num Cb)
+static void Ycbcr2RgbPixel(num *R, num *G, num *B, num Y, num Cr, num Cb)
 {
 	Y -= 16;
 	Cb -= 128;
@@ -302,24 +318,24 @@ void Ycbcr2Rgb(num *R, num *G, num *B, num Y, num Cr, num Cb)
 
 
 /** @brief sRGB to JPEG-Y'CbCr Luma + Chroma */
-void Rgb2Jpegycbcr(num *Y, num *Cb, num *Cr, num R, num G, num B)
+static void Rgb2JpegycbcrPixel(num *Y, num *Cb, num *Cr, num R, num G, num B)
 {
-	Rgb2Ypbpr(Y, Cb, Cr, R, G, B);
+	Rgb2YpbprPixel(Y, Cb, Cr, R, G, B);
 	*Cb += (num)0.5;
 	*Cr += (num)0.5;
 }
 
 /** @brief JPEG-Y'CbCr to sRGB */
-void Jpegycbcr2Rgb(num *R, num *G, num *B, num Y, num Cb, num Cr)
+static void Jpegycbcr2RgbPixel(num *R, num *G, num *B, num Y, num Cb, num Cr)
 {
 	Cb -= (num)0.5;
 	Cr -= (num)0.5;
-	Ypbpr2Rgb(R, G, B, Y, Cb, Cr);
+	Ypbpr2RgbPixel(R, G, B, Y, Cb, Cr);
 }
 
 
 /** @brief sRGB to Y'PbPr Luma (ITU-R BT.601) + Chroma */
-void Rgb2Ypbpr(num *Y, num *Pb, num *Pr, num R, num G, num B)
+static void Rgb2YpbprPixel(num *Y, num *Pb, num *Pr, num R, num G, num B)
 {
 	*Y  = (num)( 0.299    *R + 0.587   *G + 0.114   *B);
 	*Pb = (num)(-0.1687367*R - 0.331264*G + 0.5     *B);
@@ -328,7 +344,7 @@ void Rgb2Ypbpr(num *Y, num *Pb, num *Pr, num R, num G, num B)
 
 
 /** @brief Y'PbPr to sRGB */
-void Ypbpr2Rgb(num *R, num *G, num *B, num Y, num Pb, num Pr)
+static void Ypbpr2RgbPixel(num *R, num *G, num *B, num Y, num Pb, num Pr)
 {
 	*R = (num)(0.99999999999914679361*Y - 1.2188941887145875e-06*Pb + 1.4019995886561440468*Pr);
 	*G = (num)(0.99999975910502514331*Y - 0.34413567816504303521*Pb - 0.71413649331646789076*Pr);
@@ -337,7 +353,7 @@ void Ypbpr2Rgb(num *R, num *G, num *B, num Y, num Pb, num Pr)
 
 
 /** @brief sRGB to SECAM Y'DbDr Luma + Chroma */
-void Rgb2Ydbdr(num *Y, num *Db, num *Dr, num R, num G, num B)
+static void Rgb2YdbdrPixel(num *Y, num *Db, num *Dr, num R, num G, num B)
 {
 	*Y  = (num)( 0.299*R + 0.587*G + 0.114*B);
 	*Db = (num)(-0.450*R - 0.883*G + 1.333*B);
@@ -346,7 +362,7 @@ void Rgb2Ydbdr(num *Y, num *Db, num *Dr, num R, num G, num B)
 
 
 /** @brief SECAM Y'DbDr to sRGB */
-void Ydbdr2Rgb(num *R, num *G, num *B, num Y, num Db, num Dr)
+static void Ydbdr2RgbPixel(num *R, num *G, num *B, num Y, num Db, num Dr)
 {
 	*R = (num)(Y + 9.2303716147657e-05*Db - 0.52591263066186533*Dr);
 	*G = (num)(Y - 0.12913289889050927*Db + 0.26789932820759876*Dr);
@@ -355,7 +371,7 @@ void Ydbdr2Rgb(num *R, num *G, num *B, num Y, num Db, num Dr)
 
 
 /** @brief sRGB to NTSC YIQ */
-void Rgb2Yiq(num *Y, num *I, num *Q, num R, num G, num B)
+static void Rgb2YiqPixel(num *Y, num *I, num *Q, num R, num G, num B)
 {
 	*Y = (num)(0.299   *R + 0.587   *G + 0.114   *B);
 	*I = (num)(0.595716*R - 0.274453*G - 0.321263*B);
@@ -364,7 +380,7 @@ void Rgb2Yiq(num *Y, num *I, num *Q, num R, num G, num B)
 
 
 /** @brief Convert NTSC YIQ to sRGB */
-void Yiq2Rgb(num *R, num *G, num *B, num Y, num I, num Q)
+static void Yiq2RgbPixel(num *R, num *G, num *B, num Y, num I, num Q)
 {
 	*R = (num)(Y + 0.9562957197589482261*I + 0.6210244164652610754*Q);
 	*G = (num)(Y - 0.2721220993185104464*I - 0.6473805968256950427*Q);
@@ -397,7 +413,7 @@ void Yiq2Rgb(num *R, num *G, num *B, num Y, num I, num Q)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Rgb2Hsv(num *H, num *S, num *V, num R, num G, num B)
+static void Rgb2HsvPixel(num *H, num *S, num *V, num R, num G, num B)
 {
 	num Max = MAX3(R, G, B);
 	num Min = MIN3(R, G, B);
@@ -443,7 +459,7 @@ void Rgb2Hsv(num *H, num *S, num *V, num R, num G, num B)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Hsv2Rgb(num *R, num *G, num *B, num H, num S, num V)
+static void Hsv2RgbPixel(num *R, num *G, num *B, num H, num S, num V)
 {
 	num C = S * V;
 	num Min = V - C;
@@ -509,7 +525,7 @@ void Hsv2Rgb(num *R, num *G, num *B, num H, num S, num V)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Rgb2Hsl(num *H, num *S, num *L, num R, num G, num B)
+static void Rgb2HslPixel(num *H, num *S, num *L, num R, num G, num B)
 {
 	num Max = MAX3(R, G, B);
 	num Min = MIN3(R, G, B);
@@ -555,7 +571,7 @@ void Rgb2Hsl(num *H, num *S, num *L, num R, num G, num B)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Hsl2Rgb(num *R, num *G, num *B, num H, num S, num L)
+static void Hsl2RgbPixel(num *R, num *G, num *B, num H, num S, num L)
 {
 	num C = (L <= 0.5) ? (2*L*S) : ((2 - 2*L)*S);
 	num Min = L - 0.5*C;
@@ -619,7 +635,7 @@ void Hsl2Rgb(num *R, num *G, num *B, num H, num S, num L)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Rgb2Hsi(num *H, num *S, num *I, num R, num G, num B)
+static void Rgb2HsiPixel(num *H, num *S, num *I, num R, num G, num B)
 {
 	num alpha = 0.5*(2*R - G - B);
 	num beta = 0.866025403784439*(G - B);
@@ -655,7 +671,7 @@ void Rgb2Hsi(num *H, num *S, num *I, num R, num G, num B)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/HSL_and_HSV
  */
-void Hsi2Rgb(num *R, num *G, num *B, num H, num S, num I)
+static void Hsi2RgbPixel(num *R, num *G, num *B, num H, num S, num I)
 {
 	H -= 360*floor(H/360);
 	
@@ -701,7 +717,7 @@ void Hsi2Rgb(num *R, num *G, num *B, num H, num S, num I)
  * Wikipedia: http://en.wikipedia.org/wiki/SRGB
  * Wikipedia: http://en.wikipedia.org/wiki/CIE_1931_color_space
  */
-void Rgb2Xyz(num *X, num *Y, num *Z, num R, num G, num B)
+static void Rgb2XyzPixel(num *X, num *Y, num *Z, num R, num G, num B)
 {
 	R = INVGAMMACORRECTION(R);
 	G = INVGAMMACORRECTION(G);
@@ -723,7 +739,7 @@ void Rgb2Xyz(num *X, num *Y, num *Z, num R, num G, num B)
  * Wikipedia: http://en.wikipedia.org/wiki/SRGB
  * Wikipedia: http://en.wikipedia.org/wiki/CIE_1931_color_space
  */
-void Xyz2Rgb(num *R, num *G, num *B, num X, num Y, num Z)
+static void Xyz2RgbPixel(num *R, num *G, num *B, num X, num Y, num Z)
 {	
 	num R1, B1, G1, Min;
 	
@@ -757,7 +773,7 @@ void Xyz2Rgb(num *R, num *G, num *B, num X, num Y, num Z)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/Lab_color_space
  */
-void Xyz2Lab(num *L, num *a, num *b, num X, num Y, num Z)
+static void Xyz2LabPixel(num *L, num *a, num *b, num X, num Y, num Z)
 {
 	X /= WHITEPOINT_X;
 	Y /= WHITEPOINT_Y;
@@ -779,7 +795,7 @@ void Xyz2Lab(num *L, num *a, num *b, num X, num Y, num Z)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/Lab_color_space 
  */
-void Lab2Xyz(num *X, num *Y, num *Z, num L, num a, num b)
+static void Lab2XyzPixel(num *X, num *Y, num *Z, num L, num a, num b)
 {
 	L = (L + 16)/116;
 	a = L + a/500;
@@ -798,7 +814,7 @@ void Lab2Xyz(num *X, num *Y, num *Z, num L, num a, num b)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/CIELUV_color_space
  */
-void Xyz2Luv(num *L, num *u, num *v, num X, num Y, num Z)
+static void Xyz2LuvPixel(num *L, num *u, num *v, num X, num Y, num Z)
 {	
 	num u1, v1, Denom;
 	
@@ -827,7 +843,7 @@ void Xyz2Luv(num *L, num *u, num *v, num X, num Y, num Z)
  *
  * Wikipedia: http://en.wikipedia.org/wiki/CIELUV_color_space
  */
-void Luv2Xyz(num *X, num *Y, num *Z, num L, num u, num v)
+static void Luv2XyzPixel(num *X, num *Y, num *Z, num L, num u, num v)
 {
 	*Y = (L + 16)/116;
 	*Y = WHITEPOINT_Y*LABINVF(*Y);
@@ -855,12 +871,12 @@ void Luv2Xyz(num *X, num *Y, num *Z, num L, num u, num v)
  *    a* = C* cos(H* pi/180),
  *    b* = C* sin(H* pi/180).
  */
-void Xyz2Lch(num *L, num *C, num *H, num X, num Y, num Z)
+static void Xyz2LchPixel(num *L, num *C, num *H, num X, num Y, num Z)
 {
 	num a, b;
 	
 	
-	Xyz2Lab(L, &a, &b, X, Y, Z);
+	Xyz2LabPixel(L, &a, &b, X, Y, Z);
 	*C = sqrt(a*a + b*b);
 	*H = atan2(b, a)*180.0/M_PI;
 	
@@ -874,18 +890,18 @@ void Xyz2Lch(num *L, num *C, num *H, num X, num Y, num Z)
  * @param X, Y, Z pointers to hold the result
  * @param L, C, H the input L*C*H* values
  */
-void Lch2Xyz(num *X, num *Y, num *Z, num L, num C, num H)
+static void Lch2XyzPixel(num *X, num *Y, num *Z, num L, num C, num H)
 {
 	num a = C * cos(H*(M_PI/180.0));
 	num b = C * sin(H*(M_PI/180.0));
 	
 	
-	Lab2Xyz(X, Y, Z, L, a, b);
+	Lab2XyzPixel(X, Y, Z, L, a, b);
 }
 
 
 /** @brief XYZ to CAT02 LMS */
-void Xyz2Cat02lms(num *L, num *M, num *S, num X, num Y, num Z)
+static void Xyz2Cat02lmsPixel(num *L, num *M, num *S, num X, num Y, num Z)
 {
 	*L = (num)( 0.7328*X + 0.4296*Y - 0.1624*Z);
 	*M = (num)(-0.7036*X + 1.6975*Y + 0.0061*Z);
@@ -894,7 +910,7 @@ void Xyz2Cat02lms(num *L, num *M, num *S, num X, num Y, num Z)
 
 
 /** @brief CAT02 LMS to XYZ */
-void Cat02lms2Xyz(num *X, num *Y, num *Z, num L, num M, num S)
+static void Cat02lms2XyzPixel(num *X, num *Y, num *Z, num L, num M, num S)
 {
 	*X = (num)( 1.096123820835514*L - 0.278869000218287*M + 0.182745179382773*S);
 	*Y = (num)( 0.454369041975359*L + 0.473533154307412*M + 0.072097803717229*S);
@@ -906,68 +922,613 @@ void Cat02lms2Xyz(num *X, num *Y, num *Z, num L, num M, num S)
  * == Glue functions for multi-stage transforms ==
  */
 
-void Rgb2Lab(num *L, num *a, num *b, num R, num G, num B)
+static void Rgb2LabPixel(num *L, num *a, num *b, num R, num G, num B)
 {
 	num X, Y, Z;
-	Rgb2Xyz(&X, &Y, &Z, R, G, B);
-	Xyz2Lab(L, a, b, X, Y, Z);
+	Rgb2XyzPixel(&X, &Y, &Z, R, G, B);
+	Xyz2LabPixel(L, a, b, X, Y, Z);
 }
 
 
-void Lab2Rgb(num *R, num *G, num *B, num L, num a, num b)
+static void Lab2RgbPixel(num *R, num *G, num *B, num L, num a, num b)
 {
 	num X, Y, Z;
-	Lab2Xyz(&X, &Y, &Z, L, a, b);
-	Xyz2Rgb(R, G, B, X, Y, Z);
+	Lab2XyzPixel(&X, &Y, &Z, L, a, b);
+	Xyz2RgbPixel(R, G, B, X, Y, Z);
 }
 
 
-void Rgb2Luv(num *L, num *u, num *v, num R, num G, num B)
+static void Rgb2LuvPixel(num *L, num *u, num *v, num R, num G, num B)
 {
 	num X, Y, Z;
-	Rgb2Xyz(&X, &Y, &Z, R, G, B);
-	Xyz2Luv(L, u, v, X, Y, Z);
+	Rgb2XyzPixel(&X, &Y, &Z, R, G, B);
+	Xyz2LuvPixel(L, u, v, X, Y, Z);
 }
 
 
-void Luv2Rgb(num *R, num *G, num *B, num L, num u, num v)
+static void Luv2RgbPixel(num *R, num *G, num *B, num L, num u, num v)
 {
 	num X, Y, Z;
-	Luv2Xyz(&X, &Y, &Z, L, u, v);
-	Xyz2Rgb(R, G, B, X, Y, Z);
+	Luv2XyzPixel(&X, &Y, &Z, L, u, v);
+	Xyz2RgbPixel(R, G, B, X, Y, Z);
 }
 
-void Rgb2Lch(num *L, num *C, num *H, num R, num G, num B)
+static void Rgb2LchPixel(num *L, num *C, num *H, num R, num G, num B)
 {
 	num X, Y, Z;
-	Rgb2Xyz(&X, &Y, &Z, R, G, B);
-	Xyz2Lch(L, C, H, X, Y, Z);
+	Rgb2XyzPixel(&X, &Y, &Z, R, G, B);
+	Xyz2LchPixel(L, C, H, X, Y, Z);
 }
 
 
-void Lch2Rgb(num *R, num *G, num *B, num L, num C, num H)
+static void Lch2RgbPixel(num *R, num *G, num *B, num L, num C, num H)
 {
 	num X, Y, Z;
-	Lch2Xyz(&X, &Y, &Z, L, C, H);
-	Xyz2Rgb(R, G, B, X, Y, Z);
+	Lch2XyzPixel(&X, &Y, &Z, L, C, H);
+	Xyz2RgbPixel(R, G, B, X, Y, Z);
 }
 
 
-void Rgb2Cat02lms(num *L, num *M, num *S, num R, num G, num B)
+static void Rgb2Cat02lmsPixel(num *L, num *M, num *S, num R, num G, num B)
 {
 	num X, Y, Z;
-	Rgb2Xyz(&X, &Y, &Z, R, G, B);
-	Xyz2Cat02lms(L, M, S, X, Y, Z);
+	Rgb2XyzPixel(&X, &Y, &Z, R, G, B);
+	Xyz2Cat02lmsPixel(L, M, S, X, Y, Z);
 }
 
 
-void Cat02lms2Rgb(num *R, num *G, num *B, num L, num M, num S)
+static void Cat02lms2RgbPixel(num *R, num *G, num *B, num L, num M, num S)
 {
 	num X, Y, Z;
-	Cat02lms2Xyz(&X, &Y, &Z, L, M, S);
-	Xyz2Rgb(R, G, B, X, Y, Z);
+	Cat02lms2XyzPixel(&X, &Y, &Z, L, M, S);
+	Xyz2RgbPixel(R, G, B, X, Y, Z);
+}
+
+
+
+/*
+ * == Public and block routines ==
+ *
+ * Every transformation is written once as a static per-pixel kernel FooPixel.
+ * The public routine Foo calls it for one pixel, and the block routine
+ * FooBlock calls it over contiguous arrays of up to COLOR_BLOCK_SIZE pixels.
+ * FooBlockf does the same over float arrays, computing in num and rounding
+ * the results to float.
+ * Since the kernels are static, the compiler inlines them into the block
+ * loops, so that whole-image conversions do not pay an indirect call per
+ * pixel.
+ */
+
+/** @brief Define the public routine of a per-pixel kernel */
+#define DEFINE_PIXEL_TRANSFORM(Fun)	\
+void Fun(num *D0, num *D1, num *D2, num S0, num S1, num S2)	\
+{	\
+	Fun##Pixel(D0, D1, D2, S0, S1, S2);	\
+}
+
+/** @brief Define the block routines of a per-pixel kernel */
+#define DEFINE_BLOCK_TRANSFORM(Fun)	\
+static void Fun##Block(num *D0, num *D1, num *D2,	\
+	const num *S0, const num *S1, const num *S2, int N)	\
+{	\
+	int i;	\
+	\
+	for(i = 0; i < N; i++)	\
+		Fun##Pixel(&D0[i], &D1[i], &D2[i], S0[i], S1[i], S2[i]);	\
+}	\
+	\
+static void Fun##Blockf(float *D0, float *D1, float *D2,	\
+	const float *S0, const float *S1, const float *S2, int N)	\
+{	\
+	num T0, T1, T2;	\
+	int i;	\
+	\
+	for(i = 0; i < N; i++)	\
+	{	\
+		Fun##Pixel(&T0, &T1, &T2, S0[i], S1[i], S2[i]);	\
+		D0[i] = (float)T0;	\
+		D1[i] = (float)T1;	\
+		D2[i] = (float)T2;	\
+	}	\
+}
+
+/** @brief Define the public and block routines of a per-pixel kernel */
+#define DEFINE_TRANSFORM(Fun)	\
+DEFINE_PIXEL_TRANSFORM(Fun)	\
+DEFINE_BLOCK_TRANSFORM(Fun)
+
+DEFINE_TRANSFORM(Rgb2Yuv)
+DEFINE_TRANSFORM(Yuv2Rgb)
+DEFINE_TRANSFORM(Rgb2Ycbcr)
+DEFINE_TRANSFORM(Ycbcr2Rgb)
+DEFINE_TRANSFORM(Rgb2Jpegycbcr)
+DEFINE_TRANSFORM(Jpegycbcr2Rgb)
+DEFINE_TRANSFORM(Rgb2Ypbpr)
+DEFINE_TRANSFORM(Ypbpr2Rgb)
+DEFINE_TRANSFORM(Rgb2Ydbdr)
+DEFINE_TRANSFORM(Ydbdr2Rgb)
+DEFINE_TRANSFORM(Rgb2Yiq)
+DEFINE_TRANSFORM(Yiq2Rgb)
+/* The block routines of these are defined with the branch-free kernels */
+DEFINE_PIXEL_TRANSFORM(Rgb2Hsv)
+DEFINE_PIXEL_TRANSFORM(Hsv2Rgb)
+DEFINE_PIXEL_TRANSFORM(Rgb2Hsl)
+DEFINE_PIXEL_TRANSFORM(Hsl2Rgb)
+DEFINE_TRANSFORM(Rgb2Hsi)
+DEFINE_TRANSFORM(Hsi2Rgb)
+DEFINE_TRANSFORM(Rgb2Xyz)
+DEFINE_TRANSFORM(Xyz2Rgb)
+DEFINE_TRANSFORM(Xyz2Lab)
+DEFINE_TRANSFORM(Lab2Xyz)
+DEFINE_TRANSFORM(Xyz2Luv)
+DEFINE_TRANSFORM(Luv2Xyz)
+DEFINE_TRANSFORM(Xyz2Lch)
+DEFINE_TRANSFORM(Lch2Xyz)
+DEFINE_TRANSFORM(Xyz2Cat02lms)
+DEFINE_TRANSFORM(Cat02lms2Xyz)
+DEFINE_TRANSFORM(Rgb2Lab)
+DEFINE_TRANSFORM(Lab2Rgb)
+DEFINE_TRANSFORM(Rgb2Luv)
+DEFINE_TRANSFORM(Luv2Rgb)
+DEFINE_TRANSFORM(Rgb2Lch)
+DEFINE_TRANSFORM(Lch2Rgb)
+DEFINE_TRANSFORM(Rgb2Cat02lms)
+DEFINE_TRANSFORM(Cat02lms2Rgb)
+
+
+/*
+ * == Matrix stages ==
+ *
+ * GetColorTransform folds consecutive linear stages of a transform into one
+ * colormatrix stage.  The Rgb2Xyz and Xyz2Rgb stages count as linear between
+ * the sRGB linearization and gamma correction, whose matrices are given by
+ * the following two routines.
+ */
+
+/** @brief The matrix of Rgb2Xyz, applied to linear RGB */
+static void LinearRgb2Xyz(num *X, num *Y, num *Z, num R, num G, num B)
+{
+	*X = (num)(0.4123955889674142161*R + 0.3575834307637148171*G + 0.1804926473817015735*B);
+	*Y = (num)(0.2125862307855955516*R + 0.7151703037034108499*G + 0.07220049864333622685*B);
+	*Z = (num)(0.01929721549174694484*R + 0.1191838645808485318*G + 0.9504971251315797660*B);
+}
+
+
+/** @brief The matrix of Xyz2Rgb, giving linear RGB */
+static void Xyz2LinearRgb(num *R, num *G, num *B, num X, num Y, num Z)
+{
+	*R = (num)( 3.2406*X - 1.5372*Y - 0.4986*Z);
+	*G = (num)(-0.9689*X + 1.8758*Y + 0.0415*Z);
+	*B = (num)( 0.0557*X - 0.2040*Y + 1.0570*Z);
+}
+
+
+/** @brief Apply a colormatrix stage to one pixel */
+static void ColorMatrixPixel(const colormatrix *Matrix,
+	num *D0, num *D1, num *D2, num S0, num S1, num S2)
+{
+	num Min;
+	
+	
+	if(Matrix->Linearize)
+	{
+		S0 = INVGAMMACORRECTION(S0);
+		S1 = INVGAMMACORRECTION(S1);
+		S2 = INVGAMMACORRECTION(S2);
+	}
+	
+	*D0 = Matrix->M[0][0]*S0 + Matrix->M[0][1]*S1 + Matrix->M[0][2]*S2 + Matrix->M[0][3];
+	*D1 = Matrix->M[1][0]*S0 + Matrix->M[1][1]*S1 + Matrix->M[1][2]*S2 + Matrix->M[1][3];
+	*D2 = Matrix->M[2][0]*S0 + Matrix->M[2][1]*S1 + Matrix->M[2][2]*S2 + Matrix->M[2][3];
+	
+	if(Matrix->GammaCorrect)
+	{
+		/* Force nonnegative values as in Xyz2Rgb */
+		Min = MIN3(*D0, *D1, *D2);
+		
+		if(Min < 0)
+		{
+			*D0 -= Min;
+			*D1 -= Min;
+			*D2 -= Min;
+		}
+		
+		*D0 = GAMMACORRECTION(*D0);
+		*D1 = GAMMACORRECTION(*D1);
+		*D2 = GAMMACORRECTION(*D2);
+	}
+}
+
+
+/** @brief Define the block routine of colormatrix stages for a real type */
+#define DEFINE_COLOR_MATRIX_BLOCK(Name, Type)	\
+static void Name(const colormatrix *Matrix, Type *D0, Type *D1, Type *D2,	\
+	const Type *S0, const Type *S1, const Type *S2, int N)	\
+{	\
+	const num M00 = Matrix->M[0][0], M01 = Matrix->M[0][1],	\
+		M02 = Matrix->M[0][2], M03 = Matrix->M[0][3],	\
+		M10 = Matrix->M[1][0], M11 = Matrix->M[1][1],	\
+		M12 = Matrix->M[1][2], M13 = Matrix->M[1][3],	\
+		M20 = Matrix->M[2][0], M21 = Matrix->M[2][1],	\
+		M22 = Matrix->M[2][2], M23 = Matrix->M[2][3];	\
+	num T0, T1, T2;	\
+	int i;	\
+	\
+	if(Matrix->Linearize || Matrix->GammaCorrect)	\
+		for(i = 0; i < N; i++)	\
+		{	\
+			ColorMatrixPixel(Matrix, &T0, &T1, &T2, S0[i], S1[i], S2[i]);	\
+			D0[i] = (Type)T0;	\
+			D1[i] = (Type)T1;	\
+			D2[i] = (Type)T2;	\
+		}	\
+	else	\
+		for(i = 0; i < N; i++)	\
+		{	\
+			T0 = S0[i];	\
+			T1 = S1[i];	\
+			T2 = S2[i];	\
+			D0[i] = (Type)(M00*T0 + M01*T1 + M02*T2 + M03);	\
+			D1[i] = (Type)(M10*T0 + M11*T1 + M12*T2 + M13);	\
+			D2[i] = (Type)(M20*T0 + M21*T1 + M22*T2 + M23);	\
+		}	\
+}
+
+DEFINE_COLOR_MATRIX_BLOCK(ColorMatrixBlock, num)
+DEFINE_COLOR_MATRIX_BLOCK(ColorMatrixBlockf, float)
+
+
+/*
+ * Threads used by the planar routines, 0 for the OpenMP default, and the
+ * minimum number of pixels for which they are used.  See SetColorThreads.
+ */
+static int ColorNumThreads = 0;
+static long ColorParallelSize = COLOR_PARALLEL_SIZE;
+
+#ifdef _OPENMP
+#define COLOR_NUM_THREADS	\
+	((ColorNumThreads > 0) ? ColorNumThreads : omp_get_max_threads())
+#endif
+
+
+/*
+ * == Fast transformations ==
+ *
+ * Branch-free block routines for the sRGB, XYZ, L*a*b*, and L*u*v* family.
+ * The powers in the sRGB transfer functions and the cube root in L*a*b* are
+ * computed as FastExp2(p*FastLog2(t)) from polynomial approximations that
+ * vectorize, and branches are written as bitwise selects, so that every loop
+ * compiles to SIMD code.  With GCC on x86-64 Linux, each routine is compiled
+ * for AVX-512, AVX2, and the baseline, and the best version for the running
+ * CPU is selected when the library is loaded.  The routines are vectorized
+ * from -O2 up, with or without -ffast-math.  The double versions need the
+ * 64-bit integer operations of AVX2 to vectorize FastLog2 and FastExp2, so
+ * the baseline double version stays scalar on SSE2.
+ *
+ * FastLog2 has an absolute error below 3e-14 and FastExp2 a relative error
+ * below 1e-15, so the transfer functions and cube root have a relative error
+ * below 5e-14.  End to end, outputs differ from the exact routines by less
+ * than 1e-11 in absolute terms for input within the sRGB gamut.  Out of
+ * gamut, L*u*v* divides by X + 15Y + 3Z, which can come close to zero and
+ * magnify the difference, to about 3e-7 for sRGB values in [-0.2, 1.2].
+ * They assume finite input.  The fast routines are used in place of the
+ * exact ones after calling SetColorTransformFast.  They need a C99 compiler.
+ *
+ * The bit manipulations and FastSelect are in colorspace_internal.h.  The
+ * float routines use single-precision versions of FastLog2 and FastExp2
+ * and compute in float throughout, so that they process twice as many pixels
+ * per vector.  Their results differ from the exact ones by about 1e-6 of the
+ * range of each channel.
+ */
+#ifdef COLOR_FAST_KERNELS
+
+/**
+ * @brief Base-2 logarithm of a positive finite number
+ *
+ * The argument is split as x = m 2^e with sqrt(1/2) <= m < sqrt(2) using
+ * unsigned 64-bit integer operations on its bits, which vectorize with AVX2
+ * and need no AVX-512 conversions, and log2(m) is computed from the series
+ * of atanh in s = (m - 1)/(m + 1), |s| <= 0.1716, truncated after the s^15
+ * term.
+ */
+FAST_INLINE double FastLog2(double x)
+{
+	/* Bits of x relative to sqrt(1/2), biased to stay positive */
+	uint64_t Bits = (uint64_t)AsInt64(x) - UINT64_C(0x3FE6A09E667F3BCD)
+		+ UINT64_C(0x3FE0000000000000);
+	uint64_t Exponent = Bits & UINT64_C(0xFFF0000000000000);
+	int32_t e = (int32_t)(Bits >> 52) - 1022;
+	double m = AsDouble((int64_t)((uint64_t)AsInt64(x) - Exponent
+		+ UINT64_C(0x3FE0000000000000)));
+	double s = (m - 1)/(m + 1);
+	double s2 = s*s;
+	double p;
+	
+	
+	p = 1.0/15;
+	p = p*s2 + 1.0/13;
+	p = p*s2 + 1.0/11;
+	p = p*s2 + 1.0/9;
+	p = p*s2 + 1.0/7;
+	p = p*s2 + 1.0/5;
+	p = p*s2 + 1.0/3;
+	p = p*s2 + 1;
+	return (double)e + (2*1.4426950408889634)*s*p;
+}
+
+
+/**
+ * @brief Base-2 exponential
+ *
+ * The argument is clamped to [-1022, 1023] and split as x = n + f with n the
+ * nearest integer and |f| <= 1/2.  2^f is the Taylor series of exp(f ln 2)
+ * through the f^12 term, and 2^n is built in the exponent bits.  Rounding is
+ * done by integer conversion rather than by adding and subtracting a large
+ * constant, so that the result holds under -ffast-math.
+ */
+FAST_INLINE double FastExp2(double x)
+{
+	int32_t n;
+	double f, p;
+	
+	
+	x = FastMin(FastMax(x, -1022), 1023);
+	n = (int32_t)(x + 1024.5) - 1024;
+	f = (x - (double)n)*0.69314718055994531;
+	p = 1.0/479001600;
+	p = p*f + 1.0/39916800;
+	p = p*f + 1.0/3628800;
+	p = p*f + 1.0/362880;
+	p = p*f + 1.0/40320;
+	p = p*f + 1.0/5040;
+	p = p*f + 1.0/720;
+	p = p*f + 1.0/120;
+	p = p*f + 1.0/24;
+	p = p*f + 1.0/6;
+	p = p*f + 0.5;
+	p = p*f + 1;
+	p = p*f + 1;
+	return p*AsDouble((int64_t)(n + 1023) << 52);
+}
+
+
+/** @brief Reinterpret the bits of a float as an integer and back */
+FAST_INLINE int32_t AsInt32(float x)
+{
+	int32_t i;
+	memcpy(&i, &x, sizeof(i));
+	return i;
+}
+
+FAST_INLINE float AsFloat(int32_t i)
+{
+	float x;
+	memcpy(&x, &i, sizeof(x));
+	return x;
+}
+
+
+/** @brief Single-precision FastSelect, FastMax, and FastMin */
+FAST_INLINE float FastSelectf(int32_t Cond, float A, float B)
+{
+	int32_t Mask = -Cond;
+	return AsFloat((AsInt32(A) & Mask) | (AsInt32(B) & ~Mask));
+}
+
+FAST_INLINE float FastMaxf(float A, float B)
+{
+	return FastSelectf(A > B, A, B);
+}
+
+FAST_INLINE float FastMinf(float A, float B)
+{
+	return FastSelectf(A < B, A, B);
+}
+
+
+/**
+ * @brief Single-precision FastLog2
+ *
+ * Same as FastLog2, with the series truncated after the s^9 term, for an
+ * absolute error below 1e-7.
+ */
+FAST_INLINE float FastLog2f(float x)
+{
+	uint32_t Bits = (uint32_t)AsInt32(x) - UINT32_C(0x3F3504F3)
+		+ UINT32_C(0x3F000000);
+	uint32_t Exponent = Bits & UINT32_C(0xFF800000);
+	int32_t e = (int32_t)(Bits >> 23) - 126;
+	float m = AsFloat((int32_t)((uint32_t)AsInt32(x) - Exponent
+		+ UINT32_C(0x3F000000)));
+	float s = (m - 1)/(m + 1);
+	float s2 = s*s;
+	float p;
+	
+	
+	p = 1.0f/9;
+	p = p*s2 + 1.0f/7;
+	p = p*s2 + 1.0f/5;
+	p = p*s2 + 1.0f/3;
+	p = p*s2 + 1;
+	return (float)e + (2*1.44269504f)*s*p;
+}
+
+
+/**
+ * @brief Single-precision FastExp2
+ *
+ * Same as FastExp2 on [-126, 127], with the series truncated after the f^7
+ * term, for a relative error below 3e-7.
+ */
+FAST_INLINE float FastExp2f(float x)
+{
+	int32_t n;
+	float f, p;
+	
+	
+	x = FastMinf(FastMaxf(x, -126), 127);
+	n = (int32_t)(x + 128.5f) - 128;
+	f = (x - (float)n)*0.693147181f;
+	p = 1.0f/5040;
+	p = p*f + 1.0f/720;
+	p = p*f + 1.0f/120;
+	p = p*f + 1.0f/24;
+	p = p*f + 1.0f/6;
+	p = p*f + 0.5f;
+	p = p*f + 1;
+	p = p*f + 1;
+	return p*AsFloat((n + 127) << 23);
 }
 
+#endif  /* C99 */
+
+
+/*
+ * == Branch-free HSV and HSL ==
+ *
+ * When compiled as C99, the block routines of the hue-based transforms used
+ * by ApplyColorTransformPlanar are the branch-free ones of
+ * colorspace_select.c, without the need for SetColorTransformFast.  They give
+ * the same results as the per-pixel kernels bit for bit when both files are
+ * built without -ffast-math.  As colorspace_select.c is always built with
+ * -fno-fast-math, the branch-free routines keep these IEEE results when
+ * colorspace.c is built with -Ofast, while the reassociated per-pixel kernels
+ * may not.  HSI keeps the per-pixel loops, as vector atan2 and cos do not
+ * round as the scalar ones do.
+ */
+#ifndef COLOR_FAST_KERNELS
+
+DEFINE_BLOCK_TRANSFORM(Rgb2Hsv)
+DEFINE_BLOCK_TRANSFORM(Hsv2Rgb)
+DEFINE_BLOCK_TRANSFORM(Rgb2Hsl)
+DEFINE_BLOCK_TRANSFORM(Hsl2Rgb)
+
+#endif
+
+
+/*
+ * The fast kernels, ApplyColorTransformPlanar, and ApplyColorLutPlanar are
+ * written once in colorspace_real.h and compiled for num and for float.
+ */
+#define REAL		num
+#define REAL_NAME(Name)	Name
+#include "colorspace_real.h"
+#undef REAL
+#undef REAL_NAME
+
+#define REAL		float
+#define REAL_NAME(Name)	Name##f
+#include "colorspace_real.h"
+#undef REAL
+#undef REAL_NAME
+
+#ifdef COLOR_FAST_KERNELS
+
+#define NUM_FAST_TRANSFORMS		10
+
+/** @brief Table of exact block routines and their fast replacements */
+static const struct
+{
+	colorblockfun Exact;
+	colorblockfun Fast;
+	colorblockfunf Exactf;
+	colorblockfunf Fastf;
+} FastTransform[NUM_FAST_TRANSFORMS] = {
+	{Rgb2XyzBlock, Rgb2XyzFastBlock, Rgb2XyzBlockf, Rgb2XyzFastBlockf},
+	{Xyz2RgbBlock, Xyz2RgbFastBlock, Xyz2RgbBlockf, Xyz2RgbFastBlockf},
+	{Xyz2LabBlock, Xyz2LabFastBlock, Xyz2LabBlockf, Xyz2LabFastBlockf},
+	{Lab2XyzBlock, Lab2XyzFastBlock, Lab2XyzBlockf, Lab2XyzFastBlockf},
+	{Xyz2LuvBlock, Xyz2LuvFastBlock, Xyz2LuvBlockf, Xyz2LuvFastBlockf},
+	{Luv2XyzBlock, Luv2XyzFastBlock, Luv2XyzBlockf, Luv2XyzFastBlockf},
+	{Rgb2LabBlock, Rgb2LabFastBlock, Rgb2LabBlockf, Rgb2LabFastBlockf},
+	{Lab2RgbBlock, Lab2RgbFastBlock, Lab2RgbBlockf, Lab2RgbFastBlockf},
+	{Rgb2LuvBlock, Rgb2LuvFastBlock, Rgb2LuvBlockf, Rgb2LuvFastBlockf},
+	{Luv2RgbBlock, Luv2RgbFastBlock, Luv2RgbBlockf, Luv2RgbFastBlockf}
+	};
+
+#endif  /* COLOR_FAST_KERNELS */
+
+
+
+/** @brief Table representing all transformations in this file */
+static const struct
+{
+	int Space[2];
+	void (*Fun[2])(num*, num*, num*, num, num, num);
+	colorblockfun BlockFun[2];
+	colorblockfunf BlockFunf[2];
+} TransformPair[NUM_TRANSFORM_PAIRS] = {
+	{{RGB_SPACE, YUV_SPACE}, {Rgb2Yuv, Yuv2Rgb}, {Rgb2YuvBlock, Yuv2RgbBlock},
+		{Rgb2YuvBlockf, Yuv2RgbBlockf}},
+	{{RGB_SPACE, YCBCR_SPACE}, {Rgb2Ycbcr, Ycbcr2Rgb}, {Rgb2YcbcrBlock, Ycbcr2RgbBlock},
+		{Rgb2YcbcrBlockf, Ycbcr2RgbBlockf}},
+	{{RGB_SPACE, JPEGYCBCR_SPACE}, {Rgb2Jpegycbcr, Jpegycbcr2Rgb}, {Rgb2JpegycbcrBlock, Jpegycbcr2RgbBlock},
+		{Rgb2JpegycbcrBlockf, Jpegycbcr2RgbBlockf}},
+	{{RGB_SPACE, YPBPR_SPACE}, {Rgb2Ypbpr, Ypbpr2Rgb}, {Rgb2YpbprBlock, Ypbpr2RgbBlock},
+		{Rgb2YpbprBlockf, Ypbpr2RgbBlockf}},
+	{{RGB_SPACE, YDBDR_SPACE}, {Rgb2Ydbdr, Ydbdr2Rgb}, {Rgb2YdbdrBlock, Ydbdr2RgbBlock},
+		{Rgb2YdbdrBlockf, Ydbdr2RgbBlockf}},
+	{{RGB_SPACE, YIQ_SPACE}, {Rgb2Yiq, Yiq2Rgb}, {Rgb2YiqBlock, Yiq2RgbBlock},
+		{Rgb2YiqBlockf, Yiq2RgbBlockf}},
+	{{RGB_SPACE, HSV_SPACE}, {Rgb2Hsv, Hsv2Rgb}, {Rgb2HsvBlock, Hsv2RgbBlock},
+		{Rgb2HsvBlockf, Hsv2RgbBlockf}},
+	{{RGB_SPACE, HSL_SPACE}, {Rgb2Hsl, Hsl2Rgb}, {Rgb2HslBlock, Hsl2RgbBlock},
+		{Rgb2HslBlockf, Hsl2RgbBlockf}},
+	{{RGB_SPACE, HSI_SPACE}, {Rgb2Hsi, Hsi2Rgb}, {Rgb2HsiBlock, Hsi2RgbBlock},
+		{Rgb2HsiBlockf, Hsi2RgbBlockf}},
+	{{RGB_SPACE, XYZ_SPACE}, {Rgb2Xyz, Xyz2Rgb}, {Rgb2XyzBlock, Xyz2RgbBlock},
+		{Rgb2XyzBlockf, Xyz2RgbBlockf}},
+	{{XYZ_SPACE, LAB_SPACE}, {Xyz2Lab, Lab2Xyz}, {Xyz2LabBlock, Lab2XyzBlock},
+		{Xyz2LabBlockf, Lab2XyzBlockf}},
+	{{XYZ_SPACE, LUV_SPACE}, {Xyz2Luv, Luv2Xyz}, {Xyz2LuvBlock, Luv2XyzBlock},
+		{Xyz2LuvBlockf, Luv2XyzBlockf}},
+	{{XYZ_SPACE, LCH_SPACE}, {Xyz2Lch, Lch2Xyz}, {Xyz2LchBlock, Lch2XyzBlock},
+		{Xyz2LchBlockf, Lch2XyzBlockf}},
+	{{XYZ_SPACE, CAT02LMS_SPACE}, {Xyz2Cat02lms, Cat02lms2Xyz}, {Xyz2Cat02lmsBlock, Cat02lms2XyzBlock},
+		{Xyz2Cat02lmsBlockf, Cat02lms2XyzBlockf}},
+	{{RGB_SPACE, LAB_SPACE}, {Rgb2Lab, Lab2Rgb}, {Rgb2LabBlock, Lab2RgbBlock},
+		{Rgb2LabBlockf, Lab2RgbBlockf}},
+	{{RGB_SPACE, LUV_SPACE}, {Rgb2Luv, Luv2Rgb}, {Rgb2LuvBlock, Luv2RgbBlock},
+		{Rgb2LuvBlockf, Luv2RgbBlockf}},
+	{{RGB_SPACE, LCH_SPACE}, {Rgb2Lch, Lch2Rgb}, {Rgb2LchBlock, Lch2RgbBlock},
+		{Rgb2LchBlockf, Lch2RgbBlockf}},
+	{{RGB_SPACE, CAT02LMS_SPACE}, {Rgb2Cat02lms, Cat02lms2Rgb}, {Rgb2Cat02lmsBlock, Cat02lms2RgbBlock},
+		{Rgb2Cat02lmsBlockf, Cat02lms2RgbBlockf}}
+	};
+
+
+
+/** @brief Maximum number of color spaces in a transform string */
+#define MAX_CHAIN_SPACES	64
+
+#define NUM_LINEAR_STAGES	16
+
+/** @brief Table of linear transformations and their affine parts */
+static const struct
+{
+	void (*Fun)(num*, num*, num*, num, num, num);
+	void (*Affine)(num*, num*, num*, num, num, num);
+	int Linearize;
+	int GammaCorrect;
+} LinearStage[NUM_LINEAR_STAGES] = {
+	{Rgb2Yuv, Rgb2Yuv, 0, 0},
+	{Yuv2Rgb, Yuv2Rgb, 0, 0},
+	{Rgb2Ycbcr, Rgb2Ycbcr, 0, 0},
+	{Ycbcr2Rgb, Ycbcr2Rgb, 0, 0},
+	{Rgb2Jpegycbcr, Rgb2Jpegycbcr, 0, 0},
+	{Jpegycbcr2Rgb, Jpegycbcr2Rgb, 0, 0},
+	{Rgb2Ypbpr, Rgb2Ypbpr, 0, 0},
+	{Ypbpr2Rgb, Ypbpr2Rgb, 0, 0},
+	{Rgb2Ydbdr, Rgb2Ydbdr, 0, 0},
+	{Ydbdr2Rgb, Ydbdr2Rgb, 0, 0},
+	{Rgb2Yiq, Rgb2Yiq, 0, 0},
+	{Yiq2Rgb, Yiq2Rgb, 0, 0},
+	{Xyz2Cat02lms, Xyz2Cat02lms, 0, 0},
+	{Cat02lms2Xyz, Cat02lms2Xyz, 0, 0},
+	{Rgb2Xyz, LinearRgb2Xyz, 1, 0},
+	{Xyz2Rgb, Xyz2LinearRgb, 0, 1}
+	};
+
 
 
 /* 
@@ -986,7 +1547,7 @@ static int IdFromName(const char *Name)
 	else if(!strcmp(Name, "ycbcr"))
 		return YCBCR_SPACE;
 	else if(!strcmp(Name, "jpegycbcr"))
-		return YCBCR_SPACE;
+		return JPEGYCBCR_SPACE;
 	else if(!strcmp(Name, "ypbpr"))
 		return YPBPR_SPACE;
 	else if(!strcmp(Name, "ydbdr"))
@@ -1014,140 +1575,164 @@ static int IdFromName(const char *Name)
 }
 
 
+/** @brief Get the colormatrix of a transformation, or return 0 if not linear */
+static int GetLinearMatrix(colormatrix *Matrix,
+	void (*Fun)(num*, num*, num*, num, num, num))
+{
+	num D[3];
+	int i, j, k;
+	
+	
+	for(i = 0; i < NUM_LINEAR_STAGES; i++)
+		if(Fun == LinearStage[i].Fun)
+		{
+			/* Evaluate the affine part at the origin and the unit vectors */
+			LinearStage[i].Affine(&D[0], &D[1], &D[2], 0, 0, 0);
+			
+			for(j = 0; j < 3; j++)
+				Matrix->M[j][3] = D[j];
+			
+			for(k = 0; k < 3; k++)
+			{
+				LinearStage[i].Affine(&D[0], &D[1], &D[2],
+					(num)(k == 0), (num)(k == 1), (num)(k == 2));
+				
+				for(j = 0; j < 3; j++)
+					Matrix->M[j][k] = D[j] - Matrix->M[j][3];
+			}
+			
+			Matrix->Linearize = LinearStage[i].Linearize;
+			Matrix->GammaCorrect = LinearStage[i].GammaCorrect;
+			Matrix->Fast = 0;
+			return 1;
+		}
+	
+	return 0;
+}
+
+
 /**
- * @brief Given a transform string, returns a colortransform struct
- *
- * @param Trans a colortransform pointer to hold the transform
- * @param TransformString string specifying the transformations
- * @return 1 on success, 0 on failure
- * 
- * This function provides a convenient interface to the collection of transform
- * functions in this file.  TransformString specifies the source and 
- * destination color spaces, 
- *    TransformString = "dest<-src" 
- * or alternatively,
- *    TransformString = "src->dest".
+ * @brief Fold an affine map into the last stage of a colortransform
  *
- * Supported color spaces are
- *    "RGB"             sRGB Red Green Blue (ITU-R BT.709 gamma-corrected),
- *    "YPbPr"           Luma (ITU-R BT.601) + Chroma,
- *    "YCbCr"           Luma + Chroma ("digitized" version of Y'PbPr),
- *    "JPEG-YCbCr"      Luma + Chroma space used in JFIF JPEG,
- *    "YUV"             NTSC PAL Y'UV Luma + Chroma,
- *    "YIQ"             NTSC Y'IQ Luma + Chroma,
- *    "YDbDr"           SECAM Y'DbDr Luma + Chroma,
- *    "HSV" or "HSB"    Hue Saturation Value/Brightness,
- *    "HSL" or "HLS"    Hue Saturation Luminance,
- *    "HSI"             Hue Saturation Intensity,
- *    "XYZ"             CIE XYZ,
- *    "Lab"             CIE L*a*b* (CIELAB),
- *    "Luv"             CIE L*u*v* (CIELUV),
- *    "LCH"             CIE L*C*H* (CIELCH),
- *    "CAT02 LMS"       CIE CAT02 LMS.
- * Color space names are case-insensitive and spaces are ignored.  When sRGB
- * is the source or destination, it can be omitted.  For example "yuv<-" is 
- * short for "yuv<-rgb".
+ * @return 1 if the last stage is linear and was replaced by its composition
+ * with Second, 0 otherwise
  *
- * The routine returns a colortransform structure representing the transform.
- * The transform is performed by calling GetColorTransform.  For example,
-@code
-       num S[3] = {173, 0.8, 0.5};
-       num D[3];
-       colortransform Trans;
-       
-       if(!(GetColorTransform(&Trans, "HSI -> Lab")))
-       {
-           printf("Invalid syntax or unknown color space\n");
-           return;
-       }   
-       
-       ApplyColorTransform(Trans, &D[0], &D[1], &D[2], S[0], S[1], S[2]);
-@endcode
+ * Stages are not folded when gamma correction comes between them.
  */
-int GetColorTransform(colortransform *Trans, const char *TransformString)
+static int FoldMatrix(colortransform *Trans, const colormatrix *Second)
 {
-	int LeftNumChars = 0, RightNumChars = 0, LeftSide = 1, LeftToRight = 0;
-	int i, j, SrcSpaceId, DestSpaceId;
-	char LeftSpace[16], RightSpace[16], c;
+	colormatrix First;
+	int Last = Trans->NumStages - 1, i, j, k;
 	
 	
-	Trans->NumStages = 0;
-	Trans->Fun[0] = 0;
-	Trans->Fun[1] = 0;
+	if(Last < 0 || Second->Linearize)
+		return 0;
+	else if(!Trans->Fun[Last])
+		First = Trans->Matrix[Last];
+	else if(!GetLinearMatrix(&First, Trans->Fun[Last]))
+		return 0;
 	
-	/* Parse the transform string */
-	while(1)
-	{
-		c = *(TransformString++);	/* Read the next character */
-		
-		if(!c)
-			break;
-		else if(c == '<')
-		{
-			LeftToRight = 0;
-			LeftSide = 0;
-		}
-		else if(c == '>')
-		{
-			LeftToRight = 1;
-			LeftSide = 0;
-		}
-		else if(c != ' ' && c != '-' && c != '=')
+	if(First.GammaCorrect)
+		return 0;
+	
+	/* Compose the affine maps, Second after First */
+	for(i = 0; i < 3; i++)
+		for(j = 0; j < 4; j++)
 		{
-			if(LeftSide)
-			{	/* Append the character to LeftSpace */
-				if(LeftNumChars < 15)
-					LeftSpace[LeftNumChars++] = tolower(c);
-			}
-			else
-			{	/* Append the character to RightSpace */
-				if(RightNumChars < 15)
-					RightSpace[RightNumChars++] = tolower(c);
-			}
+			Trans->Matrix[Last].M[i][j] = (j == 3) ? Second->M[i][3] : 0;
+			
+			for(k = 0; k < 3; k++)
+				Trans->Matrix[Last].M[i][j] += Second->M[i][k]*First.M[k][j];
 		}
-	}
-	
-	/* Append null terminators on the LeftSpace and RightSpace strings */
-	LeftSpace[LeftNumChars] = 0;
-	RightSpace[RightNumChars] = 0;
 	
-	/* Convert names to colorspace enum */
-	if(LeftToRight)
-	{
-		SrcSpaceId = IdFromName(LeftSpace);
-		DestSpaceId = IdFromName(RightSpace);
-	}
-	else
-	{
-		SrcSpaceId = IdFromName(RightSpace);
-		DestSpaceId = IdFromName(LeftSpace);
-	}
+	Trans->Matrix[Last].Linearize = First.Linearize;
+	Trans->Matrix[Last].GammaCorrect = Second->GammaCorrect;
+	Trans->Matrix[Last].Fast = 0;
+	Trans->Fun[Last] = NULL;
+	Trans->BlockFun[Last] = NULL;
+	Trans->BlockFunf[Last] = NULL;
+	return 1;
+}
+
+
+/**
+ * @brief Append a transformation from the TransformPair table
+ *
+ * @param Trans the colortransform to extend
+ * @param Pair, Direction the transformation TransformPair[Pair].Fun[Direction]
+ * @return 1 on success, 0 if Trans has COLOR_MAX_STAGES stages
+ *
+ * A linear transformation is folded into the last stage if that stage is
+ * also linear.
+ */
+static int AppendStage(colortransform *Trans, int Pair, int Direction)
+{
+	void (*Fun)(num*, num*, num*, num, num, num)
+		= TransformPair[Pair].Fun[Direction];
+	colormatrix Matrix;
+	
+	
+	if(GetLinearMatrix(&Matrix, Fun) && FoldMatrix(Trans, &Matrix))
+		return 1;
+	else if(Trans->NumStages == COLOR_MAX_STAGES)
+		return 0;
+	
+	Trans->Fun[Trans->NumStages] = Fun;
+	Trans->BlockFun[Trans->NumStages] = TransformPair[Pair].BlockFun[Direction];
+	Trans->BlockFunf[Trans->NumStages] = TransformPair[Pair].BlockFunf[Direction];
+	Trans->NumStages++;
+	return 1;
+}
+
+
+/**
+ * @brief Append an affine map as a colormatrix stage
+ *
+ * @return 1 on success, 0 if Trans has COLOR_MAX_STAGES stages
+ */
+static int AppendMatrix(colortransform *Trans, const colormatrix *Matrix)
+{
+	if(FoldMatrix(Trans, Matrix))
+		return 1;
+	else if(Trans->NumStages == COLOR_MAX_STAGES)
+		return 0;
+	
+	Trans->Fun[Trans->NumStages] = NULL;
+	Trans->BlockFun[Trans->NumStages] = NULL;
+	Trans->BlockFunf[Trans->NumStages] = NULL;
+	Trans->Matrix[Trans->NumStages] = *Matrix;
+	Trans->Matrix[Trans->NumStages].Fast = 0;
+	Trans->NumStages++;
+	return 1;
+}
+
+
+/**
+ * @brief Append the transformation between two color spaces
+ *
+ * @return 1 on success, 0 if there is no such transformation or Trans is full
+ *
+ * The transformation is a pair from the TransformPair table, or two pairs
+ * meeting at sRGB or XYZ.
+ */
+static int AppendRoute(colortransform *Trans, int SrcSpaceId, int DestSpaceId)
+{
+	int i, j;
 	
-	/* Is either space is unknown? (probably a parsing error) */
-	if(SrcSpaceId == UNKNOWN_SPACE || DestSpaceId == UNKNOWN_SPACE)
-		return 0;	/* Return failure */
 	
 	/* Is this an identity transform? */
 	if(SrcSpaceId == DestSpaceId)
-		return 1;	/* Return successfully */
+		return 1;
 	
 	/* Search the TransformPair table for a direct transformation */
 	for(i = 0; i < NUM_TRANSFORM_PAIRS; i++)
 	{
 		if(SrcSpaceId == TransformPair[i].Space[0] 
 			&& DestSpaceId == TransformPair[i].Space[1])
-		{
-			Trans->NumStages = 1;
-			Trans->Fun[0] = TransformPair[i].Fun[0];
-			return 1;
-		}
+			return AppendStage(Trans, i, 0);
 		else if(DestSpaceId == TransformPair[i].Space[0] 
 			&& SrcSpaceId == TransformPair[i].Space[1])
-		{
-			Trans->NumStages = 1;
-			Trans->Fun[0] = TransformPair[i].Fun[1];
-			return 1;
-		}
+			return AppendStage(Trans, i, 1);
 	}
 	
 	/* Search the TransformPair table for a two-stage transformation */
@@ -1157,30 +1742,506 @@ int GetColorTransform(colortransform *Trans, const char *TransformString)
 			{
 				if(DestSpaceId == TransformPair[j].Space[1]
 					&& TransformPair[i].Space[0] == TransformPair[j].Space[0])
-				{
-					Trans->NumStages = 2;
-					Trans->Fun[0] = TransformPair[i].Fun[1];
-					Trans->Fun[1] = TransformPair[j].Fun[0];
-					return 1;
-				}
+					return AppendStage(Trans, i, 1)
+						&& AppendStage(Trans, j, 0);
 			}
 		else if(DestSpaceId == TransformPair[i].Space[1])
 			for(j = 0; j < i; j++)
 			{
 				if(SrcSpaceId == TransformPair[j].Space[1]
 					&& TransformPair[j].Space[0] == TransformPair[i].Space[0])
-				{
-					Trans->NumStages = 2;
-					Trans->Fun[0] = TransformPair[j].Fun[1];
-					Trans->Fun[1] = TransformPair[i].Fun[0];
-					return 1;
-				}
+					return AppendStage(Trans, j, 1)
+						&& AppendStage(Trans, i, 0);
 			}
 	
 	return 0;
 }
 
 
+/**
+ * @brief Parse a transform string into colorspace IDs
+ *
+ * @param SpaceId array to hold the IDs, ordered from source to destination
+ * @param TransformString string as described for GetColorTransform
+ * @return number of IDs, or 0 on failure
+ */
+static int ParseTransformString(int SpaceId[MAX_CHAIN_SPACES], 
+	const char *TransformString)
+{
+	int Id[MAX_CHAIN_SPACES], NumSpaces = 0, NumChars = 0, i;
+	char Space[16], Arrow = 0, c;
+	
+	
+	do
+	{
+		c = *(TransformString++);	/* Read the next character */
+		
+		if(!c || c == '<' || c == '>')
+		{
+			/* The arrows should all point the same way */
+			if((c && Arrow && c != Arrow) || NumSpaces == MAX_CHAIN_SPACES)
+				return 0;
+			
+			Space[NumChars] = 0;
+			NumChars = 0;
+			
+			/* Convert the name to colorspace enum */
+			if((Id[NumSpaces++] = IdFromName(Space)) == UNKNOWN_SPACE)
+				return 0;
+			
+			if(c)
+				Arrow = c;
+		}
+		else if(c != ' ' && c != '-' && c != '=')
+		{	/* Append the character to the current name */
+			if(NumChars < 15)
+				Space[NumChars++] = tolower(c);
+		}
+	}while(c);
+	
+	/* A lone name is the destination, with sRGB as the source */
+	if(NumSpaces == 1)
+		Id[NumSpaces++] = RGB_SPACE;
+	
+	for(i = 0; i < NumSpaces; i++)
+		SpaceId[i] = (Arrow == '>') ? Id[i] : Id[NumSpaces - 1 - i];
+	
+	return NumSpaces;
+}
+
+
+/**
+ * @brief Given a transform string, returns a colortransform struct
+ *
+ * @param Trans a colortransform pointer to hold the transform
+ * @param TransformString string specifying the transformations
+ * @return 1 on success, 0 on failure
+ * 
+ * This function provides a convenient interface to the collection of transform
+ * functions in this file.  TransformString specifies the source and 
+ * destination color spaces, 
+ *    TransformString = "dest<-src" 
+ * or alternatively,
+ *    TransformString = "src->dest".
+ *
+ * Supported color spaces are
+ *    "RGB"             sRGB Red Green Blue (ITU-R BT.709 gamma-corrected),
+ *    "YPbPr"           Luma (ITU-R BT.601) + Chroma,
+ *    "YCbCr"           Luma + Chroma ("digitized" version of Y'PbPr),
+ *    "JPEG-YCbCr"      Luma + Chroma space used in JFIF JPEG,
+ *    "YUV"             NTSC PAL Y'UV Luma + Chroma,
+ *    "YIQ"             NTSC Y'IQ Luma + Chroma,
+ *    "YDbDr"           SECAM Y'DbDr Luma + Chroma,
+ *    "HSV" or "HSB"    Hue Saturation Value/Brightness,
+ *    "HSL" or "HLS"    Hue Saturation Luminance,
+ *    "HSI"             Hue Saturation Intensity,
+ *    "XYZ"             CIE XYZ,
+ *    "Lab"             CIE L*a*b* (CIELAB),
+ *    "Luv"             CIE L*u*v* (CIELUV),
+ *    "LCH"             CIE L*C*H* (CIELCH),
+ *    "CAT02 LMS"       CIE CAT02 LMS.
+ * Color space names are case-insensitive and spaces are ignored.  When sRGB
+ * is the source or destination, it can be omitted.  For example "yuv<-" is 
+ * short for "yuv<-rgb".
+ *
+ * Longer chains are written with more arrows, as in "rgb->yuv->rgb->ycbcr",
+ * with up to COLOR_MAX_STAGES stages in all.  Consecutive linear stages, such
+ * as the transformations among sRGB, Y'UV, Y'CbCr, Y'PbPr, Y'DbDr, and Y'IQ
+ * or between XYZ and CAT02 LMS, are folded into one matrix, so that a chain
+ * costs no more than its nonlinear stages.  The matrices of sRGB <-> XYZ
+ * fold with their neighbors on the linear RGB side.
+ *
+ * The routine returns a colortransform structure representing the transform.
+ * The transform is performed by calling GetColorTransform.  For example,
+@code
+       num S[3] = {173, 0.8, 0.5};
+       num D[3];
+       colortransform Trans;
+       
+       if(!(GetColorTransform(&Trans, "HSI -> Lab")))
+       {
+           printf("Invalid syntax or unknown color space\n");
+           return;
+       }   
+       
+       ApplyColorTransform(&Trans, &D[0], &D[1], &D[2], S[0], S[1], S[2]);
+@endcode
+ */
+int GetColorTransform(colortransform *Trans, const char *TransformString)
+{
+	int SpaceId[MAX_CHAIN_SPACES], NumSpaces, i;
+	
+	
+	Trans->NumStages = 0;
+	
+	if(!(NumSpaces = ParseTransformString(SpaceId, TransformString)))
+		return 0;	/* Return failure */
+	
+	/* Append the stages from source to destination */
+	for(i = 1; i < NumSpaces; i++)
+		if(!AppendRoute(Trans, SpaceId[i - 1], SpaceId[i]))
+		{
+			Trans->NumStages = 0;
+			return 0;
+		}
+	
+	return 1;
+}
+
+
+/*
+ * == White points and chromatic adaptation ==
+ *
+ * GetColorTransformWhite converts colors seen under one white point to the
+ * corresponding colors under another.  The source is converted to XYZ, which
+ * is adapted by a von Kries-type transform in the cone space of a matrix M,
+ *    XYZ' = inv(M) diag((M DestWhite)./(M SrcWhite)) M XYZ,
+ * and then converted to the destination.  L*a*b* and LCH are taken relative
+ * to the white point of their side by scaling XYZ by the ratio of that white
+ * to the reference white of colorspace.h, which is exact since they depend on
+ * X/Xn, Y/Yn, and Z/Zn only.  L*u*v* depends on the chromaticity u'n v'n of
+ * the white, which no scaling of XYZ reproduces, so it is supported only
+ * under the reference white.
+ *
+ * All of these maps are linear, so the planner folds them into one matrix
+ * together with the matrix of sRGB <-> XYZ and any other linear neighbor.
+ * The matrix is computed once by GetColorTransformWhite and kept in the
+ * colortransform, so that an adapted conversion costs about the same as a
+ * conversion under D65.
+ */
+
+/** @brief Cone response matrices M of the chromatic adaptation methods */
+static const num AdaptationCone[4][3][3] = {
+	/* XYZ scaling */
+	{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+	/* von Kries, Hunt-Pointer-Estevez cones normalized to D65 */
+	{{0.40024, 0.70760, -0.08081}, {-0.22630, 1.16532, 0.04570}, 
+		{0, 0, 0.91822}},
+	/* Bradford */
+	{{0.8951, 0.2664, -0.1614}, {-0.7502, 1.7135, 0.0367}, 
+		{0.0389, -0.0685, 1.0296}},
+	/* CAT02 */
+	{{0.7328, 0.4296, -0.1624}, {-0.7036, 1.6975, 0.0061}, 
+		{0.0030, 0.0136, 0.9834}}
+	};
+
+#define NUM_WHITE_POINTS	10
+
+/** @brief XYZ of the CIE standard illuminants, two degree observer */
+static const struct
+{
+	const char *Name;
+	num White[3];
+} WhitePoint[NUM_WHITE_POINTS] = {
+	{"a", {1.09850, 1.0, 0.35585}},
+	{"c", {0.98074, 1.0, 1.18232}},
+	{"d50", {0.96422, 1.0, 0.82521}},
+	{"d55", {0.95682, 1.0, 0.92149}},
+	{"d65", {WHITEPOINT_X, WHITEPOINT_Y, WHITEPOINT_Z}},
+	{"d75", {0.94972, 1.0, 1.22638}},
+	{"e", {1.0, 1.0, 1.0}},
+	{"f2", {0.99187, 1.0, 0.67395}},
+	{"f7", {0.95044, 1.0, 1.08755}},
+	{"f11", {1.00966, 1.0, 0.64370}}
+	};
+
+
+/** @brief Convert a name to lower case without spaces, '-', or '=' */
+static void NormalizeName(char Dest[16], const char *Src)
+{
+	int NumChars = 0;
+	
+	
+	for(; *Src; Src++)
+		if(*Src != ' ' && *Src != '-' && *Src != '=' && NumChars < 15)
+			Dest[NumChars++] = tolower(*Src);
+	
+	Dest[NumChars] = 0;
+}
+
+
+/**
+ * @brief Get the XYZ of a CIE standard illuminant
+ *
+ * @param White array to hold the XYZ, normalized to Y = 1
+ * @param Name "A", "C", "D50", "D55", "D65", "D75", "E", "F2", "F7", or "F11"
+ * @return 1 on success, 0 if the name is unknown
+ */
+int GetWhitePoint(num White[3], const char *Name)
+{
+	char Buf[16];
+	int i;
+	
+	
+	NormalizeName(Buf, Name);
+	
+	for(i = 0; i < NUM_WHITE_POINTS; i++)
+		if(!strcmp(Buf, WhitePoint[i].Name))
+		{
+			White[0] = WhitePoint[i].White[0];
+			White[1] = WhitePoint[i].White[1];
+			White[2] = WhitePoint[i].White[2];
+			return 1;
+		}
+	
+	return 0;
+}
+
+
+/**
+ * @brief Convert a chromatic adaptation method name to its COLOR_ADAPT_ ID
+ *
+ * @param Name "XYZ scaling", "von Kries", "Bradford", or "CAT02"
+ * @return the ID, or -1 if the name is unknown
+ */
+int GetAdaptationMethod(const char *Name)
+{
+	char Buf[16];
+	
+	
+	NormalizeName(Buf, Name);
+	
+	if(!strcmp(Buf, "xyzscaling") || !strcmp(Buf, "xyz"))
+		return COLOR_ADAPT_XYZ_SCALING;
+	else if(!strcmp(Buf, "vonkries"))
+		return COLOR_ADAPT_VON_KRIES;
+	else if(!strcmp(Buf, "bradford"))
+		return COLOR_ADAPT_BRADFORD;
+	else if(!strcmp(Buf, "cat02"))
+		return COLOR_ADAPT_CAT02;
+	else
+		return -1;
+}
+
+
+/** @brief Invert a 3x3 matrix, returning 0 if it is singular */
+static int Invert3x3(num Inv[3][3], const num A[3][3])
+{
+	num Det;
+	int i, j;
+	
+	
+	/* Cofactors, transposed */
+	for(i = 0; i < 3; i++)
+		for(j = 0; j < 3; j++)
+			Inv[j][i] = A[(i + 1) % 3][(j + 1) % 3]*A[(i + 2) % 3][(j + 2) % 3]
+				- A[(i + 1) % 3][(j + 2) % 3]*A[(i + 2) % 3][(j + 1) % 3];
+	
+	Det = A[0][0]*Inv[0][0] + A[0][1]*Inv[1][0] + A[0][2]*Inv[2][0];
+	
+	if(Det == 0)
+		return 0;
+	
+	for(i = 0; i < 3; i++)
+		for(j = 0; j < 3; j++)
+			Inv[i][j] /= Det;
+	
+	return 1;
+}
+
+
+/** @brief Is a space defined relative to the white point? */
+#define IS_WHITE_RELATIVE(SpaceId)	((SpaceId) == LAB_SPACE \
+	|| (SpaceId) == LUV_SPACE || (SpaceId) == LCH_SPACE)
+
+/**
+ * @brief Get a color transform between spaces under different white points
+ *
+ * @param Trans a colortransform pointer to hold the transform
+ * @param TransformString "dest<-src" or "src->dest" as for GetColorTransform
+ * @param SrcWhite, DestWhite XYZ of the white points of source and destination
+ * @param Method chromatic adaptation, COLOR_ADAPT_XYZ_SCALING, 
+ *    COLOR_ADAPT_VON_KRIES, COLOR_ADAPT_BRADFORD, or COLOR_ADAPT_CAT02
+ * @return 1 on success, 0 on failure
+ *
+ * The transform fails if L*u*v* is the source or destination and its white
+ * is not the reference white of colorspace.h.  For example, the following
+ * converts L*a*b* relative to D50 to sRGB:
+@code
+       num D50[3], D65[3];
+       
+       GetWhitePoint(D50, "D50");
+       GetWhitePoint(D65, "D65");
+       GetColorTransformWhite(&Trans, "Lab -> RGB", D50, D65, 
+           COLOR_ADAPT_BRADFORD);
+@endcode
+ * TransformString should name only the source and destination.
+ */
+int GetColorTransformWhite(colortransform *Trans, const char *TransformString,
+	const num SrcWhite[3], const num DestWhite[3], int Method)
+{
+	const num RefWhite[3] = {WHITEPOINT_X, WHITEPOINT_Y, WHITEPOINT_Z};
+	num Inv[3][3], Src[3], Dest[3], SrcScale[3], DestScale[3];
+	colormatrix Adapt;
+	int SpaceId[MAX_CHAIN_SPACES], SameWhite = 1, SrcRef = 1, DestRef = 1;
+	int i, j, k;
+	
+	
+	Trans->NumStages = 0;
+	
+	if(Method < COLOR_ADAPT_XYZ_SCALING || Method > COLOR_ADAPT_CAT02
+		|| ParseTransformString(SpaceId, TransformString) != 2
+		|| !Invert3x3(Inv, AdaptationCone[Method]))
+		return 0;
+	
+	for(i = 0; i < 3; i++)
+	{
+		/* Cone responses of the white points */
+		Src[i] = Dest[i] = 0;
+		
+		for(k = 0; k < 3; k++)
+		{
+			Src[i] += AdaptationCone[Method][i][k]*SrcWhite[k];
+			Dest[i] += AdaptationCone[Method][i][k]*DestWhite[k];
+		}
+		
+		if(!(Src[i] > 0 && Dest[i] > 0))
+			return 0;
+		
+		SameWhite &= (SrcWhite[i] == DestWhite[i]);
+		SrcRef &= (SrcWhite[i] == RefWhite[i]);
+		DestRef &= (DestWhite[i] == RefWhite[i]);
+		SrcScale[i] = (IS_WHITE_RELATIVE(SpaceId[0])) ? 
+			SrcWhite[i]/RefWhite[i] : 1;
+		DestScale[i] = (IS_WHITE_RELATIVE(SpaceId[1])) ? 
+			RefWhite[i]/DestWhite[i] : 1;
+	}
+	
+	/* L*u*v* cannot be rescaled to another white */
+	if((SpaceId[0] == LUV_SPACE && !SrcRef)
+		|| (SpaceId[1] == LUV_SPACE && !DestRef))
+		return 0;
+	
+	/* Adapt = diag(DestScale) inv(M) diag(Dest./Src) M diag(SrcScale) */
+	for(i = 0; i < 3; i++)
+	{
+		for(j = 0; j < 3; j++)
+			if(!SameWhite)
+			{
+				for(k = 0, Adapt.M[i][j] = 0; k < 3; k++)
+					Adapt.M[i][j] += Inv[i][k]*(Dest[k]/Src[k])
+						*AdaptationCone[Method][k][j];
+				
+				Adapt.M[i][j] *= DestScale[i]*SrcScale[j];
+			}
+			else if(i != j)
+				Adapt.M[i][j] = 0;
+			else	/* The scalings cancel if both sides are relative */
+				Adapt.M[i][j] = (IS_WHITE_RELATIVE(SpaceId[0])
+					&& IS_WHITE_RELATIVE(SpaceId[1])) ? 1 
+					: DestScale[i]*SrcScale[j];
+		
+		Adapt.M[i][3] = 0;
+	}
+	
+	Adapt.Linearize = Adapt.GammaCorrect = Adapt.Fast = 0;
+	
+	/* With nothing to adapt, this is the transform of GetColorTransform */
+	if(SameWhite && Adapt.M[0][0] == 1 && Adapt.M[1][1] == 1 
+		&& Adapt.M[2][2] == 1)
+	{
+		if(AppendRoute(Trans, SpaceId[0], SpaceId[1]))
+			return 1;
+	}
+	else if(AppendRoute(Trans, SpaceId[0], XYZ_SPACE) 
+		&& AppendMatrix(Trans, &Adapt)
+		&& AppendRoute(Trans, XYZ_SPACE, SpaceId[1]))
+		return 1;
+	
+	Trans->NumStages = 0;
+	return 0;
+}
+
+
+/**
+ * @brief Use the fast block routines in a colortransform
+ *
+ * @param Trans a colortransform created by GetColorTransform
+ * @return 1 if the fast routines are available, 0 otherwise
+ *
+ * Stages of the sRGB, XYZ, L*a*b*, and L*u*v* family are switched to the
+ * vectorized routines of the "Fast transformations" section, which differ from
+ * the exact ones by about 1e-11, as are the sRGB linearization and gamma
+ * correction of colormatrix stages.  Only the planar interfaces
+ * ApplyColorTransformPlanar and ApplyColorTransformPlanarf use them;
+ * ApplyColorTransform stays exact.  The
+ * routines are compiled only by C99 compilers.
+ */
+int SetColorTransformFast(colortransform *Trans)
+{
+#ifdef COLOR_FAST_KERNELS
+	int Stage, i;
+	
+	
+	for(Stage = 0; Stage < Trans->NumStages; Stage++)
+	{
+		if(!Trans->Fun[Stage])
+			Trans->Matrix[Stage].Fast = 1;
+		
+		for(i = 0; i < NUM_FAST_TRANSFORMS; i++)
+			if(Trans->BlockFun[Stage] == FastTransform[i].Exact)
+			{
+				Trans->BlockFun[Stage] = FastTransform[i].Fast;
+				Trans->BlockFunf[Stage] = FastTransform[i].Fastf;
+				break;
+			}
+	}
+	
+	return 1;
+#else
+	(void)Trans;
+	return 0;
+#endif
+}
+
+
+/**
+ * @brief Set the threads used by the planar routines
+ *
+ * @param NumThreads number of threads, or 0 for the OpenMP default
+ * @param ParallelSize minimum number of pixels for which threads are used
+ * @return 1 if compiled with OpenMP, 0 otherwise
+ *
+ * The setting applies to ApplyColorTransformPlanar, ApplyColorLutPlanar, and
+ * their float and integer versions.  Images smaller than ParallelSize pixels,
+ * COLOR_PARALLEL_SIZE by default, are converted on the calling thread, where
+ * starting threads would cost more than it saves.  Each thread converts a
+ * contiguous run of blocks of COLOR_BLOCK_SIZE pixels, whose buffers stay in
+ * the first-level cache.  This routine should not be called while a
+ * conversion is running.
+ */
+int SetColorThreads(int NumThreads, long ParallelSize)
+{
+	ColorNumThreads = MAX(NumThreads, 0);
+	ColorParallelSize = MAX(ParallelSize, 1);
+#ifdef _OPENMP
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+
+/**
+ * @brief Number of threads the planar routines use for an image
+ *
+ * @param NumPixels number of pixels in the image
+ * @return number of threads, 1 without OpenMP or below the parallel size
+ *
+ * For routines built on the planar ones, such as ColorDifferencePlanar, to
+ * follow the setting of SetColorThreads.
+ */
+int GetColorThreads(long NumPixels)
+{
+#ifdef _OPENMP
+	return (NumPixels >= ColorParallelSize) ? COLOR_NUM_THREADS : 1;
+#else
+	(void)NumPixels;
+	return 1;
+#endif
+}
+
+
 /**
  * @brief Apply a colortransform 
  *
@@ -1188,61 +2249,614 @@ int GetColorTransform(colortransform *Trans, const char *TransformString)
  * @param D0, D1, D2 pointers to hold the result
  * @param S0, S1, S2 the input values
  */
-void ApplyColorTransform(colortransform Trans, 
+void ApplyColorTransform(const colortransform *Trans,
 	num *D0, num *D1, num *D2, num S0, num S1, num S2)
 {
-	switch(Trans.NumStages)
+	int Stage;
+	
+	
+	*D0 = S0;
+	*D1 = S1;
+	*D2 = S2;
+	
+	for(Stage = 0; Stage < Trans->NumStages; Stage++)
+		if(Trans->Fun[Stage])
+			Trans->Fun[Stage](D0, D1, D2, *D0, *D1, *D2);
+		else
+			ColorMatrixPixel(&Trans->Matrix[Stage], D0, D1, D2, *D0, *D1, *D2);
+}
+
+
+/*
+ * == Integer input ==
+ *
+ * 8- and 16-bit images are read through tables of 256 or 65536 entries that
+ * map each code value k to k/255 or k/65535, so that integer input costs one
+ * lookup per channel.  When the transform linearizes sRGB on its way to XYZ,
+ * or starts with a colormatrix stage that linearizes, the tables hold
+ * INVGAMMACORRECTION(k/255) or INVGAMMACORRECTION(k/65535) instead, and the
+ * block goes directly to the matrix, so that no pixel evaluates pow.  The
+ * results agree with double input divided by 255 or 65535 to rounding but
+ * not bit for bit, as the table and matrix stages evaluate the same formulas
+ * in a different order.  Under -Ofast they differ by up to about 1e-10.
+ * The tables are filled once, on first use, inside a named OpenMP critical
+ * section that later calls do not enter.
+ */
+
+/** @brief Transforms from sRGB through XYZ and their stages after XYZ */
+static const struct
+{
+	colorblockfun Block;
+	colorblockfun FromXyz;
+} LinearizedTransform[] = {
+	{Rgb2XyzBlock, NULL},
+	{Rgb2LabBlock, Xyz2LabBlock},
+	{Rgb2LuvBlock, Xyz2LuvBlock},
+	{Rgb2LchBlock, Xyz2LchBlock},
+	{Rgb2Cat02lmsBlock, Xyz2Cat02lmsBlock}
+#ifdef COLOR_FAST_KERNELS
+	,
+	{Rgb2XyzFastBlock, NULL},
+	{Rgb2LabFastBlock, Xyz2LabFastBlock},
+	{Rgb2LuvFastBlock, Xyz2LuvFastBlock}
+#endif
+	};
+
+/** @brief Normalized [0] and linearized [1] tables of 8-bit code values */
+static num IntegerTable8[2][256];
+
+/** @brief Normalized [0] and linearized [1] tables of 16-bit code values */
+static num IntegerTable16[2][65536];
+
+static int IntegerTable8Filled = 0;
+static int IntegerTable16Filled = 0;
+
+
+/** @brief Fill the normalized and linearized tables of NumValues codes */
+static void FillIntegerTables(num *Normalized, num *Linearized, long NumValues)
+{
+	num t;
+	long k;
+	
+	
+	for(k = 0; k < NumValues; k++)
 	{
-	case 1:
-		Trans.Fun[0](D0, D1, D2, S0, S1, S2);
-		break;
-	case 2:
+		t = (num)k/(num)(NumValues - 1);
+		Normalized[k] = t;
+		Linearized[k] = (num)(INVGAMMACORRECTION(t));
+	}
+}
+
+
+/** @brief Fill the tables of NumValues codes unless Filled is set */
+static void FillIntegerTablesOnce(int *Filled,
+	num *Normalized, num *Linearized, long NumValues)
+{
+	/* Only the first calls, which find the flag unset, take the lock */
+	if(*Filled)
+		return;
+	
+#ifdef _OPENMP
+#pragma omp critical(ColorIntegerTables)
+#endif
+	if(!*Filled)
+	{
+		FillIntegerTables(Normalized, Linearized, NumValues);
+#ifdef _OPENMP
+#pragma omp flush
+#endif
+		*Filled = 1;
+	}
+}
+
+
+/**
+ * @brief Apply a colortransform to planar 8- or 16-bit arrays
+ *
+ * Src points to unsigned char if Bits is 8 and to unsigned short if Bits is
+ * 16, and Normalized and Linearized are the tables of their code values.
+ */
+static void ApplyColorTransformInteger(const colortransform *Trans,
+	num *Dest[3], long DestStride, const void *Src[3], long SrcStride,
+	long NumPixels, int Bits, const num *Normalized, const num *Linearized)
+{
+	colorblockfun Stage[COLOR_MAX_STAGES + 1];
+	colormatrix Matrix[COLOR_MAX_STAGES + 1];
+	const num *Table;
+	long NumBlocks = (NumPixels + COLOR_BLOCK_SIZE - 1)/COLOR_BLOCK_SIZE;
+	long Block;
+	int NumStages = 0, Linearize = 0, Pair, t;
+	
+	
+	/* Replace the linearization by the table where possible */
+	if(Trans->NumStages && !Trans->BlockFun[0] && Trans->Matrix[0].Linearize)
+	{
+		Linearize = 1;
+		Stage[NumStages] = NULL;
+		Matrix[NumStages] = Trans->Matrix[0];
+		Matrix[NumStages++].Linearize = 0;
+	}
+	else if(Trans->NumStages)
+		for(Pair = 0; Pair < (int)(sizeof(LinearizedTransform)
+			/sizeof(*LinearizedTransform)); Pair++)
+			if(Trans->BlockFun[0] == LinearizedTransform[Pair].Block)
+			{
+				Linearize = 1;
+				Stage[NumStages] = NULL;
+				GetLinearMatrix(&Matrix[NumStages], Rgb2Xyz);
+				Matrix[NumStages++].Linearize = 0;
+				
+				if(LinearizedTransform[Pair].FromXyz)
+					Stage[NumStages++] = LinearizedTransform[Pair].FromXyz;
+				
+				break;
+			}
+	
+	for(t = Linearize; t < Trans->NumStages; t++)
+	{
+		Stage[NumStages] = Trans->BlockFun[t];
+		Matrix[NumStages++] = Trans->Matrix[t];
+	}
+	
+	Table = (Linearize) ? Linearized : Normalized;
+	
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if(NumPixels >= ColorParallelSize) \
+	num_threads(COLOR_NUM_THREADS)
+#endif
+	for(Block = 0; Block < NumBlocks; Block++)
+	{
+		num Buf[2][3][COLOR_BLOCK_SIZE];
+		const num *In[3];
+		num *Out[3];
+		long Start = Block*COLOR_BLOCK_SIZE;
+		int N = (int)MIN(NumPixels - Start, COLOR_BLOCK_SIZE);
+		int s, Channel, i;
+		
+		
+		for(Channel = 0; Channel < 3; Channel++)
 		{
-			num T0, T1, T2;
-			Trans.Fun[0](&T0, &T1, &T2, S0, S1, S2);
-			Trans.Fun[1](D0, D1, D2, T0, T1, T2);
+			if(Bits == 8)
+				for(i = 0; i < N; i++)
+					Buf[0][Channel][i] = Table[((const unsigned char *)
+						Src[Channel])[(Start + i)*SrcStride]];
+			else
+				for(i = 0; i < N; i++)
+					Buf[0][Channel][i] = Table[((const unsigned short *)
+						Src[Channel])[(Start + i)*SrcStride]];
+			
+			In[Channel] = Buf[0][Channel];
 		}
-		break;
-	default:
-		*D0 = S0;
-		*D1 = S1;
-		*D2 = S2;
-		break;
+		
+		for(s = 0; s < NumStages; s++)
+		{
+			/* The last stage writes to contiguous outputs directly */
+			for(Channel = 0; Channel < 3; Channel++)
+				Out[Channel] = (s == NumStages - 1 && DestStride == 1) ?
+					Dest[Channel] + Start : Buf[(s + 1) % 2][Channel];
+			
+			if(Stage[s])
+				Stage[s](Out[0], Out[1], Out[2], In[0], In[1], In[2], N);
+			else
+				ApplyColorMatrix(&Matrix[s],
+					Out[0], Out[1], Out[2], In[0], In[1], In[2], N);
+			
+			for(Channel = 0; Channel < 3; Channel++)
+				In[Channel] = Out[Channel];
+		}
+		
+		if(!NumStages || DestStride != 1)
+			for(Channel = 0; Channel < 3; Channel++)
+				for(i = 0; i < N; i++)
+					Dest[Channel][(Start + i)*DestStride] = In[Channel][i];
+	}
+}
+
+
+/**
+ * @brief Apply a colortransform to planar 8-bit arrays
+ *
+ * Same as ApplyColorTransformPlanar, with code values 0 to 255 standing for
+ * 0 to 1.  Safe to call concurrently from OpenMP threads.
+ */
+void ApplyColorTransformPlanaru8(const colortransform *Trans,
+	num *Dest[3], long DestStride, const unsigned char *Src[3], long SrcStride,
+	long NumPixels)
+{
+	const void *Data[3];
+	
+	
+	FillIntegerTablesOnce(&IntegerTable8Filled,
+		IntegerTable8[0], IntegerTable8[1], 256);
+	Data[0] = Src[0];
+	Data[1] = Src[1];
+	Data[2] = Src[2];
+	ApplyColorTransformInteger(Trans, Dest, DestStride, Data, SrcStride,
+		NumPixels, 8, IntegerTable8[0], IntegerTable8[1]);
+}
+
+
+/**
+ * @brief Apply a colortransform to planar 16-bit arrays
+ *
+ * Same as ApplyColorTransformPlanar, with code values 0 to 65535 standing for
+ * 0 to 1.  Safe to call concurrently from OpenMP threads.
+ */
+void ApplyColorTransformPlanaru16(const colortransform *Trans,
+	num *Dest[3], long DestStride, const unsigned short *Src[3], long SrcStride,
+	long NumPixels)
+{
+	const void *Data[3];
+	
+	
+	FillIntegerTablesOnce(&IntegerTable16Filled,
+		IntegerTable16[0], IntegerTable16[1], 65536);
+	Data[0] = Src[0];
+	Data[1] = Src[1];
+	Data[2] = Src[2];
+	ApplyColorTransformInteger(Trans, Dest, DestStride, Data, SrcStride,
+		NumPixels, 16, IntegerTable16[0], IntegerTable16[1]);
+}
+
+
+/*
+ * == 3D lookup tables ==
+ *
+ * A colorlut samples a chain of transforms on a Size x Size x Size grid and
+ * interpolates between the nodes, so that its cost per pixel is the same for
+ * any chain.  Each input channel first goes through a shaper table that maps
+ * [Min, Max] to grid coordinates along the curve t^(1/ShaperGamma).  Gamma 1
+ * spaces the nodes evenly, and larger values put more of them at the dark
+ * end, as suits linear or HDR input.  The nodes are placed at the exact
+ * inverse of the interpolated shaper, so that the table is exact at nodes.
+ */
+
+/** @brief Apply a chain of transforms in place to planar arrays */
+static void ApplyColorChain(const colortransform *Chain, int NumTransforms,
+	num *Plane, long NumPixels)
+{
+	const num *Src[3];
+	num *Dest[3];
+	int Channel, t;
+	
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		Src[Channel] = Dest[Channel] = Plane + Channel*NumPixels;
+	
+	for(t = 0; t < NumTransforms; t++)
+		ApplyColorTransformPlanar(&Chain[t], Dest, 1, Src, 1, NumPixels);
+}
+
+
+/** @brief Normalized input of a grid coordinate under a shaper table */
+static num InvertShaper(const float *Shaper, num u)
+{
+	int Low = 0, High = COLOR_LUT_SHAPER_SIZE - 1, Mid;
+	
+	
+	/* Find the interval [Shaper[Low], Shaper[Low + 1]] that contains u */
+	while(High - Low > 1)
+	{
+		Mid = (Low + High)/2;
+		
+		if(Shaper[Mid] <= u)
+			Low = Mid;
+		else
+			High = Mid;
 	}
+	
+	return (Low + (u - Shaper[Low])/(Shaper[High] - Shaper[Low]))
+		/(COLOR_LUT_SHAPER_SIZE - 1);
+}
+
+
+/**
+ * @brief Bake a chain of color transforms into a 3D lookup table
+ *
+ * @param Lut the colorlut to fill, to be released with FreeColorLut
+ * @param Chain array of colortransforms, applied in order
+ * @param NumTransforms number of elements in Chain
+ * @param Size number of grid nodes along each axis, e.g. 33 or 65
+ * @param Min, Max range of each input channel
+ * @param ShaperGamma exponent of the shaper curve, 1 for an even grid
+ * @return 1 on success, 0 on invalid arguments or failed allocation
+ */
+int BakeColorLut(colorlut *Lut, const colortransform *Chain, int NumTransforms,
+	int Size, const num Min[3], const num Max[3], num ShaperGamma)
+{
+	num *Node, *Plane;
+	long NumNodes, n;
+	int Channel, i, j, k;
+	
+	
+	Lut->Shaper = NULL;
+	Lut->Table = NULL;
+	
+	if(Size < 2 || !(ShaperGamma > 0))
+		return 0;
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		if(!(Max[Channel] > Min[Channel]))
+			return 0;
+	
+	NumNodes = (long)Size*Size*Size;
+	Lut->Shaper = (float *)malloc(sizeof(float)*3*COLOR_LUT_SHAPER_SIZE);
+	Lut->Table = (float *)malloc(sizeof(float)*3*NumNodes);
+	Node = (num *)malloc(sizeof(num)*3*Size);
+	Plane = (num *)malloc(sizeof(num)*3*NumNodes);
+	
+	if(!Lut->Shaper || !Lut->Table || !Node || !Plane)
+	{
+		FreeColorLut(Lut);
+		free(Node);
+		free(Plane);
+		return 0;
+	}
+	
+	Lut->Size = Size;
+	Lut->ShaperGamma = ShaperGamma;
+	
+	for(Channel = 0; Channel < 3; Channel++)
+	{
+		Lut->Min[Channel] = Min[Channel];
+		Lut->Max[Channel] = Max[Channel];
+		
+		for(i = 0; i < COLOR_LUT_SHAPER_SIZE; i++)
+			Lut->Shaper[Channel*COLOR_LUT_SHAPER_SIZE + i] = (float)((Size - 1)
+				*pow((num)i/(COLOR_LUT_SHAPER_SIZE - 1), 1/ShaperGamma));
+		
+		for(i = 0; i < Size; i++)
+			Node[Channel*Size + i] = Min[Channel] + (Max[Channel] - Min[Channel])
+				*InvertShaper(Lut->Shaper + Channel*COLOR_LUT_SHAPER_SIZE, i);
+	}
+	
+	/* Evaluate the chain at the grid nodes */
+	for(k = 0, n = 0; k < Size; k++)
+		for(j = 0; j < Size; j++)
+			for(i = 0; i < Size; i++, n++)
+			{
+				Plane[n] = Node[i];
+				Plane[NumNodes + n] = Node[Size + j];
+				Plane[2*NumNodes + n] = Node[2*Size + k];
+			}
+	
+	ApplyColorChain(Chain, NumTransforms, Plane, NumNodes);
+	
+	for(n = 0; n < NumNodes; n++)
+		for(Channel = 0; Channel < 3; Channel++)
+			Lut->Table[3*n + Channel] = (float)Plane[Channel*NumNodes + n];
+	
+	free(Node);
+	free(Plane);
+	return 1;
+}
+
+
+/** @brief Release the tables of a colorlut */
+void FreeColorLut(colorlut *Lut)
+{
+	free(Lut->Shaper);
+	free(Lut->Table);
+	Lut->Shaper = NULL;
+	Lut->Table = NULL;
+}
+
+
+/**
+ * @brief Measure the error of a colorlut against its transforms
+ *
+ * @param Report a colorlutreport to hold the errors of each output channel
+ * @param Lut colorlut created by BakeColorLut
+ * @param Chain, NumTransforms the transforms Lut was baked from
+ * @param NumSamples number of test colors
+ * @return 1 on success, 0 on failed allocation
+ *
+ * Test colors are drawn uniformly in the shaped coordinates, which is to say
+ * in proportion to the density of the grid, with a fixed seed so that reports
+ * are reproducible.  Errors are absolute, in the units of the output space.
+ */
+int GetColorLutAccuracy(colorlutreport *Report, const colorlut *Lut,
+	const colortransform *Chain, int NumTransforms, long NumSamples)
+{
+	num *Exact = (num *)malloc(sizeof(num)*3*NumSamples);
+	num *Approx = (num *)malloc(sizeof(num)*3*NumSamples);
+	const num *Src[3];
+	num *Dest[3];
+	unsigned long Seed = 1;
+	num Error;
+	long n;
+	int Channel;
+	
+	
+	if(!Exact || !Approx || NumSamples <= 0)
+	{
+		free(Exact);
+		free(Approx);
+		return 0;
+	}
+	
+	for(Channel = 0; Channel < 3; Channel++)
+		for(n = 0; n < NumSamples; n++)
+		{
+			Seed = (Seed*1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+			Exact[Channel*NumSamples + n] = Lut->Min[Channel] 
+				+ (Lut->Max[Channel] - Lut->Min[Channel])
+				*pow((Seed >> 8)/16777215.0, Lut->ShaperGamma);
+		}
+	
+	for(Channel = 0; Channel < 3; Channel++)
+	{
+		Src[Channel] = Exact + Channel*NumSamples;
+		Dest[Channel] = Approx + Channel*NumSamples;
+	}
+	
+	ApplyColorLutPlanar(Lut, Dest, 1, Src, 1, NumSamples);
+	ApplyColorChain(Chain, NumTransforms, Exact, NumSamples);
+	
+	for(Channel = 0; Channel < 3; Channel++)
+	{
+		Report->MaxError[Channel] = 0;
+		Report->MeanError[Channel] = 0;
+		
+		for(n = 0; n < NumSamples; n++)
+		{
+			Error = fabs(Approx[Channel*NumSamples + n] 
+				- Exact[Channel*NumSamples + n]);
+			Report->MaxError[Channel] = MAX(Report->MaxError[Channel], Error);
+			Report->MeanError[Channel] += Error;
+		}
+		
+		Report->MeanError[Channel] /= NumSamples;
+	}
+	
+	free(Exact);
+	free(Approx);
+	return 1;
 }
 
 
 /* The code below allows this file to be compiled as a MATLAB MEX function.  
  * From MATLAB, the calling syntax is
  *    B = colorspace('dest<-src', A);
- * See colorspace.m for details.
+ *    [B, Report] = colorspace('dest<-src', A, Options);
+ * See colorspace.m for details.  A may be double or single, and B has the
+ * same class, or A may be uint8 or uint16 with values scaled to [0,1], and B
+ * is double.  The optional Options struct has the fields
+ *    fast        nonzero to use the vectorized routines,
+ *    lut         size of a 3D lookup table to bake over the range of A and
+ *                apply instead of the transform, or 0 for none,
+ *    lutgamma    exponent of the lookup table's shaper curve (default 1),
+ *    threads     number of threads, or 0 for the OpenMP default,
+ *    parallelsize  minimum number of pixels converted on several threads
+ *                (default COLOR_PARALLEL_SIZE),
+ *    srcwhite, destwhite  white points of the source and destination, as XYZ
+ *                or names such as 'D50' (default 'D65'), where L*u*v*
+ *                is supported only under D65,
+ *    adaptation  'Bradford' (default), 'CAT02', 'von Kries', or 'XYZ scaling'.
+ * With a lookup table, Report has fields maxerror and meanerror holding the
+ * errors of the table in each output channel.  The gateway is compiled with
+ * colorspace_select.c, and threads are used when built with OpenMP, as in
+ *    mex CFLAGS='$CFLAGS -fopenmp -ffp-contract=off'
+ *       LDFLAGS='$LDFLAGS -fopenmp' colorspace.c colorspace_select.c
+ * Defining COLORSPACE_NO_GATEWAY leaves the gateway out, for MEX functions of
+ * other files that link with colorspace.c and colorspace_select.c.
  */
-#ifdef MATLAB_MEX_FILE
+#if defined(MATLAB_MEX_FILE) && !defined(COLORSPACE_NO_GATEWAY)
+/** @brief Define a routine finding the range of each channel of an image */
+#define DEFINE_GET_CHANNEL_RANGE(Name, Type)	\
+static void Name(num Min[3], num Max[3], const Type *A, long NumPixels)	\
+{	\
+	num Value;	\
+	long i;	\
+	int Channel;	\
+	\
+	for(Channel = 0; Channel < 3; Channel++)	\
+	{	\
+		Min[Channel] = HUGE_VAL;	\
+		Max[Channel] = -HUGE_VAL;	\
+		\
+		/* Nonfinite values are ignored */	\
+		for(i = 0; i < NumPixels; i++)	\
+		{	\
+			Value = (num)A[Channel*NumPixels + i];	\
+			\
+			if(Value > -HUGE_VAL && Value < HUGE_VAL)	\
+			{	\
+				Min[Channel] = MIN(Min[Channel], Value);	\
+				Max[Channel] = MAX(Max[Channel], Value);	\
+			}	\
+		}	\
+		\
+		if(!(Max[Channel] > Min[Channel]))	\
+		{	\
+			Min[Channel] = (Min[Channel] < HUGE_VAL) ? Min[Channel] : 0;	\
+			Max[Channel] = Min[Channel] + 1;	\
+		}	\
+	}	\
+}
+
+DEFINE_GET_CHANNEL_RANGE(GetChannelRange, num)
+DEFINE_GET_CHANNEL_RANGE(GetChannelRangef, float)
+
+/** @brief Read a white point option, given as XYZ or an illuminant name */
+static int GetWhiteOption(num White[3], const mxArray *Field)
+{
+	char Name[16];
+	
+	
+	if(mxIsChar(Field))
+	{
+		mxGetString(Field, Name, sizeof(Name));
+		
+		if(!GetWhitePoint(White, Name))
+			mexErrMsgTxt("Unknown white point.");
+	}
+	else if(mxIsDouble(Field) && !mxIsComplex(Field) 
+		&& mxGetNumberOfElements(Field) == 3)
+	{
+		const double *Data = (const double *)mxGetData(Field);
+		
+		White[0] = Data[0];
+		White[1] = Data[1];
+		White[2] = Data[2];
+	}
+	else
+		mexErrMsgTxt("White points should be 3-element XYZ vectors or names.");
+	
+	return 1;
+}
+
+
 /** @brief MEX gateway */
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
 { 
     #define	S_IN	     prhs[0]
     #define	A_IN	     prhs[1]
+    #define	OPT_IN	     prhs[2]
     #define	B_OUT	     plhs[0]
+    #define	REPORT_OUT	 plhs[1]
 #define IS_REAL_FULL_DOUBLE(P) (!mxIsComplex(P) \
 && !mxIsSparse(P) && mxIsDouble(P))
+#define IS_REAL_FULL_SINGLE(P) (!mxIsComplex(P) \
+&& !mxIsSparse(P) && mxIsSingle(P))
+#define IS_REAL_FULL_INTEGER(P) (!mxIsComplex(P) \
+&& !mxIsSparse(P) && (mxIsUint8(P) || mxIsUint16(P)))
+	static const char *ReportFields[2] = {"maxerror", "meanerror"};
 	num *A, *B;
+	const num *Src[3];
+	num *Dest[3];
+	float *Af, *Bf;
+	const float *Srcf[3];
+	float *Destf[3];
+	const unsigned char *Src8[3];
+	const unsigned short *Src16[3];
+	num Min[3], Max[3], LutGamma = 1;
 	char *SBuf;
 	const int *Size;
 	colortransform Trans;
-	int SBufLen, NumPixels, Channel, Channel2;
+	colorlut Lut;
+	colorlutreport Report;
+	const mxArray *Field;
+	num SrcWhite[3] = {WHITEPOINT_X, WHITEPOINT_Y, WHITEPOINT_Z};
+	num DestWhite[3] = {WHITEPOINT_X, WHITEPOINT_Y, WHITEPOINT_Z};
+	char MethodName[16];
+	long ParallelSize = COLOR_PARALLEL_SIZE;
+	mwSize NumPixels, Channel, Channel2;
+	int SBufLen, LutSize = 0, NumThreads = 0;
+	int Fast = 0, Adapt = 0, Method = COLOR_ADAPT_BRADFORD;
     
 	   
     /* Parse the input arguments */
-    if(nrhs != 2)
-        mexErrMsgTxt("Two input arguments required.");
-    else if(nlhs > 1)
+    if(nrhs != 2 && nrhs != 3)
+        mexErrMsgTxt("Two or three input arguments required.");
+    else if(nlhs > 2)
         mexErrMsgTxt("Too many output arguments.");
     
 	if(!mxIsChar(S_IN))
 		mexErrMsgTxt("First argument should be a string.");
-    if(!IS_REAL_FULL_DOUBLE(A_IN))
-        mexErrMsgTxt("Second argument should be a real full double array.");
+    if(!IS_REAL_FULL_DOUBLE(A_IN) && !IS_REAL_FULL_SINGLE(A_IN)
+		&& !IS_REAL_FULL_INTEGER(A_IN))
+        mexErrMsgTxt("Second argument should be a real full double, single, uint8, or uint16 array.");
 	
 	Size = mxGetDimensions(A_IN);
 	
@@ -1255,31 +2869,179 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
 	SBuf = mxMalloc(SBufLen);
 	mxGetString(S_IN, SBuf, SBufLen);
 	
-	if(!(GetColorTransform(&Trans, SBuf)))
-		mexErrMsgTxt("Invalid syntax or unknown color space.");
+	/* Read the options struct */
+	if(nrhs == 3)
+	{
+		if(!mxIsStruct(OPT_IN))
+			mexErrMsgTxt("Third argument should be a struct.");
+		
+		if((Field = mxGetField(OPT_IN, 0, "fast")) != NULL)
+			Fast = (mxGetScalar(Field) != 0);
+		
+		if((Field = mxGetField(OPT_IN, 0, "srcwhite")) != NULL)
+			Adapt = GetWhiteOption(SrcWhite, Field);
+		
+		if((Field = mxGetField(OPT_IN, 0, "destwhite")) != NULL)
+			Adapt = GetWhiteOption(DestWhite, Field);
+		
+		if((Field = mxGetField(OPT_IN, 0, "adaptation")) != NULL)
+		{
+			if(!mxIsChar(Field))
+				mexErrMsgTxt("Option adaptation should be a string.");
+			
+			mxGetString(Field, MethodName, sizeof(MethodName));
+			
+			if((Method = GetAdaptationMethod(MethodName)) < 0)
+				mexErrMsgTxt("Unknown adaptation method.");
+		}
+		
+		if((Field = mxGetField(OPT_IN, 0, "lut")) != NULL)
+			LutSize = (int)mxGetScalar(Field);
+		
+		if((Field = mxGetField(OPT_IN, 0, "lutgamma")) != NULL)
+			LutGamma = mxGetScalar(Field);
+		
+		if((Field = mxGetField(OPT_IN, 0, "threads")) != NULL)
+			NumThreads = (int)mxGetScalar(Field);
+		
+		if((Field = mxGetField(OPT_IN, 0, "parallelsize")) != NULL)
+			ParallelSize = (long)mxGetScalar(Field);
+	}
+	
+	SetColorThreads(NumThreads, ParallelSize);
+	
+	if(!(Adapt ? GetColorTransformWhite(&Trans, SBuf, SrcWhite, DestWhite,
+		Method) : GetColorTransform(&Trans, SBuf)))
+		mexErrMsgTxt(Adapt ? "Invalid syntax, unknown color space, or Luv "
+			"under a white point other than D65."
+			: "Invalid syntax or unknown color space.");
 	
 	mxFree(SBuf);
 	
-	A = (num *)mxGetData(A_IN);
-	NumPixels = mxGetNumberOfElements(A_IN)/3;
+	if(Fast)
+		SetColorTransformFast(&Trans);
 	
-	/* Create the output image */ 
-	B_OUT = mxCreateDoubleMatrix(0, 0, mxREAL); 
-	mxSetDimensions(B_OUT, Size, mxGetNumberOfDimensions(A_IN));
-	mxSetData(B_OUT, B = mxMalloc(sizeof(num)*mxGetNumberOfElements(A_IN)));
+	if(LutSize != 0 && (LutSize < 2 || !(LutGamma > 0)))
+		mexErrMsgTxt("Option lut should be at least 2 and lutgamma positive.");
+	else if(nlhs > 1 && !LutSize)
+		mexErrMsgTxt("The second output requires the lut option.");
+	else if(LutSize && IS_REAL_FULL_INTEGER(A_IN))
+		mexErrMsgTxt("Option lut requires a double or single array.");
 	
+	NumPixels = mxGetNumberOfElements(A_IN)/3;
 	Channel = NumPixels;
 	Channel2 = NumPixels*2;
 	
-	/* Apply the color transform */
-	while(NumPixels--)
+	/* Single images are converted in single precision */
+	if(IS_REAL_FULL_SINGLE(A_IN))
 	{
-		ApplyColorTransform(Trans, B, B + Channel, B + Channel2,
-			A[0], A[Channel], A[Channel2]);
-		A++;
-		B++;
+		Af = (float *)mxGetData(A_IN);
+		B_OUT = mxCreateNumericArray(mxGetNumberOfDimensions(A_IN), Size,
+			mxSINGLE_CLASS, mxREAL);
+		Bf = (float *)mxGetData(B_OUT);
+		
+		Srcf[0] = Af;
+		Srcf[1] = Af + Channel;
+		Srcf[2] = Af + Channel2;
+		Destf[0] = Bf;
+		Destf[1] = Bf + Channel;
+		Destf[2] = Bf + Channel2;
+		
+		if(!LutSize)
+		{
+			ApplyColorTransformPlanarf(&Trans, Destf, 1, Srcf, 1, NumPixels);
+			return;
+		}
+		
+		GetChannelRangef(Min, Max, Af, NumPixels);
+		
+		if(!BakeColorLut(&Lut, &Trans, 1, LutSize, Min, Max, LutGamma))
+			mexErrMsgTxt("Out of memory.");
+		
+		ApplyColorLutPlanarf(&Lut, Destf, 1, Srcf, 1, NumPixels);
 	}
-
+	else if(IS_REAL_FULL_INTEGER(A_IN))
+	{
+		B_OUT = mxCreateDoubleMatrix(0, 0, mxREAL); 
+		mxSetDimensions(B_OUT, Size, mxGetNumberOfDimensions(A_IN));
+		mxSetData(B_OUT, B = mxMalloc(sizeof(num)*mxGetNumberOfElements(A_IN)));
+		
+		Dest[0] = B;
+		Dest[1] = B + Channel;
+		Dest[2] = B + Channel2;
+		
+		if(mxIsUint8(A_IN))
+		{
+			Src8[0] = (const unsigned char *)mxGetData(A_IN);
+			Src8[1] = Src8[0] + Channel;
+			Src8[2] = Src8[0] + Channel2;
+			ApplyColorTransformPlanaru8(&Trans, Dest, 1, Src8, 1, NumPixels);
+		}
+		else
+		{
+			Src16[0] = (const unsigned short *)mxGetData(A_IN);
+			Src16[1] = Src16[0] + Channel;
+			Src16[2] = Src16[0] + Channel2;
+			ApplyColorTransformPlanaru16(&Trans, Dest, 1, Src16, 1, NumPixels);
+		}
+		
+		return;
+	}
+	else
+	{
+		A = (num *)mxGetData(A_IN);
+		
+		/* Create the output image */ 
+		B_OUT = mxCreateDoubleMatrix(0, 0, mxREAL); 
+		mxSetDimensions(B_OUT, Size, mxGetNumberOfDimensions(A_IN));
+		mxSetData(B_OUT, B = mxMalloc(sizeof(num)*mxGetNumberOfElements(A_IN)));
+		
+		Src[0] = A;
+		Src[1] = A + Channel;
+		Src[2] = A + Channel2;
+		Dest[0] = B;
+		Dest[1] = B + Channel;
+		Dest[2] = B + Channel2;
+		
+		/* Apply the color transform */
+		if(!LutSize)
+		{
+			ApplyColorTransformPlanar(&Trans, Dest, 1, Src, 1, NumPixels);
+			return;
+		}
+		
+		GetChannelRange(Min, Max, A, NumPixels);
+		
+		if(!BakeColorLut(&Lut, &Trans, 1, LutSize, Min, Max, LutGamma))
+			mexErrMsgTxt("Out of memory.");
+		
+		ApplyColorLutPlanar(&Lut, Dest, 1, Src, 1, NumPixels);
+	}
+	
+	if(nlhs > 1)
+	{
+		if(!GetColorLutAccuracy(&Report, &Lut, &Trans, 1, 65536))
+		{
+			FreeColorLut(&Lut);
+			mexErrMsgTxt("Out of memory.");
+		}
+		
+		REPORT_OUT = mxCreateStructMatrix(1, 1, 2, ReportFields);
+		mxSetField(REPORT_OUT, 0, "maxerror", 
+			mxCreateDoubleMatrix(1, 3, mxREAL));
+		mxSetField(REPORT_OUT, 0, "meanerror", 
+			mxCreateDoubleMatrix(1, 3, mxREAL));
+		
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			((double *)mxGetData(mxGetField(REPORT_OUT, 0, "maxerror")))[Channel]
+				= Report.MaxError[Channel];
+			((double *)mxGetData(mxGetField(REPORT_OUT, 0, "meanerror")))[Channel]
+				= Report.MeanError[Channel];
+		}
+	}
+	
+	FreeColorLut(&Lut);
     return;
 }
 #endif
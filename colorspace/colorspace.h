@@ -18,16 +18,117 @@ typedef double num;
 
 
 
-/** @brief struct for representing a color transform */
+/** @brief Number of pixels processed at a time by ApplyColorTransformPlanar */
+#define COLOR_BLOCK_SIZE	256
+
+/** @brief Default minimum number of pixels converted on several threads */
+#define COLOR_PARALLEL_SIZE	65536
+
+/** @brief Transform routine over contiguous arrays of N pixels */
+typedef void (*colorblockfun)(num*, num*, num*, 
+	const num*, const num*, const num*, int);
+
+/** @brief Transform routine over contiguous arrays of N float pixels */
+typedef void (*colorblockfunf)(float*, float*, float*, 
+	const float*, const float*, const float*, int);
+
+/** @brief Maximum number of stages in a colortransform */
+#define COLOR_MAX_STAGES	8
+
+/** @brief Affine stage D = M(:,1:3) S + M(:,4) of a colortransform 
+ * If Linearize is set, the input is sRGB and is first linearized.  If 
+ * GammaCorrect is set, the output is gamma-corrected to sRGB as in Xyz2Rgb.
+ * Fast is set by SetColorTransformFast.
+ */
+typedef struct
+{
+	num M[3][4];
+	int Linearize;
+	int GammaCorrect;
+	int Fast;
+} colormatrix;
+
+/** @brief struct for representing a color transform 
+ * Stages with a null Fun are performed by their Matrix.
+ */
 typedef struct
 {
 	int NumStages;
-	void (*Fun[2])(num*, num*, num*, num, num, num);
+	void (*Fun[COLOR_MAX_STAGES])(num*, num*, num*, num, num, num);
+	colorblockfun BlockFun[COLOR_MAX_STAGES];
+	colorblockfunf BlockFunf[COLOR_MAX_STAGES];
+	colormatrix Matrix[COLOR_MAX_STAGES];
 } colortransform;
 
+/** @brief Chromatic adaptation methods of GetColorTransformWhite */
+#define COLOR_ADAPT_XYZ_SCALING	0
+#define COLOR_ADAPT_VON_KRIES	1
+#define COLOR_ADAPT_BRADFORD	2
+#define COLOR_ADAPT_CAT02		3
+
+/** @brief Number of entries in each shaper table of a colorlut */
+#define COLOR_LUT_SHAPER_SIZE	4096
+
+/** @brief 3D lookup table baked from a chain of color transforms */
+typedef struct
+{
+	int Size;
+	num Min[3];
+	num Max[3];
+	num ShaperGamma;
+	float *Shaper;
+	float *Table;
+} colorlut;
+
+/** @brief Errors of a colorlut against the transforms it was baked from */
+typedef struct
+{
+	num MaxError[3];
+	num MeanError[3];
+} colorlutreport;
+
 int GetColorTransform(colortransform *Trans, const char *TransformString);
-void ApplyColorTransform(colortransform Trans, 
+int GetColorTransformWhite(colortransform *Trans, const char *TransformString,
+	const num SrcWhite[3], const num DestWhite[3], int Method);
+int GetWhitePoint(num White[3], const char *Name);
+int GetAdaptationMethod(const char *Name);
+int SetColorTransformFast(colortransform *Trans);
+int SetColorThreads(int NumThreads, long ParallelSize);
+int GetColorThreads(long NumPixels);
+void ApplyColorTransform(const colortransform *Trans,
 	num *D0, num *D1, num *D2, num S0, num S1, num S2);
+void ApplyColorTransformPlanar(const colortransform *Trans,
+	num *Dest[3], long DestStride, const num *Src[3], long SrcStride,
+	long NumPixels);
+void ApplyColorTransformPlanarf(const colortransform *Trans,
+	float *Dest[3], long DestStride, const float *Src[3], long SrcStride,
+	long NumPixels);
+void ApplyColorTransformImage(const colortransform *Trans,
+	num *Dest[3], long DestStride, long DestRowStride, 
+	const num *Src[3], long SrcStride, long SrcRowStride, 
+	long Width, long Height);
+void ApplyColorTransformImagef(const colortransform *Trans,
+	float *Dest[3], long DestStride, long DestRowStride, 
+	const float *Src[3], long SrcStride, long SrcRowStride, 
+	long Width, long Height);
+void ApplyColorTransformPlanaru8(const colortransform *Trans,
+	num *Dest[3], long DestStride, const unsigned char *Src[3], long SrcStride,
+	long NumPixels);
+void ApplyColorTransformPlanaru16(const colortransform *Trans,
+	num *Dest[3], long DestStride, const unsigned short *Src[3], long SrcStride,
+	long NumPixels);
+
+int BakeColorLut(colorlut *Lut, const colortransform *Chain, int NumTransforms,
+	int Size, const num Min[3], const num Max[3], num ShaperGamma);
+void FreeColorLut(colorlut *Lut);
+int GetColorLutAccuracy(colorlutreport *Report, const colorlut *Lut,
+	const colortransform *Chain, int NumTransforms, long NumSamples);
+void ApplyColorLutPlanar(const colorlut *Lut, 
+	num *Dest[3], long DestStride, const num *Src[3], long SrcStride,
+	long NumPixels);
+void ApplyColorLutPlanarf(const colorlut *Lut, 
+	float *Dest[3], long DestStride, const float *Src[3], long SrcStride,
+	long NumPixels);
 
 void Rgb2Yuv(num *Y, num *U, num *V, num R, num G, num B);
 void Yuv2Rgb(num *R, num *G, num *B, num Y, num U, num V);
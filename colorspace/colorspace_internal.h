@@ -0,0 +1,133 @@
+/**
+ * @file colorspace_internal.h
+ * @author igkiou 2026
+ *
+ * Definitions shared by colorspace.c and colorspace_select.c, which holds the
+ * branch-free HSV and HSL block routines.  These are kept in their own file so
+ * that they are compiled without -ffast-math even when colorspace.c is not.
+ * This file is not part of the interface of colorspace.c.
+ */
+#ifndef _COLORSPACE_INTERNAL_H_
+#define _COLORSPACE_INTERNAL_H_
+
+#include <string.h>
+#include "colorspace.h"
+
+/** @brief Min of A and B */
+#define MIN(A,B)	(((A) <= (B)) ? (A) : (B))
+
+/** @brief Max of A and B */
+#define MAX(A,B)	(((A) >= (B)) ? (A) : (B))
+
+/** @brief Min of A, B, and C */
+#define MIN3(A,B,C)	(((A) <= (B)) ? MIN(A,C) : MIN(B,C))
+
+/** @brief Max of A, B, and C */
+#define MAX3(A,B,C)	(((A) >= (B)) ? MAX(A,C) : MAX(B,C))
+
+
+/*
+ * == Vectorization support ==
+ *
+ * FAST_TARGETS marks block routines to be compiled for several instruction
+ * sets, FAST_INLINE marks the per-pixel kernels they call, and SIMD_LOOP
+ * marks their loops over pixels.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) \
+	&& defined(__linux__)
+#define FAST_TARGETS	__attribute__((target_clones("avx512f","avx2","default"), \
+	optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#else
+#define FAST_TARGETS
+#endif
+
+/* Kernels must be inlined into the block loops for these to vectorize */
+#if defined(__GNUC__)
+#define FAST_INLINE		static __inline__ __attribute__((always_inline))
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#define FAST_INLINE		static inline
+#else
+#define FAST_INLINE		static
+#endif
+
+/*
+ * Loops over blocks carry no dependences, even in place, as every pixel is
+ * read before it is written.
+ */
+#if defined(_OPENMP)
+#define SIMD_LOOP	_Pragma("omp simd")
+#elif defined(__GNUC__)
+#define SIMD_LOOP	_Pragma("GCC ivdep")
+#else
+#define SIMD_LOOP
+#endif
+
+
+/* The branch-free routines need a C99 compiler */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#define COLOR_FAST_KERNELS
+
+#include <stdint.h>
+
+/** @brief Reinterpret the bits of a double as an integer and back */
+FAST_INLINE int64_t AsInt64(double x)
+{
+	int64_t i;
+	memcpy(&i, &x, sizeof(i));
+	return i;
+}
+
+FAST_INLINE double AsDouble(int64_t i)
+{
+	double x;
+	memcpy(&x, &i, sizeof(x));
+	return x;
+}
+
+/**
+ * @brief Select A if Cond is nonzero and B otherwise
+ *
+ * Unlike the ?: operator, the select is done on the bits of both values, so
+ * the compiler cannot move the computation of A or B under a branch, which
+ * keeps loops from vectorizing unless floating-point traps are disabled.
+ */
+FAST_INLINE double FastSelect(int64_t Cond, double A, double B)
+{
+	int64_t Mask = -Cond;
+	return AsDouble((AsInt64(A) & Mask) | (AsInt64(B) & ~Mask));
+}
+
+
+/** @brief Branch-free MAX and MIN of finite values */
+FAST_INLINE double FastMax(double A, double B)
+{
+	return FastSelect(A > B, A, B);
+}
+
+FAST_INLINE double FastMin(double A, double B)
+{
+	return FastSelect(A < B, A, B);
+}
+
+
+/* Block routines of colorspace_select.c */
+void Rgb2HsvBlock(num *D0, num *D1, num *D2,
+	const num *S0, const num *S1, const num *S2, int N);
+void Rgb2HsvBlockf(float *D0, float *D1, float *D2,
+	const float *S0, const float *S1, const float *S2, int N);
+void Hsv2RgbBlock(num *D0, num *D1, num *D2,
+	const num *S0, const num *S1, const num *S2, int N);
+void Hsv2RgbBlockf(float *D0, float *D1, float *D2,
+	const float *S0, const float *S1, const float *S2, int N);
+void Rgb2HslBlock(num *D0, num *D1, num *D2,
+	const num *S0, const num *S1, const num *S2, int N);
+void Rgb2HslBlockf(float *D0, float *D1, float *D2,
+	const float *S0, const float *S1, const float *S2, int N);
+void Hsl2RgbBlock(num *D0, num *D1, num *D2,
+	const num *S0, const num *S1, const num *S2, int N);
+void Hsl2RgbBlockf(float *D0, float *D1, float *D2,
+	const float *S0, const float *S1, const float *S2, int N);
+
+#endif  /* C99 */
+
+#endif  /* _COLORSPACE_INTERNAL_H_ */
@@ -0,0 +1,611 @@
+/**
+ * @file colorspace_real.h
+ * @author igkiou 2026
+ *
+ * Routines of colorspace.c that are compiled once for each real type.  This
+ * file is included by colorspace.c with REAL defined as num and REAL_NAME(Foo)
+ * as Foo, and again with REAL defined as float and REAL_NAME(Foo) as Foof.
+ * Floating-point constants are wrapped in K() so that the float routines
+ * compute in single precision.
+ */
+
+#define K(x)	((REAL)(x))
+
+/* Selects of real values that do not keep loops from vectorizing */
+#ifdef COLOR_FAST_KERNELS
+#define SELECT(Cond, A, B)	REAL_NAME(FastSelect)(Cond, A, B)
+#else
+#define SELECT(Cond, A, B)	((Cond) ? (A) : (B))
+#endif
+
+
+#ifdef COLOR_FAST_KERNELS
+
+/** @brief Branch-free INVGAMMACORRECTION */
+FAST_INLINE REAL REAL_NAME(FastInvGammaCorrection)(REAL t)
+{
+	REAL Linear = t*K(1/12.92);
+	REAL Power = REAL_NAME(FastExp2)(K(2.4)*REAL_NAME(FastLog2)(
+		(REAL_NAME(FastMax)(t, K(0.0404482362771076)) + K(0.055))*K(1/1.055)));
+	return REAL_NAME(FastSelect)(t <= K(0.0404482362771076), Linear, Power);
+}
+
+
+/** @brief Branch-free GAMMACORRECTION */
+FAST_INLINE REAL REAL_NAME(FastGammaCorrection)(REAL t)
+{
+	REAL Linear = K(12.92)*t;
+	REAL Power = K(1.055)*REAL_NAME(FastExp2)(K(0.416666666666666667)
+		*REAL_NAME(FastLog2)(REAL_NAME(FastMax)(t, K(0.0031306684425005883))))
+		- K(0.055);
+	return REAL_NAME(FastSelect)(t <= K(0.0031306684425005883), Linear, Power);
+}
+
+
+/** @brief Branch-free LABF */
+FAST_INLINE REAL REAL_NAME(FastLabf)(REAL t)
+{
+	REAL Linear = K(841.0/108.0)*t + K(4.0/29.0);
+	REAL Root = REAL_NAME(FastExp2)(K(0.333333333333333333)*REAL_NAME(FastLog2)(
+		REAL_NAME(FastMax)(t, K(8.85645167903563082e-3))));
+	return REAL_NAME(FastSelect)(t >= K(8.85645167903563082e-3), Root, Linear);
+}
+
+
+/** @brief Branch-free LABINVF */
+FAST_INLINE REAL REAL_NAME(FastLabinvf)(REAL t)
+{
+	REAL Linear = K(108.0/841.0)*(t - K(4.0/29.0));
+	REAL Cube = t*t*t;
+	return REAL_NAME(FastSelect)(t >= K(0.206896551724137931), Cube, Linear);
+}
+
+
+/*
+ * Per-pixel kernels built from the above.  They mirror the exact kernels,
+ * with branches replaced by selects.
+ */
+
+FAST_INLINE void REAL_NAME(Rgb2XyzFast)(REAL *X, REAL *Y, REAL *Z,
+	REAL R, REAL G, REAL B)
+{
+	REAL R1 = REAL_NAME(FastInvGammaCorrection)(R);
+	REAL G1 = REAL_NAME(FastInvGammaCorrection)(G);
+	REAL B1 = REAL_NAME(FastInvGammaCorrection)(B);
+	
+	
+	*X = K(0.4123955889674142161)*R1 + K(0.3575834307637148171)*G1 + K(0.1804926473817015735)*B1;
+	*Y = K(0.2125862307855955516)*R1 + K(0.7151703037034108499)*G1 + K(0.07220049864333622685)*B1;
+	*Z = K(0.01929721549174694484)*R1 + K(0.1191838645808485318)*G1 + K(0.9504971251315797660)*B1;
+}
+
+
+FAST_INLINE void REAL_NAME(Xyz2RgbFast)(REAL *R, REAL *G, REAL *B,
+	REAL X, REAL Y, REAL Z)
+{
+	REAL R1 = K(3.2406)*X - K(1.5372)*Y - K(0.4986)*Z;
+	REAL G1 = K(-0.9689)*X + K(1.8758)*Y + K(0.0415)*Z;
+	REAL B1 = K(0.0557)*X - K(0.2040)*Y + K(1.0570)*Z;
+	REAL Min = REAL_NAME(FastMin)(REAL_NAME(FastMin)(
+		REAL_NAME(FastMin)(R1, G1), B1), 0);
+	
+	
+	/* Force nonnegative values so that gamma correction is well-defined. */
+	*R = REAL_NAME(FastGammaCorrection)(R1 - Min);
+	*G = REAL_NAME(FastGammaCorrection)(G1 - Min);
+	*B = REAL_NAME(FastGammaCorrection)(B1 - Min);
+}
+
+
+FAST_INLINE void REAL_NAME(Xyz2LabFast)(REAL *L, REAL *a, REAL *b,
+	REAL X, REAL Y, REAL Z)
+{
+	REAL fX = REAL_NAME(FastLabf)(X*K(1/WHITEPOINT_X));
+	REAL fY = REAL_NAME(FastLabf)(Y*K(1/WHITEPOINT_Y));
+	REAL fZ = REAL_NAME(FastLabf)(Z*K(1/WHITEPOINT_Z));
+	
+	
+	*L = 116*fY - 16;
+	*a = 500*(fX - fY);
+	*b = 200*(fY - fZ);
+}
+
+
+FAST_INLINE void REAL_NAME(Lab2XyzFast)(REAL *X, REAL *Y, REAL *Z,
+	REAL L, REAL a, REAL b)
+{
+	REAL fY = (L + 16)*K(1.0/116);
+	
+	
+	*X = K(WHITEPOINT_X)*REAL_NAME(FastLabinvf)(fY + a*K(1.0/500));
+	*Y = K(WHITEPOINT_Y)*REAL_NAME(FastLabinvf)(fY);
+	*Z = K(WHITEPOINT_Z)*REAL_NAME(FastLabinvf)(fY - b*K(1.0/200));
+}
+
+
+FAST_INLINE void REAL_NAME(Xyz2LuvFast)(REAL *L, REAL *u, REAL *v,
+	REAL X, REAL Y, REAL Z)
+{
+	REAL Denom = X + 15*Y + 3*Z;
+	REAL Scale = REAL_NAME(FastSelect)(Denom > 0,
+		1/REAL_NAME(FastSelect)(Denom > 0, Denom, 1), 0);
+	REAL L1 = 116*REAL_NAME(FastLabf)(Y*K(1/WHITEPOINT_Y)) - 16;
+	
+	
+	*L = L1;
+	*u = 13*L1*(4*X*Scale - K(WHITEPOINT_U));
+	*v = 13*L1*(9*Y*Scale - K(WHITEPOINT_V));
+}
+
+
+FAST_INLINE void REAL_NAME(Luv2XyzFast)(REAL *X, REAL *Y, REAL *Z,
+	REAL L, REAL u, REAL v)
+{
+	REAL Y1 = K(WHITEPOINT_Y)*REAL_NAME(FastLabinvf)((L + 16)*K(1.0/116));
+	REAL Scale = 1/(13*REAL_NAME(FastSelect)(L != 0, L, 1));
+	REAL u1 = u*Scale + K(WHITEPOINT_U);
+	REAL v1 = v*Scale + K(WHITEPOINT_V);
+	
+	
+	*X = Y1*((9*u1)/(4*v1));
+	*Y = Y1;
+	*Z = Y1*((3 - K(0.75)*u1)/v1 - 5);
+}
+
+
+/* Glue kernels pass XYZ in registers */
+
+FAST_INLINE void REAL_NAME(Rgb2LabFast)(REAL *L, REAL *a, REAL *b,
+	REAL R, REAL G, REAL B)
+{
+	REAL X, Y, Z;
+	REAL_NAME(Rgb2XyzFast)(&X, &Y, &Z, R, G, B);
+	REAL_NAME(Xyz2LabFast)(L, a, b, X, Y, Z);
+}
+
+
+FAST_INLINE void REAL_NAME(Lab2RgbFast)(REAL *R, REAL *G, REAL *B,
+	REAL L, REAL a, REAL b)
+{
+	REAL X, Y, Z;
+	REAL_NAME(Lab2XyzFast)(&X, &Y, &Z, L, a, b);
+	REAL_NAME(Xyz2RgbFast)(R, G, B, X, Y, Z);
+}
+
+
+FAST_INLINE void REAL_NAME(Rgb2LuvFast)(REAL *L, REAL *u, REAL *v,
+	REAL R, REAL G, REAL B)
+{
+	REAL X, Y, Z;
+	REAL_NAME(Rgb2XyzFast)(&X, &Y, &Z, R, G, B);
+	REAL_NAME(Xyz2LuvFast)(L, u, v, X, Y, Z);
+}
+
+
+FAST_INLINE void REAL_NAME(Luv2RgbFast)(REAL *R, REAL *G, REAL *B,
+	REAL L, REAL u, REAL v)
+{
+	REAL X, Y, Z;
+	REAL_NAME(Luv2XyzFast)(&X, &Y, &Z, L, u, v);
+	REAL_NAME(Xyz2RgbFast)(R, G, B, X, Y, Z);
+}
+
+
+/** @brief Define the fast block routine of a fast per-pixel kernel */
+#define DEFINE_FAST_TRANSFORM(Fun)	\
+FAST_TARGETS static void REAL_NAME(Fun##FastBlock)(REAL *D0, REAL *D1,	\
+	REAL *D2, const REAL *S0, const REAL *S1, const REAL *S2, int N)	\
+{	\
+	int i;	\
+	\
+	SIMD_LOOP	\
+	for(i = 0; i < N; i++)	\
+		REAL_NAME(Fun##Fast)(&D0[i], &D1[i], &D2[i], S0[i], S1[i], S2[i]);	\
+}
+
+DEFINE_FAST_TRANSFORM(Rgb2Xyz)
+DEFINE_FAST_TRANSFORM(Xyz2Rgb)
+DEFINE_FAST_TRANSFORM(Xyz2Lab)
+DEFINE_FAST_TRANSFORM(Lab2Xyz)
+DEFINE_FAST_TRANSFORM(Xyz2Luv)
+DEFINE_FAST_TRANSFORM(Luv2Xyz)
+DEFINE_FAST_TRANSFORM(Rgb2Lab)
+DEFINE_FAST_TRANSFORM(Lab2Rgb)
+DEFINE_FAST_TRANSFORM(Rgb2Luv)
+DEFINE_FAST_TRANSFORM(Luv2Rgb)
+
+#undef DEFINE_FAST_TRANSFORM
+
+
+/** @brief Branch-free colormatrix stage, with the flags known at compile time */
+FAST_INLINE void REAL_NAME(ColorMatrixFast)(const REAL M[12],
+	int Linearize, int GammaCorrect, REAL *D0, REAL *D1, REAL *D2,
+	REAL S0, REAL S1, REAL S2)
+{
+	REAL T0, T1, T2, Min;
+	
+	
+	if(Linearize)
+	{
+		S0 = REAL_NAME(FastInvGammaCorrection)(S0);
+		S1 = REAL_NAME(FastInvGammaCorrection)(S1);
+		S2 = REAL_NAME(FastInvGammaCorrection)(S2);
+	}
+	
+	T0 = M[0]*S0 + M[1]*S1 + M[2]*S2 + M[3];
+	T1 = M[4]*S0 + M[5]*S1 + M[6]*S2 + M[7];
+	T2 = M[8]*S0 + M[9]*S1 + M[10]*S2 + M[11];
+	
+	if(GammaCorrect)
+	{
+		Min = REAL_NAME(FastMin)(REAL_NAME(FastMin)(
+			REAL_NAME(FastMin)(T0, T1), T2), 0);
+		T0 = REAL_NAME(FastGammaCorrection)(T0 - Min);
+		T1 = REAL_NAME(FastGammaCorrection)(T1 - Min);
+		T2 = REAL_NAME(FastGammaCorrection)(T2 - Min);
+	}
+	
+	*D0 = T0;
+	*D1 = T1;
+	*D2 = T2;
+}
+
+
+/** @brief Vectorized colormatrix stage with sRGB linearization or gamma */
+FAST_TARGETS static void REAL_NAME(ColorMatrixFastBlock)(
+	const colormatrix *Matrix, REAL *D0, REAL *D1, REAL *D2,
+	const REAL *S0, const REAL *S1, const REAL *S2, int N)
+{
+	REAL M[12];
+	int i;
+	
+	
+	for(i = 0; i < 12; i++)
+		M[i] = (REAL)Matrix->M[i / 4][i % 4];
+	
+	if(Matrix->Linearize && Matrix->GammaCorrect)
+	{
+		SIMD_LOOP
+		for(i = 0; i < N; i++)
+			REAL_NAME(ColorMatrixFast)(M, 1, 1, &D0[i], &D1[i], &D2[i],
+				S0[i], S1[i], S2[i]);
+	}
+	else if(Matrix->Linearize)
+	{
+		SIMD_LOOP
+		for(i = 0; i < N; i++)
+			REAL_NAME(ColorMatrixFast)(M, 1, 0, &D0[i], &D1[i], &D2[i],
+				S0[i], S1[i], S2[i]);
+	}
+	else
+	{
+		SIMD_LOOP
+		for(i = 0; i < N; i++)
+			REAL_NAME(ColorMatrixFast)(M, 0, 1, &D0[i], &D1[i], &D2[i],
+				S0[i], S1[i], S2[i]);
+	}
+}
+
+#endif  /* COLOR_FAST_KERNELS */
+
+
+/** @brief Apply a colormatrix stage to a block */
+static void REAL_NAME(ApplyColorMatrix)(const colormatrix *Matrix,
+	REAL *D0, REAL *D1, REAL *D2, const REAL *S0, const REAL *S1,
+	const REAL *S2, int N)
+{
+#ifdef COLOR_FAST_KERNELS
+	/* Purely affine stages are already fast */
+	if(Matrix->Fast && (Matrix->Linearize || Matrix->GammaCorrect))
+	{
+		REAL_NAME(ColorMatrixFastBlock)(Matrix, D0, D1, D2, S0, S1, S2, N);
+		return;
+	}
+#endif
+	
+	REAL_NAME(ColorMatrixBlock)(Matrix, D0, D1, D2, S0, S1, S2, N);
+}
+
+
+/**
+ * @brief Apply a colortransform to one block of pixels
+ *
+ * Strided channels are gathered into contiguous buffers, and every stage of
+ * the transform runs over the whole block before the next one.
+ */
+static void REAL_NAME(TransformBlock)(const colortransform *Trans,
+	REAL *Dest[3], long DestStride, const REAL *Src[3], long SrcStride,
+	long Start, int N)
+{
+	REAL Buf[2][3][COLOR_BLOCK_SIZE];
+	const REAL *In[3];
+	REAL *Out[3];
+	int Stage, Channel, i;
+	
+	
+	/* Read the block, in place if the channels are contiguous */
+	for(Channel = 0; Channel < 3; Channel++)
+		if(SrcStride == 1)
+			In[Channel] = Src[Channel] + Start;
+		else
+		{
+			for(i = 0; i < N; i++)
+				Buf[0][Channel][i] = Src[Channel][(Start + i)*SrcStride];
+			
+			In[Channel] = Buf[0][Channel];
+		}
+	
+	for(Stage = 0; Stage < Trans->NumStages; Stage++)
+	{
+		/* The last stage writes to contiguous outputs directly */
+		for(Channel = 0; Channel < 3; Channel++)
+			Out[Channel] = (Stage == Trans->NumStages - 1 && DestStride == 1) ?
+				Dest[Channel] + Start : Buf[(Stage + 1) % 2][Channel];
+		
+		if(Trans->REAL_NAME(BlockFun)[Stage])
+			Trans->REAL_NAME(BlockFun)[Stage](Out[0], Out[1], Out[2],
+				In[0], In[1], In[2], N);
+		else
+			REAL_NAME(ApplyColorMatrix)(&Trans->Matrix[Stage],
+				Out[0], Out[1], Out[2], In[0], In[1], In[2], N);
+		
+		for(Channel = 0; Channel < 3; Channel++)
+			In[Channel] = Out[Channel];
+	}
+	
+	/* Write the block, unless the last stage did */
+	if(!Trans->NumStages || DestStride != 1)
+		for(Channel = 0; Channel < 3; Channel++)
+			for(i = 0; i < N; i++)
+				Dest[Channel][(Start + i)*DestStride] = In[Channel][i];
+}
+
+
+/**
+ * @brief Apply a colortransform to an array of pixels
+ *
+ * @param Trans colortransform struct created by GetColorTransform
+ * @param Dest pointers to the first pixel of each output channel
+ * @param DestStride distance in elements between consecutive output pixels
+ * @param Src pointers to the first pixel of each input channel
+ * @param SrcStride distance in elements between consecutive input pixels
+ * @param NumPixels number of pixels
+ *
+ * The pixels are processed in blocks of COLOR_BLOCK_SIZE.  When compiled
+ * with OpenMP, the blocks are split into contiguous runs over the threads set
+ * by SetColorThreads.  Dest may equal Src for an in-place transform, but the
+ * arrays should not otherwise overlap.
+ */
+void REAL_NAME(ApplyColorTransformPlanar)(const colortransform *Trans,
+	REAL *Dest[3], long DestStride, const REAL *Src[3], long SrcStride,
+	long NumPixels)
+{
+	long NumBlocks = (NumPixels + COLOR_BLOCK_SIZE - 1)/COLOR_BLOCK_SIZE;
+	long Block;
+	
+	
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if(NumPixels >= ColorParallelSize) \
+	num_threads(COLOR_NUM_THREADS)
+#endif
+	for(Block = 0; Block < NumBlocks; Block++)
+		REAL_NAME(TransformBlock)(Trans, Dest, DestStride, Src, SrcStride,
+			Block*COLOR_BLOCK_SIZE, 
+			(int)MIN(NumPixels - Block*COLOR_BLOCK_SIZE, COLOR_BLOCK_SIZE));
+}
+
+
+/**
+ * @brief Apply a colortransform to a rectangle of pixels
+ *
+ * @param Trans colortransform struct created by GetColorTransform
+ * @param Dest pointers to the top-left pixel of each output channel
+ * @param DestStride distance in elements between pixels in an output row
+ * @param DestRowStride distance in elements between output rows
+ * @param Src pointers to the top-left pixel of each input channel
+ * @param SrcStride distance in elements between pixels in an input row
+ * @param SrcRowStride distance in elements between input rows
+ * @param Width, Height size of the rectangle in pixels
+ *
+ * Same as ApplyColorTransformPlanar over each row, for converting a tile or
+ * a region of a larger image into caller-provided output planes.  The blocks
+ * of all rows are distributed over the threads together, so that narrow
+ * regions are also converted in parallel.  Dest may equal Src, with the same
+ * strides, for an in-place transform.
+ */
+void REAL_NAME(ApplyColorTransformImage)(const colortransform *Trans,
+	REAL *Dest[3], long DestStride, long DestRowStride, 
+	const REAL *Src[3], long SrcStride, long SrcRowStride, 
+	long Width, long Height)
+{
+	long BlocksPerRow = (Width + COLOR_BLOCK_SIZE - 1)/COLOR_BLOCK_SIZE;
+	long Unit;
+	
+	
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+	if(Width*Height >= ColorParallelSize) num_threads(COLOR_NUM_THREADS)
+#endif
+	for(Unit = 0; Unit < BlocksPerRow*Height; Unit++)
+	{
+		REAL *RowDest[3];
+		const REAL *RowSrc[3];
+		long Row = Unit / BlocksPerRow;
+		long Start = (Unit % BlocksPerRow)*COLOR_BLOCK_SIZE;
+		int Channel;
+		
+		
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			RowDest[Channel] = Dest[Channel] + Row*DestRowStride;
+			RowSrc[Channel] = Src[Channel] + Row*SrcRowStride;
+		}
+		
+		REAL_NAME(TransformBlock)(Trans, RowDest, DestStride, 
+			RowSrc, SrcStride, Start, (int)MIN(Width - Start, COLOR_BLOCK_SIZE));
+	}
+}
+
+
+/**
+ * @brief Grid coordinate of an input value through a shaper table
+ *
+ * @param Shaper the shaper table of the channel
+ * @param x the input value, scaled to [0, COLOR_LUT_SHAPER_SIZE - 1]
+ */
+FAST_INLINE REAL REAL_NAME(ColorLutShape)(const float *Shaper, REAL x)
+{
+	int n;
+	
+	
+	x = SELECT(x > 0, x, 0);
+	x = SELECT(x < COLOR_LUT_SHAPER_SIZE - 1, x, COLOR_LUT_SHAPER_SIZE - 1);
+	n = (int)x;
+	n = (n < COLOR_LUT_SHAPER_SIZE - 2) ? n : COLOR_LUT_SHAPER_SIZE - 2;
+	return Shaper[n] + (x - n)*(Shaper[n + 1] - Shaper[n]);
+}
+
+
+/**
+ * @brief Apply a colorlut over contiguous arrays of N pixels
+ *
+ * The unit cube of the grid around each pixel is split into six tetrahedra
+ * along its diagonal.  The tetrahedron holding the pixel is found by sorting
+ * the fractional coordinates, and its four vertices are interpolated
+ * barycentrically.  The sort is written with selects so that the loop
+ * vectorizes into gathers.
+ */
+FAST_TARGETS static void REAL_NAME(ColorLutBlock)(const colorlut *Lut,
+	REAL *D0, REAL *D1, REAL *D2, const REAL *S0, const REAL *S1,
+	const REAL *S2, int N)
+{
+	const float *Shaper0 = Lut->Shaper;
+	const float *Shaper1 = Lut->Shaper + COLOR_LUT_SHAPER_SIZE;
+	const float *Shaper2 = Lut->Shaper + 2*COLOR_LUT_SHAPER_SIZE;
+	const float *Table = Lut->Table;
+	const int Size = Lut->Size, StrideY = 3*Size, StrideZ = 3*Size*Size;
+	const REAL Min0 = (REAL)Lut->Min[0], Min1 = (REAL)Lut->Min[1], 
+		Min2 = (REAL)Lut->Min[2];
+	const REAL Scale0 = (REAL)((COLOR_LUT_SHAPER_SIZE - 1)
+		/(Lut->Max[0] - Lut->Min[0]));
+	const REAL Scale1 = (REAL)((COLOR_LUT_SHAPER_SIZE - 1)
+		/(Lut->Max[1] - Lut->Min[1]));
+	const REAL Scale2 = (REAL)((COLOR_LUT_SHAPER_SIZE - 1)
+		/(Lut->Max[2] - Lut->Min[2]));
+	int i;
+	
+	
+	SIMD_LOOP
+	for(i = 0; i < N; i++)
+	{
+		REAL u = REAL_NAME(ColorLutShape)(Shaper0, (S0[i] - Min0)*Scale0);
+		REAL v = REAL_NAME(ColorLutShape)(Shaper1, (S1[i] - Min1)*Scale1);
+		REAL w = REAL_NAME(ColorLutShape)(Shaper2, (S2[i] - Min2)*Scale2);
+		int x0 = (int)u, y0 = (int)v, z0 = (int)w;
+		int Base, MaxX, MidY, MinZ, MinY, StrideMax, StrideMin;
+		REAL fx, fy, fz, FMax, FMin, FMid;
+		REAL W0, W1, W2, W3;
+		int V1, V2, V3;
+		
+		
+		x0 = (x0 < Size - 2) ? x0 : Size - 2;
+		y0 = (y0 < Size - 2) ? y0 : Size - 2;
+		z0 = (z0 < Size - 2) ? z0 : Size - 2;
+		fx = u - x0;
+		fy = v - y0;
+		fz = w - z0;
+		Base = 3*x0 + StrideY*y0 + StrideZ*z0;
+		
+		/* Axes of the largest and smallest fractional coordinates */
+		MaxX = (fx >= fy) & (fx >= fz);
+		MidY = (fy >= fz);
+		MinZ = (fz <= fx) & (fz <= fy);
+		MinY = (fy <= fx);
+		StrideMax = MaxX ? 3 : (MidY ? StrideY : StrideZ);
+		FMax = SELECT(MaxX, fx, SELECT(MidY, fy, fz));
+		StrideMin = MinZ ? StrideZ : (MinY ? StrideY : 3);
+		FMin = SELECT(MinZ, fz, SELECT(MinY, fy, fx));
+		FMid = fx + fy + fz - FMax - FMin;
+		
+		V1 = Base + StrideMax;
+		V3 = Base + 3 + StrideY + StrideZ;
+		V2 = V3 - StrideMin;
+		W0 = 1 - FMax;
+		W1 = FMax - FMid;
+		W2 = FMid - FMin;
+		W3 = FMin;
+		
+		D0[i] = W0*Table[Base] + W1*Table[V1] + W2*Table[V2] + W3*Table[V3];
+		D1[i] = W0*Table[Base + 1] + W1*Table[V1 + 1] 
+			+ W2*Table[V2 + 1] + W3*Table[V3 + 1];
+		D2[i] = W0*Table[Base + 2] + W1*Table[V1 + 2] 
+			+ W2*Table[V2 + 2] + W3*Table[V3 + 2];
+	}
+}
+
+
+/**
+ * @brief Apply a colorlut to an array of pixels
+ *
+ * @param Lut colorlut created by BakeColorLut
+ * @param Dest pointers to the first pixel of each output channel
+ * @param DestStride distance in elements between consecutive output pixels
+ * @param Src pointers to the first pixel of each input channel
+ * @param SrcStride distance in elements between consecutive input pixels
+ * @param NumPixels number of pixels
+ *
+ * Inputs outside the range of the table are clamped to it.  Blocks of
+ * COLOR_BLOCK_SIZE pixels are distributed over the threads set by
+ * SetColorThreads when compiled with OpenMP.  Dest may equal Src for an
+ * in-place lookup.
+ */
+void REAL_NAME(ApplyColorLutPlanar)(const colorlut *Lut,
+	REAL *Dest[3], long DestStride, const REAL *Src[3], long SrcStride,
+	long NumPixels)
+{
+	long NumBlocks = (NumPixels + COLOR_BLOCK_SIZE - 1)/COLOR_BLOCK_SIZE;
+	long Block;
+	
+	
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if(NumPixels >= ColorParallelSize) \
+	num_threads(COLOR_NUM_THREADS)
+#endif
+	for(Block = 0; Block < NumBlocks; Block++)
+	{
+		REAL Buf[2][3][COLOR_BLOCK_SIZE];
+		const REAL *In[3];
+		REAL *Out[3];
+		long Start = Block*COLOR_BLOCK_SIZE;
+		int N = (int)MIN(NumPixels - Start, COLOR_BLOCK_SIZE);
+		int Channel, i;
+		
+		
+		for(Channel = 0; Channel < 3; Channel++)
+		{
+			if(SrcStride == 1)
+				In[Channel] = Src[Channel] + Start;
+			else
+			{
+				for(i = 0; i < N; i++)
+					Buf[0][Channel][i] = Src[Channel][(Start + i)*SrcStride];
+				
+				In[Channel] = Buf[0][Channel];
+			}
+			
+			Out[Channel] = (DestStride == 1) ? 
+				Dest[Channel] + Start : Buf[1][Channel];
+		}
+		
+		REAL_NAME(ColorLutBlock)(Lut, Out[0], Out[1], Out[2], 
+			In[0], In[1], In[2], N);
+		
+		if(DestStride != 1)
+			for(Channel = 0; Channel < 3; Channel++)
+				for(i = 0; i < N; i++)
+					Dest[Channel][(Start + i)*DestStride] = Out[Channel][i];
+	}
+}
+
+#undef K
+#undef SELECT
@@ -0,0 +1,160 @@
+/**
+ * @file colorspace_select.c
+ * @author igkiou 2026
+ *
+ * Branch-free block routines of the HSV and HSL transforms of colorspace.c,
+ * with the choices of max channel and hue sextant written as bitwise
+ * selects.  Every candidate is computed with the same operations in the same
+ * order as in the per-pixel kernels of colorspace.c, and the select picks the
+ * one the branches would, so the results are identical bit for bit,
+ * including for NaN and out-of-range input.
+ *
+ * This holds only with IEEE semantics and without fused multiply-adds, which
+ * would round differently from the per-pixel kernels, so this file must be
+ * compiled with -fno-fast-math -ffp-contract=off, whatever the options of
+ * colorspace.c.  For example, with GCC,
+ *    gcc -O2 -fno-fast-math -ffp-contract=off -c colorspace_select.c
+ *    gcc -Ofast -c colorspace.c
+ * The routines need a C99 compiler, and the file is empty otherwise.
+ */
+#include <math.h>
+#include "colorspace_internal.h"
+
+#ifdef COLOR_FAST_KERNELS
+
+#ifdef __FAST_MATH__
+#error "colorspace_select.c must be compiled with -fno-fast-math"
+#endif
+
+/** @brief Hue of Rgb2HsvPixel and Rgb2HslPixel in [0,6) before scaling */
+FAST_INLINE num HexHueSelect(num Max, num C, num R, num G, num B)
+{
+	num Q = FastSelect(Max == R, G - B, FastSelect(Max == G, B - R, R - G))/C;
+	
+	
+	return FastSelect(Max == R, FastSelect(G < B, Q + 6, Q),
+		FastSelect(Max == G, 2 + Q, 4 + Q));
+}
+
+
+/** 
+ * @brief Select the RGB of a hue sextant as in the switch of Hsv2RgbPixel
+ *
+ * The sextant is (int)H, for which H in (-1,6) gives 0 to 5 and other values,
+ * including NaN, give black.
+ */
+FAST_INLINE void HexSextantSelect(num *R, num *G, num *B, 
+	num H, num Min, num MinC, num MinX)
+{
+	int64_t Valid = (H > -1) & (H < 6);
+	int64_t k = (int64_t)(H >= 1) + (H >= 2) + (H >= 3) + (H >= 4) + (H >= 5);
+	
+	
+	*R = FastSelect(Valid, FastSelect((k == 0) | (k == 5), MinC,
+		FastSelect((k == 1) | (k == 4), MinX, Min)), 0);
+	*G = FastSelect(Valid, FastSelect((k == 1) | (k == 2), MinC,
+		FastSelect((k == 0) | (k == 3), MinX, Min)), 0);
+	*B = FastSelect(Valid, FastSelect((k == 3) | (k == 4), MinC,
+		FastSelect((k == 2) | (k == 5), MinX, Min)), 0);
+}
+
+
+/** @brief Branch-free Rgb2HsvPixel */
+FAST_INLINE void Rgb2HsvSelect(num *H, num *S, num *V, num R, num G, num B)
+{
+	num Max = MAX3(R, G, B);
+	num Min = MIN3(R, G, B);
+	num C = Max - Min;
+	
+	
+	*V = Max;
+	*H = FastSelect(C > 0, HexHueSelect(Max, C, R, G, B)*60, 0);
+	*S = FastSelect(C > 0, C / Max, 0);
+}
+
+
+/** @brief Branch-free Hsv2RgbPixel */
+FAST_INLINE void Hsv2RgbSelect(num *R, num *G, num *B, num H, num S, num V)
+{
+	num C = S * V;
+	num Min = V - C;
+	num X;
+	
+	
+	H -= 360*floor(H/360);
+	H /= 60;
+	X = C*(1 - fabs(H - 2*floor(H/2) - 1));
+	HexSextantSelect(R, G, B, H, Min, Min + C, Min + X);
+}
+
+
+/** @brief Branch-free Rgb2HslPixel */
+FAST_INLINE void Rgb2HslSelect(num *H, num *S, num *L, num R, num G, num B)
+{
+	num Max = MAX3(R, G, B);
+	num Min = MIN3(R, G, B);
+	num C = Max - Min;
+	num Lightness = (Max + Min)/2;
+	
+	
+	*L = Lightness;
+	*H = FastSelect(C > 0, HexHueSelect(Max, C, R, G, B)*60, 0);
+	*S = FastSelect(C > 0, C/FastSelect(Lightness <= 0.5, 
+		2*Lightness, 2 - 2*Lightness), 0);
+}
+
+
+/** @brief Branch-free Hsl2RgbPixel */
+FAST_INLINE void Hsl2RgbSelect(num *R, num *G, num *B, num H, num S, num L)
+{
+	num C = FastSelect(L <= 0.5, 2*L*S, (2 - 2*L)*S);
+	num Min = L - 0.5*C;
+	num X;
+	
+	
+	H -= 360*floor(H/360);
+	H /= 60;
+	X = C*(1 - fabs(H - 2*floor(H/2) - 1));
+	HexSextantSelect(R, G, B, H, Min, Min + C, Min + X);
+}
+
+
+/** 
+ * @brief Define the block routines of a branch-free per-pixel kernel 
+ * As in DEFINE_BLOCK_TRANSFORM of colorspace.c, the float routine computes
+ * in num.
+ */
+#define DEFINE_SELECT_TRANSFORM(Fun)	\
+FAST_TARGETS void Fun##Block(num *D0, num *D1, num *D2,	\
+	const num *S0, const num *S1, const num *S2, int N)	\
+{	\
+	int i;	\
+	\
+	SIMD_LOOP	\
+	for(i = 0; i < N; i++)	\
+		Fun##Select(&D0[i], &D1[i], &D2[i], S0[i], S1[i], S2[i]);	\
+}	\
+	\
+FAST_TARGETS void Fun##Blockf(float *D0, float *D1, float *D2,	\
+	const float *S0, const float *S1, const float *S2, int N)	\
+{	\
+	int i;	\
+	\
+	SIMD_LOOP	\
+	for(i = 0; i < N; i++)	\
+	{	\
+		num T0, T1, T2;	\
+		\
+		Fun##Select(&T0, &T1, &T2, S0[i], S1[i], S2[i]);	\
+		D0[i] = (float)T0;	\
+		D1[i] = (float)T1;	\
+		D2[i] = (float)T2;	\
+	}	\
+}
+
+DEFINE_SELECT_TRANSFORM(Rgb2Hsv)
+DEFINE_SELECT_TRANSFORM(Hsv2Rgb)
+DEFINE_SELECT_TRANSFORM(Rgb2Hsl)
+DEFINE_SELECT_TRANSFORM(Hsl2Rgb)
+
+#endif  /* COLOR_FAST_KERNELS */
@@ -27,4 +27,304 @@ for k = 1:length(Space)
    fprintf(' RGB<->%-10s   %9.2e    %9.2e\n', Space{k}, RMSE, MaxError);
 end
 
+fprintf(['\nBranch-free HSV and HSL test\n\n',...
+      'The block routines of HSV and HSL should give the same results, bit\n',...
+      'for bit, as the per-pixel routines, whose formulas are written out\n',...
+      'below.  Both are tested with ties, out-of-range values, and hues\n',...
+      'outside [0,360).\n']);
+A = rand(N,3);
+A(1:4:end,2) = A(1:4:end,1);        % Ties between channels
+A(2:4:end,:) = 3*A(2:4:end,:) - 1;  % Out-of-range values
+A(3:8:end,:) = repmat(A(3:8:end,1),1,3);  % Grays
+fprintf('\n Mismatches         double      single\n\n');
+
+for Space = {'HSV', 'HSL'}
+   % Per-pixel forward transform
+   R = A(:,1);
+   G = A(:,2);
+   B = A(:,3);
+   Max = max(max(R,G),B);
+   Min = min(min(R,G),B);
+   C = Max - Min;
+   H = zeros(N,1);
+   S = zeros(N,1);
+   iR = (C > 0) & (Max == R);
+   iG = (C > 0) & (Max ~= R) & (Max == G);
+   iB = (C > 0) & (Max ~= R) & (Max ~= G);
+   H(iR) = (G(iR) - B(iR))./C(iR);
+   H(iR & G < B) = H(iR & G < B) + 6;
+   H(iG) = 2 + (B(iG) - R(iG))./C(iG);
+   H(iB) = 4 + (R(iB) - G(iB))./C(iB);
+   H = H*60;
+   i = (C > 0);
+   
+   if strcmp(Space{1}, 'HSV')
+      Third = Max;
+      S(i) = C(i)./Max(i);
+   else
+      Third = (Max + Min)/2;
+      Low = i & (Third <= 0.5);
+      High = i & ~(Third <= 0.5);
+      S(Low) = C(Low)./(2*Third(Low));
+      S(High) = C(High)./(2 - 2*Third(High));
+   end
+   
+   Ref = {[H,S,Third]};
+   
+   % Per-pixel inverse transform, on hues over several turns
+   H = 1080*A(:,1) - 360;
+   S = min(max(A(:,2),0),1);
+   Third = A(:,3);
+   
+   if strcmp(Space{1}, 'HSV')
+      C = S.*Third;
+      Min = Third - C;
+   else
+      C = (2 - 2*Third).*S;
+      C(Third <= 0.5) = 2*Third(Third <= 0.5).*S(Third <= 0.5);
+      Min = Third - 0.5*C;
+   end
+   
+   H = H - 360*floor(H/360);
+   H = H/60;
+   X = C.*(1 - abs(H - 2*floor(H/2) - 1));
+   Candidates = [Min, Min + C, Min + X];
+   Sextant = [2 3 1; 3 2 1; 1 2 3; 1 3 2; 3 1 2; 2 1 3];
+   Out = zeros(N,3);
+   
+   for k = 0:5
+      i = (fix(H) == k);
+      
+      for Channel = 1:3
+         Out(i,Channel) = Candidates(i,Sextant(k+1,Channel));
+      end
+   end
+   
+   Ref{2} = Out;
+   Src = {A, [1080*A(:,1) - 360, S, Third]};
+   Name = {[Space{1},'<-RGB'], ['RGB<-',Space{1}]};
+   
+   for k = 1:2
+      % Single input is converted in double and rounded
+      Bd = colorspace(Name{k}, Src{k});
+      Bs = colorspace(Name{k}, single(Src{k}));
+      Refs = single(colorspace(Name{k}, double(single(Src{k}))));
+      fprintf(' %-14s   %9d   %9d\n', Name{k}, ...
+         sum(any(Bd ~= Ref{k},2)), sum(any(Bs ~= Refs,2)));
+   end
+end
+
+fprintf(['\nFast routine test\n\n',...
+      'With the option struct(''fast'', true), conversions among sRGB, XYZ,\n',...
+      'L*a*b*, and L*u*v* use vectorized routines, which should agree with\n',...
+      'the exact routines to about 1e-11.\n']);
+A = rand(N,3);
+Fast = struct('fast', true);
+Pairs = {'XYZ','RGB'; 'Lab','RGB'; 'Luv','RGB'; 'Lab','XYZ'; 'Luv','XYZ'};
+fprintf('\n Transform          Max Error\n\n');
+
+for k = 1:size(Pairs,1)
+   Name = {[Pairs{k,1},'<-',Pairs{k,2}], [Pairs{k,2},'<-',Pairs{k,1}]};
+   Src = colorspace([Pairs{k,2},'<-RGB'], A);
+   Src = {Src, colorspace(Name{1}, Src)};
+   
+   for j = 1:2
+      MaxError = max(max(abs(colorspace(Name{j}, Src{j}, Fast) ...
+         - colorspace(Name{j}, Src{j}))));
+      fprintf(' %-16s   %9.2e\n', Name{j}, MaxError);
+   end
+end
+
+fprintf(['\nSingle precision test\n\n',...
+      'Single arrays are converted in single precision.  Relative to the\n',...
+      'largest output, the difference from double precision should be a\n',...
+      'small multiple of eps(''single'') = 1.19e-07.\n']);
+A = single(rand(N,3));
+Space = {'YPbPr', 'YCbCr', 'JPEG-YCbCr', 'YDbDr', 'YIQ','YUV', 'HSV', ...
+      'HSL', 'HSI', 'XYZ', 'Lab', 'Luv', 'LCH', 'CAT02 LMS'};
+fprintf('\n Transform          Rel Error   Class\n\n');
+
+for k = 1:length(Space)
+   Name = [Space{k},'<-RGB'];
+   Bs = colorspace(Name, A);
+   Bd = colorspace(Name, double(A));
+   RelError = max(abs(double(Bs(:)) - Bd(:)))/max(abs(Bd(:)));
+   fprintf(' %-16s   %9.2e   %s\n', Name, RelError, class(Bs));
+end
+
+fprintf(['\nLookup table test\n\n',...
+      'With the option lut, a 3D lookup table is baked over the range of the\n',...
+      'image and applied instead of the transform.  The max error reported\n',...
+      'from random samples should be close to the max error on the image,\n',...
+      'and both should fall as the table grows.  Linear transforms are\n',...
+      'reproduced up to rounding.\n']);
+A = rand(N,3);
+fprintf('\n Transform          Size    Reported    Measured\n\n');
+
+for Name = {'YCbCr<-RGB', 'XYZ<-RGB', 'Lab<-RGB', 'Luv<-RGB'}
+   Exact = colorspace(Name{1}, A);
+   
+   for LutSize = [17, 33, 65]
+      [B, Report] = colorspace(Name{1}, A, struct('lut', LutSize));
+      fprintf(' %-16s   %4d   %9.2e   %9.2e\n', Name{1}, LutSize, ...
+         max(Report.maxerror), max(max(abs(B - Exact))));
+   end
+end
+
+fprintf(['\nInteger input test\n\n',...
+      'uint8 and uint16 images are read as code values 0 to 255 or 0 to\n',...
+      '65535 scaled to [0,1], through precomputed tables.  They should agree\n',...
+      'with double input divided by 255 or 65535 up to rounding.\n']);
+A8 = uint8(floor(256*rand(N,3)));
+A16 = uint16(floor(65536*rand(N,3)));
+A8(1,:) = 0;
+A8(2,:) = 255;
+A16(1,:) = 0;
+A16(2,:) = 65535;
+fprintf('\n Transform          uint8       uint16\n\n');
+
+for k = 1:length(Space)
+   Name = [Space{k},'<-RGB'];
+   Error8 = max(max(abs(colorspace(Name, A8) ...
+      - colorspace(Name, double(A8)/255))));
+   Error16 = max(max(abs(colorspace(Name, A16) ...
+      - colorspace(Name, double(A16)/65535))));
+   fprintf(' %-16s   %9.2e   %9.2e\n', Name, Error8, Error16);
+end
+
+fprintf(['\nTransform chain test\n\n',...
+      'Longer chains are written with more arrows.  Consecutive linear\n',...
+      'stages are folded into one matrix, which should agree with converting\n',...
+      'hop by hop up to rounding.\n']);
+A = rand(N,3);
+Chain = {'RGB->YUV->RGB->YCbCr', 'RGB->YIQ->RGB->JPEG-YCbCr->RGB->HSV', ...
+      'RGB->YDbDr->RGB->Lab', 'XYZ->CAT02 LMS->XYZ->RGB', ...
+      'Lab->XYZ->CAT02 LMS'};
+fprintf('\n Chain                                   Rel Error\n\n');
+
+for k = 1:length(Chain)
+   Hop = regexp(Chain{k}, '->', 'split');
+   Src = colorspace([Hop{1},'<-RGB'], A);
+   Ref = Src;
+   
+   for j = 2:length(Hop)
+      Ref = colorspace([Hop{j-1},'->',Hop{j}], Ref);
+   end
+   
+   B = colorspace(Chain{k}, Src);
+   RelError = max(abs(B(:) - Ref(:)))/max(abs(Ref(:)));
+   fprintf(' %-38s  %9.2e\n', Chain{k}, RelError);
+end
+
+fprintf(['\nThread test\n\n',...
+      'When built with OpenMP, large images are split over threads.  The\n',...
+      'result should not depend on the number of threads.\n']);
+A = rand(N,3);
+Serial = struct('threads', 1);
+Parallel = struct('threads', 4, 'parallelsize', 1);
+fprintf('\n Transform          Mismatches\n\n');
+
+for k = 1:length(Space)
+   Name = [Space{k},'<-RGB'];
+   B1 = colorspace(Name, A, Serial);
+   B4 = colorspace(Name, A, Parallel);
+   fprintf(' %-16s   %10d\n', Name, sum(any(B1 ~= B4,2)));
+end
+
+fprintf(['\nWhite point test\n\n',...
+      'With the options srcwhite and destwhite, colors are adapted between\n',...
+      'white points.  Every adaptation method should map the D50 white to\n',...
+      'the D65 white, L*a*b* = (100,0,0).  Converting to L*a*b* relative to\n',...
+      'D50 and back should recover the image, and the same white on both\n',...
+      'sides should give the unadapted transform.\n']);
+A = rand(N,3);
+D50 = [0.96422, 1, 0.82521];
+fprintf('\n Test                        Max Error\n\n');
+
+for Method = {'XYZ scaling', 'von Kries', 'Bradford', 'CAT02'}
+   Lab = colorspace('Lab<-XYZ', D50, ...
+      struct('srcwhite', 'D50', 'adaptation', Method{1}));
+   fprintf(' D50 white, %-14s   %9.2e\n', Method{1}, ...
+      max(abs(Lab - [100,0,0])));
+end
+
+Lab = colorspace('Lab<-RGB', A, struct('destwhite', 'D50'));
+R = colorspace('RGB<-Lab', Lab, struct('srcwhite', 'D50'));
+fprintf(' RGB<->Lab under D50         %9.2e\n', max(abs(R(:) - A(:))));
+B = colorspace('Lab<-RGB', A, struct('srcwhite', 'D65', 'destwhite', 'D65'));
+fprintf(' Same white                  %9.2e\n', ...
+   max(max(abs(B - colorspace('Lab<-RGB', A)))));
+
+fprintf(['\nStreaming conversion test\n\n',...
+      'colorcalc converts PFM files in bands of rows, and should match\n',...
+      'colorspace on the same single precision image.  The test is skipped\n',...
+      'unless colorcalc is compiled in the current directory.\n']);
+
+if exist('colorcalc', 'file')
+   A = single(rand(150,37,3));
+   fprintf('\n Transform          Rel Error\n\n');
+   
+   for Name = {'Lab<-RGB', 'HSV<-RGB', 'YCbCr<-RGB'}
+      % PFM holds interleaved float rows from the bottom up
+      fid = fopen('colorspace_test_in.pfm', 'w');
+      fprintf(fid, 'PF\n%d %d\n-1.0\n', size(A,2), size(A,1));
+      fwrite(fid, permute(A(end:-1:1,:,:), [3,2,1]), 'float32', 'ieee-le');
+      fclose(fid);
+      
+      system(['./colorcalc -b 16 "', Name{1}, ...
+         '" colorspace_test_in.pfm colorspace_test_out.pfm']);
+      
+      fid = fopen('colorspace_test_out.pfm', 'r');
+      fgetl(fid);
+      Size = sscanf(fgetl(fid), '%d %d');
+      fgetl(fid);
+      B = fread(fid, 3*Size(1)*Size(2), 'float32', 'ieee-le');
+      fclose(fid);
+      B = permute(reshape(B, [3, Size(1), Size(2)]), [3,2,1]);
+      B = B(end:-1:1,:,:);
+      delete('colorspace_test_in.pfm', 'colorspace_test_out.pfm');
+      
+      Ref = colorspace(Name{1}, double(A));
+      fprintf(' %-16s   %9.2e\n', Name{1}, ...
+         max(abs(B(:) - Ref(:)))/max(abs(Ref(:))));
+   end
+end
+
+fprintf(['\nColor difference test\n\n',...
+      'colordiff should reproduce the CIEDE2000 test data of Sharma, Wu, and\n',...
+      'Dalal (2005) to the four decimals given, and DE76 should equal the\n',...
+      'Euclidean distance in L*a*b*.  The test is skipped unless colordiff\n',...
+      'is compiled.\n']);
+Data = [50.0000   2.6772 -79.7751  50.0000   0.0000 -82.7485   2.0425
+        50.0000   3.1571 -77.2803  50.0000   0.0000 -82.7485   2.8615
+        50.0000   2.8361 -74.0200  50.0000   0.0000 -82.7485   3.4412
+        50.0000  -1.3802 -84.2814  50.0000   0.0000 -82.7485   1.0000
+        50.0000   0.0000   0.0000  50.0000  -1.0000   2.0000   2.3669
+        50.0000  -1.0000   2.0000  50.0000   0.0000   0.0000   2.3669
+        50.0000   2.4900  -0.0010  50.0000  -2.4900   0.0009   7.1792
+        50.0000   2.4900  -0.0010  50.0000  -2.4900   0.0011   7.2195
+        50.0000   2.5000   0.0000  50.0000   0.0000  -2.5000   4.3065
+        50.0000   2.5000   0.0000  73.0000  25.0000 -18.0000  27.1492
+        50.0000   2.5000   0.0000  61.0000  -5.0000  29.0000  22.8977
+        50.0000   2.5000   0.0000  56.0000 -27.0000  -3.0000  31.9030
+        50.0000   2.5000   0.0000  58.0000  24.0000  15.0000  19.4535
+        60.2574 -34.0099  36.2677  60.4626 -34.1751  39.4387   1.2644
+        63.0109 -31.0961  -5.8663  62.8187 -29.7946  -4.0864   1.2630
+        22.7233  20.0904 -46.6940  23.0331  14.9730 -42.5619   2.0373
+        90.8027  -2.0831   1.4410  91.1528  -1.6435   0.0447   1.4441
+         2.0776   0.0795  -1.1350   0.9033  -0.0636  -0.5514   0.9082];
+if exist('colordiff', 'file')
+   Lab1 = Data(:,1:3);
+   Lab2 = Data(:,4:6);
+   [Stats, D] = colordiff(Lab1, Lab2, struct('space', 'Lab'));
+   [Stats76, D76] = colordiff(Lab1, Lab2, ...
+      struct('space', 'Lab', 'formula', 'DE76'));
+   fprintf('\n Formula            Max Error\n\n');
+   fprintf(' DE2000             %9.2e\n', max(abs(D - Data(:,7))));
+   fprintf(' DE76               %9.2e\n', ...
+      max(abs(D76 - sqrt(sum((Lab1 - Lab2).^2,2)))));
+   fprintf(' DE2000 mean, max   %9.2e\n', ...
+      max(abs([Stats.mean - mean(D), Stats.max - max(D)])));
+end
+
 fprintf('\n\n');
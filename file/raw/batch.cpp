@@ -0,0 +1,356 @@
+/*
+ * batch.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+#include "../raw/batch.h"
+#include "../raw/packing.h"
+
+namespace raw {
+
+namespace {
+
+/*
+ * Worker statuses for a file that decoded fine but does not fit the stack.
+ * LibRaw error codes are negative, so these cannot collide with them.
+ */
+const int kSizeMismatch = 1;
+const int kBitDepthMismatch = 2;
+
+struct BatchOptions {
+	bool doSubtractDarkFrame;
+	bool doProcess;
+	libraw_output_params_t params;
+};
+
+struct FrameSize {
+	int height;
+	int width;
+	int numChannels;
+
+	bool operator==(const FrameSize& other) const {
+		return (height == other.height) && (width == other.width) &&
+				(numChannels == other.numChannels);
+	}
+
+	std::size_t getNumberOfElements() const {
+		return static_cast<std::size_t>(height) * width * numChannels;
+	}
+};
+
+/*
+ * The following run on worker threads and must not call into the MEX API, so
+ * failures are returned as LibRaw error codes and reported afterwards.
+ */
+int decodeFile(libraw::LibRawExtension& rawProcessor,
+			const std::string& fileName, const MappedFile& mappedFile,
+			const BatchOptions& options) {
+	rawProcessor.imgdata.params = options.params;
+	int errorCode = openRawFile(rawProcessor, fileName, mappedFile);
+	if (errorCode != LIBRAW_SUCCESS) {
+		return errorCode;
+	}
+	errorCode = rawProcessor.unpack();
+	if (errorCode != LIBRAW_SUCCESS) {
+		return errorCode;
+	}
+	if (options.doProcess) {
+		return rawProcessor.dcraw_process();
+	}
+	errorCode = rawProcessor.raw2image();
+	if ((errorCode != LIBRAW_SUCCESS) || (!options.doSubtractDarkFrame)) {
+		return errorCode;
+	}
+	return rawProcessor.subtract_black();
+}
+
+FrameSize getFrameSize(const libraw::LibRawExtension& rawProcessor,
+					const BatchOptions& options) {
+	FrameSize frameSize;
+	frameSize.height = rawProcessor.imgdata.sizes.iheight;
+	frameSize.width = rawProcessor.imgdata.sizes.iwidth;
+	frameSize.numChannels = (options.doProcess)
+							?(rawProcessor.imgdata.idata.colors)
+							:(1);
+	return frameSize;
+}
+
+int copyFrame(libraw::LibRawExtension& rawProcessor,
+			const BatchOptions& options, PixelType* pixelBuffer) {
+	return (options.doProcess)?(rawProcessor.copy_processed(pixelBuffer))
+							:(rawProcessor.copy_mosaic(pixelBuffer));
+}
+
+void checkErrorCodes(const std::vector<std::string>& fileNames,
+					const std::vector<int>& errorCodes) {
+	for (int iterFile = 0, numFiles = static_cast<int>(fileNames.size());
+			iterFile < numFiles; ++iterFile) {
+		if (errorCodes[iterFile] == kSizeMismatch) {
+			std::string message = fileNames[iterFile]
+				+ ": dimensions differ from the first file, use cell output";
+			mexAssertEx(0, message.c_str());
+		} else if (errorCodes[iterFile] == kBitDepthMismatch) {
+			std::string message = fileNames[iterFile]
+				+ ": white level exceeds the packed bit depth of the first file";
+			mexAssertEx(0, message.c_str());
+		} else if (errorCodes[iterFile] != LIBRAW_SUCCESS) {
+			std::string message = fileNames[iterFile] + ": "
+								+ libraw_strerror(errorCodes[iterFile]);
+			mexAssertEx(0, message.c_str());
+		}
+	}
+}
+
+std::vector<int> getDimensions(const FrameSize& frameSize) {
+	std::vector<int> dimensions;
+	dimensions.push_back(frameSize.height);
+	dimensions.push_back(frameSize.width);
+	if (frameSize.numChannels > 1) {
+		dimensions.push_back(frameSize.numChannels);
+	}
+	return dimensions;
+}
+
+mex::MxArray readStack(const std::vector<std::string>& fileNames,
+					const BatchOptions& options) {
+	int numFiles = static_cast<int>(fileNames.size());
+	std::vector<int> errorCodes(numFiles, LIBRAW_SUCCESS);
+
+	/*
+	 * The first file is decoded on its own to size the stack, after which
+	 * every worker writes straight into its slice.
+	 */
+	FrameSize frameSize = {0, 0, 0};
+	std::unique_ptr<mex::MxNumeric<PixelType> > pixelArray;
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		libraw::LibRawExtension& rawProcessor = rawProcessorHandle.get();
+		MappedFile mappedFile(fileNames[0]);
+		errorCodes[0] = decodeFile(rawProcessor, fileNames[0], mappedFile,
+								options);
+		if (errorCodes[0] == LIBRAW_SUCCESS) {
+			frameSize = getFrameSize(rawProcessor, options);
+			std::vector<int> dimensions = getDimensions(frameSize);
+			dimensions.push_back(numFiles);
+			pixelArray.reset(new mex::MxNumeric<PixelType>(
+						static_cast<int>(dimensions.size()), &dimensions[0]));
+			errorCodes[0] = copyFrame(rawProcessor, options,
+									pixelArray->getData());
+		}
+	}
+	checkErrorCodes(fileNames, errorCodes);
+
+	PixelType* pixelBuffer = pixelArray->getData();
+	const std::size_t frameElements = frameSize.getNumberOfElements();
+#pragma omp parallel
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		libraw::LibRawExtension& rawProcessor = rawProcessorHandle.get();
+#pragma omp for schedule(dynamic)
+		for (int iterFile = 1; iterFile < numFiles; ++iterFile) {
+			MappedFile mappedFile(fileNames[iterFile]);
+			int errorCode = decodeFile(rawProcessor, fileNames[iterFile],
+									mappedFile, options);
+			if (errorCode == LIBRAW_SUCCESS) {
+				if (getFrameSize(rawProcessor, options) == frameSize) {
+					errorCode = copyFrame(rawProcessor, options, pixelBuffer
+								+ static_cast<std::size_t>(iterFile)
+									* frameElements);
+				} else {
+					errorCode = kSizeMismatch;
+				}
+			}
+			errorCodes[iterFile] = errorCode;
+		}
+	}
+	checkErrorCodes(fileNames, errorCodes);
+
+	return mex::MxArray(pixelArray->get_array());
+}
+
+mex::MxArray readCell(const std::vector<std::string>& fileNames,
+					const BatchOptions& options) {
+	int numFiles = static_cast<int>(fileNames.size());
+	std::vector<int> errorCodes(numFiles, LIBRAW_SUCCESS);
+	std::vector<FrameSize> frameSizes(numFiles);
+	std::vector<std::vector<PixelType> > frames(numFiles);
+
+	/*
+	 * MATLAB arrays cannot be created on worker threads, so frames are decoded
+	 * into private buffers and moved into the cell array afterwards.
+	 */
+#pragma omp parallel
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		libraw::LibRawExtension& rawProcessor = rawProcessorHandle.get();
+#pragma omp for schedule(dynamic)
+		for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+			MappedFile mappedFile(fileNames[iterFile]);
+			int errorCode = decodeFile(rawProcessor, fileNames[iterFile],
+									mappedFile, options);
+			if (errorCode == LIBRAW_SUCCESS) {
+				frameSizes[iterFile] = getFrameSize(rawProcessor, options);
+				frames[iterFile].resize(
+								frameSizes[iterFile].getNumberOfElements());
+				errorCode = copyFrame(rawProcessor, options,
+									&frames[iterFile][0]);
+			}
+			errorCodes[iterFile] = errorCode;
+		}
+	}
+	checkErrorCodes(fileNames, errorCodes);
+
+	std::vector<mex::MxArray*> pixelArrays;
+	for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+		std::vector<int> dimensions = getDimensions(frameSizes[iterFile]);
+		mex::MxNumeric<PixelType>* pixelArray = new mex::MxNumeric<PixelType>(
+						static_cast<int>(dimensions.size()), &dimensions[0]);
+		std::copy(frames[iterFile].begin(), frames[iterFile].end(),
+				pixelArray->getData());
+		std::vector<PixelType>().swap(frames[iterFile]);
+		pixelArrays.push_back(pixelArray);
+	}
+	mex::MxCell retArg(pixelArrays);
+	for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+		delete pixelArrays[iterFile];
+	}
+	return retArg;
+}
+
+mex::MxArray readPacked(const std::vector<std::string>& fileNames,
+					const BatchOptions& options) {
+	mexAssertEx(!options.doProcess,
+				"Packed output is supported only for raw mosaics");
+	int numFiles = static_cast<int>(fileNames.size());
+	std::vector<int> errorCodes(numFiles, LIBRAW_SUCCESS);
+
+	/*
+	 * As for stacks, the first file sizes the output and also fixes its bit
+	 * depth. Workers check that their own white level fits that depth, as
+	 * packing would otherwise silently truncate their samples.
+	 */
+	FrameSize frameSize = {0, 0, 0};
+	std::unique_ptr<PackedMosaic> packedMosaic;
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		libraw::LibRawExtension& rawProcessor = rawProcessorHandle.get();
+		MappedFile mappedFile(fileNames[0]);
+		errorCodes[0] = decodeFile(rawProcessor, fileNames[0], mappedFile,
+								options);
+		if (errorCodes[0] == LIBRAW_SUCCESS) {
+			frameSize = getFrameSize(rawProcessor, options);
+			int bitDepth = getPackedBitDepth(
+									rawProcessor.imgdata.color.maximum);
+			mexAssertEx(bitDepth > 0,
+						"Packed output requires data of at most 14 bits");
+			packedMosaic.reset(new PackedMosaic(frameSize.height,
+									frameSize.width, numFiles, bitDepth));
+			std::vector<PixelType> frame(frameSize.getNumberOfElements());
+			errorCodes[0] = copyFrame(rawProcessor, options, &frame[0]);
+			if (errorCodes[0] == LIBRAW_SUCCESS) {
+				packedMosaic->packFrame(0, &frame[0]);
+			}
+		}
+	}
+	checkErrorCodes(fileNames, errorCodes);
+
+#pragma omp parallel
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		libraw::LibRawExtension& rawProcessor = rawProcessorHandle.get();
+		std::vector<PixelType> frame(frameSize.getNumberOfElements());
+#pragma omp for schedule(dynamic)
+		for (int iterFile = 1; iterFile < numFiles; ++iterFile) {
+			MappedFile mappedFile(fileNames[iterFile]);
+			int errorCode = decodeFile(rawProcessor, fileNames[iterFile],
+									mappedFile, options);
+			if (errorCode == LIBRAW_SUCCESS) {
+				int bitDepth = getPackedBitDepth(
+									rawProcessor.imgdata.color.maximum);
+				if (!(getFrameSize(rawProcessor, options) == frameSize)) {
+					errorCode = kSizeMismatch;
+				} else if ((bitDepth == 0) ||
+						(bitDepth > packedMosaic->getBitDepth())) {
+					errorCode = kBitDepthMismatch;
+				} else {
+					errorCode = copyFrame(rawProcessor, options, &frame[0]);
+					if (errorCode == LIBRAW_SUCCESS) {
+						packedMosaic->packFrame(iterFile, &frame[0]);
+					}
+				}
+			}
+			errorCodes[iterFile] = errorCode;
+		}
+	}
+	checkErrorCodes(fileNames, errorCodes);
+
+	return toMxArray(*packedMosaic);
+}
+
+}  // namespace
+
+EBatchOutput toBatchOutput(const std::string& outputName) {
+	if (!outputName.compare("stack")) {
+		return EBatchOutput::EStack;
+	} else if (!outputName.compare("cell")) {
+		return EBatchOutput::ECell;
+	} else if (!outputName.compare("packed")) {
+		return EBatchOutput::EPacked;
+	} else {
+		return EBatchOutput::EInvalid;
+	}
+}
+
+mex::MxArray readBatch(const std::vector<std::string>& fileNames,
+					bool doSubtractDarkFrame, const std::string& dcrawFlags,
+					EBatchOutput output) {
+	mexAssertEx(!fileNames.empty(), "At least one file name is required");
+
+	/*
+	 * Flags are parsed once, on this thread, into a parameter block that every
+	 * worker copies into its processor. String parameters point into
+	 * dcrawFlags, which outlives the workers.
+	 */
+	BatchOptions options;
+	options.doSubtractDarkFrame = doSubtractDarkFrame;
+	options.doProcess = !dcrawFlags.empty();
+	{
+		libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+		options.params = rawProcessorHandle.get().imgdata.params;
+	}
+	if (options.doProcess) {
+		parseDcrawFlags(dcrawFlags, options.params);
+		options.params.output_tiff = 1;
+		options.params.output_bps = 16;
+	}
+
+	switch (output) {
+		case EBatchOutput::EStack: {
+			return readStack(fileNames, options);
+		}
+		case EBatchOutput::ECell: {
+			return readCell(fileNames, options);
+		}
+		case EBatchOutput::EPacked: {
+			return readPacked(fileNames, options);
+		}
+		default: {
+			mexAssertEx(0, "Unknown batch output type");
+			return mex::MxArray();
+		}
+	}
+}
+
+}  // namespace raw
@@ -0,0 +1,51 @@
+/*
+ * batch.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <string>
+#include <vector>
+
+#include "../include/file.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Batch reading of raw files, e.g. an exposure bracket or a timelapse. Files
+ * are decoded concurrently by OpenMP worker threads, each holding one
+ * processor from the default LibRawPool for the whole batch. The processing
+ * options are shared: with empty dcrawFlags every file is read as a raw
+ * mosaic (optionally dark-subtracted), otherwise it goes through
+ * dcraw_process() as in RawInputFile::readData.
+ *
+ * Stacked output is a single height x width x (channels x) numFiles array,
+ * written in place; every file must then decode to the same dimensions as the
+ * first one, which is decoded before the others to size the stack. Cell output
+ * allows heterogeneous files. Packed output is a stack of raw mosaics stored
+ * as a PackedMosaic, at the bit depth of the white level of the first file;
+ * every worker packs its frame as soon as it is decoded, so the unpacked stack
+ * is never held in memory.
+ */
+enum class EBatchOutput {
+	EStack = 0,
+	ECell,
+	EPacked,
+	ELength,
+	EInvalid = -1
+};
+
+EBatchOutput toBatchOutput(const std::string& outputName);
+
+mex::MxArray readBatch(const std::vector<std::string>& fileNames,
+					bool doSubtractDarkFrame, const std::string& dcrawFlags,
+					EBatchOutput output);
+
+}  // namespace raw
+
+#endif  // BATCH_H_
@@ -0,0 +1,548 @@
+/*
+ * calibration.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <utility>
+
+#include "../raw/calibration.h"
+
+namespace raw {
+
+namespace {
+
+/*
+ * Number of planes buffered per remedian level. The median of five is
+ * computed with a sorting network, so this cannot be changed on its own.
+ */
+const int kRemedianBase = 5;
+
+/*
+ * Number of samples per thread chunk in flat, streaming passes.
+ */
+const std::ptrdiff_t kChunkSize = 1 << 16;
+
+const char kSidecarMagic[8] = {'I', 'U', 'R', 'A', 'W', 'C', 'A', 'L'};
+const std::int32_t kSidecarVersion = 1;
+
+inline void sortPair(PixelType& first, PixelType& second) {
+	PixelType low = std::min(first, second);
+	second = std::max(first, second);
+	first = low;
+}
+
+/*
+ * Median of five planes, with the optimal nine-comparator sorting network.
+ * Only min and max are used, so the inner loop vectorizes.
+ */
+void medianOfFive(const PixelType* planes, std::size_t numPixels,
+				PixelType* median) {
+	const PixelType* plane0 = planes;
+	const PixelType* plane1 = plane0 + numPixels;
+	const PixelType* plane2 = plane1 + numPixels;
+	const PixelType* plane3 = plane2 + numPixels;
+	const PixelType* plane4 = plane3 + numPixels;
+	const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(numPixels);
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+		const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+		for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+			PixelType v0 = plane0[iter];
+			PixelType v1 = plane1[iter];
+			PixelType v2 = plane2[iter];
+			PixelType v3 = plane3[iter];
+			PixelType v4 = plane4[iter];
+			sortPair(v0, v1);
+			sortPair(v3, v4);
+			sortPair(v2, v4);
+			sortPair(v2, v3);
+			sortPair(v0, v3);
+			sortPair(v0, v2);
+			sortPair(v1, v4);
+			sortPair(v1, v3);
+			sortPair(v1, v2);
+			median[iter] = v2;
+		}
+	}
+}
+
+}  // namespace
+
+std::string toSidecarToken(const std::string& name) {
+	std::string token(name);
+	for (std::string::iterator iter = token.begin(); iter != token.end();
+			++iter) {
+		if (!std::isalnum(static_cast<unsigned char>(*iter))) {
+			*iter = '_';
+		}
+	}
+	return token;
+}
+
+std::string joinPath(const std::string& directory,
+					const std::string& fileName) {
+	if (directory.empty()) {
+		return fileName;
+	}
+	char separator = directory[directory.size() - 1];
+	return ((separator == '/') || (separator == '\\'))
+			?(directory + fileName)
+			:(directory + "/" + fileName);
+}
+
+void writeString(std::ofstream& file, const std::string& value) {
+	std::uint32_t length = static_cast<std::uint32_t>(value.size());
+	file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	file.write(value.data(), length);
+}
+
+bool readString(std::ifstream& file, std::string& value) {
+	std::uint32_t length;
+	file.read(reinterpret_cast<char*>(&length), sizeof(length));
+	if ((!file) || (length > 1024)) {
+		return false;
+	}
+	value.resize(length);
+	if (length > 0) {
+		file.read(&value[0], length);
+	}
+	return static_cast<bool>(file);
+}
+
+ECalibrationType toCalibrationType(const std::string& typeName) {
+	if (!typeName.compare("dark")) {
+		return ECalibrationType::EDark;
+	} else if (!typeName.compare("flat")) {
+		return ECalibrationType::EFlat;
+	} else {
+		return ECalibrationType::EInvalid;
+	}
+}
+
+ECombineMethod toCombineMethod(const std::string& methodName) {
+	if (!methodName.compare("mean")) {
+		return ECombineMethod::EMean;
+	} else if (!methodName.compare("median")) {
+		return ECombineMethod::EMedian;
+	} else {
+		return ECombineMethod::EInvalid;
+	}
+}
+
+/*
+ * FrameCombiner implementation.
+ */
+FrameCombiner::FrameCombiner(ECombineMethod method, int height, int width)
+						: m_method(method),
+						  m_numPixels(static_cast<std::size_t>(height) * width),
+						  m_numFrames(0),
+						  m_sum(),
+						  m_levels(),
+						  m_levelCounts(),
+						  m_median() {
+	mexAssert((method == ECombineMethod::EMean) ||
+			(method == ECombineMethod::EMedian));
+	if (m_method == ECombineMethod::EMean) {
+		m_sum.resize(m_numPixels, 0.0);
+	} else {
+		m_median.resize(m_numPixels);
+	}
+}
+
+void FrameCombiner::addFrame(const PixelType* mosaic) {
+	if (m_method == ECombineMethod::EMean) {
+		double* sum = &m_sum[0];
+		const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(m_numPixels);
+#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+			const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+			for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+				sum[iter] += static_cast<double>(mosaic[iter]);
+			}
+		}
+	} else {
+		addToLevel(mosaic, 0);
+	}
+	++m_numFrames;
+}
+
+void FrameCombiner::addToLevel(const PixelType* plane, int level) {
+	if (level == static_cast<int>(m_levels.size())) {
+		m_levels.push_back(std::vector<PixelType>(kRemedianBase * m_numPixels));
+		m_levelCounts.push_back(0);
+	}
+	PixelType* levelPlanes = &m_levels[level][0];
+	std::copy(plane, plane + m_numPixels,
+			levelPlanes + m_levelCounts[level] * m_numPixels);
+	if (++m_levelCounts[level] == kRemedianBase) {
+		/*
+		 * plane may alias m_median when called from the level below, but it
+		 * has been copied into this level before m_median is overwritten.
+		 */
+		medianOfFive(levelPlanes, m_numPixels, &m_median[0]);
+		m_levelCounts[level] = 0;
+		addToLevel(&m_median[0], level + 1);
+	}
+}
+
+int FrameCombiner::getNumberOfFrames() const {
+	return m_numFrames;
+}
+
+void FrameCombiner::combine(CalibrationPixelType* master) const {
+	mexAssertEx(m_numFrames > 0, "No frames to combine");
+	const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(m_numPixels);
+	if (m_method == ECombineMethod::EMean) {
+		const double* sum = &m_sum[0];
+		const double scale = 1.0 / m_numFrames;
+#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+			const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+			for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+				master[iter] = static_cast<CalibrationPixelType>(
+														sum[iter] * scale);
+			}
+		}
+		return;
+	}
+
+	/*
+	 * Weighted median over all buffered planes, where a plane at level l
+	 * stands for kRemedianBase^l frames.
+	 */
+	const int numLevels = static_cast<int>(m_levels.size());
+	std::vector<double> levelWeights(numLevels);
+	double totalWeight = 0.0;
+	for (int level = 0, weight = 1; level < numLevels;
+			++level, weight *= kRemedianBase) {
+		levelWeights[level] = weight;
+		totalWeight += m_levelCounts[level] * static_cast<double>(weight);
+	}
+#pragma omp parallel
+	{
+		std::vector<std::pair<PixelType, double> > samples;
+		samples.reserve(kRemedianBase * numLevels);
+#pragma omp for schedule(static)
+		for (std::ptrdiff_t iter = 0; iter < length; ++iter) {
+			samples.clear();
+			for (int level = 0; level < numLevels; ++level) {
+				const PixelType* levelPlanes = &m_levels[level][0];
+				for (int slot = 0; slot < m_levelCounts[level]; ++slot) {
+					samples.push_back(std::make_pair(
+								levelPlanes[slot * m_numPixels + iter],
+								levelWeights[level]));
+				}
+			}
+			std::sort(samples.begin(), samples.end());
+			double cumulativeWeight = 0.0;
+			std::vector<std::pair<PixelType, double> >::const_iterator sample =
+															samples.begin();
+			for (; sample != samples.end(); ++sample) {
+				cumulativeWeight += sample->second;
+				if (2.0 * cumulativeWeight >= totalWeight) {
+					break;
+				}
+			}
+			master[iter] = static_cast<CalibrationPixelType>(sample->first);
+		}
+	}
+}
+
+/*
+ * MasterFrame implementation.
+ */
+MasterFrame::MasterFrame()
+						: m_type(ECalibrationType::EInvalid),
+						  m_settings(),
+						  m_height(0),
+						  m_width(0),
+						  m_data() {}
+
+MasterFrame::MasterFrame(ECalibrationType type,
+						const CaptureSettings& settings, int height, int width)
+						: m_type(type),
+						  m_settings(settings),
+						  m_height(height),
+						  m_width(width),
+						  m_data(static_cast<std::size_t>(height) * width) {}
+
+ECalibrationType MasterFrame::getType() const {
+	return m_type;
+}
+
+const CaptureSettings& MasterFrame::getCaptureSettings() const {
+	return m_settings;
+}
+
+int MasterFrame::getHeight() const {
+	return m_height;
+}
+
+int MasterFrame::getWidth() const {
+	return m_width;
+}
+
+CalibrationPixelType* MasterFrame::getData() {
+	return &m_data[0];
+}
+
+const CalibrationPixelType* MasterFrame::getData() const {
+	return &m_data[0];
+}
+
+bool MasterFrame::save(const std::string& fileName) const {
+	std::ofstream file(fileName.c_str(),
+					std::ofstream::out | std::ofstream::binary);
+	if (!file) {
+		return false;
+	}
+	std::int32_t header[4] = {kSidecarVersion, static_cast<std::int32_t>(m_type),
+							m_height, m_width};
+	file.write(kSidecarMagic, sizeof(kSidecarMagic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&m_settings.isoSpeed),
+			sizeof(m_settings.isoSpeed));
+	file.write(reinterpret_cast<const char*>(&m_settings.shutter),
+			sizeof(m_settings.shutter));
+	writeString(file, m_settings.make);
+	writeString(file, m_settings.model);
+	file.write(reinterpret_cast<const char*>(&m_data[0]),
+			m_data.size() * sizeof(CalibrationPixelType));
+	return static_cast<bool>(file);
+}
+
+bool MasterFrame::load(const std::string& fileName) {
+	std::ifstream file(fileName.c_str(),
+					std::ifstream::in | std::ifstream::binary);
+	if (!file) {
+		return false;
+	}
+	char magic[sizeof(kSidecarMagic)];
+	file.read(magic, sizeof(magic));
+	if ((!file) || (!std::equal(magic, magic + sizeof(magic), kSidecarMagic))) {
+		return false;
+	}
+	std::int32_t header[4];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if ((!file) || (header[0] != kSidecarVersion) || (header[1] < 0) ||
+			(header[1] >= static_cast<std::int32_t>(ECalibrationType::ELength)) ||
+			(header[2] <= 0) || (header[3] <= 0)) {
+		return false;
+	}
+	CaptureSettings settings;
+	file.read(reinterpret_cast<char*>(&settings.isoSpeed),
+			sizeof(settings.isoSpeed));
+	file.read(reinterpret_cast<char*>(&settings.shutter),
+			sizeof(settings.shutter));
+	if ((!file) || (!readString(file, settings.make)) ||
+			(!readString(file, settings.model))) {
+		return false;
+	}
+	std::vector<CalibrationPixelType> data(
+							static_cast<std::size_t>(header[2]) * header[3]);
+	file.read(reinterpret_cast<char*>(&data[0]),
+			data.size() * sizeof(CalibrationPixelType));
+	if (!file) {
+		return false;
+	}
+	m_type = static_cast<ECalibrationType>(header[1]);
+	m_settings = settings;
+	m_height = header[2];
+	m_width = header[3];
+	m_data.swap(data);
+	return true;
+}
+
+std::string getSidecarName(const std::string& cacheDirectory,
+						ECalibrationType type,
+						const CaptureSettings& settings) {
+	/*
+	 * Shutter times are keyed in microseconds so that the name is exact for
+	 * the usual 1/n s values.
+	 */
+	char exposure[64];
+	std::snprintf(exposure, sizeof(exposure), "_iso%d_%ldus",
+				static_cast<int>(std::lround(settings.isoSpeed)),
+				std::lround(static_cast<double>(settings.shutter) * 1.0e6));
+	std::string fileName = toSidecarToken(settings.make) + "_"
+						+ toSidecarToken(settings.model) + exposure
+						+ ((type == ECalibrationType::EDark)?(".dark"):(".flat"));
+	return joinPath(cacheDirectory, fileName);
+}
+
+MasterFrame buildMasterFrame(const std::vector<std::string>& fileNames,
+							ECalibrationType type, ECombineMethod method,
+							const std::string& cacheDirectory) {
+	mexAssertEx(!fileNames.empty(), "At least one file name is required");
+	mexAssertEx((type == ECalibrationType::EDark) ||
+				(type == ECalibrationType::EFlat),
+				"Unknown calibration type");
+
+	CaptureSettings settings;
+	int height = 0;
+	int width = 0;
+	std::unique_ptr<FrameCombiner> combiner;
+	std::vector<PixelType> mosaic;
+	std::vector<unsigned char> filterArray;
+	std::vector<CalibrationPixelType> blackLevel;
+	for (int iterFile = 0, numFiles = static_cast<int>(fileNames.size());
+			iterFile < numFiles; ++iterFile) {
+		RawInputFile file(mex::MxString(fileNames[iterFile]));
+		if (iterFile == 0) {
+			settings = file.getCaptureSettings();
+			height = file.getHeight();
+			width = file.getWidth();
+			combiner.reset(new FrameCombiner(method, height, width));
+			mosaic.resize(static_cast<std::size_t>(height) * width);
+			if (type == ECalibrationType::EFlat) {
+				filterArray.resize(mosaic.size());
+				file.readFilterArray(&filterArray[0]);
+				blackLevel.resize(mosaic.size());
+				file.readBlackLevel(&blackLevel[0]);
+			}
+		}
+		CaptureSettings fileSettings = file.getCaptureSettings();
+		mexAssertEx((fileSettings.make == settings.make) &&
+					(fileSettings.model == settings.model) &&
+					(file.getHeight() == height) && (file.getWidth() == width),
+					"Calibration frames must come from the same camera");
+		file.readData(false, &mosaic[0]);
+		combiner->addFrame(&mosaic[0]);
+	}
+
+	MasterFrame masterFrame(type, settings, height, width);
+	CalibrationPixelType* master = masterFrame.getData();
+	combiner->combine(master);
+	combiner.reset();
+
+	if (type == ECalibrationType::EFlat) {
+		/*
+		 * Dark-subtract the combined flat, which commutes with the mean and the
+		 * median, and turn it into a gain that maps every CFA color to its
+		 * mean. Pixels without signal keep unit gain.
+		 */
+		MasterFrame masterDark;
+		const CalibrationPixelType* dark = &blackLevel[0];
+		if ((!cacheDirectory.empty()) &&
+				(masterDark.load(getSidecarName(cacheDirectory,
+									ECalibrationType::EDark, settings))) &&
+				(masterDark.getHeight() == height) &&
+				(masterDark.getWidth() == width)) {
+			dark = masterDark.getData();
+		}
+		const std::size_t numPixels = masterFrame.getHeight()
+									* static_cast<std::size_t>(width);
+		double colorSum[4] = {0.0, 0.0, 0.0, 0.0};
+		std::size_t colorCount[4] = {0, 0, 0, 0};
+		for (std::size_t iter = 0; iter < numPixels; ++iter) {
+			master[iter] -= dark[iter];
+			if (master[iter] > 0) {
+				colorSum[filterArray[iter] & 3] += static_cast<double>(master[iter]);
+				++colorCount[filterArray[iter] & 3];
+			}
+		}
+		CalibrationPixelType colorMean[4];
+		for (int color = 0; color < 4; ++color) {
+			colorMean[color] = (colorCount[color] > 0)
+							?(static_cast<CalibrationPixelType>(
+									colorSum[color]
+									/ static_cast<double>(colorCount[color])))
+							:(1.0f);
+		}
+		for (std::size_t iter = 0; iter < numPixels; ++iter) {
+			master[iter] = (master[iter] > 0)
+						?(colorMean[filterArray[iter] & 3] / master[iter])
+						:(1.0f);
+		}
+	}
+
+	if (!cacheDirectory.empty()) {
+		mexAssertEx(masterFrame.save(getSidecarName(cacheDirectory, type,
+													settings)),
+					"Failed to write calibration sidecar");
+	}
+	return masterFrame;
+}
+
+void applyCalibration(const PixelType* mosaic,
+					const CalibrationPixelType* dark,
+					const CalibrationPixelType* gain, std::size_t numPixels,
+					CalibrationPixelType* calibrated) {
+	const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(numPixels);
+	if (gain != nullptr) {
+#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+			const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+			for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+				calibrated[iter] = (static_cast<CalibrationPixelType>(
+								mosaic[iter]) - dark[iter]) * gain[iter];
+			}
+		}
+	} else {
+#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+			const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+			for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+				calibrated[iter] = static_cast<CalibrationPixelType>(
+											mosaic[iter]) - dark[iter];
+			}
+		}
+	}
+}
+
+mex::MxArray readCalibratedData(RawInputFile& file,
+								const std::string& cacheDirectory) {
+	const CaptureSettings settings = file.getCaptureSettings();
+	const int height = file.getHeight();
+	const int width = file.getWidth();
+	const std::size_t numPixels = static_cast<std::size_t>(height) * width;
+
+	MasterFrame masterDark;
+	bool hasDark = masterDark.load(getSidecarName(cacheDirectory,
+										ECalibrationType::EDark, settings)) &&
+					(masterDark.getHeight() == height) &&
+					(masterDark.getWidth() == width);
+	MasterFrame masterFlat;
+	bool hasFlat = masterFlat.load(getSidecarName(cacheDirectory,
+										ECalibrationType::EFlat, settings)) &&
+					(masterFlat.getHeight() == height) &&
+					(masterFlat.getWidth() == width);
+
+	std::vector<CalibrationPixelType> blackLevel;
+	if (!hasDark) {
+		blackLevel.resize(numPixels);
+		file.readBlackLevel(&blackLevel[0]);
+	}
+	file.setCalibration((hasDark)?(masterDark.getData()):(&blackLevel[0]),
+						(hasFlat)?(masterFlat.getData()):(nullptr));
+
+	mex::MxNumeric<CalibrationPixelType> pixelArray(height, width);
+	file.readData(false, pixelArray.getData());
+	return mex::MxArray(pixelArray.get_array());
+}
+
+mex::MxArray toMxArray(const MasterFrame& masterFrame) {
+	mex::MxNumeric<CalibrationPixelType> pixelArray(masterFrame.getHeight(),
+												masterFrame.getWidth());
+	std::copy(masterFrame.getData(), masterFrame.getData()
+			+ static_cast<std::size_t>(masterFrame.getHeight())
+				* masterFrame.getWidth(),
+			pixelArray.getData());
+	return mex::MxArray(pixelArray.get_array());
+}
+
+}  // namespace raw
@@ -0,0 +1,157 @@
+/*
+ * calibration.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../include/file.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Dark and flat-field calibration of raw mosaics. Master frames are built
+ * from stacks of raw frames, cached in binary sidecar files keyed by camera,
+ * ISO and shutter, and applied to the CFA plane as
+ *
+ *   calibrated = (mosaic - dark) * gain,
+ *
+ * with gain the reciprocal of the normalized master flat. Calibrated mosaics
+ * are single precision and in the layout of RawInputFile::readData.
+ */
+
+enum class ECalibrationType {
+	EDark = 0,
+	EFlat,
+	ELength,
+	EInvalid = -1
+};
+
+ECalibrationType toCalibrationType(const std::string& typeName);
+
+enum class ECombineMethod {
+	EMean = 0,
+	EMedian,
+	ELength,
+	EInvalid = -1
+};
+
+ECombineMethod toCombineMethod(const std::string& methodName);
+
+/*
+ * Streaming per-pixel combination of equally sized mosaics. The mean is
+ * accumulated in double precision. The median is a remedian: every level
+ * buffers up to five planes and passes their median to the next level, so
+ * memory grows with the logarithm of the number of frames. The result is the
+ * weighted median of the buffered planes, and is exact for up to five frames.
+ */
+class FrameCombiner {
+public:
+	FrameCombiner(ECombineMethod method, int height, int width);
+	FrameCombiner(const FrameCombiner& other) = delete;
+	FrameCombiner& operator=(const FrameCombiner& other) = delete;
+
+	void addFrame(const PixelType* mosaic);
+	int getNumberOfFrames() const;
+	void combine(CalibrationPixelType* master) const;
+
+private:
+	void addToLevel(const PixelType* plane, int level);
+
+	ECombineMethod m_method;
+	std::size_t m_numPixels;
+	int m_numFrames;
+	std::vector<double> m_sum;
+	std::vector<std::vector<PixelType> > m_levels;
+	std::vector<int> m_levelCounts;
+	std::vector<PixelType> m_median;
+};
+
+class MasterFrame {
+public:
+	MasterFrame();
+	MasterFrame(ECalibrationType type, const CaptureSettings& settings,
+				int height, int width);
+
+	ECalibrationType getType() const;
+	const CaptureSettings& getCaptureSettings() const;
+	int getHeight() const;
+	int getWidth() const;
+	CalibrationPixelType* getData();
+	const CalibrationPixelType* getData() const;
+
+	/*
+	 * Sidecar I/O. load() returns false, leaving the frame unchanged, if the
+	 * file is missing or not a valid sidecar.
+	 */
+	bool save(const std::string& fileName) const;
+	bool load(const std::string& fileName);
+
+private:
+	ECalibrationType m_type;
+	CaptureSettings m_settings;
+	int m_height;
+	int m_width;
+	std::vector<CalibrationPixelType> m_data;
+};
+
+std::string getSidecarName(const std::string& cacheDirectory,
+						ECalibrationType type,
+						const CaptureSettings& settings);
+
+/*
+ * Make a camera name safe for use in a file name, and join a file name to a
+ * directory.
+ */
+std::string toSidecarToken(const std::string& name);
+std::string joinPath(const std::string& directory,
+					const std::string& fileName);
+
+/*
+ * Length-prefixed strings of the sidecar and defect map formats. readString
+ * returns false on a read error or an implausibly long string.
+ */
+void writeString(std::ofstream& file, const std::string& value);
+bool readString(std::ifstream& file, std::string& value);
+
+/*
+ * Master frames are built from frames of one camera and size. Flats are
+ * dark-subtracted with the cached master dark matching their settings, or
+ * with the LibRaw black level if there is none. If cacheDirectory is not
+ * empty, the master frame is written to its sidecar there.
+ */
+MasterFrame buildMasterFrame(const std::vector<std::string>& fileNames,
+							ECalibrationType type, ECombineMethod method,
+							const std::string& cacheDirectory);
+
+/*
+ * Fused calibration pass over numPixels samples. dark may not be null; gain
+ * may be null, in which case no flat-field correction is applied.
+ */
+void applyCalibration(const PixelType* mosaic,
+					const CalibrationPixelType* dark,
+					const CalibrationPixelType* gain, std::size_t numPixels,
+					CalibrationPixelType* calibrated);
+
+/*
+ * Set the calibration of a file to the master frames cached in cacheDirectory
+ * for its settings, and read its calibrated mosaic. The LibRaw black level
+ * stands in for a missing master dark, and a missing master flat is skipped.
+ */
+mex::MxArray readCalibratedData(RawInputFile& file,
+								const std::string& cacheDirectory);
+
+mex::MxArray toMxArray(const MasterFrame& masterFrame);
+
+}  // namespace raw
+
+#endif  // CALIBRATION_H_
@@ -0,0 +1,280 @@
+/*
+ * defects.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+
+#include "../raw/calibration.h"
+#include "../raw/defects.h"
+
+namespace raw {
+
+namespace {
+
+const char kDefectMagic[8] = {'I', 'U', 'R', 'A', 'W', 'D', 'E', 'F'};
+const std::int32_t kDefectVersion = 1;
+
+/*
+ * Neighborhood radius of the correction, enough to reach same-color pixels of
+ * every color in a Bayer pattern.
+ */
+const int kCorrectionRadius = 2;
+
+/*
+ * Scale from median absolute deviation to standard deviation for Gaussian
+ * noise, and lower bound on the latter, as the MAD of quantized dark frames
+ * is often zero.
+ */
+const float kMadScale = 1.4826f;
+const float kMinSigma = 1.0f;
+
+float getMedian(std::vector<float>& values) {
+	std::vector<float>::iterator middle = values.begin() + values.size() / 2;
+	std::nth_element(values.begin(), middle, values.end());
+	return *middle;
+}
+
+}  // namespace
+
+/*
+ * DefectMap implementation.
+ */
+DefectMap::DefectMap()
+					: m_make(),
+					  m_model(),
+					  m_height(0),
+					  m_width(0),
+					  m_defectIndices() {}
+
+DefectMap::DefectMap(const std::string& make, const std::string& model,
+					int height, int width,
+					const std::vector<unsigned int>& defectIndices)
+					: m_make(make),
+					  m_model(model),
+					  m_height(height),
+					  m_width(width),
+					  m_defectIndices(defectIndices) {
+	std::sort(m_defectIndices.begin(), m_defectIndices.end());
+}
+
+const std::string& DefectMap::getMake() const {
+	return m_make;
+}
+
+const std::string& DefectMap::getModel() const {
+	return m_model;
+}
+
+int DefectMap::getHeight() const {
+	return m_height;
+}
+
+int DefectMap::getWidth() const {
+	return m_width;
+}
+
+int DefectMap::getNumberOfDefects() const {
+	return static_cast<int>(m_defectIndices.size());
+}
+
+const std::vector<unsigned int>& DefectMap::getDefectIndices() const {
+	return m_defectIndices;
+}
+
+bool DefectMap::isDefective(unsigned int index) const {
+	return std::binary_search(m_defectIndices.begin(), m_defectIndices.end(),
+							index);
+}
+
+bool DefectMap::save(const std::string& fileName) const {
+	std::ofstream file(fileName.c_str(),
+					std::ofstream::out | std::ofstream::binary);
+	if (!file) {
+		return false;
+	}
+	std::int32_t header[4] = {kDefectVersion, m_height, m_width,
+							static_cast<std::int32_t>(m_defectIndices.size())};
+	file.write(kDefectMagic, sizeof(kDefectMagic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	writeString(file, m_make);
+	writeString(file, m_model);
+	if (!m_defectIndices.empty()) {
+		std::vector<std::uint32_t> indices(m_defectIndices.begin(),
+										m_defectIndices.end());
+		file.write(reinterpret_cast<const char*>(&indices[0]),
+				indices.size() * sizeof(std::uint32_t));
+	}
+	return static_cast<bool>(file);
+}
+
+bool DefectMap::load(const std::string& fileName) {
+	std::ifstream file(fileName.c_str(),
+					std::ifstream::in | std::ifstream::binary);
+	if (!file) {
+		return false;
+	}
+	char magic[sizeof(kDefectMagic)];
+	file.read(magic, sizeof(magic));
+	if ((!file) || (!std::equal(magic, magic + sizeof(magic), kDefectMagic))) {
+		return false;
+	}
+	std::int32_t header[4];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if ((!file) || (header[0] != kDefectVersion) || (header[1] <= 0) ||
+			(header[2] <= 0) || (header[3] < 0) ||
+			(static_cast<double>(header[3])
+					> static_cast<double>(header[1]) * header[2])) {
+		return false;
+	}
+	std::string make;
+	std::string model;
+	if ((!readString(file, make)) || (!readString(file, model))) {
+		return false;
+	}
+	std::vector<std::uint32_t> indices(header[3]);
+	if (!indices.empty()) {
+		file.read(reinterpret_cast<char*>(&indices[0]),
+				indices.size() * sizeof(std::uint32_t));
+		if (!file) {
+			return false;
+		}
+	}
+	m_make = make;
+	m_model = model;
+	m_height = header[1];
+	m_width = header[2];
+	m_defectIndices.assign(indices.begin(), indices.end());
+	std::sort(m_defectIndices.begin(), m_defectIndices.end());
+	return true;
+}
+
+std::string getDefectMapName(const std::string& cacheDirectory,
+							const CaptureSettings& settings) {
+	return joinPath(cacheDirectory, toSidecarToken(settings.make) + "_"
+									+ toSidecarToken(settings.model)
+									+ ".defects");
+}
+
+DefectMap detectDefects(const std::vector<std::string>& fileNames,
+						float threshold, const std::string& cacheDirectory) {
+	mexAssertEx(!fileNames.empty(), "At least one file name is required");
+	mexAssertEx(threshold > 0.0f, "Detection threshold must be positive");
+
+	/*
+	 * Only the master frame is needed, so reuse the calibration pipeline
+	 * without caching.
+	 */
+	MasterFrame masterFrame = buildMasterFrame(fileNames,
+											ECalibrationType::EDark,
+											ECombineMethod::EMedian, "");
+	const int height = masterFrame.getHeight();
+	const int width = masterFrame.getWidth();
+	const std::size_t numPixels = static_cast<std::size_t>(height) * width;
+	const CalibrationPixelType* master = masterFrame.getData();
+
+	std::vector<unsigned char> filterArray(numPixels);
+	{
+		RawInputFile file(mex::MxString(fileNames.front()));
+		file.readFilterArray(&filterArray[0]);
+	}
+
+	float colorMedian[4];
+	float colorSigma[4];
+	for (int color = 0; color < 4; ++color) {
+		std::vector<float> values;
+		for (std::size_t iter = 0; iter < numPixels; ++iter) {
+			if ((filterArray[iter] & 3) == color) {
+				values.push_back(master[iter]);
+			}
+		}
+		if (values.empty()) {
+			colorMedian[color] = 0.0f;
+			colorSigma[color] = kMinSigma;
+			continue;
+		}
+		colorMedian[color] = getMedian(values);
+		for (std::vector<float>::iterator iter = values.begin();
+				iter != values.end(); ++iter) {
+			*iter = std::abs(*iter - colorMedian[color]);
+		}
+		colorSigma[color] = std::max(kMadScale * getMedian(values), kMinSigma);
+	}
+
+	std::vector<unsigned int> defectIndices;
+	for (std::size_t iter = 0; iter < numPixels; ++iter) {
+		const int color = filterArray[iter] & 3;
+		if (std::abs(master[iter] - colorMedian[color])
+				> threshold * colorSigma[color]) {
+			defectIndices.push_back(static_cast<unsigned int>(iter));
+		}
+	}
+
+	const CaptureSettings& settings = masterFrame.getCaptureSettings();
+	DefectMap defectMap(settings.make, settings.model, height, width,
+						defectIndices);
+	if (!cacheDirectory.empty()) {
+		mexAssertEx(defectMap.save(getDefectMapName(cacheDirectory, settings)),
+					"Failed to write defect map");
+	}
+	return defectMap;
+}
+
+void correctDefects(const DefectMap& defectMap,
+					const std::function<int(int, int)>& filterColor,
+					int height, int width, PixelType* mosaic) {
+	mexAssertEx((defectMap.getHeight() == height) &&
+				(defectMap.getWidth() == width),
+				"Defect map does not match the mosaic size");
+	const std::vector<unsigned int>& defectIndices =
+												defectMap.getDefectIndices();
+	const int numDefects = static_cast<int>(defectIndices.size());
+
+	/*
+	 * Defective neighbors are skipped, so no defect reads a pixel that another
+	 * thread writes.
+	 */
+#pragma omp parallel for schedule(static)
+	for (int iterDefect = 0; iterDefect < numDefects; ++iterDefect) {
+		const unsigned int index = defectIndices[iterDefect];
+		const int column = static_cast<int>(index / height);
+		const int row = static_cast<int>(index % height);
+		const int color = filterColor(row, column);
+		unsigned int sum = 0;
+		unsigned int count = 0;
+		for (int columnOffset = -kCorrectionRadius;
+				columnOffset <= kCorrectionRadius; ++columnOffset) {
+			const int neighborColumn = column + columnOffset;
+			if ((neighborColumn < 0) || (neighborColumn >= width)) {
+				continue;
+			}
+			for (int rowOffset = -kCorrectionRadius;
+					rowOffset <= kCorrectionRadius; ++rowOffset) {
+				const int neighborRow = row + rowOffset;
+				if ((neighborRow < 0) || (neighborRow >= height) ||
+						((rowOffset == 0) && (columnOffset == 0))) {
+					continue;
+				}
+				const unsigned int neighborIndex =
+									static_cast<unsigned int>(neighborColumn)
+										* height + neighborRow;
+				if ((filterColor(neighborRow, neighborColumn) == color) &&
+						(!defectMap.isDefective(neighborIndex))) {
+					sum += mosaic[neighborIndex];
+					++count;
+				}
+			}
+		}
+		if (count > 0) {
+			mosaic[index] = static_cast<PixelType>((sum + count / 2) / count);
+		}
+	}
+}
+
+}  // namespace raw
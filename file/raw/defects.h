@@ -0,0 +1,82 @@
+/*
+ * defects.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef DEFECTS_H_
+#define DEFECTS_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../include/file.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Map of the hot, dead and stuck pixels of a sensor, as sorted column-major
+ * indices into the mosaic returned by RawInputFile::readData. Maps are
+ * cached per camera in a compact binary file of 32-bit indices.
+ */
+class DefectMap {
+public:
+	DefectMap();
+	DefectMap(const std::string& make, const std::string& model, int height,
+			int width, const std::vector<unsigned int>& defectIndices);
+
+	const std::string& getMake() const;
+	const std::string& getModel() const;
+	int getHeight() const;
+	int getWidth() const;
+	int getNumberOfDefects() const;
+	const std::vector<unsigned int>& getDefectIndices() const;
+	bool isDefective(unsigned int index) const;
+
+	/*
+	 * load() returns false, leaving the map unchanged, if the file is missing
+	 * or not a valid defect map.
+	 */
+	bool save(const std::string& fileName) const;
+	bool load(const std::string& fileName);
+
+private:
+	std::string m_make;
+	std::string m_model;
+	int m_height;
+	int m_width;
+	std::vector<unsigned int> m_defectIndices;
+};
+
+std::string getDefectMapName(const std::string& cacheDirectory,
+							const CaptureSettings& settings);
+
+/*
+ * Detect defects from dark frames of one camera and settings. The frames are
+ * median-combined, and a pixel is defective if its master value deviates from
+ * the median of its CFA color by more than threshold robust standard
+ * deviations (1.4826 times the median absolute deviation). If cacheDirectory
+ * is not empty, the map is written there.
+ *
+ * Only dark frames are supported, so this finds hot and stuck pixels. Dead
+ * pixels read as black in the dark and need flat frames, whose vignetting
+ * a single median per color cannot model; such pixels are not detected.
+ */
+DefectMap detectDefects(const std::vector<std::string>& fileNames,
+						float threshold, const std::string& cacheDirectory);
+
+/*
+ * Replace every defect by the mean of the non-defective pixels of the same
+ * CFA color in its 5x5 neighborhood, as given by filterColor(row, column).
+ * Only the defects and their neighborhoods are touched.
+ */
+void correctDefects(const DefectMap& defectMap,
+					const std::function<int(int, int)>& filterColor,
+					int height, int width, PixelType* mosaic);
+
+}  // namespace raw
+
+#endif  // DEFECTS_H_
@@ -0,0 +1,496 @@
+/*
+ * demosaic.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../raw/demosaic.h"
+
+namespace raw {
+
+namespace {
+
+/*
+ * All kernels work on "lines", i.e. the columns of the column-major MATLAB
+ * mosaic, which are contiguous in memory. Every method is symmetric under
+ * transposition, so along-line and across-line neighbors play the roles of
+ * the horizontal and vertical neighbors of the textbook formulations.
+ *
+ * Lines are processed in tiles of kTileLines x kTileSpan samples, which are
+ * distributed over threads. Within a tile, green and non-green sites of a
+ * line are handled by two separate stride-2 loops, so that the inner loops are
+ * free of data-dependent branches and can be vectorized.
+ */
+const int kTileLines = 32;
+const int kTileSpan = 1024;
+
+/*
+ * Border width of the padded planes, enough for the 5x5 kernels.
+ */
+const int kBorder = 2;
+
+const int kRed = 0;
+const int kGreen = 1;
+const int kBlue = 2;
+
+/*
+ * Plane with a mirrored border of kBorder samples on every side. Mirroring
+ * without repeating the edge sample preserves the parity of the CFA, so the
+ * padded samples have the same color as the sites they stand in for.
+ */
+class PaddedPlane {
+public:
+	PaddedPlane(int height, int width)
+			: m_height(height),
+			  m_width(width),
+			  m_stride(height + 2 * kBorder),
+			  m_data(static_cast<std::size_t>(m_stride)
+					* static_cast<std::size_t>(width + 2 * kBorder)) {	}
+
+	inline float* line(int lineIndex) {
+		return &m_data[static_cast<std::size_t>(lineIndex + kBorder) * m_stride
+					+ kBorder];
+	}
+
+	inline const float* line(int lineIndex) const {
+		return &m_data[static_cast<std::size_t>(lineIndex + kBorder) * m_stride
+					+ kBorder];
+	}
+
+	inline int get_stride() const {
+		return m_stride;
+	}
+
+	void mirrorBorders() {
+#pragma omp parallel for schedule(static)
+		for (int lineIndex = 0; lineIndex < m_width; ++lineIndex) {
+			float* current = line(lineIndex);
+			for (int offset = 1; offset <= kBorder; ++offset) {
+				current[-offset] = current[offset];
+				current[m_height - 1 + offset] = current[m_height - 1 - offset];
+			}
+		}
+		for (int offset = 1; offset <= kBorder; ++offset) {
+			std::copy(line(offset) - kBorder, line(offset) - kBorder + m_stride,
+					line(-offset) - kBorder);
+			std::copy(line(m_width - 1 - offset) - kBorder,
+					line(m_width - 1 - offset) - kBorder + m_stride,
+					line(m_width - 1 + offset) - kBorder);
+		}
+	}
+
+private:
+	int m_height;
+	int m_width;
+	int m_stride;
+	std::vector<float> m_data;
+};
+
+/*
+ * Per-line layout of the Bayer pattern: the parity of the green sites, the
+ * non-green color found on the line, and the color found on adjacent lines.
+ */
+struct LineLayout {
+	int greenParity;
+	int lineColor;
+	int otherColor;
+};
+
+inline LineLayout getLineLayout(const int filterColors[2][2], int lineIndex) {
+	LineLayout layout;
+	const int evenColor = filterColors[0][lineIndex & 1];
+	const int oddColor = filterColors[1][lineIndex & 1];
+	layout.greenParity = (evenColor == kGreen) ? 0 : 1;
+	layout.lineColor = (evenColor == kGreen) ? oddColor : evenColor;
+	layout.otherColor = kRed + kBlue - layout.lineColor;
+	return layout;
+}
+
+/*
+ * First index not smaller than start with the given parity.
+ */
+inline int alignToParity(int start, int parity) {
+	return start + ((start ^ parity) & 1);
+}
+
+inline float clampNonNegative(float value) {
+	return (value > 0.0f) ? value : 0.0f;
+}
+
+template <typename SampleType>
+void fillPadded(const SampleType* mosaic, int height, int width,
+				PaddedPlane& padded) {
+#pragma omp parallel for schedule(static)
+	for (int lineIndex = 0; lineIndex < width; ++lineIndex) {
+		const SampleType* source = &mosaic[static_cast<std::size_t>(lineIndex)
+										* height];
+		float* target = padded.line(lineIndex);
+#pragma omp simd
+		for (int index = 0; index < height; ++index) {
+			target[index] = static_cast<float>(source[index]);
+		}
+	}
+	padded.mirrorBorders();
+}
+
+/*
+ * Output planes of the line being processed.
+ */
+struct LineOutput {
+	DemosaicPixelType* plane[3];
+};
+
+inline LineOutput getLineOutput(DemosaicPixelType* rgb, int height, int width,
+								int lineIndex) {
+	const std::size_t planeSize = static_cast<std::size_t>(height) * width;
+	const std::size_t offset = static_cast<std::size_t>(lineIndex) * height;
+	LineOutput output;
+	for (int channel = 0; channel < 3; ++channel) {
+		output.plane[channel] = rgb + channel * planeSize + offset;
+	}
+	return output;
+}
+
+void bilinearLine(const PaddedPlane& padded, const LineLayout& layout,
+				int lineIndex, int spanStart, int spanEnd, LineOutput& out) {
+	const int stride = padded.get_stride();
+	const float* p = padded.line(lineIndex);
+	const float* pm1 = p - stride;
+	const float* pp1 = p + stride;
+	DemosaicPixelType* green = out.plane[kGreen];
+	DemosaicPixelType* along = out.plane[layout.lineColor];
+	DemosaicPixelType* across = out.plane[layout.otherColor];
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, layout.greenParity); i < spanEnd;
+		i += 2) {
+		green[i] = p[i];
+		along[i] = 0.5f * (p[i - 1] + p[i + 1]);
+		across[i] = 0.5f * (pm1[i] + pp1[i]);
+	}
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, 1 - layout.greenParity); i < spanEnd;
+		i += 2) {
+		along[i] = p[i];
+		green[i] = 0.25f * (p[i - 1] + p[i + 1] + pm1[i] + pp1[i]);
+		across[i] = 0.25f * (pm1[i - 1] + pm1[i + 1] + pp1[i - 1] + pp1[i + 1]);
+	}
+}
+
+/*
+ * Malvar, He, Cutler, "High-quality linear interpolation for demosaicing of
+ * Bayer-patterned color images", ICASSP 2004. Gradient-corrected bilinear
+ * interpolation with the 5x5 kernels of the paper (all scaled by 1/8).
+ */
+void malvarLine(const PaddedPlane& padded, const LineLayout& layout,
+				int lineIndex, int spanStart, int spanEnd, LineOutput& out) {
+	const int stride = padded.get_stride();
+	const float* p = padded.line(lineIndex);
+	const float* pm1 = p - stride;
+	const float* pp1 = p + stride;
+	const float* pm2 = p - 2 * stride;
+	const float* pp2 = p + 2 * stride;
+	DemosaicPixelType* green = out.plane[kGreen];
+	DemosaicPixelType* along = out.plane[layout.lineColor];
+	DemosaicPixelType* across = out.plane[layout.otherColor];
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, layout.greenParity); i < spanEnd;
+		i += 2) {
+		const float center = p[i];
+		const float along1 = p[i - 1] + p[i + 1];
+		const float along2 = p[i - 2] + p[i + 2];
+		const float across1 = pm1[i] + pp1[i];
+		const float across2 = pm2[i] + pp2[i];
+		const float diagonal = pm1[i - 1] + pm1[i + 1] + pp1[i - 1] + pp1[i + 1];
+		green[i] = center;
+		along[i] = clampNonNegative(0.125f * (5.0f * center + 4.0f * along1
+							- along2 - diagonal + 0.5f * across2));
+		across[i] = clampNonNegative(0.125f * (5.0f * center + 4.0f * across1
+							- across2 - diagonal + 0.5f * along2));
+	}
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, 1 - layout.greenParity); i < spanEnd;
+		i += 2) {
+		const float center = p[i];
+		const float cross1 = p[i - 1] + p[i + 1] + pm1[i] + pp1[i];
+		const float cross2 = p[i - 2] + p[i + 2] + pm2[i] + pp2[i];
+		const float diagonal = pm1[i - 1] + pm1[i + 1] + pp1[i - 1] + pp1[i + 1];
+		along[i] = center;
+		green[i] = clampNonNegative(0.125f * (4.0f * center + 2.0f * cross1
+							- cross2));
+		across[i] = clampNonNegative(0.125f * (6.0f * center + 2.0f * diagonal
+							- 1.5f * cross2));
+	}
+}
+
+/*
+ * Hamilton, Adams, "Adaptive color plane interpolation in single sensor color
+ * electronic camera", US Patent 5,629,734. Green is interpolated along the
+ * direction with the smaller gradient, with a second-order correction from
+ * the center color; red and blue are then interpolated on color differences
+ * against the full green plane.
+ */
+void edgeDirectedGreenLine(const PaddedPlane& padded, const LineLayout& layout,
+						int lineIndex, int spanStart, int spanEnd,
+						PaddedPlane& greenPlane) {
+	const int stride = padded.get_stride();
+	const float* p = padded.line(lineIndex);
+	const float* pm1 = p - stride;
+	const float* pp1 = p + stride;
+	const float* pm2 = p - 2 * stride;
+	const float* pp2 = p + 2 * stride;
+	float* green = greenPlane.line(lineIndex);
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, layout.greenParity); i < spanEnd;
+		i += 2) {
+		green[i] = p[i];
+	}
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, 1 - layout.greenParity); i < spanEnd;
+		i += 2) {
+		const float center2 = 2.0f * p[i];
+		const float alongLaplacian = center2 - p[i - 2] - p[i + 2];
+		const float acrossLaplacian = center2 - pm2[i] - pp2[i];
+		const float alongGradient = std::fabs(p[i - 1] - p[i + 1])
+								+ std::fabs(alongLaplacian);
+		const float acrossGradient = std::fabs(pm1[i] - pp1[i])
+								+ std::fabs(acrossLaplacian);
+		const float alongEstimate = 0.5f * (p[i - 1] + p[i + 1])
+								+ 0.25f * alongLaplacian;
+		const float acrossEstimate = 0.5f * (pm1[i] + pp1[i])
+								+ 0.25f * acrossLaplacian;
+		const float estimate = (alongGradient < acrossGradient)
+						? alongEstimate
+						: ((acrossGradient < alongGradient)
+							? acrossEstimate
+							: 0.5f * (alongEstimate + acrossEstimate));
+		green[i] = clampNonNegative(estimate);
+	}
+}
+
+void edgeDirectedColorLine(const PaddedPlane& padded,
+						const PaddedPlane& greenPlane, const LineLayout& layout,
+						int lineIndex, int spanStart, int spanEnd,
+						LineOutput& out) {
+	const int stride = padded.get_stride();
+	const float* p = padded.line(lineIndex);
+	const float* pm1 = p - stride;
+	const float* pp1 = p + stride;
+	const float* q = greenPlane.line(lineIndex);
+	const float* qm1 = q - stride;
+	const float* qp1 = q + stride;
+	DemosaicPixelType* green = out.plane[kGreen];
+	DemosaicPixelType* along = out.plane[layout.lineColor];
+	DemosaicPixelType* across = out.plane[layout.otherColor];
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, layout.greenParity); i < spanEnd;
+		i += 2) {
+		green[i] = q[i];
+		along[i] = clampNonNegative(q[i] + 0.5f * (p[i - 1] - q[i - 1]
+												+ p[i + 1] - q[i + 1]));
+		across[i] = clampNonNegative(q[i] + 0.5f * (pm1[i] - qm1[i]
+												+ pp1[i] - qp1[i]));
+	}
+
+#pragma omp simd
+	for (int i = alignToParity(spanStart, 1 - layout.greenParity); i < spanEnd;
+		i += 2) {
+		green[i] = q[i];
+		along[i] = p[i];
+		across[i] = clampNonNegative(q[i] + 0.25f * (
+								pm1[i - 1] - qm1[i - 1] + pm1[i + 1] - qm1[i + 1]
+								+ pp1[i - 1] - qp1[i - 1] + pp1[i + 1] - qp1[i + 1]));
+	}
+}
+
+template <typename LineFunction>
+void forEachTile(int height, int width, LineFunction lineFunction) {
+#pragma omp parallel for collapse(2) schedule(static)
+	for (int tileLine = 0; tileLine < width; tileLine += kTileLines) {
+		for (int tileSpan = 0; tileSpan < height; tileSpan += kTileSpan) {
+			const int endLine = std::min(tileLine + kTileLines, width);
+			const int endSpan = std::min(tileSpan + kTileSpan, height);
+			for (int lineIndex = tileLine; lineIndex < endLine; ++lineIndex) {
+				lineFunction(lineIndex, tileSpan, endSpan);
+			}
+		}
+	}
+}
+
+int toChannel(char filterName) {
+	switch (filterName) {
+		case 'R': {
+			return kRed;
+		}
+		case 'G': {
+			return kGreen;
+		}
+		case 'B': {
+			return kBlue;
+		}
+		default: {
+			mexAssertEx(0, "Demosaicking supports only RGB color filter arrays");
+			return -1;
+		}
+	}
+}
+
+template <typename SampleType>
+void demosaicMosaic(const SampleType* mosaic, int height, int width,
+			const int filterColors[2][2], EDemosaicMethod method,
+			DemosaicPixelType* rgb) {
+	PaddedPlane padded(height, width);
+	fillPadded(mosaic, height, width, padded);
+
+	switch (method) {
+		case EDemosaicMethod::EBilinear: {
+			forEachTile(height, width,
+				[&](int lineIndex, int spanStart, int spanEnd) {
+					LineOutput out = getLineOutput(rgb, height, width,
+												lineIndex);
+					bilinearLine(padded,
+								getLineLayout(filterColors, lineIndex),
+								lineIndex, spanStart, spanEnd, out);
+				});
+			break;
+		}
+		case EDemosaicMethod::EMalvar: {
+			forEachTile(height, width,
+				[&](int lineIndex, int spanStart, int spanEnd) {
+					LineOutput out = getLineOutput(rgb, height, width,
+												lineIndex);
+					malvarLine(padded, getLineLayout(filterColors, lineIndex),
+							lineIndex, spanStart, spanEnd, out);
+				});
+			break;
+		}
+		case EDemosaicMethod::EEdgeDirected: {
+			PaddedPlane greenPlane(height, width);
+			forEachTile(height, width,
+				[&](int lineIndex, int spanStart, int spanEnd) {
+					edgeDirectedGreenLine(padded,
+									getLineLayout(filterColors, lineIndex),
+									lineIndex, spanStart, spanEnd, greenPlane);
+				});
+			greenPlane.mirrorBorders();
+			forEachTile(height, width,
+				[&](int lineIndex, int spanStart, int spanEnd) {
+					LineOutput out = getLineOutput(rgb, height, width,
+												lineIndex);
+					edgeDirectedColorLine(padded, greenPlane,
+									getLineLayout(filterColors, lineIndex),
+									lineIndex, spanStart, spanEnd, out);
+				});
+			break;
+		}
+		case EDemosaicMethod::ELength:
+		case EDemosaicMethod::EInvalid:
+		default: {
+			mexAssertEx(0, "Unknown demosaicking method");
+			break;
+		}
+	}
+}
+
+}  // namespace
+
+EDemosaicMethod toDemosaicMethod(const std::string& methodName) {
+	if (!methodName.compare("bilinear")) {
+		return EDemosaicMethod::EBilinear;
+	} else if (!methodName.compare("malvar")) {
+		return EDemosaicMethod::EMalvar;
+	} else if (!methodName.compare("edge")) {
+		return EDemosaicMethod::EEdgeDirected;
+	} else {
+		return EDemosaicMethod::EInvalid;
+	}
+}
+
+void demosaic(const PixelType* mosaic, int height, int width,
+			const int filterColors[2][2], EDemosaicMethod method,
+			DemosaicPixelType* rgb) {
+	demosaicMosaic(mosaic, height, width, filterColors, method, rgb);
+}
+
+void demosaic(const DemosaicPixelType* mosaic, int height, int width,
+			const int filterColors[2][2], EDemosaicMethod method,
+			DemosaicPixelType* rgb) {
+	demosaicMosaic(mosaic, height, width, filterColors, method, rgb);
+}
+
+void getFilterColors(const unsigned char* filterBuffer, int height, int width,
+					const std::string& filterNames, int filterColors[2][2]) {
+	/*
+	 * Resolve the 2x2 Bayer cell through the filter names, so that LibRaw's
+	 * second green (index 3 in "RGBG") maps to green, and verify that the
+	 * whole filter array repeats it.
+	 */
+	int colorCount[3] = {0, 0, 0};
+	for (int row = 0; row < 2; ++row) {
+		for (int column = 0; column < 2; ++column) {
+			int filterIndex = filterBuffer[column * height + row];
+			mexAssert(filterIndex < static_cast<int>(filterNames.size()));
+			filterColors[row][column] = toChannel(filterNames[filterIndex]);
+			++colorCount[filterColors[row][column]];
+		}
+	}
+	mexAssertEx((colorCount[kRed] == 1) && (colorCount[kGreen] == 2) &&
+				(colorCount[kBlue] == 1) &&
+				((filterColors[0][0] == kGreen) == (filterColors[1][1] == kGreen)),
+				"Demosaicking supports only Bayer color filter arrays");
+
+	bool isPeriodic = true;
+#pragma omp parallel for schedule(static) reduction(&&:isPeriodic)
+	for (int column = 0; column < width; ++column) {
+		for (int row = 0; row < height; ++row) {
+			isPeriodic = isPeriodic &&
+				(filterBuffer[column * height + row]
+							== filterBuffer[(column & 1) * height + (row & 1)]);
+		}
+	}
+	mexAssertEx(isPeriodic, "Demosaicking supports only Bayer color filter arrays");
+}
+
+mex::MxArray demosaic(const mex::MxNumeric<PixelType>& mosaic,
+					const mex::MxNumeric<unsigned char>& filterArray,
+					const mex::MxString& filterNames,
+					const mex::MxString& methodName) {
+	std::vector<int> dimensions = mosaic.getDimensions();
+	mexAssert((dimensions.size() == 2) &&
+			(filterArray.getDimensions() == dimensions));
+	int height = dimensions[0];
+	int width = dimensions[1];
+	mexAssertEx((height > 2 * kBorder) && (width > 2 * kBorder),
+				"Mosaic is too small to demosaic");
+
+	EDemosaicMethod method = toDemosaicMethod(methodName.get_string());
+	mexAssertEx(method != EDemosaicMethod::EInvalid,
+				"Unknown demosaicking method");
+
+	int filterColors[2][2];
+	getFilterColors(filterArray.getData(), height, width,
+					filterNames.get_string(), filterColors);
+
+	std::vector<int> rgbDimensions;
+	rgbDimensions.push_back(height);
+	rgbDimensions.push_back(width);
+	rgbDimensions.push_back(3);
+	mex::MxNumeric<DemosaicPixelType> rgbArray(
+						static_cast<int>(rgbDimensions.size()), &rgbDimensions[0]);
+	demosaic(mosaic.getData(), height, width, filterColors, method,
+			rgbArray.getData());
+	return mex::MxArray(rgbArray.get_array());
+}
+
+}  // namespace raw
@@ -0,0 +1,62 @@
+/*
+ * demosaic.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef DEMOSAIC_H_
+#define DEMOSAIC_H_
+
+#include <string>
+
+#include "../include/file.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Native demosaicking of the Bayer mosaics returned by
+ * RawInputFile::readData(false, ""). Unlike dcraw_process(), no white
+ * balance, color conversion or gamma is applied: the output is a linear,
+ * height x width x 3 single-precision RGB image in the units of the mosaic.
+ */
+
+using DemosaicPixelType = float;
+
+enum class EDemosaicMethod {
+	EBilinear = 0,
+	EMalvar,
+	EEdgeDirected,
+	ELength,
+	EInvalid = -1
+};
+
+EDemosaicMethod toDemosaicMethod(const std::string& methodName);
+
+/*
+ * filterColors holds the channel (0 = R, 1 = G, 2 = B) of the 2x2 CFA cell,
+ * indexed as filterColors[row][column]. Both mosaic and rgb are column-major.
+ */
+void demosaic(const PixelType* mosaic, int height, int width,
+			const int filterColors[2][2], EDemosaicMethod method,
+			DemosaicPixelType* rgb);
+void demosaic(const DemosaicPixelType* mosaic, int height, int width,
+			const int filterColors[2][2], EDemosaicMethod method,
+			DemosaicPixelType* rgb);
+
+/*
+ * Resolve the filterColors of a filter array and filter names as returned by
+ * RawInputFile::getCFAInformation, checking that they form a Bayer pattern.
+ */
+void getFilterColors(const unsigned char* filterBuffer, int height, int width,
+					const std::string& filterNames, int filterColors[2][2]);
+
+mex::MxArray demosaic(const mex::MxNumeric<PixelType>& mosaic,
+					const mex::MxNumeric<unsigned char>& filterArray,
+					const mex::MxString& filterNames,
+					const mex::MxString& methodName);
+
+}  // namespace raw
+
+#endif  // DEMOSAIC_H_
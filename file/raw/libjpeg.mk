@@ -0,0 +1,7 @@
+LIBJPEGDIR = /usr
+
+LIBJPEGLIBS = -L$(LIBJPEGDIR)/lib -ljpeg
+LIBS += $(LIBJPEGLIBS)
+
+LIBJPEGINCLUDE= -I$(LIBJPEGDIR)/include
+INCLUDES += $(LIBJPEGINCLUDE)
@@ -5,6 +5,8 @@
  *      Author: igkiou
  */
 
+#include <algorithm>
+
 #include "../raw/libraw_ext.h"
 
 #define EXCEPTION_HANDLER(e) do{                        \
@@ -38,6 +40,17 @@
 
 namespace libraw {
 
+namespace {
+
+/*
+ * Side of the square tiles used when transposing the row-major LibRaw image
+ * into column-major MATLAB planes. 64x64 tiles of 4-sample pixels fit
+ * comfortably in L2 together with their transposed output.
+ */
+const int kTileSize = 64;
+
+}  // namespace
+
 LibRawExtension::LibRawExtension(unsigned int flags) : LibRaw(flags) {}
 
 int LibRawExtension::copy_processed(unsigned short* pixelBuffer) {
@@ -63,6 +76,24 @@ int LibRawExtension::copy_processed(unsigned short* pixelBuffer) {
 	}
 }
 
+int LibRawExtension::copy_mosaic(unsigned short* pixelBuffer) {
+	if(!imgdata.image) {
+		return LIBRAW_OUT_OF_ORDER_CALL;
+	}
+
+	const int width = imgdata.sizes.iwidth;
+	const int height = imgdata.sizes.iheight;
+	for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
+		for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
+			int arrayIndex = pixelWidth * height + pixelHeight;
+			int rawIndex = pixelHeight * width + pixelWidth;
+			pixelBuffer[arrayIndex] = imgdata.image[rawIndex]
+											[COLOR(pixelHeight, pixelWidth)];
+		}
+	}
+	return LIBRAW_SUCCESS;
+}
+
 void LibRawExtension::copy_processed_internal(unsigned short* pixelBuffer) {
 	int perc = imgdata.sizes.width * imgdata.sizes.height
 			* imgdata.params.auto_bright_thr;
@@ -91,18 +122,102 @@ void LibRawExtension::copy_processed_internal(unsigned short* pixelBuffer) {
 //		SWAP(imgdata.sizes.height, imgdata.sizes.width);
 //	}
 
-	int width = imgdata.sizes.width;
-	int height = imgdata.sizes.height;
-	int colors = imgdata.idata.colors;
-	for (int pixelChannel = 0; pixelChannel < colors; ++pixelChannel) {
-		for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
-			for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
-				int arrayIndex = pixelChannel * width * height + pixelWidth * height + pixelHeight;
-				int rawIndex = pixelHeight * width + pixelWidth;
-				pixelBuffer[arrayIndex] = imgdata.color.curve[imgdata.image[rawIndex][pixelChannel]];
+	/*
+	 * Single pass over the row-major LibRaw image: each tile is read once, the
+	 * gamma curve is applied to all channels of a pixel together, and the
+	 * transposed tile is written to every column-major output plane. Tiles are
+	 * independent, so they are distributed over threads.
+	 */
+	const int width = imgdata.sizes.width;
+	const int height = imgdata.sizes.height;
+	const int colors = imgdata.idata.colors;
+	const int planeSize = width * height;
+	const unsigned short* curve = imgdata.color.curve;
+	const unsigned short (*image)[4] = imgdata.image;
+#pragma omp parallel for collapse(2) schedule(static)
+	for (int tileWidth = 0; tileWidth < width; tileWidth += kTileSize) {
+		for (int tileHeight = 0; tileHeight < height; tileHeight += kTileSize) {
+			const int endWidth = std::min(tileWidth + kTileSize, width);
+			const int endHeight = std::min(tileHeight + kTileSize, height);
+			for (int pixelHeight = tileHeight; pixelHeight < endHeight;
+				++pixelHeight) {
+				const unsigned short (*rawRow)[4] = &image[pixelHeight * width];
+				for (int pixelWidth = tileWidth; pixelWidth < endWidth;
+					++pixelWidth) {
+					unsigned short* arrayPixel = &pixelBuffer[pixelWidth * height
+															+ pixelHeight];
+					const unsigned short* rawPixel = rawRow[pixelWidth];
+					for (int pixelChannel = 0; pixelChannel < colors;
+						++pixelChannel) {
+						arrayPixel[pixelChannel * planeSize] =
+												curve[rawPixel[pixelChannel]];
+					}
+				}
 			}
 		}
 	}
 }
 
+LibRawPool::Handle::Handle(LibRawPool* pool, LibRawExtension* processor)
+						: m_pool(pool),
+						  m_processor(processor) {}
+
+LibRawPool::Handle::Handle(Handle&& other)
+						: m_pool(other.m_pool),
+						  m_processor(other.m_processor) {
+	other.m_pool = nullptr;
+	other.m_processor = nullptr;
+}
+
+LibRawPool::Handle::~Handle() {
+	if (m_pool != nullptr) {
+		m_pool->release(m_processor);
+	}
+}
+
+LibRawPool::LibRawPool(unsigned int flags)
+						: m_flags(flags),
+						  m_defaultParams(),
+						  m_mutex(),
+						  m_processors(),
+						  m_availableProcessors() {}
+
+LibRawPool::Handle LibRawPool::acquire() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_availableProcessors.empty()) {
+		m_processors.push_back(std::unique_ptr<LibRawExtension>(
+											new LibRawExtension(m_flags)));
+		if (m_processors.size() == 1) {
+			m_defaultParams = m_processors.back()->imgdata.params;
+		}
+		m_availableProcessors.push_back(m_processors.back().get());
+	}
+	LibRawExtension* processor = m_availableProcessors.back();
+	m_availableProcessors.pop_back();
+	return Handle(this, processor);
+}
+
+int LibRawPool::getNumberOfProcessors() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<int>(m_processors.size());
+}
+
+LibRawPool& LibRawPool::getDefault() {
+	static LibRawPool pool;
+	return pool;
+}
+
+void LibRawPool::release(LibRawExtension* processor) {
+	/*
+	 * Free the per-file buffers outside the lock; the processor itself, with
+	 * its memory manager and decoder state, is kept for the next file.
+	 * recycle() leaves the output parameters alone, so restore the defaults
+	 * to keep dcraw flags from leaking into the next file.
+	 */
+	processor->recycle();
+	processor->imgdata.params = m_defaultParams;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_availableProcessors.push_back(processor);
+}
+
 }  // namespace libraw
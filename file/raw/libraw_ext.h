@@ -8,6 +8,10 @@
 #ifndef LIBRAW_EXT_H_
 #define LIBRAW_EXT_H_
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "libraw.h"
 
 //class DllDef LibRawExt : public LibRaw {
@@ -35,10 +39,69 @@ public:
 	LibRawExtension(unsigned int flags = LIBRAW_OPTIONS_NONE);
 	int copy_processed(unsigned short* pixelBuffer);
 
+	/*
+	 * Copy the CFA sample of every pixel of the raw2image() output into a
+	 * column-major iheight x iwidth buffer.
+	 */
+	int copy_mosaic(unsigned short* pixelBuffer);
+
 private:
 	void copy_processed_internal(unsigned short* pixelBuffer);
 };
 
+/*
+ * Pool of recyclable processors. Constructing a LibRaw object allocates its
+ * memory manager and decoder state, which is wasted work when many files are
+ * read in a row. Processors are handed out through a Handle that recycles
+ * the processor and returns it to the pool when it goes out of scope. The
+ * pool grows to the largest number of processors simultaneously in use and
+ * is safe to use from multiple threads.
+ */
+class LibRawPool {
+public:
+	class Handle {
+	public:
+		Handle(Handle&& other);
+		Handle(const Handle& other) = delete;
+		Handle& operator=(const Handle& other) = delete;
+
+		LibRawExtension& get() const {
+			return *m_processor;
+		}
+
+		~Handle();
+
+	private:
+		friend class LibRawPool;
+		Handle(LibRawPool* pool, LibRawExtension* processor);
+
+		LibRawPool* m_pool;
+		LibRawExtension* m_processor;
+	};
+
+	explicit LibRawPool(unsigned int flags = LIBRAW_OPTIONS_NONE);
+	LibRawPool(const LibRawPool& other) = delete;
+	LibRawPool& operator=(const LibRawPool& other) = delete;
+
+	Handle acquire();
+	int getNumberOfProcessors();
+
+	/*
+	 * Process-wide pool. It lives until the MEX file is cleared, so processors
+	 * are reused across calls as well as within a batch.
+	 */
+	static LibRawPool& getDefault();
+
+private:
+	void release(LibRawExtension* processor);
+
+	unsigned int m_flags;
+	libraw_output_params_t m_defaultParams;
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<LibRawExtension> > m_processors;
+	std::vector<LibRawExtension*> m_availableProcessors;
+};
+
 }  // namespace libraw
 
 #endif  // LIBRAW_EXT_H_
@@ -0,0 +1,66 @@
+/*
+ * mapped_file.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include "../raw/mapped_file.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace raw {
+
+MappedFile::MappedFile(const std::string& fileName)
+					: m_data(nullptr),
+					  m_size(0) {
+#if !defined(_WIN32)
+	int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		return;
+	}
+	struct stat fileStatus;
+	if ((fstat(fileDescriptor, &fileStatus) == 0) &&
+			(S_ISREG(fileStatus.st_mode)) && (fileStatus.st_size > 0)) {
+		void* data = mmap(nullptr, static_cast<std::size_t>(fileStatus.st_size),
+						PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (data != MAP_FAILED) {
+			m_data = data;
+			m_size = static_cast<std::size_t>(fileStatus.st_size);
+		}
+	}
+	/*
+	 * The mapping holds its own reference to the file.
+	 */
+	close(fileDescriptor);
+#else
+	(void) fileName;
+#endif
+}
+
+bool MappedFile::isValid() const {
+	return m_data != nullptr;
+}
+
+const void* MappedFile::getData() const {
+	return m_data;
+}
+
+std::size_t MappedFile::getSize() const {
+	return m_size;
+}
+
+MappedFile::~MappedFile() {
+#if !defined(_WIN32)
+	if (m_data != nullptr) {
+		munmap(m_data, m_size);
+	}
+#endif
+}
+
+}  // namespace raw
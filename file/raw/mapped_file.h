@@ -0,0 +1,41 @@
+/*
+ * mapped_file.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+namespace raw {
+
+/*
+ * Read-only memory mapping of a whole file. Construction never fails loudly,
+ * so it can be used from worker threads; callers check isValid() and fall
+ * back to regular file I/O, e.g. for special files or on platforms without
+ * mmap.
+ */
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& fileName);
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+
+	bool isValid() const;
+	const void* getData() const;
+	std::size_t getSize() const;
+
+	~MappedFile();
+
+private:
+	void* m_data;
+	std::size_t m_size;
+};
+
+}  // namespace raw
+
+#endif  // MAPPED_FILE_H_
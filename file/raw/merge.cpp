@@ -0,0 +1,210 @@
+/*
+ * merge.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+#include "../raw/merge.h"
+
+namespace raw {
+
+namespace {
+
+/*
+ * Number of samples per thread chunk in the accumulation passes.
+ */
+const std::ptrdiff_t kChunkSize = 1 << 16;
+
+/*
+ * Exposure flags, accumulated over frames for every site.
+ */
+const unsigned char kUnderExposed = 1;
+const unsigned char kOverExposed = 2;
+const unsigned char kProperlyExposed = 4;
+
+}  // namespace
+
+MergeOptions::MergeOptions()
+					: exposures(),
+					  minLimit(0.002f),
+					  maxLimit(0.98f),
+					  sigmasq(0.0f) {}
+
+void mergeExposures(const std::vector<std::string>& fileNames,
+					const MergeOptions& options, int& height, int& width,
+					std::vector<HdrPixelType>& hdr,
+					std::vector<unsigned char>& filterArray,
+					std::string& filterNames) {
+	const int numFiles = static_cast<int>(fileNames.size());
+	mexAssertEx(numFiles > 0, "At least one file name is required");
+	mexAssertEx(options.exposures.empty() ||
+				(static_cast<int>(options.exposures.size()) == numFiles),
+				"Number of exposure values must be equal to number of files");
+	mexAssertEx((options.minLimit >= 0.0f) &&
+				(options.minLimit < options.maxLimit) &&
+				(options.sigmasq >= 0.0f),
+				"Invalid merge limits");
+
+	CaptureSettings settings;
+	std::size_t numPixels = 0;
+	std::vector<PixelType> mosaic;
+	std::vector<HdrPixelType> denominator;
+	std::vector<unsigned char> exposureFlags;
+	float maxRange[4];
+	float minExposure = std::numeric_limits<float>::max();
+
+	for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+		RawInputFile file(mex::MxString(fileNames[iterFile]));
+		if (iterFile == 0) {
+			settings = file.getCaptureSettings();
+			height = file.getHeight();
+			width = file.getWidth();
+			numPixels = static_cast<std::size_t>(height) * width;
+			mosaic.resize(numPixels);
+			hdr.assign(numPixels, 0.0f);
+			denominator.assign(numPixels, 0.0f);
+			exposureFlags.assign(numPixels, 0);
+			filterArray.resize(numPixels);
+			file.readFilterArray(&filterArray[0]);
+			filterNames = file.getFilterNames();
+			std::fill(maxRange, maxRange + 4, 0.0f);
+		}
+		CaptureSettings fileSettings = file.getCaptureSettings();
+		mexAssertEx((fileSettings.make == settings.make) &&
+					(fileSettings.model == settings.model) &&
+					(file.getHeight() == height) && (file.getWidth() == width),
+					"Bracketed frames must come from the same camera");
+
+		const float exposure = (options.exposures.empty())
+							?(fileSettings.shutter)
+							:(options.exposures[iterFile]);
+		mexAssertEx(exposure > 0.0f, "Exposure values must be positive");
+		minExposure = std::min(minExposure, exposure);
+
+		/*
+		 * Limits are converted to raw units of this frame, whose black level
+		 * may differ from the first one.
+		 */
+		float black[4];
+		float lowLimit[4];
+		float highLimit[4];
+		const float white = file.getWhiteLevel();
+		for (int color = 0; color < 4; ++color) {
+			black[color] = file.getBlackLevel(color);
+			const float range = white - black[color];
+			mexAssertEx(range > 0.0f, "Invalid black and white levels");
+			lowLimit[color] = options.minLimit * range;
+			highLimit[color] = options.maxLimit * range;
+			maxRange[color] = std::max(maxRange[color], range);
+		}
+		file.readData(false, &mosaic[0]);
+
+		const PixelType* mosaicBuffer = &mosaic[0];
+		const unsigned char* filterBuffer = &filterArray[0];
+		HdrPixelType* numeratorBuffer = &hdr[0];
+		HdrPixelType* denominatorBuffer = &denominator[0];
+		unsigned char* flagBuffer = &exposureFlags[0];
+		const float sigmasq = options.sigmasq;
+		const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(numPixels);
+#pragma omp parallel for schedule(static)
+		for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+			const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+			for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+				const int color = filterBuffer[iter] & 3;
+				const float value = static_cast<float>(mosaicBuffer[iter])
+									- black[color];
+				const bool underExposed = !(value >= lowLimit[color]) ||
+										!(value > 0.0f);
+				const bool overExposed = value > highLimit[color];
+				const bool properlyExposed = !(underExposed || overExposed);
+				const float weight = (properlyExposed)
+									?(1.0f / (value + sigmasq))
+									:(0.0f);
+				numeratorBuffer[iter] += exposure * value * weight;
+				denominatorBuffer[iter] += exposure * exposure * weight;
+				flagBuffer[iter] |= static_cast<unsigned char>(
+								((underExposed)?(kUnderExposed):(0)) |
+								((overExposed)?(kOverExposed):(0)) |
+								((properlyExposed)?(kProperlyExposed):(0)));
+			}
+		}
+	}
+
+	/*
+	 * Frames may differ in black and white levels, so the result is
+	 * normalized by the largest range among them.
+	 */
+	float inverseRange[4];
+	for (int color = 0; color < 4; ++color) {
+		inverseRange[color] = 1.0f / maxRange[color];
+	}
+	HdrPixelType* hdrBuffer = &hdr[0];
+	const HdrPixelType* denominatorBuffer = &denominator[0];
+	const unsigned char* flagBuffer = &exposureFlags[0];
+	const unsigned char* filterBuffer = &filterArray[0];
+	const float saturatedValue = options.maxLimit / minExposure;
+	const std::ptrdiff_t length = static_cast<std::ptrdiff_t>(numPixels);
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t start = 0; start < length; start += kChunkSize) {
+		const std::ptrdiff_t end = std::min(start + kChunkSize, length);
+#pragma omp simd
+		for (std::ptrdiff_t iter = start; iter < end; ++iter) {
+			const bool isMerged = denominatorBuffer[iter] > 0.0f;
+			const float merged = hdrBuffer[iter]
+						/ ((isMerged)?(denominatorBuffer[iter]):(1.0f))
+						* inverseRange[filterBuffer[iter] & 3];
+			const float fallback = (flagBuffer[iter] & kOverExposed)
+								?(saturatedValue)
+								:(0.0f);
+			hdrBuffer[iter] = (isMerged)?(merged):(fallback);
+		}
+	}
+}
+
+mex::MxArray mergeExposures(const std::vector<std::string>& fileNames,
+							const MergeOptions& options) {
+	int height;
+	int width;
+	std::vector<HdrPixelType> hdr;
+	std::vector<unsigned char> filterArray;
+	std::string filterNames;
+	mergeExposures(fileNames, options, height, width, hdr, filterArray,
+				filterNames);
+	mex::MxNumeric<HdrPixelType> hdrArray(height, width);
+	std::copy(hdr.begin(), hdr.end(), hdrArray.getData());
+	return mex::MxArray(hdrArray.get_array());
+}
+
+mex::MxArray mergeExposures(const std::vector<std::string>& fileNames,
+							const MergeOptions& options,
+							EDemosaicMethod method) {
+	mexAssertEx((method != EDemosaicMethod::EInvalid) &&
+				(method != EDemosaicMethod::ELength),
+				"Unknown demosaicking method");
+	int height;
+	int width;
+	std::vector<HdrPixelType> hdr;
+	std::vector<unsigned char> filterArray;
+	std::string filterNames;
+	mergeExposures(fileNames, options, height, width, hdr, filterArray,
+				filterNames);
+
+	int filterColors[2][2];
+	getFilterColors(&filterArray[0], height, width, filterNames, filterColors);
+	std::vector<int> dimensions;
+	dimensions.push_back(height);
+	dimensions.push_back(width);
+	dimensions.push_back(3);
+	mex::MxNumeric<DemosaicPixelType> rgbArray(
+						static_cast<int>(dimensions.size()), &dimensions[0]);
+	demosaic(&hdr[0], height, width, filterColors, method, rgbArray.getData());
+	return mex::MxArray(rgbArray.get_array());
+}
+
+}  // namespace raw
@@ -0,0 +1,76 @@
+/*
+ * merge.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef MERGE_H_
+#define MERGE_H_
+
+#include <string>
+#include <vector>
+
+#include "../include/file.h"
+#include "../raw/demosaic.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Linear HDR merge of bracketed raws in the CFA domain. Files are streamed
+ * through RawInputFile one at a time, so memory stays at one mosaic plus the
+ * accumulators. Every site is merged with the Fisher (variance-optimal)
+ * weights of hdr/ldr2hdr_fisher.m,
+ *
+ *   numerator   += t * v / (v + sigmasq),
+ *   denominator += t^2 / (v + sigmasq),
+ *
+ * with v the black-subtracted value in raw units and t the exposure, over the
+ * frames where the site is properly exposed. The result is numerator /
+ * denominator, normalized by the largest white-to-black range of the frames,
+ * so it is radiance per unit exposure with 1 that white level at t = 1.
+ *
+ * The limits are relative to the range of each frame. Sites never properly exposed are set
+ * to maxLimit / (shortest exposure) if they saturated in some frame, and to
+ * zero otherwise.
+ */
+
+using HdrPixelType = float;
+
+struct MergeOptions {
+	MergeOptions();
+
+	/*
+	 * One exposure per file. If empty, the shutter times of the files are used.
+	 */
+	std::vector<float> exposures;
+	float minLimit;
+	float maxLimit;
+	float sigmasq;
+};
+
+/*
+ * Merge into the column-major mosaic hdr, resized to the size of the files,
+ * and return the filter array and filter names of the first file for
+ * demosaicking.
+ */
+void mergeExposures(const std::vector<std::string>& fileNames,
+					const MergeOptions& options, int& height, int& width,
+					std::vector<HdrPixelType>& hdr,
+					std::vector<unsigned char>& filterArray,
+					std::string& filterNames);
+
+/*
+ * Merged float mosaic, or, for a valid demosaicking method, the demosaiced
+ * height x width x 3 image.
+ */
+mex::MxArray mergeExposures(const std::vector<std::string>& fileNames,
+							const MergeOptions& options);
+mex::MxArray mergeExposures(const std::vector<std::string>& fileNames,
+							const MergeOptions& options,
+							EDemosaicMethod method);
+
+}  // namespace raw
+
+#endif  // MERGE_H_
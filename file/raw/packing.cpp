@@ -0,0 +1,428 @@
+/*
+ * packing.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+
+#include "../raw/packing.h"
+
+namespace raw {
+
+namespace {
+
+const char kPackedMagic[8] = {'I', 'U', 'R', 'A', 'W', 'P', 'A', 'K'};
+const std::int32_t kPackedVersion = 1;
+
+/*
+ * Groups of samples handled per parallel work item.
+ */
+const std::size_t kChunkSize = 1 << 16;
+
+/*
+ * Kernels over whole groups: 2 samples in 3 bytes at 12 bits, 4 samples in 7
+ * bytes at 14 bits. Groups are independent and branch-free, so the inner
+ * loops vectorize.
+ */
+void pack12(const PixelType* samples, std::size_t numGroups,
+			unsigned char* packed) {
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t chunk = 0;
+			chunk < static_cast<std::ptrdiff_t>(
+							(numGroups + kChunkSize - 1) / kChunkSize);
+			++chunk) {
+		const std::size_t begin = static_cast<std::size_t>(chunk) * kChunkSize;
+		const std::size_t end = std::min(begin + kChunkSize, numGroups);
+#pragma omp simd
+		for (std::size_t iter = begin; iter < end; ++iter) {
+			const unsigned int a = std::min<unsigned int>(samples[2 * iter],
+														0xFFF);
+			const unsigned int b = std::min<unsigned int>(samples[2 * iter + 1],
+														0xFFF);
+			packed[3 * iter] = static_cast<unsigned char>(a);
+			packed[3 * iter + 1] = static_cast<unsigned char>((a >> 8)
+															| (b << 4));
+			packed[3 * iter + 2] = static_cast<unsigned char>(b >> 4);
+		}
+	}
+}
+
+void unpack12(const unsigned char* packed, std::size_t numGroups,
+			PixelType* samples) {
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t chunk = 0;
+			chunk < static_cast<std::ptrdiff_t>(
+							(numGroups + kChunkSize - 1) / kChunkSize);
+			++chunk) {
+		const std::size_t begin = static_cast<std::size_t>(chunk) * kChunkSize;
+		const std::size_t end = std::min(begin + kChunkSize, numGroups);
+#pragma omp simd
+		for (std::size_t iter = begin; iter < end; ++iter) {
+			const unsigned int byte0 = packed[3 * iter];
+			const unsigned int byte1 = packed[3 * iter + 1];
+			const unsigned int byte2 = packed[3 * iter + 2];
+			samples[2 * iter] = static_cast<PixelType>(byte0
+													| ((byte1 & 0xF) << 8));
+			samples[2 * iter + 1] = static_cast<PixelType>((byte1 >> 4)
+														| (byte2 << 4));
+		}
+	}
+}
+
+void pack14(const PixelType* samples, std::size_t numGroups,
+			unsigned char* packed) {
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t chunk = 0;
+			chunk < static_cast<std::ptrdiff_t>(
+							(numGroups + kChunkSize - 1) / kChunkSize);
+			++chunk) {
+		const std::size_t begin = static_cast<std::size_t>(chunk) * kChunkSize;
+		const std::size_t end = std::min(begin + kChunkSize, numGroups);
+#pragma omp simd
+		for (std::size_t iter = begin; iter < end; ++iter) {
+			const std::uint64_t word =
+				static_cast<std::uint64_t>(
+						std::min<unsigned int>(samples[4 * iter], 0x3FFF))
+				| (static_cast<std::uint64_t>(
+						std::min<unsigned int>(samples[4 * iter + 1], 0x3FFF))
+						<< 14)
+				| (static_cast<std::uint64_t>(
+						std::min<unsigned int>(samples[4 * iter + 2], 0x3FFF))
+						<< 28)
+				| (static_cast<std::uint64_t>(
+						std::min<unsigned int>(samples[4 * iter + 3], 0x3FFF))
+						<< 42);
+			for (int iterByte = 0; iterByte < 7; ++iterByte) {
+				packed[7 * iter + iterByte] = static_cast<unsigned char>(
+													word >> (8 * iterByte));
+			}
+		}
+	}
+}
+
+void unpack14(const unsigned char* packed, std::size_t numGroups,
+			PixelType* samples) {
+#pragma omp parallel for schedule(static)
+	for (std::ptrdiff_t chunk = 0;
+			chunk < static_cast<std::ptrdiff_t>(
+							(numGroups + kChunkSize - 1) / kChunkSize);
+			++chunk) {
+		const std::size_t begin = static_cast<std::size_t>(chunk) * kChunkSize;
+		const std::size_t end = std::min(begin + kChunkSize, numGroups);
+#pragma omp simd
+		for (std::size_t iter = begin; iter < end; ++iter) {
+			std::uint64_t word = 0;
+			for (int iterByte = 0; iterByte < 7; ++iterByte) {
+				word |= static_cast<std::uint64_t>(packed[7 * iter + iterByte])
+						<< (8 * iterByte);
+			}
+			samples[4 * iter] = static_cast<PixelType>(word & 0x3FFF);
+			samples[4 * iter + 1] = static_cast<PixelType>((word >> 14)
+															& 0x3FFF);
+			samples[4 * iter + 2] = static_cast<PixelType>((word >> 28)
+															& 0x3FFF);
+			samples[4 * iter + 3] = static_cast<PixelType>((word >> 42)
+															& 0x3FFF);
+		}
+	}
+}
+
+int getGroupSamples(int bitDepth) {
+	return (bitDepth == 12)?(2):(4);
+}
+
+int getGroupBytes(int bitDepth) {
+	return (bitDepth == 12)?(3):(7);
+}
+
+void packGroups(const PixelType* samples, std::size_t numGroups,
+				int bitDepth, unsigned char* packed) {
+	if (bitDepth == 12) {
+		pack12(samples, numGroups, packed);
+	} else {
+		pack14(samples, numGroups, packed);
+	}
+}
+
+void unpackGroups(const unsigned char* packed, std::size_t numGroups,
+				int bitDepth, PixelType* samples) {
+	if (bitDepth == 12) {
+		unpack12(packed, numGroups, samples);
+	} else {
+		unpack14(packed, numGroups, samples);
+	}
+}
+
+}  // namespace
+
+bool isPackedBitDepth(int bitDepth) {
+	return (bitDepth == 12) || (bitDepth == 14);
+}
+
+int getPackedBitDepth(unsigned int maxValue) {
+	if (maxValue < (1U << 12)) {
+		return 12;
+	} else if (maxValue < (1U << 14)) {
+		return 14;
+	} else {
+		return 0;
+	}
+}
+
+std::size_t getPackedSize(std::size_t numSamples, int bitDepth) {
+	const std::size_t groupSamples = getGroupSamples(bitDepth);
+	return (numSamples + groupSamples - 1) / groupSamples
+			* getGroupBytes(bitDepth);
+}
+
+void packSamples(const PixelType* samples, std::size_t numSamples,
+				int bitDepth, unsigned char* packed) {
+	mexAssertEx(isPackedBitDepth(bitDepth), "Unsupported packed bit depth");
+	const std::size_t groupSamples = getGroupSamples(bitDepth);
+	const std::size_t numGroups = numSamples / groupSamples;
+	packGroups(samples, numGroups, bitDepth, packed);
+
+	/*
+	 * A trailing partial group is padded with zeros.
+	 */
+	const std::size_t tailSamples = numSamples - numGroups * groupSamples;
+	if (tailSamples > 0) {
+		PixelType tail[4] = {0, 0, 0, 0};
+		std::copy(samples + numGroups * groupSamples, samples + numSamples,
+				tail);
+		packGroups(tail, 1, bitDepth,
+				packed + numGroups * getGroupBytes(bitDepth));
+	}
+}
+
+void unpackSamples(const unsigned char* packed, std::size_t numSamples,
+				int bitDepth, PixelType* samples) {
+	mexAssertEx(isPackedBitDepth(bitDepth), "Unsupported packed bit depth");
+	const std::size_t groupSamples = getGroupSamples(bitDepth);
+	const std::size_t numGroups = numSamples / groupSamples;
+	unpackGroups(packed, numGroups, bitDepth, samples);
+
+	const std::size_t tailSamples = numSamples - numGroups * groupSamples;
+	if (tailSamples > 0) {
+		PixelType tail[4];
+		unpackGroups(packed + numGroups * getGroupBytes(bitDepth), 1, bitDepth,
+					tail);
+		std::copy(tail, tail + tailSamples,
+				samples + numGroups * groupSamples);
+	}
+}
+
+/*
+ * PackedMosaic implementation.
+ */
+PackedMosaic::PackedMosaic()
+						: m_height(0),
+						  m_width(0),
+						  m_numFrames(0),
+						  m_bitDepth(0),
+						  m_data() {}
+
+PackedMosaic::PackedMosaic(int height, int width, int numFrames,
+						int bitDepth)
+						: m_height(height),
+						  m_width(width),
+						  m_numFrames(numFrames),
+						  m_bitDepth(bitDepth),
+						  m_data() {
+	mexAssertEx((height > 0) && (width > 0) && (numFrames > 0),
+				"Packed mosaic dimensions must be positive");
+	mexAssertEx(isPackedBitDepth(bitDepth), "Unsupported packed bit depth");
+	m_data.resize(getFrameSize() * numFrames);
+}
+
+int PackedMosaic::getHeight() const {
+	return m_height;
+}
+
+int PackedMosaic::getWidth() const {
+	return m_width;
+}
+
+int PackedMosaic::getNumberOfFrames() const {
+	return m_numFrames;
+}
+
+int PackedMosaic::getBitDepth() const {
+	return m_bitDepth;
+}
+
+std::size_t PackedMosaic::getFrameSize() const {
+	return (m_numFrames > 0)?(getPackedSize(
+							static_cast<std::size_t>(m_height) * m_width,
+							m_bitDepth))
+							:(0);
+}
+
+unsigned char* PackedMosaic::getData() {
+	return m_data.empty()?(nullptr):(&m_data[0]);
+}
+
+const unsigned char* PackedMosaic::getData() const {
+	return m_data.empty()?(nullptr):(&m_data[0]);
+}
+
+void PackedMosaic::packFrame(int frame, const PixelType* mosaic) {
+	mexAssertEx((frame >= 0) && (frame < m_numFrames),
+				"Frame index out of range");
+	packSamples(mosaic, static_cast<std::size_t>(m_height) * m_width,
+				m_bitDepth, getData() + frame * getFrameSize());
+}
+
+void PackedMosaic::unpackFrame(int frame, PixelType* mosaic) const {
+	mexAssertEx((frame >= 0) && (frame < m_numFrames),
+				"Frame index out of range");
+	unpackSamples(getData() + frame * getFrameSize(),
+				static_cast<std::size_t>(m_height) * m_width, m_bitDepth,
+				mosaic);
+}
+
+bool PackedMosaic::save(const std::string& fileName) const {
+	std::ofstream file(fileName.c_str(),
+					std::ofstream::out | std::ofstream::binary);
+	if (!file) {
+		return false;
+	}
+	std::int32_t header[5] = {kPackedVersion, m_height, m_width, m_numFrames,
+							m_bitDepth};
+	file.write(kPackedMagic, sizeof(kPackedMagic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	if (!m_data.empty()) {
+		file.write(reinterpret_cast<const char*>(&m_data[0]), m_data.size());
+	}
+	return static_cast<bool>(file);
+}
+
+bool PackedMosaic::load(const std::string& fileName) {
+	std::ifstream file(fileName.c_str(),
+					std::ifstream::in | std::ifstream::binary);
+	if (!file) {
+		return false;
+	}
+	char magic[sizeof(kPackedMagic)];
+	file.read(magic, sizeof(magic));
+	if ((!file) || (!std::equal(magic, magic + sizeof(magic), kPackedMagic))) {
+		return false;
+	}
+	std::int32_t header[5];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if ((!file) || (header[0] != kPackedVersion) || (header[1] <= 0) ||
+			(header[2] <= 0) || (header[3] <= 0) ||
+			(!isPackedBitDepth(header[4]))) {
+		return false;
+	}
+	std::vector<unsigned char> data(getPackedSize(
+							static_cast<std::size_t>(header[1]) * header[2],
+							header[4]) * header[3]);
+	file.read(reinterpret_cast<char*>(&data[0]), data.size());
+	if (!file) {
+		return false;
+	}
+	m_height = header[1];
+	m_width = header[2];
+	m_numFrames = header[3];
+	m_bitDepth = header[4];
+	m_data.swap(data);
+	return true;
+}
+
+mex::MxArray toMxArray(const PackedMosaic& packedMosaic) {
+	const std::size_t frameSize = packedMosaic.getFrameSize();
+	mexAssertEx(frameSize <= static_cast<std::size_t>(INT_MAX),
+				"Packed frame is too large");
+	const std::size_t dataSize = frameSize * packedMosaic.getNumberOfFrames();
+	mex::MxNumeric<unsigned char> dataArray(static_cast<int>(frameSize),
+											packedMosaic.getNumberOfFrames());
+	std::copy(packedMosaic.getData(), packedMosaic.getData() + dataSize,
+			dataArray.getData());
+	mex::MxNumeric<double> height(
+						static_cast<double>(packedMosaic.getHeight()));
+	mex::MxNumeric<double> width(static_cast<double>(packedMosaic.getWidth()));
+	mex::MxNumeric<double> numFrames(
+					static_cast<double>(packedMosaic.getNumberOfFrames()));
+	mex::MxNumeric<double> bitDepth(
+						static_cast<double>(packedMosaic.getBitDepth()));
+
+	std::vector<std::string> names;
+	std::vector<mex::MxArray*> arrays;
+	names.push_back("height");
+	arrays.push_back(&height);
+	names.push_back("width");
+	arrays.push_back(&width);
+	names.push_back("numFrames");
+	arrays.push_back(&numFrames);
+	names.push_back("bitDepth");
+	arrays.push_back(&bitDepth);
+	names.push_back("data");
+	arrays.push_back(&dataArray);
+	return mex::MxArray(mex::MxStruct(names, arrays).get_array());
+}
+
+PackedMosaic toPackedMosaic(const mex::MxStruct& packedStruct) {
+	const int height = static_cast<int>(mex::MxNumeric<double>(
+							packedStruct[std::string("height")])[0]);
+	const int width = static_cast<int>(mex::MxNumeric<double>(
+							packedStruct[std::string("width")])[0]);
+	const int numFrames = static_cast<int>(mex::MxNumeric<double>(
+							packedStruct[std::string("numFrames")])[0]);
+	const int bitDepth = static_cast<int>(mex::MxNumeric<double>(
+							packedStruct[std::string("bitDepth")])[0]);
+	mex::MxNumeric<unsigned char> dataArray(
+							packedStruct[std::string("data")]);
+
+	/*
+	 * The element count is formed from the dimensions, as it may not fit in
+	 * an int.
+	 */
+	const std::vector<int> dimensions = dataArray.getDimensions();
+	std::size_t dataSize = 1;
+	for (std::vector<int>::const_iterator iter = dimensions.begin();
+			iter != dimensions.end(); ++iter) {
+		dataSize *= static_cast<std::size_t>(*iter);
+	}
+
+	PackedMosaic packedMosaic(height, width, numFrames, bitDepth);
+	mexAssertEx(dataSize == packedMosaic.getFrameSize() * numFrames,
+				"Packed data size does not match the mosaic dimensions");
+	std::copy(dataArray.getData(), dataArray.getData() + dataSize,
+			packedMosaic.getData());
+	return packedMosaic;
+}
+
+mex::MxArray unpackMosaic(const PackedMosaic& packedMosaic,
+						const std::vector<int>& frames) {
+	std::vector<int> frameIndices(frames);
+	if (frameIndices.empty()) {
+		for (int iterFrame = 0; iterFrame < packedMosaic.getNumberOfFrames();
+				++iterFrame) {
+			frameIndices.push_back(iterFrame);
+		}
+	}
+	std::vector<int> dimensions;
+	dimensions.push_back(packedMosaic.getHeight());
+	dimensions.push_back(packedMosaic.getWidth());
+	dimensions.push_back(static_cast<int>(frameIndices.size()));
+	mex::MxNumeric<PixelType> pixelArray(static_cast<int>(dimensions.size()),
+										&dimensions[0]);
+	const std::size_t frameElements =
+						static_cast<std::size_t>(packedMosaic.getHeight())
+						* packedMosaic.getWidth();
+	for (int iterFrame = 0, numFrames = static_cast<int>(frameIndices.size());
+			iterFrame < numFrames; ++iterFrame) {
+		packedMosaic.unpackFrame(frameIndices[iterFrame], pixelArray.getData()
+							+ static_cast<std::size_t>(iterFrame)
+								* frameElements);
+	}
+	return mex::MxArray(pixelArray.get_array());
+}
+
+}  // namespace raw
@@ -0,0 +1,93 @@
+/*
+ * packing.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#ifndef PACKING_H_
+#define PACKING_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "../include/file.h"
+#include "../raw/raw.h"
+
+namespace raw {
+
+/*
+ * Bit-packed storage of raw mosaics. 12-bit samples are packed two to three
+ * bytes and 14-bit samples four to seven bytes, little-endian, saving 25% and
+ * 12.5% over PixelType. Samples above the bit depth saturate. Every frame is
+ * packed on its own, so that frames can be unpacked independently.
+ */
+
+bool isPackedBitDepth(int bitDepth);
+
+/*
+ * Smallest packed bit depth that holds maxValue, or 0 if none does.
+ */
+int getPackedBitDepth(unsigned int maxValue);
+
+std::size_t getPackedSize(std::size_t numSamples, int bitDepth);
+
+void packSamples(const PixelType* samples, std::size_t numSamples,
+				int bitDepth, unsigned char* packed);
+void unpackSamples(const unsigned char* packed, std::size_t numSamples,
+				int bitDepth, PixelType* samples);
+
+/*
+ * A stack of packed height x width mosaics, cached in a binary file with a
+ * short header followed by the packed frames.
+ */
+class PackedMosaic {
+public:
+	PackedMosaic();
+	PackedMosaic(int height, int width, int numFrames, int bitDepth);
+
+	int getHeight() const;
+	int getWidth() const;
+	int getNumberOfFrames() const;
+	int getBitDepth() const;
+	std::size_t getFrameSize() const;
+	unsigned char* getData();
+	const unsigned char* getData() const;
+
+	void packFrame(int frame, const PixelType* mosaic);
+	void unpackFrame(int frame, PixelType* mosaic) const;
+
+	/*
+	 * load() returns false, leaving the mosaic unchanged, if the file is
+	 * missing or not a valid packed mosaic.
+	 */
+	bool save(const std::string& fileName) const;
+	bool load(const std::string& fileName);
+
+private:
+	int m_height;
+	int m_width;
+	int m_numFrames;
+	int m_bitDepth;
+	std::vector<unsigned char> m_data;
+};
+
+/*
+ * Packed mosaics are exchanged with MATLAB as structs with fields height,
+ * width, numFrames, bitDepth and data, the last a uint8 matrix with one
+ * packed frame per column, so that stacks over 2 GB keep int dimensions.
+ */
+mex::MxArray toMxArray(const PackedMosaic& packedMosaic);
+PackedMosaic toPackedMosaic(const mex::MxStruct& packedStruct);
+
+/*
+ * Unpack all frames (empty frames) or the given 0-based frames into a
+ * height x width x numel(frames) stack.
+ */
+mex::MxArray unpackMosaic(const PackedMosaic& packedMosaic,
+						const std::vector<int>& frames);
+
+}  // namespace raw
+
+#endif  // PACKING_H_
@@ -6,36 +6,218 @@
  */
 
 #include <algorithm>
+#include <csetjmp>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
 #include <ctime>
 #include <string>
+#include <vector>
+
+#include "jpeglib.h"
 
 #include "../raw/raw.h"
+#include "../raw/calibration.h"
+#include "../raw/defects.h"
 
 namespace raw {
 
+namespace {
+
+/*
+ * Number of histogram bins between black and white level in
+ * RawInputFile::getExposureStatistics.
+ */
+const int kHistogramBins = 1024;
+
+/*
+ * Scatter one row of interleaved 8-bit samples into column-major planes.
+ */
+void scatterRow(const unsigned char* row, int rowIndex, int height, int width,
+				int numChannels, unsigned char* planes) {
+	for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
+		for (int pixelChannel = 0; pixelChannel < numChannels; ++pixelChannel) {
+			planes[(pixelChannel * width + pixelWidth) * height + rowIndex] =
+									row[pixelWidth * numChannels + pixelChannel];
+		}
+	}
+}
+
+/*
+ * libjpeg reports errors through error_exit, which must not return. Jump back
+ * to the decoder instead of letting the default handler exit MATLAB.
+ */
+struct JpegErrorManager {
+	jpeg_error_mgr errorManager;
+	std::jmp_buf jumpBuffer;
+};
+
+void exitJpegError(j_common_ptr info) {
+	std::longjmp(reinterpret_cast<JpegErrorManager*>(info->err)->jumpBuffer, 1);
+}
+
+/*
+ * Decodes JPEG thumbnails to RGB. Grayscale JPEGs are decoded as such and the
+ * channel is replicated, as not every libjpeg converts gray to RGB. CMYK and
+ * YCCK JPEGs have no meaningful RGB conversion and are rejected.
+ */
+class JpegDecoder {
+public:
+	JpegDecoder(const unsigned char* data, unsigned long size)
+			: m_info(),
+			  m_errorManager(),
+			  m_colorSpace(JCS_UNKNOWN),
+			  m_isValid(false) {
+		m_info.err = jpeg_std_error(&m_errorManager.errorManager);
+		m_errorManager.errorManager.error_exit = exitJpegError;
+		jpeg_create_decompress(&m_info);
+		if (setjmp(m_errorManager.jumpBuffer)) {
+			return;
+		}
+		jpeg_mem_src(&m_info, const_cast<unsigned char*>(data), size);
+		jpeg_read_header(&m_info, TRUE);
+		m_colorSpace = m_info.jpeg_color_space;
+		if (isCmyk()) {
+			return;
+		}
+		m_info.out_color_space = (m_colorSpace == JCS_GRAYSCALE)
+								?(JCS_GRAYSCALE)
+								:(JCS_RGB);
+		jpeg_start_decompress(&m_info);
+		m_isValid = true;
+	}
+
+	JpegDecoder(const JpegDecoder& other) = delete;
+	JpegDecoder& operator=(const JpegDecoder& other) = delete;
+
+	bool isValid() const {
+		return m_isValid;
+	}
+
+	bool isCmyk() const {
+		return (m_colorSpace == JCS_CMYK) || (m_colorSpace == JCS_YCCK);
+	}
+
+	int getHeight() const {
+		return static_cast<int>(m_info.output_height);
+	}
+
+	int getWidth() const {
+		return static_cast<int>(m_info.output_width);
+	}
+
+	int getNumberOfChannels() const {
+		return 3;
+	}
+
+	bool decode(unsigned char* planes) {
+		int height = getHeight();
+		int width = getWidth();
+		int numComponents = m_info.output_components;
+		std::vector<unsigned char> scanline(width * numComponents);
+		JSAMPROW scanlinePointer = &scanline[0];
+		if (setjmp(m_errorManager.jumpBuffer)) {
+			return false;
+		}
+		while (static_cast<int>(m_info.output_scanline) < height) {
+			int rowIndex = static_cast<int>(m_info.output_scanline);
+			jpeg_read_scanlines(&m_info, &scanlinePointer, 1);
+			if (numComponents == 1) {
+				for (int channel = 0; channel < 3; ++channel) {
+					scatterRow(scanlinePointer, rowIndex, height, width, 1,
+							planes + channel * height * width);
+				}
+			} else {
+				scatterRow(scanlinePointer, rowIndex, height, width,
+						numComponents, planes);
+			}
+		}
+		jpeg_finish_decompress(&m_info);
+		return true;
+	}
+
+	~JpegDecoder() {
+		jpeg_destroy_decompress(&m_info);
+	}
+
+private:
+	jpeg_decompress_struct m_info;
+	JpegErrorManager m_errorManager;
+	J_COLOR_SPACE m_colorSpace;
+	bool m_isValid;
+};
+
+}  // namespace
+
 /*
  * Check valid file function.
  */
 mex::MxNumeric<bool> isRawFile(const mex::MxString& fileName) {
-	LibRaw rawProcessor;
-	return mex::MxNumeric<bool>(rawProcessor.open_file(fileName.c_str())
+	libraw::LibRawPool::Handle rawProcessorHandle =
+									libraw::LibRawPool::getDefault().acquire();
+	return mex::MxNumeric<bool>(
+			rawProcessorHandle.get().open_file(fileName.c_str())
 								== LIBRAW_SUCCESS);
 }
 
+std::vector<std::string> toStringVector(const mex::MxCell& fileNames) {
+	std::vector<std::string> fileNameVector;
+	for (int iterName = 0; iterName < fileNames.getNumberOfElements();
+			++iterName) {
+		fileNameVector.push_back(
+							mex::MxString(fileNames[iterName]).get_string());
+	}
+	return fileNameVector;
+}
+
+int openRawFile(libraw::LibRawExtension& rawProcessor,
+				const std::string& fileName, const MappedFile& mappedFile) {
+	if (mappedFile.isValid()) {
+		/*
+		 * LibRaw only reads through the buffer datastream, so the read-only
+		 * mapping can be handed over as is.
+		 */
+		return rawProcessor.open_buffer(const_cast<void*>(mappedFile.getData()),
+										mappedFile.getSize());
+	}
+	return rawProcessor.open_file(fileName.c_str());
+}
+
 /*
  * Input file handling.
  */
 RawInputFile::RawInputFile(const mex::MxString& fileName):
 						m_fileName(fileName.get_string()),
 						m_unpackedFile(false),
-						m_rawProcessor() {
-	int errorCode = m_rawProcessor.open_file(m_fileName.c_str());
+						m_unpackedThumbnail(false),
+						m_mappedFile(new MappedFile(m_fileName)),
+						m_rawProcessorHandle(
+									libraw::LibRawPool::getDefault().acquire()),
+						m_rawProcessor(m_rawProcessorHandle.get()),
+						m_defectMap() {
+	int errorCode = openRawFile(m_rawProcessor, m_fileName, *m_mappedFile);
 	mexAssert(errorCode == LIBRAW_SUCCESS);
 }
 
+RawInputFile::RawInputFile(const mex::MxNumeric<unsigned char>& fileBuffer):
+						m_fileName(),
+						m_unpackedFile(false),
+						m_unpackedThumbnail(false),
+						m_mappedFile(),
+						m_rawProcessorHandle(
+									libraw::LibRawPool::getDefault().acquire()),
+						m_rawProcessor(m_rawProcessorHandle.get()),
+						m_defectMap() {
+	mexAssertEx(fileBuffer.getNumberOfElements() > 0, "Empty file buffer");
+	int errorCode = m_rawProcessor.open_buffer(fileBuffer.getData(),
+									static_cast<std::size_t>(
+										fileBuffer.getNumberOfElements()));
+	mexAssert(errorCode == LIBRAW_SUCCESS);
+}
+
+RawInputFile::~RawInputFile() = default;
+
 mex::MxString RawInputFile::getFileName() const {
 	return mex::MxString(m_fileName);
 }
@@ -84,31 +266,19 @@ mex::MxArray RawInputFile::readData(bool doSubtractDarkFrame,
 	unpackFile();
 	int errorCode;
 
-	if (dcrawFlags.empty()) {
-		errorCode = m_rawProcessor.raw2image();
-		mexAssert(errorCode == LIBRAW_SUCCESS);
-
-		if (doSubtractDarkFrame) {
-			errorCode = m_rawProcessor.subtract_black();
-			mexAssert(errorCode == LIBRAW_SUCCESS);
-		}
-
-		int width = getWidth();
-		int height = getHeight();
-		mex::MxNumeric<PixelType> pixelArray(height, width);
-
-		PixelType* pixelBuffer = pixelArray.getData();
-		for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
-			for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
-				int arrayIndex = pixelWidth * height + pixelHeight;
-				int rawIndex = pixelHeight * width + pixelWidth;
-				pixelBuffer[arrayIndex] = m_rawProcessor.imgdata.image[rawIndex]
-								[m_rawProcessor.COLOR(pixelHeight, pixelWidth)];
-			}
-		}
+	if (isCalibrated()) {
+		mexAssertEx(dcrawFlags.empty(),
+					"dcraw processing is not supported on calibrated data");
+		mex::MxNumeric<CalibrationPixelType> pixelArray(getHeight(),
+														getWidth());
+		readData(doSubtractDarkFrame, pixelArray.getData());
+		return mex::MxArray(pixelArray.get_array());
+	} else if (dcrawFlags.empty()) {
+		mex::MxNumeric<PixelType> pixelArray(getHeight(), getWidth());
+		readData(doSubtractDarkFrame, pixelArray.getData());
 		return mex::MxArray(pixelArray.get_array());
 	} else {
-		parseDcrawFlags(dcrawFlags);
+		parseDcrawFlags(dcrawFlags, m_rawProcessor.imgdata.params);
 
 		/*
 		 * raw_mex only supports 16-bit formats and processes data as if it was
@@ -140,12 +310,470 @@ mex::MxArray RawInputFile::readData(bool doSubtractDarkFrame,
 	}
 }
 
-mex::MxArray RawInputFile::getCFAInformation() {
+void RawInputFile::readData(bool doSubtractDarkFrame, PixelType* pixelBuffer) {
+	unpackFile();
+	int errorCode = m_rawProcessor.raw2image();
+	mexAssert(errorCode == LIBRAW_SUCCESS);
+
+	if (doSubtractDarkFrame) {
+		errorCode = m_rawProcessor.subtract_black();
+		mexAssert(errorCode == LIBRAW_SUCCESS);
+	}
+
+	errorCode = m_rawProcessor.copy_mosaic(pixelBuffer);
+	mexAssert(errorCode == LIBRAW_SUCCESS);
+
+	if (m_defectMap != nullptr) {
+		correctDefects(*m_defectMap,
+					[this](int row, int column) {
+						return m_rawProcessor.COLOR(row, column);
+					},
+					getHeight(), getWidth(), pixelBuffer);
+	}
+}
+
+void RawInputFile::readData(bool doSubtractDarkFrame,
+							CalibrationPixelType* calibratedBuffer) {
+	const std::size_t numPixels = static_cast<std::size_t>(getHeight())
+								* static_cast<std::size_t>(getWidth());
+	std::vector<PixelType> mosaic(numPixels);
+	readData(doSubtractDarkFrame, &mosaic[0]);
+
+	if (isCalibrated()) {
+		mexAssertEx(!doSubtractDarkFrame,
+					"Black subtraction is not supported on calibrated data");
+		applyCalibration(&mosaic[0], &m_calibrationDark[0],
+						(m_calibrationGain.empty())?(nullptr)
+												:(&m_calibrationGain[0]),
+						numPixels, calibratedBuffer);
+	} else {
+		std::copy(mosaic.begin(), mosaic.end(), calibratedBuffer);
+	}
+}
+
+void RawInputFile::setDefectMap(const DefectMap& defectMap) {
+	m_defectMap.reset(new DefectMap(defectMap));
+}
+
+void RawInputFile::setCalibration(const CalibrationPixelType* dark,
+								const CalibrationPixelType* gain) {
+	mexAssert(dark != nullptr);
+	const std::size_t numPixels = static_cast<std::size_t>(getHeight())
+								* static_cast<std::size_t>(getWidth());
+	m_calibrationDark.assign(dark, dark + numPixels);
+	if (gain != nullptr) {
+		m_calibrationGain.assign(gain, gain + numPixels);
+	} else {
+		m_calibrationGain.clear();
+	}
+}
+
+bool RawInputFile::isCalibrated() const {
+	return !m_calibrationDark.empty();
+}
+
+mex::MxArray RawInputFile::readPreview() {
+	unpackFile();
+
+	const libraw_data_t& imgdata = m_rawProcessor.imgdata;
+	mexAssertEx((imgdata.rawdata.raw_image != nullptr) &&
+				(imgdata.idata.filters >= 1000),
+				"Preview is supported only for Bayer raw data");
+
+	const int outHeight = imgdata.sizes.height / 2;
+	const int outWidth = imgdata.sizes.width / 2;
+	const int rawPitch = static_cast<int>(imgdata.sizes.raw_pitch
+									/ sizeof(PixelType));
+	const PixelType* rawImage = imgdata.rawdata.raw_image
+							+ imgdata.sizes.top_margin * rawPitch
+							+ imgdata.sizes.left_margin;
+
+	/*
+	 * White balance from the camera multipliers, falling back to the daylight
+	 * multipliers, normalized to green.
+	 */
+	float whiteBalance[4];
+	const float* multipliers = (imgdata.color.cam_mul[0] > 0)
+							?(imgdata.color.cam_mul)
+							:(imgdata.color.pre_mul);
+	for (int color = 0; color < 4; ++color) {
+		whiteBalance[color] = (multipliers[color] > 0)
+							?(multipliers[color])
+							:(multipliers[1]);
+	}
+	if (!(whiteBalance[1] > 0)) {
+		std::fill(whiteBalance, whiteBalance + 4, 1.0f);
+	}
+
+	/*
+	 * Every output channel is a weighted sum of the four black-subtracted
+	 * sites of a quad; the weights fold in white balance, normalization to
+	 * the white level, and averaging of the two greens.
+	 */
+	float black[4];
+	float weights[3][4] = {};
+	int siteChannel[4];
+	int channelCount[3] = {0, 0, 0};
+	for (int site = 0; site < 4; ++site) {
+		int color = m_rawProcessor.COLOR(site >> 1, site & 1);
+		mexAssert((color >= 0) && (color < 4));
+		switch (imgdata.idata.cdesc[color]) {
+			case 'R': {
+				siteChannel[site] = 0;
+				break;
+			}
+			case 'G': {
+				siteChannel[site] = 1;
+				break;
+			}
+			case 'B': {
+				siteChannel[site] = 2;
+				break;
+			}
+			default: {
+				mexAssertEx(0, "Preview is supported only for RGB raw data");
+				break;
+			}
+		}
+		++channelCount[siteChannel[site]];
+		black[site] = static_cast<float>(imgdata.color.black
+										+ imgdata.color.cblack[color]);
+		float range = static_cast<float>(imgdata.color.maximum) - black[site];
+		mexAssertEx(range > 0.0f, "Invalid black and white levels");
+		weights[siteChannel[site]][site] = (whiteBalance[color]
+										/ whiteBalance[1]) / range;
+	}
+	mexAssertEx((channelCount[0] > 0) && (channelCount[1] > 0) &&
+				(channelCount[2] > 0),
+				"Preview is supported only for RGB raw data");
+	for (int site = 0; site < 4; ++site) {
+		weights[siteChannel[site]][site] /=
+				static_cast<float>(channelCount[siteChannel[site]]);
+	}
+
+	std::vector<int> dimensions;
+	dimensions.push_back(outHeight);
+	dimensions.push_back(outWidth);
+	dimensions.push_back(3);
+	mex::MxNumeric<PreviewPixelType> pixelArray(
+						static_cast<int>(dimensions.size()), &dimensions[0]);
+	PreviewPixelType* redBuffer = pixelArray.getData();
+	PreviewPixelType* greenBuffer = redBuffer + outHeight * outWidth;
+	PreviewPixelType* blueBuffer = greenBuffer + outHeight * outWidth;
+
+	const int tileSize = 64;
+#pragma omp parallel for collapse(2) schedule(static)
+	for (int tileWidth = 0; tileWidth < outWidth; tileWidth += tileSize) {
+		for (int tileHeight = 0; tileHeight < outHeight; tileHeight += tileSize) {
+			const int endWidth = std::min(tileWidth + tileSize, outWidth);
+			const int endHeight = std::min(tileHeight + tileSize, outHeight);
+			for (int pixelHeight = tileHeight; pixelHeight < endHeight;
+				++pixelHeight) {
+				const PixelType* topRow = rawImage + 2 * pixelHeight * rawPitch;
+				const PixelType* bottomRow = topRow + rawPitch;
+#pragma omp simd
+				for (int pixelWidth = tileWidth; pixelWidth < endWidth;
+					++pixelWidth) {
+					float site[4];
+					site[0] = static_cast<float>(topRow[2 * pixelWidth]) - black[0];
+					site[1] = static_cast<float>(topRow[2 * pixelWidth + 1]) - black[1];
+					site[2] = static_cast<float>(bottomRow[2 * pixelWidth]) - black[2];
+					site[3] = static_cast<float>(bottomRow[2 * pixelWidth + 1]) - black[3];
+					for (int iter = 0; iter < 4; ++iter) {
+						site[iter] = (site[iter] > 0.0f)?(site[iter]):(0.0f);
+					}
+					int arrayIndex = pixelWidth * outHeight + pixelHeight;
+					redBuffer[arrayIndex] = weights[0][0] * site[0]
+										+ weights[0][1] * site[1]
+										+ weights[0][2] * site[2]
+										+ weights[0][3] * site[3];
+					greenBuffer[arrayIndex] = weights[1][0] * site[0]
+										+ weights[1][1] * site[1]
+										+ weights[1][2] * site[2]
+										+ weights[1][3] * site[3];
+					blueBuffer[arrayIndex] = weights[2][0] * site[0]
+										+ weights[2][1] * site[1]
+										+ weights[2][2] * site[2]
+										+ weights[2][3] * site[3];
+				}
+			}
+		}
+	}
+	return mex::MxArray(pixelArray.get_array());
+}
+
+mex::MxArray RawInputFile::getExposureStatistics() {
+	unpackFile();
+
+	const libraw_data_t& imgdata = m_rawProcessor.imgdata;
+	mexAssertEx((imgdata.rawdata.raw_image != nullptr) &&
+				(imgdata.idata.filters >= 1000),
+				"Exposure statistics are supported only for Bayer raw data");
+
+	const int height = imgdata.sizes.height;
+	const int width = imgdata.sizes.width;
+	const int rawPitch = static_cast<int>(imgdata.sizes.raw_pitch
+									/ sizeof(PixelType));
+	const PixelType* rawImage = imgdata.rawdata.raw_image
+							+ imgdata.sizes.top_margin * rawPitch
+							+ imgdata.sizes.left_margin;
+	const float white = static_cast<float>(imgdata.color.maximum);
+
+	float black[4];
+	float binScale[4];
+	for (int color = 0; color < 4; ++color) {
+		black[color] = static_cast<float>(imgdata.color.black
+										+ imgdata.color.cblack[color]);
+		binScale[color] = (white > black[color])
+						?(kHistogramBins / (white - black[color]))
+						:(0.0f);
+	}
+
+	/*
+	 * Bayer filter patterns repeat every two columns, so every row is split
+	 * into its even and odd columns, each of a single color. Each thread
+	 * accumulates into its own histograms, which are summed at the end.
+	 */
+	std::vector<double> histogram(4 * kHistogramBins, 0.0);
+	double sum[4] = {0.0, 0.0, 0.0, 0.0};
+	double pixelCount[4] = {0.0, 0.0, 0.0, 0.0};
+	double saturatedCount[4] = {0.0, 0.0, 0.0, 0.0};
+	double underexposedCount[4] = {0.0, 0.0, 0.0, 0.0};
+#pragma omp parallel
+	{
+		std::vector<unsigned int> threadHistogram(4 * kHistogramBins, 0);
+		std::vector<int> binIndices((width + 1) / 2);
+		double threadSum[4] = {0.0, 0.0, 0.0, 0.0};
+		double threadPixelCount[4] = {0.0, 0.0, 0.0, 0.0};
+		double threadSaturatedCount[4] = {0.0, 0.0, 0.0, 0.0};
+		double threadUnderexposedCount[4] = {0.0, 0.0, 0.0, 0.0};
+#pragma omp for schedule(static)
+		for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
+			const PixelType* row = rawImage + pixelHeight * rawPitch;
+			for (int parity = 0; parity < 2; ++parity) {
+				const int color = m_rawProcessor.COLOR(pixelHeight, parity) & 3;
+				const int numSamples = (width - parity + 1) / 2;
+				const float colorBlack = black[color];
+				const float colorBinScale = binScale[color];
+				const PixelType* samples = row + parity;
+				int* bins = &binIndices[0];
+				double rowSum = 0.0;
+				int rowSaturated = 0;
+				int rowUnderexposed = 0;
+#pragma omp simd reduction(+:rowSum, rowSaturated, rowUnderexposed)
+				for (int iter = 0; iter < numSamples; ++iter) {
+					float value = static_cast<float>(samples[2 * iter]);
+					float level = value - colorBlack;
+					rowSum += static_cast<double>(level);
+					rowSaturated += (value >= white)?(1):(0);
+					rowUnderexposed += (level <= 0.0f)?(1):(0);
+					float bin = level * colorBinScale;
+					bin = (bin > 0.0f)?(bin):(0.0f);
+					bin = (bin < kHistogramBins - 1)?(bin)
+													:(kHistogramBins - 1);
+					bins[iter] = static_cast<int>(bin);
+				}
+				unsigned int* colorHistogram = &threadHistogram[color
+															* kHistogramBins];
+				for (int iter = 0; iter < numSamples; ++iter) {
+					++colorHistogram[bins[iter]];
+				}
+				threadSum[color] += rowSum;
+				threadPixelCount[color] += numSamples;
+				threadSaturatedCount[color] += rowSaturated;
+				threadUnderexposedCount[color] += rowUnderexposed;
+			}
+		}
+#pragma omp critical
+		{
+			for (int iter = 0; iter < 4 * kHistogramBins; ++iter) {
+				histogram[iter] += threadHistogram[iter];
+			}
+			for (int color = 0; color < 4; ++color) {
+				sum[color] += threadSum[color];
+				pixelCount[color] += threadPixelCount[color];
+				saturatedCount[color] += threadSaturatedCount[color];
+				underexposedCount[color] += threadUnderexposedCount[color];
+			}
+		}
+	}
+
+	double normalizedMean[4];
+	double blackLevel[4];
+	for (int color = 0; color < 4; ++color) {
+		normalizedMean[color] = ((pixelCount[color] > 0) && (white > black[color]))
+						?(sum[color] / pixelCount[color]
+							/ static_cast<double>(white - black[color]))
+						:(0.0);
+		blackLevel[color] = black[color];
+	}
+
+	mex::MxString channelNamesArray(std::string(imgdata.idata.cdesc, 4));
+	mex::MxNumeric<double> histogramArray(kHistogramBins, 4);
+	std::copy(histogram.begin(), histogram.end(), histogramArray.getData());
+	mex::MxNumeric<double> pixelCountArray(pixelCount, 1, 4);
+	mex::MxNumeric<double> saturatedCountArray(saturatedCount, 1, 4);
+	mex::MxNumeric<double> underexposedCountArray(underexposedCount, 1, 4);
+	mex::MxNumeric<double> normalizedMeanArray(normalizedMean, 1, 4);
+	mex::MxNumeric<double> blackLevelArray(blackLevel, 1, 4);
+	mex::MxNumeric<double> whiteLevelArray(static_cast<double>(white));
+
+	std::vector<std::string> arrayNames;
+	arrayNames.push_back("channelNames");
+	arrayNames.push_back("histogram");
+	arrayNames.push_back("pixelCount");
+	arrayNames.push_back("saturatedCount");
+	arrayNames.push_back("underexposedCount");
+	arrayNames.push_back("normalizedMean");
+	arrayNames.push_back("blackLevel");
+	arrayNames.push_back("whiteLevel");
+	std::vector<mex::MxArray*> arrayVars;
+	arrayVars.push_back(&channelNamesArray);
+	arrayVars.push_back(&histogramArray);
+	arrayVars.push_back(&pixelCountArray);
+	arrayVars.push_back(&saturatedCountArray);
+	arrayVars.push_back(&underexposedCountArray);
+	arrayVars.push_back(&normalizedMeanArray);
+	arrayVars.push_back(&blackLevelArray);
+	arrayVars.push_back(&whiteLevelArray);
+	return mex::MxArray(mex::MxStruct(arrayNames, arrayVars).get_array());
+}
+
+mex::MxArray RawInputFile::readThumbnail() {
+	return readThumbnail(true);
+}
+
+mex::MxArray RawInputFile::readThumbnail(
+									const mex::MxNumeric<bool>& doDecode) {
+	return readThumbnail(doDecode[0]);
+}
+
+mex::MxArray RawInputFile::readThumbnail(bool doDecode) {
+	unpackThumbnail();
+	const libraw_thumbnail_t& thumbnail = m_rawProcessor.imgdata.thumbnail;
+	const unsigned char* thumbnailBuffer =
+						reinterpret_cast<const unsigned char*>(thumbnail.thumb);
+
+	switch (thumbnail.tformat) {
+		case LIBRAW_THUMBNAIL_JPEG: {
+			if (!doDecode) {
+				return mex::MxArray(mex::MxNumeric<unsigned char>(
+								thumbnailBuffer, 1, thumbnail.tlength).get_array());
+			}
+			JpegDecoder decoder(thumbnailBuffer, thumbnail.tlength);
+			mexAssertEx(!decoder.isCmyk(),
+						"CMYK JPEG thumbnails are not supported");
+			mexAssertEx(decoder.isValid(), "Corrupt JPEG thumbnail");
+			std::vector<int> dimensions;
+			dimensions.push_back(decoder.getHeight());
+			dimensions.push_back(decoder.getWidth());
+			dimensions.push_back(decoder.getNumberOfChannels());
+			mex::MxNumeric<unsigned char> pixelArray(
+						static_cast<int>(dimensions.size()), &dimensions[0]);
+			mexAssertEx(decoder.decode(pixelArray.getData()),
+						"Corrupt JPEG thumbnail");
+			return mex::MxArray(pixelArray.get_array());
+		}
+		case LIBRAW_THUMBNAIL_BITMAP: {
+			int width = thumbnail.twidth;
+			int height = thumbnail.theight;
+			int numChannels = thumbnail.tcolors;
+			mexAssertEx(static_cast<int>(thumbnail.tlength)
+									>= width * height * numChannels,
+						"Corrupt bitmap thumbnail");
+			std::vector<int> dimensions;
+			dimensions.push_back(height);
+			dimensions.push_back(width);
+			if (numChannels > 1) {
+				dimensions.push_back(numChannels);
+			}
+			mex::MxNumeric<unsigned char> pixelArray(
+						static_cast<int>(dimensions.size()), &dimensions[0]);
+			unsigned char* pixelBuffer = pixelArray.getData();
+			for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
+				scatterRow(&thumbnailBuffer[pixelHeight * width * numChannels],
+						pixelHeight, height, width, numChannels, pixelBuffer);
+			}
+			return mex::MxArray(pixelArray.get_array());
+		}
+		default: {
+			mexAssertEx(0, "Unsupported thumbnail format");
+			return mex::MxArray();
+		}
+	}
+}
+
+mex::MxArray RawInputFile::getThumbnailInformation() {
+	unpackThumbnail();
+	const libraw_thumbnail_t& thumbnail = m_rawProcessor.imgdata.thumbnail;
+
+	std::string format;
+	switch (thumbnail.tformat) {
+		case LIBRAW_THUMBNAIL_JPEG: {
+			format = "jpeg";
+			break;
+		}
+		case LIBRAW_THUMBNAIL_BITMAP: {
+			format = "bitmap";
+			break;
+		}
+		default: {
+			format = "unknown";
+			break;
+		}
+	}
+
+	/*
+	 * LibRaw flip codes: 0 none, 3 rotate by 180, 5 rotate 90 degrees
+	 * counterclockwise, 6 rotate 90 degrees clockwise.
+	 */
+	std::string orientation;
+	switch (m_rawProcessor.imgdata.sizes.flip) {
+		case 3: {
+			orientation = "rotate180";
+			break;
+		}
+		case 5: {
+			orientation = "rotate90ccw";
+			break;
+		}
+		case 6: {
+			orientation = "rotate90cw";
+			break;
+		}
+		default: {
+			orientation = "none";
+			break;
+		}
+	}
+
+	mex::MxString formatArray(format);
+	mex::MxNumeric<int> widthArray(static_cast<int>(thumbnail.twidth));
+	mex::MxNumeric<int> heightArray(static_cast<int>(thumbnail.theight));
+	mex::MxNumeric<int> colorsArray(thumbnail.tcolors);
+	mex::MxNumeric<int> flipArray(m_rawProcessor.imgdata.sizes.flip);
+	mex::MxString orientationArray(orientation);
+
+	std::vector<std::string> arrayNames;
+	arrayNames.push_back("format");
+	arrayNames.push_back("width");
+	arrayNames.push_back("height");
+	arrayNames.push_back("colors");
+	arrayNames.push_back("flip");
+	arrayNames.push_back("orientation");
+	std::vector<mex::MxArray*> arrayVars;
+	arrayVars.push_back(&formatArray);
+	arrayVars.push_back(&widthArray);
+	arrayVars.push_back(&heightArray);
+	arrayVars.push_back(&colorsArray);
+	arrayVars.push_back(&flipArray);
+	arrayVars.push_back(&orientationArray);
+	return mex::MxArray(mex::MxStruct(arrayNames, arrayVars).get_array());
+}
+
+void RawInputFile::readFilterArray(unsigned char* filterBuffer) {
 	int width = getWidth();
 	int height = getHeight();
-	mex::MxNumeric<unsigned char> filterArray(height, width);
-
-	unsigned char* filterBuffer = filterArray.getData();
 	for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
 		for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
 			int arrayIndex = pixelWidth * height + pixelHeight;
@@ -153,8 +781,52 @@ mex::MxArray RawInputFile::getCFAInformation() {
 								m_rawProcessor.COLOR(pixelHeight, pixelWidth));
 		}
 	}
+}
+
+void RawInputFile::readBlackLevel(float* blackBuffer) {
+	unpackFile();
+	const libraw_colordata_t& color = m_rawProcessor.imgdata.color;
+	int width = getWidth();
+	int height = getHeight();
+	for (int pixelWidth = 0; pixelWidth < width; ++pixelWidth) {
+		for (int pixelHeight = 0; pixelHeight < height; ++pixelHeight) {
+			int arrayIndex = pixelWidth * height + pixelHeight;
+			blackBuffer[arrayIndex] = static_cast<float>(color.black
+					+ color.cblack[m_rawProcessor.COLOR(pixelHeight, pixelWidth)]);
+		}
+	}
+}
+
+std::string RawInputFile::getFilterNames() const {
+	return std::string(m_rawProcessor.imgdata.idata.cdesc);
+}
 
-    mex::MxString filterNames(m_rawProcessor.imgdata.idata.cdesc);
+float RawInputFile::getBlackLevel(int color) {
+	unpackFile();
+	mexAssert((color >= 0) && (color < 4));
+	return static_cast<float>(m_rawProcessor.imgdata.color.black
+							+ m_rawProcessor.imgdata.color.cblack[color]);
+}
+
+float RawInputFile::getWhiteLevel() {
+	unpackFile();
+	return static_cast<float>(m_rawProcessor.imgdata.color.maximum);
+}
+
+CaptureSettings RawInputFile::getCaptureSettings() const {
+	CaptureSettings settings;
+	settings.make = m_rawProcessor.imgdata.idata.make;
+	settings.model = m_rawProcessor.imgdata.idata.model;
+	settings.isoSpeed = m_rawProcessor.imgdata.other.iso_speed;
+	settings.shutter = m_rawProcessor.imgdata.other.shutter;
+	return settings;
+}
+
+mex::MxArray RawInputFile::getCFAInformation() {
+	mex::MxNumeric<unsigned char> filterArray(getHeight(), getWidth());
+	readFilterArray(filterArray.getData());
+
+    mex::MxString filterNames(getFilterNames());
 
     std::vector<std::string> arrayNames;
     arrayNames.push_back("filterArray");
@@ -165,7 +837,8 @@ mex::MxArray RawInputFile::getCFAInformation() {
     return mex::MxArray(mex::MxStruct(arrayNames, arrayVars).get_array());
 }
 
-void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
+void parseDcrawFlags(const std::string& dcrawFlags,
+					libraw_output_params_t& params) {
 	int argc = std::count(dcrawFlags.begin(), dcrawFlags.end(), ' ') + 2;
 	std::vector<const char*> argv(argc);
 
@@ -201,87 +874,87 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 				break;
 			}
 			case 'G': {
-				m_rawProcessor.imgdata.params.green_matching = 1;
+				params.green_matching = 1;
 				break;
 			}
 			case 'c': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.adjust_maximum_thr =
+				params.adjust_maximum_thr =
 									static_cast<float>(std::atof(argv[++arg]));
 				break;
 			}
 			case 'U': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.auto_bright_thr =
+				params.auto_bright_thr =
 									static_cast<float>(std::atof(argv[++arg]));
 				break;
 			}
 			case 'n': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.threshold =
+				params.threshold =
 									static_cast<float>(std::atof(argv[++arg]));
 				break;
 			}
 			case 'b': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.bright =
+				params.bright =
 									static_cast<float>(std::atof(argv[++arg]));
 				break;
 			}
 			case 'P': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.bad_pixels =
+				params.bad_pixels =
 												const_cast<char *>(argv[++arg]);
 				break;
 			}
 			case 'K': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.dark_frame =
+				params.dark_frame =
 												const_cast<char *>(argv[++arg]);
 				break;
 			}
 			case 'r': {
 				for(int c = 0; c < 4; ++c) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.user_mul[c] =
+					params.user_mul[c] =
 									static_cast<float>(std::atof(argv[++arg]));
 				}
 				break;
 			}
 			case 'C': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.aber[0]
+				params.aber[0]
 												   = 1 / std::atof(argv[++arg]);
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.aber[2]
+				params.aber[2]
 												   = 1 / std::atof(argv[++arg]);
 				break;
 			}
 			case 'g': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.gamm[0]
+				params.gamm[0]
 												   = 1 / std::atof(argv[++arg]);
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.gamm[1]
+				params.gamm[1]
 												   =  std::atof(argv[++arg]);
 				break;
 			}
 			case 'k': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.user_black
+				params.user_black
 													= std::atoi(argv[++arg]);
 				break;
 			}
 			case 'S': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.user_sat
+				params.user_sat
 													= std::atoi(argv[++arg]);
 				break;
 			}
 			case 't': {
 				if(!argv[arg][2]) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.user_flip
+					params.user_flip
 													= std::atoi(argv[++arg]);
 				} else {
 					std::fprintf(stderr, "Unknown option \"%s\".\n", argv[arg]);
@@ -291,14 +964,14 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 			}
 			case 'q': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.user_qual
+				params.user_qual
 													= std::atoi(argv[++arg]);
 				break;
 			}
 			case 'm': {
 				if(!argv[arg][2]) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.med_passes
+					params.med_passes
 													= std::atoi(argv[++arg]);
 				} else {
 					std::fprintf(stderr, "Unknown option \"%s\".\n", argv[arg]);
@@ -308,13 +981,13 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 			}
 			case 'H': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.highlight
+				params.highlight
 											= std::atoi(argv[++arg]);
 				break;
 			}
 			case 's': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.shot_select
+				params.shot_select
 											= std::abs(std::atoi(argv[++arg]));
 				break;
 			}
@@ -322,32 +995,32 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
 				if (std::isdigit(argv[arg + 1][0]) &&
 						!std::isdigit(argv[arg + 1][1])) {
-					m_rawProcessor.imgdata.params.output_color
+					params.output_color
 													= std::atoi(argv[++arg]);
 				} else {
-					m_rawProcessor.imgdata.params.output_profile
+					params.output_profile
 											= const_cast<char *>(argv[++arg]);
 				}
 				break;
 			}
 			case 'p': {
 				mexAssertEx(arg < argc - 1, "Unknown attribute type");
-				m_rawProcessor.imgdata.params.camera_profile
+				params.camera_profile
 											= const_cast<char *>(argv[++arg]);
 				break;
 			}
 			case 'h': {
-				m_rawProcessor.imgdata.params.half_size = 1;
+				params.half_size = 1;
 				break;
 			}
 			case 'f': {
 				if (!std::strcmp(optstr, "-fbdd")) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.fbdd_noiserd
+					params.fbdd_noiserd
 													= std::atoi(argv[++arg]);
 				} else {
 					if(!argv[arg-1][2]) {
-						m_rawProcessor.imgdata.params.four_color_rgb = 1;
+						params.four_color_rgb = 1;
 					} else {
 						std::fprintf(stderr, "Unknown option \"%s\".\n",
 																	argv[arg]);
@@ -359,7 +1032,7 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 			case 'A': {
 				for(int c = 0; c < 4; ++c) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.greybox[c]
+					params.greybox[c]
 													= std::atoi(argv[++arg]);
 				}
 				break;
@@ -367,22 +1040,22 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 			case 'B': {
 				for(int c = 0; c < 4; ++c) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.cropbox[c]
+					params.cropbox[c]
 													= std::atoi(argv[++arg]);
 				}
 				break;
 			}
 			case 'a': {
 				if (!std::strcmp(optstr, "-aexpo")) {
-					m_rawProcessor.imgdata.params.exp_correc = 1;
+					params.exp_correc = 1;
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.exp_shift
+					params.exp_shift
 								= static_cast<float>(std::atof(argv[++arg]));
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.exp_preser
+					params.exp_preser
 								= static_cast<float>(std::atof(argv[++arg]));
 				} else if (!argv[arg][2]) {
-					m_rawProcessor.imgdata.params.use_auto_wb = 1;
+					params.use_auto_wb = 1;
 				} else {
 					std::fprintf(stderr, "Unknown option \"%s\".\n", argv[arg]);
 					mexAssertEx(0, "Unknown attribute type");
@@ -390,44 +1063,44 @@ void RawInputFile::parseDcrawFlags(const std::string& dcrawFlags) {
 				break;
 			}
 			case 'w': {
-				m_rawProcessor.imgdata.params.use_camera_wb = 1;
+				params.use_camera_wb = 1;
 				break;
 			}
 			case 'M': {
-				m_rawProcessor.imgdata.params.use_camera_matrix = (opm == '+');
+				params.use_camera_matrix = (opm == '+');
 				break;
 			}
 			case 'j': {
-				m_rawProcessor.imgdata.params.use_fuji_rotate = 0;
+				params.use_fuji_rotate = 0;
 				break;
 			}
 			case 'W': {
-				m_rawProcessor.imgdata.params.no_auto_bright = 1;
+				params.no_auto_bright = 1;
 				break;
 			}
 			case 'd': {
 				if (!strcmp(optstr, "-dcbi")) {
 					mexAssertEx(arg < argc - 1, "Unknown attribute type");
-					m_rawProcessor.imgdata.params.dcb_iterations
+					params.dcb_iterations
 													= std::atoi(argv[++arg]);
 				} else if (!strcmp(optstr, "-disars")) {
-					m_rawProcessor.imgdata.params.use_rawspeed = 0;
+					params.use_rawspeed = 0;
 				} else if (!strcmp(optstr, "-disadcf")) {
-					m_rawProcessor.imgdata.params.force_foveon_x3f = 1;
+					params.force_foveon_x3f = 1;
 				} else if (!strcmp(optstr, "-disinterp")) {
-					m_rawProcessor.imgdata.params.no_interpolation = 1;
+					params.no_interpolation = 1;
 				} else if (!strcmp(optstr, "-dcbe")) {
-					m_rawProcessor.imgdata.params.dcb_enhance_fl = 1;
+					params.dcb_enhance_fl = 1;
 				} else if (!strcmp(optstr, "-dsrawrgb1")) {
-					m_rawProcessor.imgdata.params.sraw_ycc = 1;
+					params.sraw_ycc = 1;
 				} else if (!strcmp(optstr, "-dsrawrgb2")) {
-					m_rawProcessor.imgdata.params.sraw_ycc = 2;
+					params.sraw_ycc = 2;
 				} else if (!strcmp(optstr, "-dbnd")) {
 					for(int c = 0; c < 4; ++c) {
 						mexAssertEx(arg < argc - 1, "Unknown attribute type");
-						m_rawProcessor.imgdata.params.wf_deband_treshold[c]
+						params.wf_deband_treshold[c]
 								= static_cast<float>(std::atof(argv[++arg]));
-						m_rawProcessor.imgdata.params.wf_debanding = 1;
+						params.wf_debanding = 1;
 					}
 				} else {
 					fprintf(stderr, "Unknown option \"%s\".\n", argv[arg]);
@@ -452,6 +1125,14 @@ void RawInputFile::unpackFile() {
 	}
 }
 
+void RawInputFile::unpackThumbnail() {
+	if (!m_unpackedThumbnail) {
+		int errorCode = m_rawProcessor.unpack_thumb();
+		mexAssertEx(errorCode == LIBRAW_SUCCESS, "No supported thumbnail found");
+		m_unpackedThumbnail = true;
+	}
+}
+
 /*
  * TODO: Add attribute getting.
  * --sizes:
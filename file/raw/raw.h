@@ -8,10 +8,13 @@
 #ifndef RAW_MEX_H_
 #define RAW_MEX_H_
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "../include/file.h"
 #include "../raw/libraw_ext.h"
+#include "../raw/mapped_file.h"
 
 /*
  * TODO: Read color and lens attributes.
@@ -20,12 +23,54 @@
 namespace raw {
 
 using PixelType = unsigned short;
+using PreviewPixelType = float;
+using CalibrationPixelType = float;
+
+class DefectMap;
 
 mex::MxNumeric<bool> isRawFile(const mex::MxString& fileName);
 
+/*
+ * File names of a cell array of strings, as taken by the batch entry points.
+ */
+std::vector<std::string> toStringVector(const mex::MxCell& fileNames);
+
+/*
+ * Parse dcraw command-line flags into LibRaw output parameters. String
+ * parameters (-P, -K, -o, -p) point into dcrawFlags, which must outlive their
+ * use.
+ */
+void parseDcrawFlags(const std::string& dcrawFlags,
+					libraw_output_params_t& params);
+
+/*
+ * Open a file from its memory mapping if valid, and through LibRaw's own file
+ * datastream otherwise. Does not use the MEX API, so it is safe on worker
+ * threads. The mapping must outlive the use of the processor.
+ */
+int openRawFile(libraw::LibRawExtension& rawProcessor,
+				const std::string& fileName, const MappedFile& mappedFile);
+
+/*
+ * Camera and exposure settings that calibration frames are matched on.
+ */
+struct CaptureSettings {
+	std::string make;
+	std::string model;
+	float isoSpeed;
+	float shutter;
+};
+
 class RawInputFile : public file::InputFileInterface {
 public:
+	/*
+	 * Local files are memory-mapped and decoded from the mapping, falling back
+	 * to regular reads if mapping fails. A file can also be decoded from an
+	 * in-memory copy, such as a uint8 array fetched from an archive store; the
+	 * buffer is not copied and must outlive the RawInputFile.
+	 */
 	explicit RawInputFile(const mex::MxString& fileName);
+	explicit RawInputFile(const mex::MxNumeric<unsigned char>& fileBuffer);
 
 	mex::MxString getFileName() const override;
 	mex::MxNumeric<bool> isValidFile() const override;
@@ -40,20 +85,98 @@ public:
 	mex::MxArray readData(const mex::MxNumeric<bool>& doSubtractDarkFrame,
 						const mex::MxString& dcrawFlags);
 
+	/*
+	 * Write the raw mosaic into a caller-owned, column-major height x width
+	 * buffer, e.g. one frame of a preallocated stack.
+	 */
+	void readData(bool doSubtractDarkFrame, PixelType* pixelBuffer);
+
+	/*
+	 * Same as above, calibrated with the frames of setCalibration if set, and
+	 * converted to single precision otherwise.
+	 */
+	void readData(bool doSubtractDarkFrame,
+				CalibrationPixelType* calibratedBuffer);
+
+	/*
+	 * Correct the pixels of a defect map in every subsequent raw mosaic read.
+	 * The map is copied.
+	 */
+	void setDefectMap(const DefectMap& defectMap);
+
+	/*
+	 * Calibrate the single precision mosaics of subsequent reads, and of the
+	 * MATLAB readData overloads, as (mosaic - dark) * gain with frames in the
+	 * layout of readData. gain may be null, in which case no flat-field
+	 * correction is applied. The frames are copied. dcraw processing and
+	 * LibRaw black subtraction are not supported on calibrated mosaics.
+	 */
+	void setCalibration(const CalibrationPixelType* dark,
+						const CalibrationPixelType* gain);
+	bool isCalibrated() const;
+
+	/*
+	 * Quarter-resolution linear RGB preview, binning every 2x2 Bayer quad of
+	 * the raw data into one pixel with black level and white balance applied.
+	 * Values are normalized so that the white level maps to 1.
+	 */
+	mex::MxArray readPreview();
+
+	/*
+	 * Per-CFA-color histograms, clipped-sample counts and black/white-level
+	 * normalized means of the raw data, computed in one pass over the unpacked
+	 * Bayer data without allocating an image. Histogram bins span the range
+	 * from black to white level; samples outside it fall in the end bins.
+	 */
+	mex::MxArray getExposureStatistics();
+
+	/*
+	 * Embedded preview image, extracted without unpacking the raw data. JPEG
+	 * previews are decoded to RGB if doDecode is true (default), and returned
+	 * as the JPEG byte stream otherwise. Grayscale JPEGs are decoded to three
+	 * equal channels, and CMYK JPEGs can only be returned undecoded.
+	 */
+	mex::MxArray readThumbnail();
+	mex::MxArray readThumbnail(const mex::MxNumeric<bool>& doDecode);
+	mex::MxArray getThumbnailInformation();
+
 	mex::MxArray getCFAInformation();
 
-	~RawInputFile() override = default;
+	CaptureSettings getCaptureSettings() const;
+
+	/*
+	 * CFA color index and LibRaw black level (black + cblack) of every pixel,
+	 * in the column-major layout of readData.
+	 */
+	void readFilterArray(unsigned char* filterBuffer);
+	void readBlackLevel(float* blackBuffer);
+	std::string getFilterNames() const;
+
+	/*
+	 * LibRaw black level of a CFA color index, and white level.
+	 */
+	float getBlackLevel(int color);
+	float getWhiteLevel();
+
+	~RawInputFile() override;
 
 private:
 	mex::MxArray readData(bool doSubtractDarkFrame,
 						const std::string& dcrawFlags);
 	mex::MxArray getAttribute(const std::string& attributeName) const;
-	void parseDcrawFlags(const std::string& dcrawFlags);
+	mex::MxArray readThumbnail(bool doDecode);
 	void unpackFile();
+	void unpackThumbnail();
 
 	std::string m_fileName;
 	bool m_unpackedFile;
-	libraw::LibRawExtension m_rawProcessor;
+	bool m_unpackedThumbnail;
+	std::unique_ptr<MappedFile> m_mappedFile;
+	libraw::LibRawPool::Handle m_rawProcessorHandle;
+	libraw::LibRawExtension& m_rawProcessor;
+	std::unique_ptr<const DefectMap> m_defectMap;
+	std::vector<CalibrationPixelType> m_calibrationDark;
+	std::vector<CalibrationPixelType> m_calibrationGain;
 };
 
 }  // namespace raw
@@ -0,0 +1,67 @@
+/*
+ * image_utils//image_utils/raw/rawcalibrate.cpp/rawcalibrate.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <string>
+#include <vector>
+
+#include "mex_utils.h"
+
+#include "../raw/calibration.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 2) || (nrhs > 4)) {
+		mexErrMsgTxt("Between two and four input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * master = rawcalibrate('dark' | 'flat', fileNames, cacheDirectory, method)
+	 * builds a master frame with method 'median' (default) or 'mean', and
+	 * caches it in cacheDirectory if that is not empty.
+	 * im = rawcalibrate('apply', fileName, cacheDirectory) reads a calibrated
+	 * mosaic using the master frames cached in cacheDirectory.
+	 */
+	std::string operation = mex::MxString(const_cast<mxArray*>(prhs[0])).get_string();
+	std::string cacheDirectory;
+	if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+		cacheDirectory = mex::MxString(const_cast<mxArray*>(prhs[2])).get_string();
+	}
+
+	if (!operation.compare("apply")) {
+		if (nrhs > 3) {
+			mexErrMsgTxt("Too many input arguments.");
+		}
+		raw::RawInputFile file(mex::MxString(const_cast<mxArray*>(prhs[1])));
+		plhs[0] = raw::readCalibratedData(file, cacheDirectory).get_array();
+		return;
+	}
+
+	raw::ECalibrationType type = raw::toCalibrationType(operation);
+	if (type == raw::ECalibrationType::EInvalid) {
+		mexErrMsgTxt("Unknown calibration operation.");
+	}
+
+	raw::ECombineMethod method = raw::ECombineMethod::EMedian;
+	if ((nrhs >= 4) && (!mex::MxArray(const_cast<mxArray*>(prhs[3])).isEmpty())) {
+		method = raw::toCombineMethod(
+					mex::MxString(const_cast<mxArray*>(prhs[3])).get_string());
+		if (method == raw::ECombineMethod::EInvalid) {
+			mexErrMsgTxt("Unknown combination method.");
+		}
+	}
+
+	std::vector<std::string> fileNameVector = raw::toStringVector(
+					mex::MxCell(const_cast<mxArray*>(prhs[1])));
+	plhs[0] = raw::toMxArray(raw::buildMasterFrame(fileNameVector, type,
+									method, cacheDirectory)).get_array();
+}
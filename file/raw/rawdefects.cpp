@@ -0,0 +1,87 @@
+/*
+ * image_utils//image_utils/raw/rawdefects.cpp/rawdefects.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <string>
+#include <vector>
+
+#include "mex_utils.h"
+
+#include "../raw/defects.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 2) || (nrhs > 4)) {
+		mexErrMsgTxt("Between two and four input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * indices = rawdefects('detect', fileNames, cacheDirectory, threshold)
+	 * detects hot and stuck pixels from dark frames, with threshold (default
+	 * 8) in robust standard deviations, and caches the map in cacheDirectory
+	 * if that is not empty. Dead pixels need flat frames and are not
+	 * detected. indices are 1-based linear indices into the mosaic.
+	 * im = rawdefects('apply', fileName, cacheDirectory, doSubtractDarkFrame)
+	 * reads a mosaic corrected with the defect map cached in cacheDirectory
+	 * for its camera.
+	 */
+	std::string operation = mex::MxString(const_cast<mxArray*>(prhs[0])).get_string();
+	std::string cacheDirectory;
+	if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+		cacheDirectory = mex::MxString(const_cast<mxArray*>(prhs[2])).get_string();
+	}
+
+	if (!operation.compare("apply")) {
+		bool doSubtractDarkFrame = false;
+		if ((nrhs >= 4) && (!mex::MxArray(const_cast<mxArray*>(prhs[3])).isEmpty())) {
+			doSubtractDarkFrame = mex::MxNumeric<bool>(
+									const_cast<mxArray*>(prhs[3]))[0];
+		}
+		raw::RawInputFile file(mex::MxString(const_cast<mxArray*>(prhs[1])));
+		raw::DefectMap defectMap;
+		if (!defectMap.load(raw::getDefectMapName(cacheDirectory,
+												file.getCaptureSettings()))) {
+			mexErrMsgTxt("No cached defect map for this camera.");
+		}
+		file.setDefectMap(defectMap);
+		mex::MxNumeric<raw::PixelType> pixelArray(file.getHeight(),
+												file.getWidth());
+		file.readData(doSubtractDarkFrame, pixelArray.getData());
+		plhs[0] = pixelArray.get_array();
+		return;
+	}
+
+	if (operation.compare("detect")) {
+		mexErrMsgTxt("Unknown defect operation.");
+	}
+
+	float threshold = 8.0f;
+	if ((nrhs >= 4) && (!mex::MxArray(const_cast<mxArray*>(prhs[3])).isEmpty())) {
+		threshold = static_cast<float>(
+				mex::MxNumeric<double>(const_cast<mxArray*>(prhs[3]))[0]);
+	}
+
+	std::vector<std::string> fileNameVector = raw::toStringVector(
+					mex::MxCell(const_cast<mxArray*>(prhs[1])));
+	raw::DefectMap defectMap = raw::detectDefects(fileNameVector, threshold,
+												cacheDirectory);
+	const std::vector<unsigned int>& defectIndices =
+												defectMap.getDefectIndices();
+	mex::MxNumeric<double> indices(static_cast<int>(defectIndices.size()), 1);
+	double* indexBuffer = indices.getData();
+	for (int iterDefect = 0, numDefects = defectMap.getNumberOfDefects();
+			iterDefect < numDefects; ++iterDefect) {
+		indexBuffer[iterDefect] = static_cast<double>(defectIndices[iterDefect])
+								+ 1.0;
+	}
+	plhs[0] = indices.get_array();
+}
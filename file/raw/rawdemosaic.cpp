@@ -0,0 +1,63 @@
+/*
+ * image_utils//image_utils/raw/rawdemosaic.cpp/rawdemosaic.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include "mex_utils.h"
+
+#include "../raw/raw.h"
+#include "../raw/demosaic.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if (nrhs > 3) {
+		mexErrMsgTxt("Three or fewer arguments are required.");
+	} else if (nrhs < 1) {
+		mexErrMsgTxt("At least one input argument is required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * Either rawdemosaic(fileName, method, doSubtractDarkFrame), or
+	 * rawdemosaic(mosaic, cfaInformation, method) with the outputs of rawread.
+	 */
+	if (mxIsChar(prhs[0])) {
+		raw::RawInputFile file(mex::MxString(const_cast<mxArray*>(prhs[0])));
+		std::string methodName("malvar");
+		if ((nrhs >= 2) && (!mex::MxArray(const_cast<mxArray*>(prhs[1])).isEmpty())) {
+			methodName = mex::MxString(const_cast<mxArray*>(prhs[1])).get_string();
+		}
+		mxArray* mosaic;
+		if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+			mosaic = file.readData(mex::MxNumeric<bool>(const_cast<mxArray*>(prhs[2]))).get_array();
+		} else {
+			mosaic = file.readData().get_array();
+		}
+		mex::MxStruct cfaInformation(file.getCFAInformation().get_array());
+		plhs[0] = raw::demosaic(mex::MxNumeric<raw::PixelType>(mosaic),
+					mex::MxNumeric<unsigned char>(cfaInformation[std::string("filterArray")]),
+					mex::MxString(cfaInformation[std::string("filterNames")]),
+					mex::MxString(methodName)).get_array();
+	} else {
+		if (nrhs < 2) {
+			mexErrMsgTxt("The color filter array information is required.");
+		}
+		mex::MxNumeric<raw::PixelType> mosaic(const_cast<mxArray*>(prhs[0]));
+		mex::MxStruct cfaInformation(const_cast<mxArray*>(prhs[1]));
+		std::string methodName("malvar");
+		if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+			methodName = mex::MxString(const_cast<mxArray*>(prhs[2])).get_string();
+		}
+		plhs[0] = raw::demosaic(mosaic,
+					mex::MxNumeric<unsigned char>(cfaInformation[std::string("filterArray")]),
+					mex::MxString(cfaInformation[std::string("filterNames")]),
+					mex::MxString(methodName)).get_array();
+	}
+}
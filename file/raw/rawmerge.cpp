@@ -0,0 +1,90 @@
+/*
+ * image_utils//image_utils/raw/rawmerge.cpp/rawmerge.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <string>
+#include <vector>
+
+#include "mex_utils.h"
+
+#include "../exr/exr.h"
+#include "../raw/merge.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 1) || (nrhs > 7)) {
+		mexErrMsgTxt("Between one and seven input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * hdr = rawmerge(fileNames, exposures, minLimit, maxLimit, sigmasq, output,
+	 * 				exrFileName)
+	 *
+	 * output is 'mosaic' (default) for the merged float mosaic, or a
+	 * demosaicking method ('bilinear', 'malvar', 'edge') for an RGB image. If
+	 * exrFileName is given, the result is also written to an EXR file. Empty
+	 * arguments take defaults; limits are fractions of the black-to-white
+	 * range and sigmasq is in raw units squared.
+	 */
+	std::vector<std::string> fileNameVector = raw::toStringVector(
+					mex::MxCell(const_cast<mxArray*>(prhs[0])));
+
+	raw::MergeOptions options;
+	if ((nrhs >= 2) && (!mex::MxArray(const_cast<mxArray*>(prhs[1])).isEmpty())) {
+		std::vector<double> exposures =
+			mex::MxNumeric<double>(const_cast<mxArray*>(prhs[1])).vectorize();
+		options.exposures.assign(exposures.begin(), exposures.end());
+	}
+	if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+		options.minLimit = static_cast<float>(
+				mex::MxNumeric<double>(const_cast<mxArray*>(prhs[2]))[0]);
+	}
+	if ((nrhs >= 4) && (!mex::MxArray(const_cast<mxArray*>(prhs[3])).isEmpty())) {
+		options.maxLimit = static_cast<float>(
+				mex::MxNumeric<double>(const_cast<mxArray*>(prhs[3]))[0]);
+	}
+	if ((nrhs >= 5) && (!mex::MxArray(const_cast<mxArray*>(prhs[4])).isEmpty())) {
+		options.sigmasq = static_cast<float>(
+				mex::MxNumeric<double>(const_cast<mxArray*>(prhs[4]))[0]);
+	}
+
+	std::string output("mosaic");
+	if ((nrhs >= 6) && (!mex::MxArray(const_cast<mxArray*>(prhs[5])).isEmpty())) {
+		output = mex::MxString(const_cast<mxArray*>(prhs[5])).get_string();
+	}
+
+	mxArray* hdr;
+	bool isMosaic = !output.compare("mosaic");
+	if (isMosaic) {
+		hdr = raw::mergeExposures(fileNameVector, options).get_array();
+	} else {
+		raw::EDemosaicMethod method = raw::toDemosaicMethod(output);
+		if (method == raw::EDemosaicMethod::EInvalid) {
+			mexErrMsgTxt("Unknown output type.");
+		}
+		hdr = raw::mergeExposures(fileNameVector, options, method).get_array();
+	}
+
+	if ((nrhs >= 7) && (!mex::MxArray(const_cast<mxArray*>(prhs[6])).isEmpty())) {
+		mex::MxArray hdrArray(hdr);
+		std::vector<int> dimensions = hdrArray.getDimensions();
+		exr::ExrOutputFile file(mex::MxString(const_cast<mxArray*>(prhs[6])),
+								dimensions[1], dimensions[0]);
+		if (isMosaic) {
+			file.writeDataY(hdrArray);
+		} else {
+			file.writeDataRGB(hdrArray);
+		}
+	}
+
+	plhs[0] = hdr;
+}
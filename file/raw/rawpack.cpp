@@ -0,0 +1,103 @@
+/*
+ * image_utils//image_utils/raw/rawpack.cpp/rawpack.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "mex_utils.h"
+
+#include "../raw/packing.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 2) || (nrhs > 3)) {
+		mexErrMsgTxt("Two or three input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * packed = rawpack('pack', mosaic, bitDepth) packs a uint16 mosaic or
+	 * stack of mosaics at bitDepth 12 or 14, by default the smallest that
+	 * holds its maximum.
+	 * mosaic = rawpack('unpack', packed, frames) unpacks all or the given
+	 * 1-based frames of a packed mosaic.
+	 * rawpack('write', fileName, packed) writes a packed mosaic to a cache
+	 * file, and packed = rawpack('read', fileName) reads it back.
+	 */
+	std::string operation = mex::MxString(const_cast<mxArray*>(prhs[0])).get_string();
+
+	if (!operation.compare("pack")) {
+		mex::MxNumeric<raw::PixelType> mosaic(const_cast<mxArray*>(prhs[1]));
+		if (mosaic.getNumberOfElements() == 0) {
+			mexErrMsgTxt("Empty mosaic.");
+		}
+		std::vector<int> dimensions = mosaic.getDimensions();
+		const int numFrames = (dimensions.size() > 2)?(dimensions[2]):(1);
+		const std::size_t frameElements =
+						static_cast<std::size_t>(dimensions[0]) * dimensions[1];
+		const raw::PixelType* mosaicBuffer = mosaic.getData();
+		int bitDepth;
+		if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+			bitDepth = static_cast<int>(
+					mex::MxNumeric<double>(const_cast<mxArray*>(prhs[2]))[0]);
+			if (!raw::isPackedBitDepth(bitDepth)) {
+				mexErrMsgTxt("Bit depth must be 12 or 14.");
+			}
+		} else {
+			bitDepth = raw::getPackedBitDepth(*std::max_element(mosaicBuffer,
+								mosaicBuffer + frameElements * numFrames));
+			if (bitDepth == 0) {
+				mexErrMsgTxt("Mosaic values exceed 14 bits.");
+			}
+		}
+		raw::PackedMosaic packedMosaic(dimensions[0], dimensions[1], numFrames,
+									bitDepth);
+		for (int iterFrame = 0; iterFrame < numFrames; ++iterFrame) {
+			packedMosaic.packFrame(iterFrame, mosaicBuffer
+								+ static_cast<std::size_t>(iterFrame)
+									* frameElements);
+		}
+		plhs[0] = raw::toMxArray(packedMosaic).get_array();
+	} else if (!operation.compare("unpack")) {
+		raw::PackedMosaic packedMosaic = raw::toPackedMosaic(
+							mex::MxStruct(const_cast<mxArray*>(prhs[1])));
+		std::vector<int> frames;
+		if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+			mex::MxNumeric<double> frameArray(const_cast<mxArray*>(prhs[2]));
+			for (int iterFrame = 0;
+					iterFrame < frameArray.getNumberOfElements(); ++iterFrame) {
+				frames.push_back(static_cast<int>(frameArray[iterFrame]) - 1);
+			}
+		}
+		plhs[0] = raw::unpackMosaic(packedMosaic, frames).get_array();
+	} else if (!operation.compare("write")) {
+		if (nrhs < 3) {
+			mexErrMsgTxt("A packed mosaic is required.");
+		}
+		std::string fileName = mex::MxString(const_cast<mxArray*>(prhs[1])).get_string();
+		raw::PackedMosaic packedMosaic = raw::toPackedMosaic(
+							mex::MxStruct(const_cast<mxArray*>(prhs[2])));
+		if (!packedMosaic.save(fileName)) {
+			mexErrMsgTxt("Failed to write packed mosaic.");
+		}
+	} else if (!operation.compare("read")) {
+		std::string fileName = mex::MxString(const_cast<mxArray*>(prhs[1])).get_string();
+		raw::PackedMosaic packedMosaic;
+		if (!packedMosaic.load(fileName)) {
+			mexErrMsgTxt("Failed to read packed mosaic.");
+		}
+		plhs[0] = raw::toMxArray(packedMosaic).get_array();
+	} else {
+		mexErrMsgTxt("Unknown packing operation.");
+	}
+}
@@ -5,6 +5,8 @@
  *      Author: igkiou
  */
 
+#include <memory>
+
 #include "mex_utils.h"
 
 #include "../raw/raw.h"
@@ -23,7 +25,19 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
 		mexErrMsgTxt("Too many output arguments.");
 	}
 
-	raw::RawInputFile file(mex::MxString(const_cast<mxArray*>(prhs[0])));
+	/*
+	 * The first argument is either a file name or the contents of a raw file
+	 * as a uint8 array.
+	 */
+	std::unique_ptr<raw::RawInputFile> filePointer;
+	if (mxIsUint8(prhs[0])) {
+		filePointer.reset(new raw::RawInputFile(
+					mex::MxNumeric<unsigned char>(const_cast<mxArray*>(prhs[0]))));
+	} else {
+		filePointer.reset(new raw::RawInputFile(
+					mex::MxString(const_cast<mxArray*>(prhs[0]))));
+	}
+	raw::RawInputFile& file = *filePointer;
 	if ((nrhs == 2) && (!mex::MxArray(const_cast<mxArray*>(prhs[1])).isEmpty())) {
 		plhs[0] = file.readData(mex::MxNumeric<bool>(const_cast<mxArray*>(prhs[1]))).get_array();
 	} else if (nrhs == 3) {
@@ -0,0 +1,54 @@
+/*
+ * image_utils//image_utils/raw/rawreadbatch.cpp/rawreadbatch.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <string>
+
+#include "mex_utils.h"
+
+#include "../raw/batch.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 1) || (nrhs > 4)) {
+		mexErrMsgTxt("Between one and four input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 1) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * rawreadbatch(fileNames, doSubtractDarkFrame, dcrawFlags, output), where
+	 * output is 'stack' (default), 'cell' or 'packed'. Empty arguments take
+	 * defaults.
+	 */
+	std::vector<std::string> fileNameVector = raw::toStringVector(
+					mex::MxCell(const_cast<mxArray*>(prhs[0])));
+
+	bool doSubtractDarkFrame = false;
+	if ((nrhs >= 2) && (!mex::MxArray(const_cast<mxArray*>(prhs[1])).isEmpty())) {
+		doSubtractDarkFrame = mex::MxNumeric<bool>(const_cast<mxArray*>(prhs[1]))[0];
+	}
+
+	std::string dcrawFlags;
+	if ((nrhs >= 3) && (!mex::MxArray(const_cast<mxArray*>(prhs[2])).isEmpty())) {
+		dcrawFlags = mex::MxString(const_cast<mxArray*>(prhs[2])).get_string();
+	}
+
+	raw::EBatchOutput output = raw::EBatchOutput::EStack;
+	if ((nrhs >= 4) && (!mex::MxArray(const_cast<mxArray*>(prhs[3])).isEmpty())) {
+		output = raw::toBatchOutput(
+					mex::MxString(const_cast<mxArray*>(prhs[3])).get_string());
+		mexAssertEx(output != raw::EBatchOutput::EInvalid,
+					"Unknown batch output type");
+	}
+
+	plhs[0] = raw::readBatch(fileNameVector, doSubtractDarkFrame, dcrawFlags,
+							output).get_array();
+}
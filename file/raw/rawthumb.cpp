@@ -0,0 +1,47 @@
+/*
+ * image_utils//image_utils/raw/rawthumb.cpp/rawthumb.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <memory>
+
+#include "mex_utils.h"
+
+#include "../raw/raw.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if ((nrhs < 1) || (nrhs > 2)) {
+		mexErrMsgTxt("One or two input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 2) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	/*
+	 * The first argument is either a file name or the contents of a raw file
+	 * as a uint8 array.
+	 */
+	std::unique_ptr<raw::RawInputFile> filePointer;
+	if (mxIsUint8(prhs[0])) {
+		filePointer.reset(new raw::RawInputFile(
+					mex::MxNumeric<unsigned char>(const_cast<mxArray*>(prhs[0]))));
+	} else {
+		filePointer.reset(new raw::RawInputFile(
+					mex::MxString(const_cast<mxArray*>(prhs[0]))));
+	}
+	raw::RawInputFile& file = *filePointer;
+	if (nrhs >= 2) {
+		plhs[0] = file.readThumbnail(mex::MxNumeric<bool>(const_cast<mxArray*>(prhs[1]))).get_array();
+	} else {
+		plhs[0] = file.readThumbnail().get_array();
+	}
+	if (nlhs >= 2) {
+		plhs[1] = file.getThumbnailInformation().get_array();
+	}
+}
@@ -0,0 +1,783 @@
+/*
+ * test_raw.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: igkiou
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "jpeglib.h"
+#include "mex_utils.h"
+
+#include "batch.h"
+#include "calibration.h"
+#include "defects.h"
+#include "demosaic.h"
+#include "merge.h"
+#include "packing.h"
+
+namespace {
+
+/*
+ * The four Bayer patterns, as filterColors[row][column].
+ */
+const int kBayerPatterns[4][2][2] = {{{0, 1}, {1, 2}},
+									{{1, 0}, {2, 1}},
+									{{2, 1}, {1, 0}},
+									{{1, 2}, {0, 1}}};
+
+/*
+ * Whether two floats have the same bits, for results that must be exact.
+ */
+bool sameFloat(float a, float b) {
+	return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/*
+ * Whether two counts held as doubles are the same integer.
+ */
+bool sameCount(double a, double b) {
+	return std::abs(a - b) < 0.5;
+}
+
+/*
+ * Linear field with a different offset per channel, which all methods
+ * reproduce away from the borders.
+ */
+double linearField(int row, int column, int channel) {
+	return 1000.0 + 7.0 * row + 3.0 * column + 500.0 * channel;
+}
+
+void makeMosaic(const int filterColors[2][2], int height, int width,
+				bool isConstant, std::vector<raw::PixelType>& mosaic) {
+	mosaic.resize(static_cast<std::size_t>(height) * width);
+	for (int column = 0; column < width; ++column) {
+		for (int row = 0; row < height; ++row) {
+			int channel = filterColors[row & 1][column & 1];
+			mosaic[column * height + row] = static_cast<raw::PixelType>(
+						isConstant ? linearField(0, 0, channel)
+								: linearField(row, column, channel));
+		}
+	}
+}
+
+double maxDemosaicError(const int filterColors[2][2], int height, int width,
+						raw::EDemosaicMethod method, bool isConstant,
+						int border) {
+	std::vector<raw::PixelType> mosaic;
+	makeMosaic(filterColors, height, width, isConstant, mosaic);
+	std::vector<raw::DemosaicPixelType> rgb(mosaic.size() * 3);
+	raw::demosaic(&mosaic[0], height, width, filterColors, method, &rgb[0]);
+	double maxError = 0;
+	for (int channel = 0; channel < 3; ++channel) {
+		for (int column = border; column < width - border; ++column) {
+			for (int row = border; row < height - border; ++row) {
+				double expected = static_cast<raw::PixelType>(
+						isConstant ? linearField(0, 0, channel)
+								: linearField(row, column, channel));
+				double error = std::abs(
+						static_cast<double>(
+							rgb[(channel * width + column) * height + row])
+						- expected);
+				if (error > maxError) {
+					maxError = error;
+				}
+			}
+		}
+	}
+	return maxError;
+}
+
+void testDemosaic() {
+	/* Odd sizes, so that every pattern ends on a different color. */
+	const int height = 37;
+	const int width = 53;
+	const char* methodNames[] = {"bilinear", "malvar", "edge"};
+	/* Edge-directed interpolation is not exact on linear ramps. */
+	const double tolerances[] = {1e-3, 1e-3, 1.0};
+	for (int method = 0;
+		method < static_cast<int>(raw::EDemosaicMethod::ELength); ++method) {
+		mexAssert(raw::toDemosaicMethod(methodNames[method])
+				== static_cast<raw::EDemosaicMethod>(method));
+		for (int pattern = 0; pattern < 4; ++pattern) {
+			double constantError = maxDemosaicError(kBayerPatterns[pattern],
+									height, width,
+									static_cast<raw::EDemosaicMethod>(method),
+									true, 0);
+			double linearError = maxDemosaicError(kBayerPatterns[pattern],
+									height, width,
+									static_cast<raw::EDemosaicMethod>(method),
+									false, 2);
+			mexPrintf("demosaic %s, pattern %d: constant %g, linear %g\n",
+					methodNames[method], pattern, constantError, linearError);
+			mexAssertEx(constantError <= tolerances[method],
+						"Demosaicking changed a constant image.");
+			mexAssertEx(linearError <= tolerances[method],
+						"Demosaicking did not reproduce a linear image.");
+		}
+	}
+}
+
+void testFrameCombiner() {
+	const int height = 3;
+	const int width = 4;
+	const int numPixels = height * width;
+	std::vector<raw::PixelType> frame(numPixels);
+	std::vector<raw::CalibrationPixelType> master(numPixels);
+
+	/* Frames base + k, k = 0, ..., 6, averaging to base + 3. */
+	raw::FrameCombiner mean(raw::ECombineMethod::EMean, height, width);
+	for (int k = 0; k < 7; ++k) {
+		for (int iter = 0; iter < numPixels; ++iter) {
+			frame[iter] = static_cast<raw::PixelType>(100 * iter + k);
+		}
+		mean.addFrame(&frame[0]);
+	}
+	mexAssert(mean.getNumberOfFrames() == 7);
+	mean.combine(&master[0]);
+	for (int iter = 0; iter < numPixels; ++iter) {
+		mexAssertEx(std::abs(master[iter] - static_cast<float>(100 * iter + 3))
+					< 1e-3f, "Wrong mean frame.");
+	}
+
+	/* The median is exact for up to five frames, in any order. */
+	const int order[] = {3, 0, 4, 1, 2};
+	raw::FrameCombiner median(raw::ECombineMethod::EMedian, height, width);
+	for (int k = 0; k < 5; ++k) {
+		for (int iter = 0; iter < numPixels; ++iter) {
+			frame[iter] = static_cast<raw::PixelType>(100 * iter + order[k]);
+		}
+		median.addFrame(&frame[0]);
+	}
+	median.combine(&master[0]);
+	for (int iter = 0; iter < numPixels; ++iter) {
+		mexAssertEx(sameFloat(master[iter], static_cast<float>(100 * iter + 2)),
+					"Wrong median of five frames.");
+	}
+
+	/* Over many frames, the remedian still rejects saturated outliers. */
+	raw::FrameCombiner remedian(raw::ECombineMethod::EMedian, height, width);
+	for (int k = 0; k < 60; ++k) {
+		for (int iter = 0; iter < numPixels; ++iter) {
+			frame[iter] = static_cast<raw::PixelType>(
+									(k % 7 == 3) ? 65535 : 100 * iter + 50);
+		}
+		remedian.addFrame(&frame[0]);
+	}
+	mexAssert(remedian.getNumberOfFrames() == 60);
+	remedian.combine(&master[0]);
+	for (int iter = 0; iter < numPixels; ++iter) {
+		mexAssertEx(sameFloat(master[iter], static_cast<float>(100 * iter + 50)),
+					"Remedian did not reject outliers.");
+	}
+	mexPrintf("frame combiner: mean, median and remedian passed\n");
+}
+
+void testApplyCalibration() {
+	const std::size_t numPixels = 1000;
+	std::vector<raw::PixelType> mosaic(numPixels);
+	std::vector<raw::CalibrationPixelType> dark(numPixels);
+	std::vector<raw::CalibrationPixelType> gain(numPixels);
+	for (std::size_t iter = 0; iter < numPixels; ++iter) {
+		mosaic[iter] = static_cast<raw::PixelType>(1000 + iter);
+		dark[iter] = static_cast<raw::CalibrationPixelType>(iter % 64) + 0.5f;
+		gain[iter] = 1.0f + static_cast<raw::CalibrationPixelType>(iter % 3)
+							* 0.25f;
+	}
+	std::vector<raw::CalibrationPixelType> calibrated(numPixels);
+	raw::applyCalibration(&mosaic[0], &dark[0], &gain[0], numPixels,
+						&calibrated[0]);
+	double maxError = 0;
+	for (std::size_t iter = 0; iter < numPixels; ++iter) {
+		double expected = (static_cast<double>(mosaic[iter])
+						- static_cast<double>(dark[iter]))
+						* static_cast<double>(gain[iter]);
+		double error = std::abs(static_cast<double>(calibrated[iter])
+								- expected);
+		if (error > maxError) {
+			maxError = error;
+		}
+	}
+	raw::applyCalibration(&mosaic[0], &dark[0], nullptr, numPixels,
+						&calibrated[0]);
+	for (std::size_t iter = 0; iter < numPixels; ++iter) {
+		double expected = static_cast<double>(mosaic[iter])
+						- static_cast<double>(dark[iter]);
+		double error = std::abs(static_cast<double>(calibrated[iter])
+								- expected);
+		if (error > maxError) {
+			maxError = error;
+		}
+	}
+	mexPrintf("apply calibration: max error %g\n", maxError);
+	mexAssertEx(maxError < 1e-3, "Wrong calibrated mosaic.");
+}
+
+void testMasterFrame() {
+	raw::CaptureSettings settings;
+	settings.make = "Test";
+	settings.model = "Camera 1/2";
+	settings.isoSpeed = 400.0f;
+	settings.shutter = 0.125f;
+	const int height = 5;
+	const int width = 6;
+	raw::MasterFrame masterFrame(raw::ECalibrationType::EFlat, settings,
+								height, width);
+	for (int iter = 0; iter < height * width; ++iter) {
+		masterFrame.getData()[iter] = 1.0f / static_cast<float>(iter + 1);
+	}
+
+	const std::string fileName("test_raw_master.tmp");
+	mexAssertEx(masterFrame.save(fileName), "Failed to save master frame.");
+	raw::MasterFrame loaded;
+	mexAssertEx(loaded.load(fileName), "Failed to load master frame.");
+	std::remove(fileName.c_str());
+	mexAssert(loaded.getType() == raw::ECalibrationType::EFlat);
+	mexAssert(loaded.getCaptureSettings().make == settings.make);
+	mexAssert(loaded.getCaptureSettings().model == settings.model);
+	mexAssert(loaded.getHeight() == height);
+	mexAssert(loaded.getWidth() == width);
+	for (int iter = 0; iter < height * width; ++iter) {
+		mexAssertEx(sameFloat(loaded.getData()[iter],
+							masterFrame.getData()[iter]),
+					"Master frame changed on reload.");
+	}
+	mexAssertEx(!loaded.load(fileName),
+				"Loaded a missing master frame.");
+
+	/* Sidecars are keyed by type and settings. */
+	raw::CaptureSettings otherSettings(settings);
+	otherSettings.isoSpeed = 800.0f;
+	mexAssert(raw::getSidecarName("cache", raw::ECalibrationType::EFlat,
+								settings)
+			!= raw::getSidecarName("cache", raw::ECalibrationType::EFlat,
+								otherSettings));
+	mexAssert(raw::getSidecarName("cache", raw::ECalibrationType::EFlat,
+								settings)
+			!= raw::getSidecarName("cache", raw::ECalibrationType::EDark,
+								settings));
+	mexAssert(raw::toSidecarToken(settings.model).find('/')
+			== std::string::npos);
+	mexPrintf("master frame: sidecar round trip passed\n");
+}
+
+void testDefects() {
+	const int height = 8;
+	const int width = 10;
+	/* Every CFA color of the 2x2 cell is constant. */
+	const auto filterColor = [](int row, int column) {
+		return (row & 1) * 2 + (column & 1);
+	};
+	std::vector<raw::PixelType> mosaic(height * width);
+	for (int column = 0; column < width; ++column) {
+		for (int row = 0; row < height; ++row) {
+			mosaic[column * height + row] = static_cast<raw::PixelType>(
+									100 * (filterColor(row, column) + 1));
+		}
+	}
+	const std::vector<raw::PixelType> expected(mosaic);
+
+	/* Adjacent, corner and border defects. */
+	const std::vector<unsigned int> defectIndices = {
+		3 * height + 4, 3 * height + 2, 0, 9 * height + 7};
+	for (unsigned int index : defectIndices) {
+		mosaic[index] = 65535;
+	}
+
+	raw::DefectMap defectMap("Test", "Camera", height, width, defectIndices);
+	const std::string fileName("test_raw_defects.tmp");
+	mexAssertEx(defectMap.save(fileName), "Failed to save defect map.");
+	raw::DefectMap loaded;
+	mexAssertEx(loaded.load(fileName), "Failed to load defect map.");
+	std::remove(fileName.c_str());
+	mexAssert(loaded.getMake() == "Test");
+	mexAssert(loaded.getModel() == "Camera");
+	mexAssert(loaded.getHeight() == height);
+	mexAssert(loaded.getWidth() == width);
+	mexAssert(loaded.getNumberOfDefects()
+			== static_cast<int>(defectIndices.size()));
+	for (unsigned int index : defectIndices) {
+		mexAssert(loaded.isDefective(index));
+	}
+	mexAssert(!loaded.isDefective(height + 1));
+
+	raw::correctDefects(loaded, filterColor, height, width, &mosaic[0]);
+	for (int iter = 0; iter < height * width; ++iter) {
+		mexAssertEx(mosaic[iter] == expected[iter],
+					"Defect correction did not restore the mosaic.");
+	}
+	mexPrintf("defects: map round trip and correction passed\n");
+}
+
+void testPacking() {
+	const int bitDepths[] = {12, 14};
+	/* Sizes that end on every position of the 12-bit and 14-bit groups. */
+	const std::size_t sizes[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 200003};
+	const unsigned char guard = 0xAB;
+	for (int bitDepth : bitDepths) {
+		mexAssert(raw::isPackedBitDepth(bitDepth));
+		for (std::size_t numSamples : sizes) {
+			std::vector<raw::PixelType> samples(numSamples + 1);
+			std::vector<raw::PixelType> unpacked(numSamples + 1);
+			for (std::size_t iter = 0; iter < numSamples; ++iter) {
+				samples[iter] = static_cast<raw::PixelType>(
+						(iter * 2654435761u) % (1u << bitDepth));
+			}
+			const std::size_t packedSize = raw::getPackedSize(numSamples,
+																bitDepth);
+			mexAssert(packedSize * 8 >= numSamples * bitDepth);
+			std::vector<unsigned char> packed(packedSize + 1, guard);
+			raw::packSamples(&samples[0], numSamples, bitDepth, &packed[0]);
+			raw::unpackSamples(&packed[0], numSamples, bitDepth,
+								&unpacked[0]);
+			mexAssertEx(packed[packedSize] == guard,
+						"Packing wrote past the packed size.");
+			mexAssertEx(samples == unpacked,
+						"Packed samples changed on unpacking.");
+		}
+	}
+	mexAssert(!raw::isPackedBitDepth(16));
+	mexAssert(raw::getPackedBitDepth(4095) == 12);
+	mexAssert(raw::getPackedBitDepth(4096) == 14);
+	mexAssert(raw::getPackedBitDepth(65535) == 0);
+
+	/* Samples above the bit depth saturate. */
+	raw::PixelType saturated[] = {5000, 70};
+	unsigned char packedSaturated[3];
+	raw::packSamples(saturated, 2, 12, packedSaturated);
+	raw::unpackSamples(packedSaturated, 2, 12, saturated);
+	mexAssert(saturated[0] == 4095);
+	mexAssert(saturated[1] == 70);
+
+	const int height = 3;
+	const int width = 5;
+	raw::PackedMosaic packedMosaic(height, width, 2, 14);
+	std::vector<raw::PixelType> frame(height * width);
+	for (int iter = 0; iter < height * width; ++iter) {
+		frame[iter] = static_cast<raw::PixelType>(iter * 1000);
+	}
+	packedMosaic.packFrame(1, &frame[0]);
+	const std::string fileName("test_raw_packed.tmp");
+	mexAssertEx(packedMosaic.save(fileName), "Failed to save packed mosaic.");
+	raw::PackedMosaic loaded;
+	mexAssertEx(loaded.load(fileName), "Failed to load packed mosaic.");
+	std::remove(fileName.c_str());
+	mexAssert(loaded.getHeight() == height);
+	mexAssert(loaded.getWidth() == width);
+	mexAssert(loaded.getNumberOfFrames() == 2);
+	mexAssert(loaded.getBitDepth() == 14);
+	mexAssert(loaded.getFrameSize() == packedMosaic.getFrameSize());
+	std::vector<raw::PixelType> unpacked(height * width);
+	loaded.unpackFrame(1, &unpacked[0]);
+	mexAssertEx(unpacked == frame, "Packed mosaic changed on reload.");
+	mexPrintf("packing: round trips and saturation passed\n");
+}
+
+/*
+ * The tests below decode a raw file given as the optional input argument.
+ */
+void readMosaic(raw::RawInputFile& file,
+				std::vector<raw::PixelType>& mosaic) {
+	mosaic.resize(static_cast<std::size_t>(file.getHeight())
+				* file.getWidth());
+	file.readData(false, &mosaic[0]);
+}
+
+void testBatch(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	std::vector<raw::PixelType> mosaic;
+	readMosaic(file, mosaic);
+
+	/* Concurrent workers decoding the same file. */
+	const int numFiles = 5;
+	const std::vector<std::string> fileNames(numFiles, fileName);
+	mex::MxNumeric<raw::PixelType> stack(raw::readBatch(fileNames, false, "",
+										raw::EBatchOutput::EStack).get_array());
+	mexAssert(stack.getNumberOfElements()
+			== static_cast<int>(mosaic.size()) * numFiles);
+	const raw::PixelType* stackBuffer = stack.getData();
+	for (int iterFile = 0; iterFile < numFiles; ++iterFile) {
+		mexAssertEx(std::equal(mosaic.begin(), mosaic.end(),
+							stackBuffer + iterFile * mosaic.size()),
+					"Batch frame differs from a single read.");
+	}
+	mexPrintf("batch: %d concurrent reads match a single read\n", numFiles);
+}
+
+void testBufferDecoding(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	std::vector<raw::PixelType> mosaic;
+	readMosaic(file, mosaic);
+
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	mexAssertEx(stream.good(), "Failed to open raw file.");
+	const std::vector<unsigned char> fileBytes(
+							(std::istreambuf_iterator<char>(stream)),
+							std::istreambuf_iterator<char>());
+	mex::MxNumeric<unsigned char> fileBuffer(
+							static_cast<int>(fileBytes.size()), 1);
+	std::copy(fileBytes.begin(), fileBytes.end(), fileBuffer.getData());
+	raw::RawInputFile bufferFile(fileBuffer);
+	mexAssert(bufferFile.getHeight() == file.getHeight());
+	mexAssert(bufferFile.getWidth() == file.getWidth());
+	std::vector<raw::PixelType> bufferMosaic;
+	readMosaic(bufferFile, bufferMosaic);
+	mexAssertEx(bufferMosaic == mosaic,
+				"Decoding from memory differs from decoding the file.");
+	mexPrintf("buffer: decoding from memory matches the file\n");
+}
+
+/*
+ * The preview is defined only for Bayer files. Its green channel does not
+ * depend on white balance, and is checked against the mean of the two
+ * black-subtracted green sites of every quad of the mosaic.
+ */
+void testPreview(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	std::vector<raw::PixelType> mosaic;
+	readMosaic(file, mosaic);
+	const int height = file.getHeight();
+	const int width = file.getWidth();
+	std::vector<unsigned char> filterArray(mosaic.size());
+	file.readFilterArray(&filterArray[0]);
+	const std::string filterNames = file.getFilterNames();
+	const float white = file.getWhiteLevel();
+	float black[4];
+	for (int color = 0; color < 4; ++color) {
+		black[color] = file.getBlackLevel(color);
+	}
+
+	mex::MxNumeric<raw::PreviewPixelType> preview(
+										file.readPreview().get_array());
+	const std::vector<int> dimensions = preview.getDimensions();
+	mexAssert(dimensions.size() == 3);
+	mexAssert((dimensions[0] == height / 2) && (dimensions[1] == width / 2)
+			&& (dimensions[2] == 3));
+	const int previewHeight = dimensions[0];
+	const int previewWidth = dimensions[1];
+	const raw::PreviewPixelType* green = preview.getData()
+										+ previewHeight * previewWidth;
+	double maxError = 0;
+	for (int column = 0; column < previewWidth; ++column) {
+		for (int row = 0; row < previewHeight; ++row) {
+			double sum = 0;
+			int count = 0;
+			for (int site = 0; site < 4; ++site) {
+				const int index = (2 * column + (site & 1)) * height
+								+ 2 * row + (site >> 1);
+				const int color = filterArray[index] & 3;
+				if (filterNames[color] != 'G') {
+					continue;
+				}
+				sum += std::max(static_cast<double>(mosaic[index])
+								- static_cast<double>(black[color]), 0.0)
+					/ static_cast<double>(white - black[color]);
+				++count;
+			}
+			mexAssert(count > 0);
+			const double error = std::abs(
+					static_cast<double>(green[column * previewHeight + row])
+					- sum / count);
+			if (error > maxError) {
+				maxError = error;
+			}
+		}
+	}
+	mexPrintf("preview: green max error %g\n", maxError);
+	mexAssertEx(maxError < 1e-5, "Wrong binned preview.");
+}
+
+/*
+ * Reference decode of a JPEG stream to interleaved samples, straight through
+ * libjpeg. Returns no samples for CMYK and YCCK JPEGs.
+ */
+std::vector<unsigned char> decodeJpeg(const unsigned char* data,
+									unsigned long size, int& height,
+									int& width, int& numComponents) {
+	jpeg_decompress_struct info;
+	jpeg_error_mgr errorManager;
+	info.err = jpeg_std_error(&errorManager);
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, const_cast<unsigned char*>(data), size);
+	jpeg_read_header(&info, TRUE);
+	std::vector<unsigned char> samples;
+	if ((info.jpeg_color_space != JCS_CMYK) &&
+		(info.jpeg_color_space != JCS_YCCK)) {
+		info.out_color_space = (info.jpeg_color_space == JCS_GRAYSCALE)
+							?(JCS_GRAYSCALE)
+							:(JCS_RGB);
+		jpeg_start_decompress(&info);
+		height = static_cast<int>(info.output_height);
+		width = static_cast<int>(info.output_width);
+		numComponents = info.output_components;
+		samples.resize(static_cast<std::size_t>(height) * width
+						* numComponents);
+		while (info.output_scanline < info.output_height) {
+			JSAMPROW row = &samples[static_cast<std::size_t>(
+								info.output_scanline) * width * numComponents];
+			jpeg_read_scanlines(&info, &row, 1);
+		}
+		jpeg_finish_decompress(&info);
+	}
+	jpeg_destroy_decompress(&info);
+	return samples;
+}
+
+/*
+ * Decoded thumbnails are checked pixel by pixel against LibRaw's own
+ * thumbnail output: bitmaps come decoded, and JPEGs as the stream, which is
+ * decoded above. Grayscale references are compared to every channel.
+ */
+void testThumbnail(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	mex::MxStruct information(file.getThumbnailInformation().get_array());
+	const std::string format = mex::MxString(
+							information[std::string("format")]).get_string();
+	const int height = mex::MxNumeric<int>(
+							information[std::string("height")])[0];
+	const int width = mex::MxNumeric<int>(
+							information[std::string("width")])[0];
+	if (format == "jpeg") {
+		/* The undecoded thumbnail is the JPEG stream itself. */
+		mex::MxNumeric<unsigned char> stream(file.readThumbnail(
+									mex::MxNumeric<bool>(false)).get_array());
+		mexAssert(stream.getNumberOfElements() > 2);
+		mexAssertEx((stream[0] == 0xFF) && (stream[1] == 0xD8),
+					"Thumbnail stream is not a JPEG.");
+	} else if (format != "bitmap") {
+		mexPrintf("thumbnail: %s, %d x %d\n", format.c_str(), height, width);
+		return;
+	}
+
+	LibRaw rawProcessor;
+	mexAssert(rawProcessor.open_file(fileName.c_str()) == LIBRAW_SUCCESS);
+	mexAssert(rawProcessor.unpack_thumb() == LIBRAW_SUCCESS);
+	int errorCode = LIBRAW_SUCCESS;
+	libraw_processed_image_t* reference =
+							rawProcessor.dcraw_make_mem_thumb(&errorCode);
+	mexAssert((reference != nullptr) && (errorCode == LIBRAW_SUCCESS));
+	int referenceHeight = reference->height;
+	int referenceWidth = reference->width;
+	int referenceComponents = reference->colors;
+	std::vector<unsigned char> referenceSamples;
+	if (reference->type == LIBRAW_IMAGE_JPEG) {
+		referenceSamples = decodeJpeg(reference->data, reference->data_size,
+									referenceHeight, referenceWidth,
+									referenceComponents);
+	} else {
+		referenceSamples.assign(reference->data,
+								reference->data + reference->data_size);
+	}
+	LibRaw::dcraw_clear_mem(reference);
+	if (referenceSamples.empty()) {
+		mexPrintf("thumbnail: %s, %d x %d, CMYK not decoded\n",
+				format.c_str(), height, width);
+		return;
+	}
+
+	mex::MxNumeric<unsigned char> thumbnail(file.readThumbnail().get_array());
+	const std::vector<int> dimensions = thumbnail.getDimensions();
+	const int numChannels = (dimensions.size() > 2)?(dimensions[2]):(1);
+	mexAssertEx((dimensions[0] == referenceHeight) &&
+				(dimensions[1] == referenceWidth) &&
+				((referenceComponents == 1) ||
+				(referenceComponents == numChannels)),
+				"Thumbnail does not match the LibRaw thumbnail size.");
+	int numDifferent = 0;
+	for (int channel = 0; channel < numChannels; ++channel) {
+		const int component = (referenceComponents == 1)?(0):(channel);
+		for (int column = 0; column < referenceWidth; ++column) {
+			for (int row = 0; row < referenceHeight; ++row) {
+				const unsigned char value = thumbnail[(channel * referenceWidth
+											+ column) * referenceHeight + row];
+				const unsigned char expected = referenceSamples[
+									(static_cast<std::size_t>(row)
+									* referenceWidth + column)
+									* referenceComponents + component];
+				numDifferent += (value != expected);
+			}
+		}
+	}
+	mexAssertEx(numDifferent == 0,
+				"Thumbnail differs from the LibRaw thumbnail.");
+	mexPrintf("thumbnail: %s, %d x %d, matches LibRaw\n", format.c_str(),
+			referenceHeight, referenceWidth);
+}
+
+/*
+ * Exposure statistics are computed in one pass over the unpacked raw data.
+ * They are checked against counts and sums over the mosaic, per CFA color
+ * index.
+ */
+void testExposureStatistics(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	std::vector<raw::PixelType> mosaic;
+	readMosaic(file, mosaic);
+	std::vector<unsigned char> filterArray(mosaic.size());
+	file.readFilterArray(&filterArray[0]);
+	const float white = file.getWhiteLevel();
+	double pixelCount[4] = {0.0, 0.0, 0.0, 0.0};
+	double saturatedCount[4] = {0.0, 0.0, 0.0, 0.0};
+	double underexposedCount[4] = {0.0, 0.0, 0.0, 0.0};
+	double sum[4] = {0.0, 0.0, 0.0, 0.0};
+	float black[4];
+	for (int color = 0; color < 4; ++color) {
+		black[color] = file.getBlackLevel(color);
+	}
+	for (std::size_t iter = 0; iter < mosaic.size(); ++iter) {
+		const int color = filterArray[iter] & 3;
+		const float value = static_cast<float>(mosaic[iter]);
+		const float level = value - black[color];
+		pixelCount[color] += 1.0;
+		saturatedCount[color] += (value >= white)?(1.0):(0.0);
+		underexposedCount[color] += (level <= 0.0f)?(1.0):(0.0);
+		sum[color] += static_cast<double>(level);
+	}
+
+	raw::RawInputFile statisticsFile((mex::MxString(fileName)));
+	mex::MxStruct statistics(
+				statisticsFile.getExposureStatistics().get_array());
+	mex::MxNumeric<double> histogram(statistics[std::string("histogram")]);
+	mex::MxNumeric<double> pixelCountArray(
+								statistics[std::string("pixelCount")]);
+	mex::MxNumeric<double> saturatedCountArray(
+								statistics[std::string("saturatedCount")]);
+	mex::MxNumeric<double> underexposedCountArray(
+								statistics[std::string("underexposedCount")]);
+	mex::MxNumeric<double> normalizedMeanArray(
+								statistics[std::string("normalizedMean")]);
+	const int numBins = histogram.getDimensions()[0];
+	for (int color = 0; color < 4; ++color) {
+		mexAssert(sameCount(pixelCountArray[color], pixelCount[color]));
+		mexAssert(sameCount(saturatedCountArray[color], saturatedCount[color]));
+		mexAssert(sameCount(underexposedCountArray[color],
+							underexposedCount[color]));
+		double histogramCount = 0.0;
+		for (int bin = 0; bin < numBins; ++bin) {
+			histogramCount += histogram[color * numBins + bin];
+		}
+		mexAssertEx(sameCount(histogramCount, pixelCount[color]),
+					"Histogram does not count every pixel.");
+		if (pixelCount[color] > 0) {
+			const double normalizedMean = sum[color] / pixelCount[color]
+						/ static_cast<double>(white - black[color]);
+			mexAssertEx(std::abs(normalizedMeanArray[color] - normalizedMean)
+						<= 1e-9 * std::abs(normalizedMean),
+						"Wrong normalized mean.");
+		}
+	}
+	mexPrintf("statistics: counts, histograms and means match the mosaic\n");
+}
+
+void mergeFiles(const std::vector<std::string>& fileNames,
+				const std::vector<float>& exposures,
+				std::vector<raw::HdrPixelType>& hdr) {
+	raw::MergeOptions options;
+	options.exposures = exposures;
+	int height;
+	int width;
+	std::vector<unsigned char> filterArray;
+	std::string filterNames;
+	raw::mergeExposures(fileNames, options, height, width, hdr, filterArray,
+						filterNames);
+}
+
+/*
+ * A single frame merges to its black-subtracted value over the white-to-black
+ * range where properly exposed. Repeating a frame leaves the merge unchanged,
+ * and doubling the exposure halves it, both exactly.
+ */
+void testMerge(const std::string& fileName) {
+	raw::RawInputFile file((mex::MxString(fileName)));
+	std::vector<raw::PixelType> mosaic;
+	readMosaic(file, mosaic);
+	std::vector<unsigned char> filterArray(mosaic.size());
+	file.readFilterArray(&filterArray[0]);
+	const float white = file.getWhiteLevel();
+	float black[4];
+	for (int color = 0; color < 4; ++color) {
+		black[color] = file.getBlackLevel(color);
+	}
+
+	std::vector<raw::HdrPixelType> hdr;
+	mergeFiles(std::vector<std::string>(1, fileName),
+			std::vector<float>(1, 1.0f), hdr);
+	mexAssert(hdr.size() == mosaic.size());
+	const raw::MergeOptions options;
+	double maxError = 0;
+	for (std::size_t iter = 0; iter < mosaic.size(); ++iter) {
+		/* Limits in single precision, as in the merge. */
+		const int color = filterArray[iter] & 3;
+		const float range = white - black[color];
+		const float value = static_cast<float>(mosaic[iter]) - black[color];
+		double expected = static_cast<double>(value)
+						/ static_cast<double>(range);
+		if (value > options.maxLimit * range) {
+			expected = static_cast<double>(options.maxLimit);
+		} else if (!(value >= options.minLimit * range) || !(value > 0.0f)) {
+			expected = 0.0;
+		}
+		const double error = std::abs(static_cast<double>(hdr[iter])
+									- expected);
+		if (error > maxError) {
+			maxError = error;
+		}
+	}
+	mexPrintf("merge: single frame max error %g\n", maxError);
+	mexAssertEx(maxError < 1e-5, "Wrong merge of a single frame.");
+
+	std::vector<raw::HdrPixelType> repeated;
+	mergeFiles(std::vector<std::string>(2, fileName),
+			std::vector<float>(2, 1.0f), repeated);
+	mexAssertEx(repeated == hdr, "Repeating a frame changed the merge.");
+
+	std::vector<raw::HdrPixelType> doubled;
+	mergeFiles(std::vector<std::string>(1, fileName),
+			std::vector<float>(1, 2.0f), doubled);
+	for (std::size_t iter = 0; iter < hdr.size(); ++iter) {
+		mexAssertEx(sameFloat(doubled[iter] * 2.0f, hdr[iter]),
+					"Doubling the exposure did not halve the merge.");
+	}
+	mexPrintf("merge: repeated and doubled exposures passed\n");
+}
+
+}  // namespace
+
+void mexFunction(int nlhs, mxArray */* plhs */[], int nrhs, const mxArray *prhs[]) {
+
+	/* Check number of input arguments */
+	if (nrhs > 1) {
+		mexErrMsgTxt("One or fewer input arguments are required.");
+	}
+
+	/* Check number of output arguments */
+	if (nlhs > 0) {
+		mexErrMsgTxt("Too many output arguments.");
+	}
+
+	testDemosaic();
+	testFrameCombiner();
+	testApplyCalibration();
+	testMasterFrame();
+	testDefects();
+	testPacking();
+	if (nrhs > 0) {
+		const std::string fileName(
+					mex::MxString(const_cast<mxArray*>(prhs[0])).get_string());
+		testBatch(fileName);
+		testBufferDecoding(fileName);
+		testPreview(fileName);
+		testThumbnail(fileName);
+		testExposureStatistics(fileName);
+		testMerge(fileName);
+	}
+	mexPrintf("All raw tests passed.\n");
+}